@@ -16,9 +16,13 @@
 #ifndef _COMMON_DISPATCH_H_
 #define _COMMON_DISPATCH_H_
 #include <stdint.h>
+#include <sys/uio.h>
 
 extern int usb_vybrid_dispatch(char *kernel, char *loadAddr, char *jump_addr, void *image, ssize_t size);
 
+/* Image is gathered from scatter list of regions */
+extern int usb_vybrid_dispatchv(char *kernel, char *loadAddr, char *jump_addr, const struct iovec *iov, int iovcnt);
+
 extern int usb_imx_dispatch(char *kernel, char *uart, char *initrd, char *append, int plugin);
 
 
@@ -30,6 +30,8 @@
 #define ERR_MSG_IO     -48
 #define ERR_MSG_ARG    -49
 #define ERR_MSG_CLOSED -50
+#define ERR_MSG_INTR   -51
+#define ERR_MSG_STALL  -52
 
 #define ERR_SERIAL_OK       -64
 #define ERR_SERIAL_INIT     -65
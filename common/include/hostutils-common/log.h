@@ -0,0 +1,84 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Leveled, buffered logging
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+
+/* Log levels */
+#define LOGL_ERR    0
+#define LOGL_WARN   1
+#define LOGL_INFO   2
+#define LOGL_DEBUG  3
+#define LOGL_TRACE  4
+
+
+/* Messages above this level are removed at compile time */
+#ifndef LOG_MAXLEVEL
+#define LOG_MAXLEVEL LOGL_TRACE
+#endif
+
+
+/* Period of aggregated event summaries (ms) */
+#define LOG_SUMPERIOD 1000
+
+
+/* Aggregated high volume events (e.g. per-read traces) */
+typedef struct _log_sum_t {
+	unsigned long count;
+	unsigned long long bytes;
+	unsigned long long start; /* start of current period (ms), 0 - no events */
+} log_sum_t;
+
+
+/* Runtime log level, use log_init() to change it */
+extern int log_level;
+
+
+#define log_enabled(lvl) (((lvl) <= LOG_MAXLEVEL) && ((lvl) <= log_level))
+
+#define log_msg(lvl, prefix, ...) \
+	do { \
+		if (log_enabled(lvl)) \
+			log_write((lvl), (prefix), __VA_ARGS__); \
+	} while (0)
+
+#define log_error(prefix, ...) log_msg(LOGL_ERR, prefix, __VA_ARGS__)
+#define log_warn(prefix, ...)  log_msg(LOGL_WARN, prefix, __VA_ARGS__)
+#define log_info(prefix, ...)  log_msg(LOGL_INFO, prefix, __VA_ARGS__)
+#define log_debug(prefix, ...) log_msg(LOGL_DEBUG, prefix, __VA_ARGS__)
+#define log_trace(prefix, ...) log_msg(LOGL_TRACE, prefix, __VA_ARGS__)
+
+
+/* Function sets runtime log level */
+extern void log_init(int level);
+
+
+/* Function formats message (without trailing newline) prefixed by pid and optional prefix, errors and warnings are flushed immediately */
+extern void log_write(int level, const char *prefix, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+
+/* Function writes buffered messages, it has to be called before fork() */
+extern void log_flush(void);
+
+
+/* Function accounts event in summary, printed at most once per LOG_SUMPERIOD */
+extern void log_sum(int level, const char *prefix, const char *name, log_sum_t *sum, unsigned long bytes);
+
+
+/* Function prints and resets summary of events accounted so far */
+extern void log_sumflush(int level, const char *prefix, const char *name, log_sum_t *sum);
+
+
+#endif
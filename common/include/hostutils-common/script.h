@@ -61,6 +61,14 @@ typedef struct _script_funct_t {
 } script_funct_t;
 
 
+/* compiled command, its arguments are replayed from token list */
+typedef struct _script_cmd_t {
+	const script_funct_t *funct;
+	script_blob_t line;           /* source line */
+	int tok;                      /* index of token following command identifier */
+} script_cmd_t;
+
+
 /* context of script parser */
 typedef struct _script_t {
 	int nfuncs;                   /* functions count */
@@ -72,6 +80,14 @@ typedef struct _script_t {
 	char *ptr;                    /* parser pointer in range of 'buf' */
 	const char *errstr;           /* error message if any occured */
 	void *arg;                    /* user argument */
+
+	script_cmd_t *cmds;           /* command list built by script_compile() */
+	int ncmds;
+	script_token_t *toks;         /* tokens in order of scanning */
+	int ntoks;
+	int sztoks;
+	int replay;                   /* tokens are taken from 'toks' instead of scanned */
+	int cursor;                   /* next replayed token */
 } script_t;
 
 
@@ -84,6 +100,12 @@ int script_set_funcs(script_t *s, const script_funct_t *functs, void *arg);
 /* main loop of the script parser */
 int script_parse(script_t *s, int flags);
 
+/* validate script (commands are run with SCRIPT_F_DRYRUN) and build command list */
+int script_compile(script_t *s);
+
+/* run compiled commands, script context may be copied to run them concurrently */
+int script_run(script_t *s, int flags);
+
 /* free script */
 void script_close(script_t *s);
 
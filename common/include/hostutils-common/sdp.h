@@ -0,0 +1,108 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Serial Download Protocol (i.MX/Vybrid boot ROM and psd)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _SDP_H_
+#define _SDP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <hidapi/hidapi.h>
+
+#include "hostutils-common/stream.h"
+
+
+/* Data report (ID 2) payload, its size has to be aligned to 16 (HID Report Descriptor - ID 2) */
+#define SDP_PAYLOAD   1024
+#define SDP_ALIGN     0x10
+
+/* Maximum size of report received from device */
+#define SDP_REPORTSZ  65
+
+/* Number of data transfers kept in flight by libusb backend */
+#define SDP_INFLIGHT  8
+
+/* sdp_writeFile() flags */
+#define SDP_F_STATUS    1 /* receive HAB mode and complete status */
+#define SDP_F_PROGRESS  2 /* print progress */
+
+/* Status reported by psd after successful WRITE_REGISTER */
+#define SDP_REG_DONE  0x128a8a12
+
+/* Status reported after successful WRITE_FILE */
+#define SDP_FILE_DONE 0x88888888
+
+
+struct _sdp_usb_t;
+
+
+typedef struct {
+	hid_device *hid;          /* hidapi backend */
+	struct _sdp_usb_t *usb;   /* libusb backend (SDP_LIBUSB builds) */
+	uint16_t vid;
+	uint16_t pid;
+} sdp_t;
+
+
+/* Function opens the first device (pid 0 - any product of vendor), libusb backend is preferred if available */
+extern int sdp_open(sdp_t *sdp, uint16_t vid, uint16_t pid);
+
+
+/* Function uses device already opened with hidapi */
+extern void sdp_attach(sdp_t *sdp, hid_device *dev);
+
+
+extern void sdp_close(sdp_t *sdp);
+
+
+/* Function returns non-zero if device is opened */
+extern int sdp_opened(sdp_t *sdp);
+
+
+/* Function sends raw report (report ID in the first byte) */
+extern int sdp_write(sdp_t *sdp, const unsigned char *report, size_t len);
+
+
+/* Function receives raw report, returns its length */
+extern int sdp_read(sdp_t *sdp, unsigned char *buff, size_t size);
+
+
+/* Function sends data as reports of given format with transfers kept in flight */
+extern int sdp_stream(sdp_t *sdp, const stream_fmt_t *fmt, const void *data, size_t size, int progress);
+
+
+/* Function sends data gathered from scatter list of regions */
+extern int sdp_streamv(sdp_t *sdp, const stream_fmt_t *fmt, const struct iovec *iov, int iovcnt, int progress);
+
+
+/* Function sends WRITE_FILE command followed by data */
+extern int sdp_writeFile(sdp_t *sdp, uint32_t addr, uint8_t format, const void *data, size_t size, int flags);
+
+
+/* Function sends WRITE_FILE command followed by data gathered from scatter list of regions */
+extern int sdp_writeFilev(sdp_t *sdp, uint32_t addr, uint8_t format, const struct iovec *iov, int iovcnt, int flags);
+
+
+/* Function writes register (or executes psd command), status is returned in *status */
+extern int sdp_writeRegister(sdp_t *sdp, uint32_t addr, uint8_t format, uint32_t data, uint32_t *status);
+
+
+/* Function sends JUMP_ADDRESS command and receives HAB mode */
+extern int sdp_jump(sdp_t *sdp, uint32_t addr);
+
+
+/* Function sends ERROR_STATUS command, device status is returned in *status */
+extern int sdp_status(sdp_t *sdp, uint32_t *status);
+
+
+#endif
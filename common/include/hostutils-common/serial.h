@@ -19,16 +19,82 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <time.h>
+#include <sys/uio.h>
 #include "types.h"
 
 
+/* Size of readahead buffer of serial_t */
+#define SERIAL_RXBUFSZ 4096
+
+/* Write fails if peer doesn't accept any data for this time (ms) */
+#define SERIAL_TXTIMEOUT 2000
+
+
+/* Buffered serial port reader */
+typedef struct {
+	int fd;
+	uint pos;                    /* first unread byte in buff */
+	uint len;                    /* number of bytes in buff */
+	int timed;                   /* deadline is set */
+	struct timespec deadline;    /* end of current operation (CLOCK_MONOTONIC) */
+	u8 buff[SERIAL_RXBUFSZ];
+} serial_t;
+
+
 extern int serial_open(char *dev, speed_t speed);
 
 
+/* Function configures tty for raw 8N1 low latency transfer, previous settings are stored in orig if it isn't NULL */
+extern int serial_setup(int fd, speed_t speed, struct termios *orig);
+
+
+/* Function restores settings saved by serial_setup() */
+extern int serial_restore(int fd, const struct termios *orig);
+
+
+/* Function enables low latency mode of tty driver (Linux only) */
+extern int serial_lowlatency(int fd);
+
+
+/* Function changes speed after pending output is sent, fails if driver doesn't support it */
+extern int serial_setspeed(int fd, speed_t speed);
+
+
+/* Function checks whether speed can be set on the port, it isn't reconfigured (driver support is verified by serial_setspeed()) */
+extern int serial_probespeed(int fd, speed_t speed);
+
+
+/* Function reads len bytes, timeout [ms] applies to the whole operation (0 - no timeout) */
 extern int serial_read(int fd, u8 *buff, uint len, uint timeout);
 
 
-extern int serial_write(int fd, u8 *buff, uint len);
+/* Function writes len bytes, returns 0 or error (ERR_SERIAL_TIMEOUT - no progress for SERIAL_TXTIMEOUT) */
+extern int serial_write(int fd, const u8 *buff, uint len);
+
+
+/* Function writes all iovecs with as few system calls as possible, iov array is modified (errors as serial_write()) */
+extern int serial_writev(int fd, struct iovec *iov, int iovcnt);
+
+
+/* Function attaches buffered reader to opened port */
+extern void serial_init(serial_t *s, int fd);
+
+
+/* Function starts receive operation, following reads fail after timeout [ms] from now (0 - no timeout) */
+extern void serial_timeout(serial_t *s, uint timeout);
+
+
+/* Function reads len bytes within current operation, returns len or error, available input is read ahead */
+extern int serial_bread(serial_t *s, u8 *buff, uint len);
+
+
+/* Function returns next byte, buffered input is returned without system call */
+extern int serial_getc(serial_t *s, u8 *c);
+
+
+/* Function discards buffered input */
+extern void serial_discard(serial_t *s);
 
 
 extern int serial_int2speed(int baudrate, speed_t *speed);
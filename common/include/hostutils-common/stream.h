@@ -0,0 +1,67 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Pipelined streaming of data as HID output reports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <hostutils-common/hid.h>
+
+
+/* Number of reports prepared ahead of transmission */
+#define STREAM_DEPTH     64
+
+/* Minimum time between progress updates (ms) */
+#define STREAM_PROGRESS  250
+
+
+typedef struct {
+	size_t hdrsz;      /* report header size (including report ID) */
+	size_t payload;    /* maximum payload of report */
+	size_t align;      /* payload of last report is zero padded to multiple of it */
+	void (*header)(unsigned char *report, size_t len); /* fills header for payload length */
+} stream_fmt_t;
+
+
+/* Position in scatter list of data being sent */
+typedef struct {
+	const struct iovec *iov;
+	int iovcnt;
+	size_t offs;       /* offset in current region */
+	size_t left;       /* data left in total */
+} stream_iter_t;
+
+
+/* Function sets iterator to the beginning of scatter list, returns size of data */
+extern size_t stream_iter(stream_iter_t *it, const struct iovec *iov, int iovcnt);
+
+
+/* Function builds report carrying data at iterator and advances it (payload length is returned in n), returns report length */
+extern size_t stream_report(const stream_fmt_t *fmt, unsigned char *report, stream_iter_t *it, size_t *n);
+
+
+/* Function prints progress a few times a second (last - time of previous update), the final update always */
+extern void stream_progress(size_t offset, size_t size, unsigned long long *last);
+
+
+/* Function sends data split into reports (printing progress if requested), returns 0 or hid_write error code */
+extern int stream_write(hid_device *dev, const stream_fmt_t *fmt, const void *data, size_t size, int progress);
+
+
+/* Function sends data gathered from scatter list of regions */
+extern int stream_writev(hid_device *dev, const stream_fmt_t *fmt, const struct iovec *iov, int iovcnt, int progress);
+
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Leveled, buffered logging
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "hostutils-common/log.h"
+
+
+#define LOG_BUFSZ  4096
+#define LOG_LINESZ 512
+
+
+int log_level = LOGL_INFO;
+
+
+static struct {
+	char buff[LOG_BUFSZ];
+	size_t len;
+	pid_t pid;  /* cached pid, reset by log_flush() (called before fork) */
+	int atexit;
+} log_common;
+
+
+static unsigned long long log_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+void log_init(int level)
+{
+	log_level = level;
+}
+
+
+void log_flush(void)
+{
+	size_t pos = 0;
+	ssize_t res;
+
+	while (pos < log_common.len) {
+		if ((res = write(STDERR_FILENO, log_common.buff + pos, log_common.len - pos)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		pos += res;
+	}
+
+	log_common.len = 0;
+	log_common.pid = 0;
+}
+
+
+void log_write(int level, const char *prefix, const char *fmt, ...)
+{
+	char line[LOG_LINESZ];
+	va_list ap;
+	int n, len;
+
+	if (log_common.pid == 0)
+		log_common.pid = getpid();
+
+	if (prefix != NULL)
+		n = snprintf(line, sizeof(line), "[%d] %s: ", (int)log_common.pid, prefix);
+	else
+		n = snprintf(line, sizeof(line), "[%d] ", (int)log_common.pid);
+
+	if (n > (int)sizeof(line) - 2)
+		n = sizeof(line) - 2;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line + n, sizeof(line) - n, fmt, ap);
+	va_end(ap);
+
+	/* Truncate too long messages */
+	if (len > 0)
+		n += len;
+	if (n > (int)sizeof(line) - 2)
+		n = sizeof(line) - 2;
+	line[n++] = '\n';
+
+	if (log_common.len + n > sizeof(log_common.buff))
+		log_flush();
+
+	if (!log_common.atexit) {
+		atexit(log_flush);
+		log_common.atexit = 1;
+	}
+
+	memcpy(log_common.buff + log_common.len, line, n);
+	log_common.len += n;
+
+	if (level <= LOGL_WARN)
+		log_flush();
+}
+
+
+void log_sumflush(int level, const char *prefix, const char *name, log_sum_t *sum)
+{
+	if (sum->count == 0)
+		return;
+
+	log_msg(level, prefix, "%s: %lu requests, %llu bytes in %llu ms", name, sum->count, sum->bytes, log_now() - sum->start);
+
+	sum->count = 0;
+	sum->bytes = 0;
+	sum->start = 0;
+}
+
+
+void log_sum(int level, const char *prefix, const char *name, log_sum_t *sum, unsigned long bytes)
+{
+	unsigned long long now;
+
+	if (!log_enabled(level))
+		return;
+
+	now = log_now();
+	if (sum->count++ == 0)
+		sum->start = now;
+	sum->bytes += bytes;
+
+	if (now - sum->start >= LOG_SUMPERIOD)
+		log_sumflush(level, prefix, name, sum);
+}
@@ -33,6 +33,9 @@
 #define IS_ALPHA(c)     (IS_ALPHA_LOW(c) || IS_ALPHA_UP(c))
 #define IS_QUOTE(c)     ((c) == '\"' || (c) == '\'')
 
+/* internal flag, scanned tokens and commands are recorded */
+#define SCRIPT_F_COMPILE 0x100
+
 
 /* initialize parser, and load psu script file */
 int script_load(script_t *s, const char *fname)
@@ -52,12 +55,6 @@ int script_load(script_t *s, const char *fname)
 		return SCRIPT_ERROR;
 	}
 
-	if (statbuf.st_size > 1024*100) {
-		LOG_ERROR("Script file too big (100kB limit).\n");
-		close(fd);
-		return SCRIPT_ERROR;
-	}
-
 	ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
 	close(fd);
@@ -79,6 +76,12 @@ int script_load(script_t *s, const char *fname)
 /* free parser context */
 void script_close(script_t *s)
 {
+	free(s->cmds);
+	free(s->toks);
+	s->cmds = NULL;
+	s->toks = NULL;
+	s->ncmds = s->ntoks = s->sztoks = 0;
+
 	if (s->buf.ptr == NULL || s->buf.ptr == MAP_FAILED)
 		return;
 
@@ -227,10 +230,8 @@ static int script_get_comment(script_t *s, script_token_t *token)
 }
 
 
-static int script_get_token(script_t *s)
+static int script_scan_token(script_t *s)
 {
-	s->token = s->next;
-
 	if (script_skip_space(s) != SCRIPT_OK) {
 		return SCRIPT_ERROR;
 	}
@@ -254,6 +255,48 @@ static int script_get_token(script_t *s)
 }
 
 
+/* record token following the current one, it's replayed by script_run() */
+static void script_record_token(script_t *s)
+{
+	script_token_t *toks;
+	int sz;
+
+	if (s->ntoks == s->sztoks) {
+		sz = (s->sztoks == 0) ? 256 : 2 * s->sztoks;
+		if ((toks = realloc(s->toks, sz * sizeof(*toks))) == NULL) {
+			s->errstr = "Unable to allocate memory.";
+			return;
+		}
+		s->toks = toks;
+		s->sztoks = sz;
+	}
+
+	s->toks[s->ntoks++] = s->next;
+}
+
+
+static int script_get_token(script_t *s)
+{
+	int res;
+
+	s->token = s->next;
+
+	/* failed scan leaves the previous token, replay reproduces it */
+	if (s->replay) {
+		if (s->cursor < s->ntoks)
+			s->next = s->toks[s->cursor++];
+		return SCRIPT_OK;
+	}
+
+	res = script_scan_token(s);
+
+	if (s->flags & SCRIPT_F_COMPILE)
+		script_record_token(s);
+
+	return res;
+}
+
+
 /* sets null terminated list of functions used by script */
 int script_set_funcs(script_t *s, const script_funct_t *funcs, void *arg)
 {
@@ -313,6 +356,51 @@ static int _script_parse_cmp(const void *k, const void *e)
 }
 
 
+/* print error with its position in the current line */
+static void script_report(script_t *s)
+{
+	int column = 1;
+	script_blob_t token_name = {s->line.ptr, s->line.ptr};
+
+	if (s->next.str.ptr < s->line.end) {
+		column = (int)(s->next.str.ptr - s->line.ptr + 1);
+		token_name = s->next.str;
+	}
+	else {
+		script_skip_to_space(s, &token_name, 1);
+	}
+
+	LOG_ERROR(
+		"Error: %s (token: '%.*s', line: %d, column: %d)\n",
+		s->errstr,
+		(int)(token_name.end - token_name.ptr),
+		token_name.ptr,
+		s->token.line_no,
+		column
+	);
+}
+
+
+/* append command, its arguments start at the last scanned token */
+static int script_record_cmd(script_t *s, const script_funct_t *p)
+{
+	script_cmd_t *cmds;
+
+	if ((cmds = realloc(s->cmds, (s->ncmds + 1) * sizeof(*cmds))) == NULL) {
+		s->errstr = "Unable to allocate memory.";
+		return SCRIPT_ERROR;
+	}
+
+	s->cmds = cmds;
+	s->cmds[s->ncmds].funct = p;
+	s->cmds[s->ncmds].line = s->line;
+	s->cmds[s->ncmds].tok = s->ntoks - 1;
+	s->ncmds++;
+
+	return SCRIPT_OK;
+}
+
+
 /* main loop of the psu script parser */
 int script_parse(script_t *s, int flags)
 {
@@ -322,6 +410,7 @@ int script_parse(script_t *s, int flags)
 	s->flags = flags;
 	s->ptr = s->buf.ptr;
 	s->next.line_no = 1;
+	s->replay = 0;
 
 	/* start with the first token */
 	script_get_token(s);
@@ -349,7 +438,9 @@ int script_parse(script_t *s, int flags)
 			if ((p = bsearch(s, s->pfuncs, s->nfuncs, sizeof(*s->pfuncs), _script_parse_cmp))) {
 				int res = SCRIPT_OK;
 
-				if (p->cmd_cb && (res = p->cmd_cb(s)) == SCRIPT_OK) {
+				if ((s->flags & SCRIPT_F_COMPILE) && (script_record_cmd(s, p) != SCRIPT_OK))
+					res = SCRIPT_ERROR;
+				else if (p->cmd_cb && (res = p->cmd_cb(s)) == SCRIPT_OK) {
 
 					if (script_accept(s, script_tok_comment) == SCRIPT_OK)
 						continue;
@@ -374,30 +465,70 @@ int script_parse(script_t *s, int flags)
 			s->errstr = "Invalid token";
 
 		if (s->errstr) {
-			int column = 1;
-			script_blob_t token_name = {s->line.ptr, s->line.ptr};
+			script_report(s);
+			return SCRIPT_ERROR;
+		}
 
-			if (s->next.str.ptr < s->line.end) {
-				column = (int)(s->next.str.ptr - s->line.ptr + 1);
-				token_name = s->next.str;
-			}
-			else {
-				script_skip_to_space(s, &token_name, 1);
-			}
+	}
 
-			LOG_ERROR(
-				"Error: %s (token: '%.*s', line: %d, column: %d)\n",
-				s->errstr,
-				(int)(token_name.end - token_name.ptr),
-				token_name.ptr,
-				s->token.line_no,
-				column
-			);
+	return SCRIPT_OK;
+}
 
-			return SCRIPT_ERROR;
+
+/* dry-run pass validates commands and records them with their tokens */
+int script_compile(script_t *s)
+{
+	free(s->cmds);
+	free(s->toks);
+	s->cmds = NULL;
+	s->toks = NULL;
+	s->ncmds = s->ntoks = s->sztoks = 0;
+
+	return script_parse(s, SCRIPT_F_DRYRUN | SCRIPT_F_COMPILE);
+}
+
+
+/* run compiled commands, tokens aren't scanned again */
+int script_run(script_t *s, int flags)
+{
+	const script_cmd_t *cmd;
+	int k, res;
+
+	s->errstr = NULL;
+	s->flags = flags;
+	s->replay = 1;
+
+	for (k = 0; k < s->ncmds; k++) {
+		cmd = &s->cmds[k];
+		s->line = cmd->line;
+		s->token = s->toks[cmd->tok - 1];
+		s->next = s->toks[cmd->tok];
+		s->cursor = cmd->tok + 1;
+
+		if (s->flags & SCRIPT_F_SHOWLINES)
+			LOG("\033[93m%.*s\033[0m\033[0K\n", (int)(s->line.end - s->line.ptr), s->line.ptr);
+
+		if (cmd->funct->cmd_cb == NULL)
+			continue;
+
+		if ((res = cmd->funct->cmd_cb(s)) == SCRIPT_OK) {
+			if (script_accept(s, script_tok_comment) == SCRIPT_OK)
+				continue;
+
+			if (script_expect(s, script_tok_nl, "End of line expected") == SCRIPT_OK)
+				continue;
 		}
 
+		if (!s->errstr)
+			s->errstr = "Command reported error status or execution timed out.";
+
+		script_report(s);
+		s->replay = 0;
+
+		return SCRIPT_ERROR;
 	}
 
+	s->replay = 0;
+
 	return SCRIPT_OK;
 }
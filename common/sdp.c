@@ -0,0 +1,522 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Serial Download Protocol (i.MX/Vybrid boot ROM and psd)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SDP_LIBUSB
+#include <libusb.h>
+#endif
+
+#include "hostutils-common/sdp.h"
+
+
+/* Command report: ID 1, type (twice), address, format, count, data, reserved */
+#define SDP_CMDSZ 17
+
+#define SDP_WRITE_REGISTER 0x02
+#define SDP_WRITE_FILE     0x04
+#define SDP_ERROR_STATUS   0x05
+#define SDP_JUMP_ADDRESS   0x0b
+
+/* Timeout of single output transfer (ms) */
+#define SDP_TIMEOUT 5000
+
+
+static void sdp_put32(unsigned char *b, uint32_t v)
+{
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >> 8;
+	b[3] = v & 0xff;
+}
+
+
+static void sdp_cmd(unsigned char *b, uint8_t type, uint32_t addr, uint8_t format, uint32_t count, uint32_t data)
+{
+	memset(b, 0, SDP_CMDSZ);
+	b[0] = 1;
+	b[1] = b[2] = type;
+	sdp_put32(b + 3, addr);
+	b[7] = format;
+	sdp_put32(b + 8, count);
+	sdp_put32(b + 12, data);
+}
+
+
+static void sdp_dataHeader(unsigned char *report, size_t len)
+{
+	report[0] = 2;
+}
+
+
+#ifdef SDP_LIBUSB
+
+/* HID class SET_REPORT request, used if device has no interrupt OUT endpoint (i.MX boot ROM) */
+#define SDP_SET_REPORT        0x09
+#define SDP_SET_REPORT_TYPE   (LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT)
+#define SDP_REPORT_OUTPUT(id) (0x200 | (id))
+
+
+typedef struct _sdp_usb_t {
+	libusb_context *ctx;
+	libusb_device_handle *h;
+	int iface;
+	unsigned char epin;
+	unsigned char epout;   /* 0 - reports are sent over control pipe */
+} sdp_usb_t;
+
+
+typedef struct {
+	sdp_usb_t *u;
+	const stream_fmt_t *fmt;
+	stream_iter_t it;      /* data to be submitted */
+	size_t size;
+	size_t done;           /* data acknowledged */
+	unsigned int inflight;
+	int err;
+	int progress;
+	unsigned long long last;
+} sdp_xfer_t;
+
+
+static void sdp_usbFree(sdp_usb_t *u)
+{
+	if (u->h != NULL)
+		libusb_close(u->h);
+	libusb_exit(u->ctx);
+	free(u);
+}
+
+
+static void sdp_usbEndpoints(sdp_usb_t *u)
+{
+	struct libusb_config_descriptor *cfg;
+	const struct libusb_interface_descriptor *id;
+	const struct libusb_endpoint_descriptor *ep;
+	int i, k;
+
+	if (libusb_get_active_config_descriptor(libusb_get_device(u->h), &cfg) != 0)
+		return;
+
+	for (i = 0; i < cfg->bNumInterfaces; i++) {
+		if ((cfg->interface[i].num_altsetting < 1) || (cfg->interface[i].altsetting[0].bInterfaceClass != LIBUSB_CLASS_HID))
+			continue;
+
+		id = &cfg->interface[i].altsetting[0];
+		u->iface = id->bInterfaceNumber;
+
+		for (k = 0; k < id->bNumEndpoints; k++) {
+			ep = &id->endpoint[k];
+			if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_INTERRUPT)
+				continue;
+
+			if (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN)
+				u->epin = ep->bEndpointAddress;
+			else
+				u->epout = ep->bEndpointAddress;
+		}
+		break;
+	}
+
+	libusb_free_config_descriptor(cfg);
+}
+
+
+static int sdp_usbOpen(sdp_t *sdp, uint16_t vid, uint16_t pid)
+{
+	struct libusb_device_descriptor dd;
+	libusb_device **list;
+	sdp_usb_t *u;
+	ssize_t n, k;
+
+	if ((u = calloc(1, sizeof(*u))) == NULL)
+		return -1;
+
+	if (libusb_init(&u->ctx) != 0) {
+		free(u);
+		return -1;
+	}
+
+	if ((n = libusb_get_device_list(u->ctx, &list)) >= 0) {
+		for (k = 0; k < n; k++) {
+			if ((libusb_get_device_descriptor(list[k], &dd) != 0) || (dd.idVendor != vid) || ((pid != 0) && (dd.idProduct != pid)))
+				continue;
+
+			if (libusb_open(list[k], &u->h) == 0) {
+				sdp->pid = dd.idProduct;
+				break;
+			}
+		}
+		libusb_free_device_list(list, 1);
+	}
+
+	if (u->h == NULL) {
+		sdp_usbFree(u);
+		return -1;
+	}
+
+	sdp_usbEndpoints(u);
+
+	/* HID driver is detached while the interface is claimed */
+	libusb_set_auto_detach_kernel_driver(u->h, 1);
+	if ((u->epin == 0) || (libusb_claim_interface(u->h, u->iface) != 0)) {
+		sdp_usbFree(u);
+		return -1;
+	}
+
+	sdp->usb = u;
+
+	return 0;
+}
+
+
+static void sdp_usbClose(sdp_usb_t *u)
+{
+	libusb_release_interface(u->h, u->iface);
+	sdp_usbFree(u);
+}
+
+
+static int sdp_usbWrite(sdp_usb_t *u, const unsigned char *report, size_t len)
+{
+	int n;
+
+	if (u->epout != 0)
+		return (libusb_interrupt_transfer(u->h, u->epout, (unsigned char *)report, len, &n, SDP_TIMEOUT) == 0) ? n : -1;
+
+	n = libusb_control_transfer(u->h, SDP_SET_REPORT_TYPE, SDP_SET_REPORT, SDP_REPORT_OUTPUT(report[0]), u->iface, (unsigned char *)report, len, SDP_TIMEOUT);
+
+	return (n < 0) ? -1 : n;
+}
+
+
+/* Reports are read whole (buffer shorter than packet would overflow), like hid_read() does it blocks */
+static int sdp_usbRead(sdp_usb_t *u, unsigned char *buff, size_t size)
+{
+	unsigned char b[SDP_PAYLOAD + 1];
+	int n;
+
+	if (libusb_interrupt_transfer(u->h, u->epin, b, sizeof(b), &n, 0) != 0)
+		return -1;
+
+	if ((size_t)n > size)
+		n = size;
+	memcpy(buff, b, n);
+
+	return n;
+}
+
+
+static void LIBUSB_CALL sdp_usbDone(struct libusb_transfer *t);
+
+
+/* Function fills transfer with the next report and submits it */
+static int sdp_usbSubmit(sdp_xfer_t *x, struct libusb_transfer *t)
+{
+	unsigned char *report = t->buffer + ((x->u->epout == 0) ? LIBUSB_CONTROL_SETUP_SIZE : 0);
+	size_t len, n;
+
+	len = stream_report(x->fmt, report, &x->it, &n);
+
+	if (x->u->epout != 0) {
+		libusb_fill_interrupt_transfer(t, x->u->h, x->u->epout, t->buffer, len, sdp_usbDone, x, SDP_TIMEOUT);
+	}
+	else {
+		libusb_fill_control_setup(t->buffer, SDP_SET_REPORT_TYPE, SDP_SET_REPORT, SDP_REPORT_OUTPUT(report[0]), x->u->iface, len);
+		libusb_fill_control_transfer(t, x->u->h, t->buffer, sdp_usbDone, x, SDP_TIMEOUT);
+	}
+
+	if (libusb_submit_transfer(t) != 0)
+		return -1;
+
+	x->inflight++;
+
+	return 0;
+}
+
+
+static void LIBUSB_CALL sdp_usbDone(struct libusb_transfer *t)
+{
+	sdp_xfer_t *x = t->user_data;
+
+	x->inflight--;
+
+	if (t->status != LIBUSB_TRANSFER_COMPLETED) {
+		x->err = -1;
+		return;
+	}
+
+	x->done = (x->size - x->done > x->fmt->payload) ? x->done + x->fmt->payload : x->size;
+	if (x->progress)
+		stream_progress(x->done, x->size, &x->last);
+
+	/* Transfer is reused for the next report while others are still in flight */
+	if (!x->err && (x->it.left > 0) && (sdp_usbSubmit(x, t) < 0))
+		x->err = -1;
+}
+
+
+static int sdp_usbStream(sdp_usb_t *u, const stream_fmt_t *fmt, const struct iovec *iov, int iovcnt, int progress)
+{
+	struct libusb_transfer *t[SDP_INFLIGHT] = { NULL };
+	sdp_xfer_t x = { .u = u, .fmt = fmt, .progress = progress };
+	size_t bufsz = LIBUSB_CONTROL_SETUP_SIZE + fmt->hdrsz + (fmt->payload + fmt->align - 1) / fmt->align * fmt->align;
+	unsigned int k;
+
+	x.size = stream_iter(&x.it, iov, iovcnt);
+
+	for (k = 0; (k < SDP_INFLIGHT) && (x.it.left > 0) && !x.err; k++) {
+		if ((t[k] = libusb_alloc_transfer(0)) == NULL) {
+			x.err = -1;
+			break;
+		}
+
+		t[k]->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+		if (((t[k]->buffer = malloc(bufsz)) == NULL) || (sdp_usbSubmit(&x, t[k]) < 0))
+			x.err = -1;
+	}
+
+	while (x.inflight > 0) {
+		if ((libusb_handle_events(u->ctx) != 0) && !x.err) {
+			x.err = -1;
+			for (k = 0; k < SDP_INFLIGHT; k++) {
+				if (t[k] != NULL)
+					libusb_cancel_transfer(t[k]);
+			}
+		}
+	}
+
+	for (k = 0; k < SDP_INFLIGHT; k++) {
+		if (t[k] != NULL)
+			libusb_free_transfer(t[k]);
+	}
+
+	return x.err;
+}
+
+#endif
+
+
+int sdp_open(sdp_t *sdp, uint16_t vid, uint16_t pid)
+{
+	struct hid_device_info *list, *it;
+
+	memset(sdp, 0, sizeof(*sdp));
+	sdp->vid = vid;
+
+#ifdef SDP_LIBUSB
+	if (sdp_usbOpen(sdp, vid, pid) == 0)
+		return 0;
+#endif
+
+	list = hid_enumerate(vid, pid);
+	for (it = list; it != NULL; it = it->next) {
+		if ((sdp->hid = hid_open_path(it->path)) != NULL) {
+			sdp->pid = it->product_id;
+			break;
+		}
+	}
+
+	if (list != NULL)
+		hid_free_enumeration(list);
+
+	return (sdp->hid != NULL) ? 0 : -1;
+}
+
+
+void sdp_attach(sdp_t *sdp, hid_device *dev)
+{
+	memset(sdp, 0, sizeof(*sdp));
+	sdp->hid = dev;
+}
+
+
+void sdp_close(sdp_t *sdp)
+{
+#ifdef SDP_LIBUSB
+	if (sdp->usb != NULL)
+		sdp_usbClose(sdp->usb);
+#endif
+	if (sdp->hid != NULL)
+		hid_close(sdp->hid);
+
+	sdp->usb = NULL;
+	sdp->hid = NULL;
+}
+
+
+int sdp_opened(sdp_t *sdp)
+{
+	return (sdp->hid != NULL) || (sdp->usb != NULL);
+}
+
+
+int sdp_write(sdp_t *sdp, const unsigned char *report, size_t len)
+{
+#ifdef SDP_LIBUSB
+	if (sdp->usb != NULL)
+		return sdp_usbWrite(sdp->usb, report, len);
+#endif
+
+	return hid_write(sdp->hid, report, len);
+}
+
+
+int sdp_read(sdp_t *sdp, unsigned char *buff, size_t size)
+{
+#ifdef SDP_LIBUSB
+	if (sdp->usb != NULL)
+		return sdp_usbRead(sdp->usb, buff, size);
+#endif
+
+	return hid_read(sdp->hid, buff, size);
+}
+
+
+int sdp_streamv(sdp_t *sdp, const stream_fmt_t *fmt, const struct iovec *iov, int iovcnt, int progress)
+{
+#ifdef SDP_LIBUSB
+	if (sdp->usb != NULL)
+		return sdp_usbStream(sdp->usb, fmt, iov, iovcnt, progress);
+#endif
+
+	return stream_writev(sdp->hid, fmt, iov, iovcnt, progress);
+}
+
+
+int sdp_stream(sdp_t *sdp, const stream_fmt_t *fmt, const void *data, size_t size, int progress)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+	return sdp_streamv(sdp, fmt, &iov, 1, progress);
+}
+
+
+/* Function receives HAB mode (report 3) and status (report 4) of command */
+static int sdp_response(sdp_t *sdp, uint32_t *status)
+{
+	unsigned char b[SDP_REPORTSZ] = { 0 };
+	int rc;
+
+	if ((rc = sdp_read(sdp, b, sizeof(b))) < 5) {
+		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
+		return -1;
+	}
+
+	if ((rc = sdp_read(sdp, b, sizeof(b))) < 0) {
+		fprintf(stderr, "Failed to receive status (rc=%d)\n", rc);
+		return -1;
+	}
+
+	*status = b[1] | ((uint32_t)b[2] << 8) | ((uint32_t)b[3] << 16) | ((uint32_t)b[4] << 24);
+
+	return 0;
+}
+
+
+int sdp_writeFilev(sdp_t *sdp, uint32_t addr, uint8_t format, const struct iovec *iov, int iovcnt, int flags)
+{
+	const stream_fmt_t fmt = { .hdrsz = 1, .payload = SDP_PAYLOAD, .align = SDP_ALIGN, .header = sdp_dataHeader };
+	unsigned char b[SDP_CMDSZ];
+	stream_iter_t it;
+	uint32_t status;
+	int rc;
+
+	sdp_cmd(b, SDP_WRITE_FILE, addr, format, stream_iter(&it, iov, iovcnt), 0);
+	if ((rc = sdp_write(sdp, b, SDP_CMDSZ)) < 0) {
+		fprintf(stderr, "Failed to send write_file command (rc=%d)\n", rc);
+		return -1;
+	}
+
+	if ((rc = sdp_streamv(sdp, &fmt, iov, iovcnt, flags & SDP_F_PROGRESS)) < 0) {
+		fprintf(stderr, "\nFailed to send file contents (rc=%d)\n", rc);
+		return -1;
+	}
+
+	if (flags & SDP_F_PROGRESS)
+		fprintf(stderr, "\n");
+
+	if (!(flags & SDP_F_STATUS))
+		return 0;
+
+	if (sdp_response(sdp, &status) < 0)
+		return -1;
+
+	if (status != SDP_FILE_DONE) {
+		fprintf(stderr, "Failed to receive complete status (status=%08x)\n", status);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int sdp_writeFile(sdp_t *sdp, uint32_t addr, uint8_t format, const void *data, size_t size, int flags)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+	return sdp_writeFilev(sdp, addr, format, &iov, 1, flags);
+}
+
+
+int sdp_writeRegister(sdp_t *sdp, uint32_t addr, uint8_t format, uint32_t data, uint32_t *status)
+{
+	unsigned char b[SDP_CMDSZ];
+	int rc;
+
+	sdp_cmd(b, SDP_WRITE_REGISTER, addr, format, format / 8, data);
+	if ((rc = sdp_write(sdp, b, SDP_CMDSZ)) < 0) {
+		fprintf(stderr, "Failed to send write_register command (rc=%d)\n", rc);
+		return -1;
+	}
+
+	return sdp_response(sdp, status);
+}
+
+
+int sdp_jump(sdp_t *sdp, uint32_t addr)
+{
+	unsigned char b[SDP_REPORTSZ];
+	int rc;
+
+	sdp_cmd(b, SDP_JUMP_ADDRESS, addr, 0x20, 0, 0);
+	if ((rc = sdp_write(sdp, b, SDP_CMDSZ)) < 0) {
+		fprintf(stderr, "Failed to send jump_address command (rc=%d)\n", rc);
+		return -1;
+	}
+
+	if ((rc = sdp_read(sdp, b, sizeof(b))) < 5) {
+		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int sdp_status(sdp_t *sdp, uint32_t *status)
+{
+	unsigned char b[SDP_CMDSZ];
+	int rc;
+
+	sdp_cmd(b, SDP_ERROR_STATUS, 0, 0, 0, 0);
+	if ((rc = sdp_write(sdp, b, SDP_CMDSZ)) < 0) {
+		fprintf(stderr, "Failed to send status command (rc=%d)\n", rc);
+		return -1;
+	}
+
+	return sdp_response(sdp, status);
+}
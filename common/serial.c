@@ -16,7 +16,16 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 
 #include "hostutils-common/types.h"
 #include "hostutils-common/errors.h"
@@ -25,18 +34,34 @@
 
 int serial_open(char *dev, speed_t speed)
 {
-	int fd;
-	struct termios newtio;
+	int fd, err;
 
 	if ((fd = open(dev, O_RDWR |  O_NONBLOCK | O_EXCL)) < 0)
 		return ERR_SERIAL_INIT;
 
+	if ((err = serial_setup(fd, speed, NULL)) < 0) {
+		close(fd);
+		return err;
+	}
+
+	return fd;
+}
+
+
+int serial_setup(int fd, speed_t speed, struct termios *orig)
+{
+	struct termios newtio;
+
+	if ((orig != NULL) && (tcgetattr(fd, orig) < 0))
+		return ERR_SERIAL_SETATTR;
+
 	memset(&newtio, 0, sizeof(newtio));
 	cfmakeraw(&newtio);
 
+	/* Reads return as soon as any byte is available, timeouts are handled by poll() */
 	newtio.c_cflag |= CS8 | CREAD | CLOCAL;
-	newtio.c_cc[VMIN] = 0;
-	newtio.c_cc[VTIME] = 1;
+	newtio.c_cc[VMIN] = 1;
+	newtio.c_cc[VTIME] = 0;
 
 	cfsetispeed(&newtio, speed);
 	cfsetospeed(&newtio, speed);
@@ -47,64 +72,282 @@ int serial_open(char *dev, speed_t speed)
 	if (tcsetattr(fd, TCSAFLUSH, &newtio) < 0)
 		return ERR_SERIAL_SETATTR;
 
-	return fd;
+	/* Not every driver supports it, transfer works anyway */
+	serial_lowlatency(fd);
+
+	return ERR_NONE;
 }
 
 
-int serial_read(int fd, u8 *buff, uint len, uint timeout)
+int serial_restore(int fd, const struct termios *orig)
 {
-	char c;
-	int p = 0;
-	fd_set fds;
-	struct timeval tv;
-	struct timeval *tvp = NULL;
-	int res;
+	if (tcsetattr(fd, TCSADRAIN, orig) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	return ERR_NONE;
+}
+
+
+int serial_lowlatency(int fd)
+{
+#ifdef __linux__
+	struct serial_struct ss;
+
+	/* USB-UART drivers flush received data to tty after up to 16 ms otherwise */
+	if (ioctl(fd, TIOCGSERIAL, &ss) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	ss.flags |= ASYNC_LOW_LATENCY;
+
+	if (ioctl(fd, TIOCSSERIAL, &ss) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	return ERR_NONE;
+#else
+	return ERR_SERIAL_SETATTR;
+#endif
+}
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
+
+int serial_setspeed(int fd, speed_t speed)
+{
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	/* Data already written is sent with previous speed */
+	if (tcsetattr(fd, TCSADRAIN, &tio) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	/* Driver may silently keep previous speed if it doesn't support the new one */
+	if ((tcgetattr(fd, &tio) < 0) || (cfgetospeed(&tio) != speed))
+		return ERR_SERIAL_SETATTR;
+
+	return ERR_NONE;
+}
+
+
+int serial_probespeed(int fd, speed_t speed)
+{
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) < 0)
+		return ERR_SERIAL_SETATTR;
+
+	/* Only a copy is changed, reconfiguring the port would disturb transfer in progress */
+	if ((cfsetispeed(&tio, speed) < 0) || (cfsetospeed(&tio, speed) < 0) || (cfgetospeed(&tio) != speed))
+		return ERR_SERIAL_SETATTR;
+
+	return ERR_NONE;
+}
+
+
+static void serial_deadline(struct timespec *deadline, uint timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (long)(timeout % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+
+/* Function waits for events until deadline passes (NULL - infinitely) */
+static int serial_wait(int fd, short events, const struct timespec *deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	struct timespec now;
+	long long ns, ms = -1;
+	int res;
 
 	for (;;) {
-		tv.tv_sec = 0;
-		tv.tv_usec = timeout * 1000;
+		if (deadline != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			ns = (long long)(deadline->tv_sec - now.tv_sec) * 1000000000 + (deadline->tv_nsec - now.tv_nsec);
+			if (ns <= 0)
+				return ERR_SERIAL_TIMEOUT;
 
-		if (timeout)
-			tvp = &tv;
+			ms = (ns + 999999) / 1000000;
+			if (ms > INT_MAX)
+				ms = INT_MAX;
+		}
 
-		if ((res = select(fd + 1, &fds, NULL, NULL, tvp)) < 0)
-			return ERR_SERIAL_IO;
-		if (!res)
-			return ERR_SERIAL_TIMEOUT;
+		/* Expired poll() is checked against deadline again, it may return early */
+		if ((res = poll(&pfd, 1, (int)ms)) > 0)
+			return ERR_NONE;
 
-		if ((res = read(fd, &c, 1)) < 0)
+		if ((res < 0) && (errno != EINTR))
 			return ERR_SERIAL_IO;
+	}
+}
+
+
+/* Function reads whatever is available (at least one byte) */
+static int serial_readsome(int fd, u8 *buff, uint len, const struct timespec *deadline)
+{
+	int res;
+
+	for (;;) {
+		if ((res = serial_wait(fd, POLLIN, deadline)) < 0)
+			return res;
+
+		if ((res = read(fd, buff, len)) > 0)
+			return res;
 
-		/* if select returned readiness but we got read size zero - we got closed conn */
-		else if (res == 0)
+		/* if poll returned readiness but we got read size zero - we got closed conn */
+		if (res == 0)
 			return ERR_SERIAL_CLOSED;
 
-		buff[p++] = c;
-		if (p == len)
-			break;
+		if ((errno != EINTR) && (errno != EAGAIN))
+			return ERR_SERIAL_IO;
+	}
+}
+
+
+int serial_read(int fd, u8 *buff, uint len, uint timeout)
+{
+	struct timespec deadline;
+	uint p = 0;
+	int res;
+
+	if (timeout)
+		serial_deadline(&deadline, timeout);
+
+	while (p < len) {
+		if ((res = serial_readsome(fd, buff + p, len - p, timeout ? &deadline : NULL)) < 0)
+			return res;
+		p += res;
 	}
+
 	return p;
 }
 
 
-int serial_write(int fd, u8 *buff, uint len)
+int serial_writev(int fd, struct iovec *iov, int iovcnt)
 {
-	int l;
+	struct timespec deadline;
+	int stalled = 0;
+	ssize_t res;
+
+	while (iovcnt > 0) {
+		if ((res = writev(fd, iov, iovcnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				return ERR_SERIAL_IO;
+
+			/* Device is opened in non-blocking mode, wait until output buffer drains unless peer stopped reading */
+			if (!stalled) {
+				serial_deadline(&deadline, SERIAL_TXTIMEOUT);
+				stalled = 1;
+			}
+
+			if ((res = serial_wait(fd, POLLOUT, &deadline)) < 0)
+				return res;
+
+			continue;
+		}
+
+		stalled = 0;
+
+		/* Skip written iovecs */
+		for (; (iovcnt > 0) && ((size_t)res >= iov->iov_len); iov++, iovcnt--)
+			res -= iov->iov_len;
+
+		if (iovcnt > 0) {
+			iov->iov_base = (u8 *)iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+
+	return ERR_NONE;
+}
 
-	for (;;) {
-		if ((l = write(fd, buff, len)) < 0)
-			return ERR_SERIAL_IO;
 
-		buff += l;
-		len -= l;
-		if (!len)
-			break;
+int serial_write(int fd, const u8 *buff, uint len)
+{
+	struct iovec iov = { .iov_base = (void *)buff, .iov_len = len };
+
+	return serial_writev(fd, &iov, 1);
+}
+
+
+void serial_init(serial_t *s, int fd)
+{
+	s->fd = fd;
+	s->pos = 0;
+	s->len = 0;
+	s->timed = 0;
+}
+
+
+void serial_timeout(serial_t *s, uint timeout)
+{
+	s->timed = (timeout != 0);
+	if (s->timed)
+		serial_deadline(&s->deadline, timeout);
+}
+
+
+int serial_bread(serial_t *s, u8 *buff, uint len)
+{
+	const struct timespec *deadline = s->timed ? &s->deadline : NULL;
+	uint p = 0, n;
+	int res;
+
+	while (p < len) {
+		if (s->pos == s->len) {
+			/* Large reads go directly to the caller's buffer */
+			if (len - p >= sizeof(s->buff)) {
+				if ((res = serial_readsome(s->fd, buff + p, len - p, deadline)) < 0)
+					return res;
+				p += res;
+				continue;
+			}
+
+			/* Read ahead everything that has arrived, following reads are served from the buffer */
+			if ((res = serial_readsome(s->fd, s->buff, sizeof(s->buff), deadline)) < 0)
+				return res;
+			s->pos = 0;
+			s->len = res;
+		}
+
+		n = s->len - s->pos;
+		if (n > len - p)
+			n = len - p;
+
+		memcpy(buff + p, s->buff + s->pos, n);
+		s->pos += n;
+		p += n;
+	}
+
+	return p;
+}
+
+
+int serial_getc(serial_t *s, u8 *c)
+{
+	if (s->pos < s->len) {
+		*c = s->buff[s->pos++];
+		return 1;
 	}
 
-	return len;
+	return serial_bread(s, c, 1);
+}
+
+
+void serial_discard(serial_t *s)
+{
+	s->pos = 0;
+	s->len = 0;
 }
 
 
@@ -129,6 +372,19 @@ int serial_int2speed(int baudrate, speed_t *speed)
 #else
 		case 230400:    *speed = B230400; return 0;
 		case 460800:    *speed = B460800; return 0;
+#endif
+#ifdef B500000
+		case 500000:    *speed = B500000;  return 0;
+		case 576000:    *speed = B576000;  return 0;
+		case 921600:    *speed = B921600;  return 0;
+		case 1000000:   *speed = B1000000; return 0;
+		case 1152000:   *speed = B1152000; return 0;
+		case 1500000:   *speed = B1500000; return 0;
+		case 2000000:   *speed = B2000000; return 0;
+		case 2500000:   *speed = B2500000; return 0;
+		case 3000000:   *speed = B3000000; return 0;
+		case 3500000:   *speed = B3500000; return 0;
+		case 4000000:   *speed = B4000000; return 0;
 #endif
 	}
 
@@ -156,6 +412,19 @@ int serial_speed2int(speed_t speed, int *baudrate)
 #else
 		case B230400:   *baudrate = 230400;  return 0;
 		case B460800:   *baudrate = 460800;  return 0;
+#endif
+#ifdef B500000
+		case B500000:   *baudrate = 500000;  return 0;
+		case B576000:   *baudrate = 576000;  return 0;
+		case B921600:   *baudrate = 921600;  return 0;
+		case B1000000:  *baudrate = 1000000; return 0;
+		case B1152000:  *baudrate = 1152000; return 0;
+		case B1500000:  *baudrate = 1500000; return 0;
+		case B2000000:  *baudrate = 2000000; return 0;
+		case B2500000:  *baudrate = 2500000; return 0;
+		case B3000000:  *baudrate = 3000000; return 0;
+		case B3500000:  *baudrate = 3500000; return 0;
+		case B4000000:  *baudrate = 4000000; return 0;
 #endif
 	}
 
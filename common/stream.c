@@ -0,0 +1,213 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Pipelined streaming of data as HID output reports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hostutils-common/stream.h"
+
+
+typedef struct {
+	const stream_fmt_t *fmt;
+	stream_iter_t it;
+
+	unsigned char *reports;      /* STREAM_DEPTH report buffers */
+	size_t reportsz;
+	size_t lens[STREAM_DEPTH];
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;        /* report prepared */
+	pthread_cond_t space;        /* report sent */
+	unsigned int prepared;
+	unsigned int sent;
+	int abort;
+} stream_t;
+
+
+static unsigned long long stream_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+void stream_progress(size_t offset, size_t size, unsigned long long *last)
+{
+	unsigned long long now = stream_now();
+
+	if ((offset < size) && (now - *last < STREAM_PROGRESS))
+		return;
+
+	*last = now;
+	fprintf(stderr, "\r - Sent (%zu/%zu) %3.0f%% ", offset, size, ((float)offset / (float)size) * 100.0f);
+}
+
+
+size_t stream_iter(stream_iter_t *it, const struct iovec *iov, int iovcnt)
+{
+	int k;
+
+	it->iov = iov;
+	it->iovcnt = iovcnt;
+	it->offs = 0;
+	it->left = 0;
+
+	for (k = 0; k < iovcnt; k++)
+		it->left += iov[k].iov_len;
+
+	return it->left;
+}
+
+
+size_t stream_report(const stream_fmt_t *fmt, unsigned char *report, stream_iter_t *it, size_t *n)
+{
+	unsigned char *p = report + fmt->hdrsz;
+	size_t len, chunk;
+
+	*n = (it->left > fmt->payload) ? fmt->payload : it->left;
+	len = (*n + fmt->align - 1) / fmt->align * fmt->align;
+
+	fmt->header(report, *n);
+
+	/* Report payload may be gathered from several regions */
+	for (it->left -= *n; p < report + fmt->hdrsz + *n; p += chunk) {
+		while (it->offs == it->iov->iov_len) {
+			it->iov++;
+			it->iovcnt--;
+			it->offs = 0;
+		}
+
+		chunk = it->iov->iov_len - it->offs;
+		if (chunk > (size_t)(report + fmt->hdrsz + *n - p))
+			chunk = report + fmt->hdrsz + *n - p;
+
+		memcpy(p, (const unsigned char *)it->iov->iov_base + it->offs, chunk);
+		it->offs += chunk;
+	}
+
+	memset(report + fmt->hdrsz + *n, 0, len - *n);
+
+	return fmt->hdrsz + len;
+}
+
+
+/* Producer copies data into reports ahead of the sender, page faults of mapped files are taken here too */
+static void *stream_producer(void *arg)
+{
+	stream_t *st = arg;
+	const stream_fmt_t *fmt = st->fmt;
+	size_t n;
+	unsigned int k;
+	int abort;
+
+	for (k = 0; st->it.left > 0; k++) {
+		pthread_mutex_lock(&st->lock);
+		while (!st->abort && (st->prepared - st->sent == STREAM_DEPTH))
+			pthread_cond_wait(&st->space, &st->lock);
+		abort = st->abort;
+		pthread_mutex_unlock(&st->lock);
+
+		if (abort)
+			break;
+
+		st->lens[k % STREAM_DEPTH] = stream_report(fmt, st->reports + (k % STREAM_DEPTH) * st->reportsz, &st->it, &n);
+
+		pthread_mutex_lock(&st->lock);
+		st->prepared++;
+		pthread_cond_signal(&st->ready);
+		pthread_mutex_unlock(&st->lock);
+	}
+
+	return NULL;
+}
+
+
+int stream_writev(hid_device *dev, const stream_fmt_t *fmt, const struct iovec *iov, int iovcnt, int progress)
+{
+	stream_t st = { .fmt = fmt };
+	unsigned long long last = 0;
+	unsigned int k, n;
+	size_t offset = 0, size;
+	pthread_t tid;
+	int rc = 0;
+
+	if ((size = stream_iter(&st.it, iov, iovcnt)) == 0)
+		return 0;
+
+	st.reportsz = fmt->hdrsz + (fmt->payload + fmt->align - 1) / fmt->align * fmt->align;
+	if ((st.reports = malloc(STREAM_DEPTH * st.reportsz)) == NULL)
+		return -1;
+
+	pthread_mutex_init(&st.lock, NULL);
+	pthread_cond_init(&st.ready, NULL);
+	pthread_cond_init(&st.space, NULL);
+
+	if (pthread_create(&tid, NULL, stream_producer, &st) != 0) {
+		pthread_cond_destroy(&st.space);
+		pthread_cond_destroy(&st.ready);
+		pthread_mutex_destroy(&st.lock);
+		free(st.reports);
+		return -1;
+	}
+
+	/* Reports are submitted back-to-back, the sender doesn't touch the data */
+	n = (size + fmt->payload - 1) / fmt->payload;
+	for (k = 0; k < n; k++) {
+		pthread_mutex_lock(&st.lock);
+		while (st.prepared == k)
+			pthread_cond_wait(&st.ready, &st.lock);
+		pthread_mutex_unlock(&st.lock);
+
+		if ((rc = hid_write(dev, st.reports + (k % STREAM_DEPTH) * st.reportsz, st.lens[k % STREAM_DEPTH])) < 0)
+			break;
+		rc = 0;
+
+		pthread_mutex_lock(&st.lock);
+		st.sent++;
+		pthread_cond_signal(&st.space);
+		pthread_mutex_unlock(&st.lock);
+
+		offset = (k + 1 == n) ? size : offset + fmt->payload;
+
+		if (progress)
+			stream_progress(offset, size, &last);
+	}
+
+	pthread_mutex_lock(&st.lock);
+	st.abort = 1;
+	pthread_cond_signal(&st.space);
+	pthread_mutex_unlock(&st.lock);
+	pthread_join(tid, NULL);
+
+	pthread_cond_destroy(&st.space);
+	pthread_cond_destroy(&st.ready);
+	pthread_mutex_destroy(&st.lock);
+	free(st.reports);
+
+	return rc;
+}
+
+
+int stream_write(hid_device *dev, const stream_fmt_t *fmt, const void *data, size_t size, int progress)
+{
+	struct iovec iov = { .iov_base = (void *)data, .iov_len = size };
+
+	return stream_writev(dev, fmt, &iov, 1, progress);
+}
@@ -21,15 +21,16 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 
-#include <hidapi/hidapi.h>
-
-
 #include "hostutils-common/dispatch.h"
+#include "hostutils-common/sdp.h"
 
 #define SIZE_PAGE 0x1000
 #define SYSPAGESZ_MAX 0x400
@@ -39,49 +40,10 @@
 #define PADDR_BEGIN 0x80000000
 #define PADDR_END (PADDR_BEGIN + 128 * 1024 * 1024 - 1)
 
-/* SDP protocol section */
-#define SET_CMD_TYPE(b,v) (b)[0]=(b)[1]=(v)
-#define SET_ADDR(b,v) *((uint32_t*)((b)+2))=htonl(v)
-#define SET_COUNT(b,v) *((uint32_t*)((b)+7))=htonl(v);
-#define SET_DATA(b,v) *((uint32_t*)((b)+11))=htonl(v);
-#define SET_FORMAT(b,v) (b)[6]=(v);
-
-#define CMD_SIZE 17
-#define BUF_SIZE 1025
-#define INTERRUPT_SIZE 65
-
-static inline void set_write_file_cmd(unsigned char* b, uint32_t addr, uint32_t size)
-{
-	SET_CMD_TYPE(b,0x04);
-	SET_ADDR(b,addr);
-	SET_COUNT(b,size);
-	SET_FORMAT(b,0x20);
-}
-
-
-static inline void set_jmp_cmd(unsigned char* b, uint32_t addr)
-{
-	SET_CMD_TYPE(b,0x0b);
-	SET_ADDR(b,addr);
-	SET_FORMAT(b,0x20);
-}
-
-
-static inline void set_status_cmd(unsigned char* b)
-{
-	SET_CMD_TYPE(b,0x05);
-}
-
-
-static inline void set_write_reg_cmd(unsigned char* b, uint32_t addr, uint32_t v)
-{
-	SET_CMD_TYPE(b,0x02);
-	SET_ADDR(b,addr);
-	SET_DATA(b,v);
-	SET_FORMAT(b,0x20);
-	SET_COUNT(b,4);
-}
-
+/* Kernel header patched by boot_image (syspage, IVT image size), the rest of image is sent from mapped files */
+#define IMG_HEADSZ SIZE_PAGE
+#define IMG_IVT 0x400
+#define IMG_MINSZ (IMG_IVT + 36 + sizeof(size_t))
 
 typedef struct {
 	uint32_t start;
@@ -113,6 +75,19 @@ typedef struct _mod_t {
 	void *data;
 } mod_t;
 
+
+/* Boot image as scatter list: patched kernel header followed by mapped kernel and programs */
+typedef struct {
+	unsigned char *head;
+	struct iovec *iov;
+	int iovcnt;
+	struct iovec *maps;   /* whole mappings of files */
+	char **names;         /* program name of mapping (NULL - kernel or file not read) */
+	int nmaps;
+	char *progs;          /* names are kept in the list of programs */
+	size_t size;
+} image_t;
+
 extern int silent;
 
 char *base_name(char *path)
@@ -151,112 +126,101 @@ char *base_name(char *path)
 }
 
 
-mod_t *load_module(char *path)
+/* Function maps file read-only, empty file gives empty mapping */
+static int map_file(const char *path, struct iovec *map)
 {
-	mod_t *mod;
-	int mod_fd;
-	struct stat mod_stat;
-	size_t offs, br;
-	int i = 0;
+	struct stat st;
+	int fd;
 
-	if (path[0] == 'X' || path[0] == 'F')
-		i++;
+	map->iov_base = NULL;
+	map->iov_len = 0;
 
-	if ((mod_fd = open(path + i, O_RDONLY)) < 0) {
-		printf("Cannot open file %s: %s\n", path, strerror(errno));
-		return NULL;
-	}
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
 
-	if (fstat(mod_fd, &mod_stat) != 0) {
+	if (fstat(fd, &st) != 0) {
 		printf("File stat error: %s\n", strerror(errno));
-		close(mod_fd);
-		return NULL;
+		close(fd);
+		return -1;
 	}
 
-	mod = malloc(sizeof(mod_t));
+	if (st.st_size > 0) {
+		if ((map->iov_base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+			printf("Cannot map file %s: %s\n", path, strerror(errno));
+			map->iov_base = NULL;
+			close(fd);
+			return -1;
+		}
+		/* Contents are read ahead while previous data is sent */
+		madvise(map->iov_base, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+		map->iov_len = st.st_size;
+	}
 
-	mod->size = mod_stat.st_size;
-	mod->name = base_name(path);
-	mod->data = malloc(mod->size);
+	close(fd);
 
-	if (mod->data == NULL) {
-		printf("Failed to allocate file data\n");
-		return NULL;
-	}
+	return 0;
+}
 
-	offs = 0;
-	br = 1;
-	while (br > 0 && offs < mod->size) {
-		br = read(mod_fd, mod->data + offs, mod->size - offs > 1024 ? 1024 : mod->size - offs);
-		offs += br;
-	}
 
-	if (br < 0) {
-		printf("Read error: %s\n", strerror(errno));
-		close(mod_fd);
+static void unmap_file(struct iovec *map)
+{
+	if (map->iov_base != NULL)
+		munmap(map->iov_base, map->iov_len);
+}
+
+
+mod_t *load_module(char *path)
+{
+	struct iovec map;
+	mod_t *mod;
+	int i = 0;
+
+	if (path[0] == 'X' || path[0] == 'F')
+		i++;
+
+	if (map_file(path + i, &map) < 0) {
+		printf("Cannot open file %s: %s\n", path, strerror(errno));
 		return NULL;
 	}
 
-	if (offs != mod->size) {
-		printf("Read error: Read %lu bytes instead of %lu.\n", offs, mod->size);
-		close(mod_fd);
+	if ((mod = malloc(sizeof(mod_t))) == NULL) {
+		printf("Failed to allocate module\n");
+		unmap_file(&map);
 		return NULL;
 	}
 
-	close(mod_fd);
+	mod->size = map.iov_len;
+	mod->name = base_name(path);
+	mod->data = map.iov_base;
+
 	return mod;
 }
 
 
-void print_progress(size_t sent, size_t all)
+void free_module(mod_t *mod)
 {
-	fprintf(stderr, "\rSent (%lu/%lu) %5.2f%%     ", sent, all, ((float)sent / (float)all) * 100.0);
+	struct iovec map = { .iov_base = mod->data, .iov_len = mod->size };
+
+	unmap_file(&map);
+	free(mod->name);
+	free(mod);
 }
 
 
-int send_close_command(hid_device *dev)
+int send_close_command(sdp_t *sdp)
 {
-	int rc;
-	unsigned char b[BUF_SIZE]={0};
-
-	b[0] = 1;
-	set_write_file_cmd(b + 1, 0, 0);
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_file command (%d)\n", rc);
-	}
-	return rc;
+	return sdp_writeFile(sdp, 0, 0x20, NULL, 0, 0);
 }
 
 
-int send_mod_name(hid_device *dev, mod_t *mod, uint32_t addr)
+int send_mod_name(sdp_t *sdp, mod_t *mod, uint32_t addr)
 {
-	int rc;
-	unsigned char b[BUF_SIZE]={0};
-
-	/* Send write command */
-	b[0] = 1;
-	set_write_file_cmd(b + 1, addr, strlen(mod->name) + 1);
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_file command (%d)\n", rc);
-		return rc;
-	}
-
-	/* Send name */
-	b[0] = 2;
-	memcpy(b + 1, mod->name, strlen(mod->name) + 1);
-	if ((rc = hid_write(dev, b, strlen(mod->name) + 2)) < 0) {
-		fprintf(stderr, "\nFailed to send image name (%d)\n", rc);
-		return rc;
-	}
-	return rc;
+	return sdp_writeFile(sdp, addr, 0x20, mod->name, strlen(mod->name) + 1, 0);
 }
 
 
-int send_mod_args(hid_device *dev, mod_t *mod, uint32_t addr)
+int send_mod_args(sdp_t *sdp, mod_t *mod, uint32_t addr)
 {
-	int rc;
-	unsigned char b[BUF_SIZE]={0};
-
 	int argsz = 0;
 	if (mod->args != NULL) {
 		argsz = strlen(mod->args) + 1;
@@ -268,87 +232,29 @@ int send_mod_args(hid_device *dev, mod_t *mod, uint32_t addr)
 		argsz = 128;
 	}
 
-	/* Send write command */
-	b[0] = 1;
-	set_write_file_cmd(b + 1, addr, argsz);
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_file command (%d)\n", rc);
-		return rc;
-	}
-
-	if (argsz > 0) {
-		/* Send arguments */
-		b[0] = 2;
-		memcpy(b + 1, mod->args, argsz);
-		if ((rc = hid_write(dev, b, argsz + 1)) < 0) {
-			fprintf(stderr, "\nFailed to send image name (%d)\n", rc);
-			return rc;
-		}
-	}
-	return rc;
+	return sdp_writeFile(sdp, addr, 0x20, mod->args, argsz, 0);
 }
 
 
-int send_mod_contents(hid_device *dev, mod_t *mod, uint32_t addr)
+int send_mod_contents(sdp_t *sdp, mod_t *mod, uint32_t addr)
 {
-	int n,rc;
-	ssize_t offset = 0;
-	unsigned char b[BUF_SIZE]={0};
-
-	/* Send write command */
-	b[0] = 1;
-	set_write_file_cmd(b + 1, addr, mod->size);
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_file command (%d)\n", rc);
-		return rc;
-	}
-
-	/* Send contents */
-	b[0] = 2;
-	int i = 0;
-	while (offset < mod->size) {
-		n = (BUF_SIZE - 1 > mod->size - offset) ? (mod->size - offset) : (BUF_SIZE - 1);
-		memcpy(b + 1, mod->data + offset, n);
-		offset += n;
-		if ((i++ % 50) == 0) {
-			print_progress(offset, mod->size);
-		}
-		if ((rc = hid_write(dev, b, n + 1)) < 0) {
-			print_progress(offset, mod->size);
-			fprintf(stderr, "\nFailed to send image contents (%d)\n", rc);
-			return rc;
-		}
-	}
-	print_progress(offset, mod->size);
-	printf("\n");
-	return 0; // ignore report 3 and 4 for now
-
-	//Receive report 3
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 5) {
-		fprintf(stderr, "Failed to receive HAB mode (n=%d)\n", rc);
-		rc = -1;
-		return rc;
-	}
-	//printf("HAB mode: %02x%02x%02x%02x\n",b[1],b[2],b[3],b[4]);
-	if ((rc = hid_read(dev, b, BUF_SIZE) < 0) || *(uint32_t*)(b + 1) != 0x88888888)
-		fprintf(stderr, "Failed to receive complete status (status=%02x%02x%02x%02x)\n", b[1], b[2], b[3], b[4]);
-
-	return rc;
+	/* Report 3 and 4 are ignored for now */
+	return sdp_writeFile(sdp, addr, 0x20, mod->data, mod->size, SDP_F_PROGRESS);
 }
 
 
-int send_module(hid_device *dev, mod_t *mod, uint32_t addr)
+int send_module(sdp_t *sdp, mod_t *mod, uint32_t addr)
 {
 	int rc = 0;
-	if ((rc = send_mod_name(dev, mod, addr)) < 0) {
+	if ((rc = send_mod_name(sdp, mod, addr)) < 0) {
 		return rc;
 	}
 
-	if ((rc = send_mod_args(dev, mod, addr)) < 0) {
+	if ((rc = send_mod_args(sdp, mod, addr)) < 0) {
 		return rc;
 	}
 
-	if ((rc = send_mod_contents(dev, mod, addr)) < 0) {
+	if ((rc = send_mod_contents(sdp, mod, addr)) < 0) {
 		return rc;
 	}
 
@@ -374,205 +280,231 @@ static void syspage_dump(syspage_t *s)
 	}
 }
 
-static int count_sysprogs(char *initrd, char *console, char *append, int *sysprogs_sz)
+static void image_free(image_t *img)
 {
-	int cnt = 0, sz = 0, pfd;
-	struct stat pstat;
-	char *progs, *prog;
+	int k;
 
-	if (asprintf(&progs, "%s %s %s", console ? console : " ", initrd ? initrd : " ",  append ? append : " ") < 0) {
-		return -1; /* memalloc in asprintf has failed */
-	}
+	for (k = 0; k < img->nmaps; k++)
+		unmap_file(&img->maps[k]);
 
-	prog = strtok(progs, " ");
+	free(img->maps);
+	free(img->names);
+	free(img->progs);
+	free(img->iov);
+	free(img->head);
+}
 
-	while (prog) {
-		if (!strlen(prog))
-			goto next;
 
-		cnt++;
-		if ((pfd = open(prog, O_RDONLY)) < 0) {
-			fprintf(stderr, "Could not open file %s\n", prog);
-			goto next;
-		}
+/* Function appends mapping of file to image, name is NULL for kernel */
+static int image_add(image_t *img, char *path, char *name)
+{
+	struct iovec *maps;
+	char **names;
+
+	if ((maps = realloc(img->maps, (img->nmaps + 1) * sizeof(*maps))) == NULL)
+		return -1;
+	img->maps = maps;
+
+	if ((names = realloc(img->names, (img->nmaps + 1) * sizeof(*names))) == NULL)
+		return -1;
+	img->names = names;
 
-		if (fstat(pfd, &pstat) != 0) {
-			printf("File stat error: %s\n", strerror(errno));
-			close(pfd);
-			goto next;
+	names[img->nmaps] = name;
+	if (map_file(path, &maps[img->nmaps]) < 0) {
+		if (name == NULL) {
+			fprintf(stderr, "Could not open kernel binary %s\n", path);
+			return -1;
 		}
-		sz += pstat.st_size;
-		close(pfd);
-next:
-		prog = strtok(NULL, " ");
+
+		/* Program which can't be read gets empty entry */
+		fprintf(stderr, "Could not open file %s\n", path);
+		names[img->nmaps] = NULL;
 	}
+	img->nmaps++;
 
-	free(progs);
-	*sysprogs_sz = sz;
-	return cnt;
+	return 0;
 }
 
-static int append_sysprogs(void *image, char *initrd, char *console, char *append, syspage_t *syspage, size_t offset, unsigned int addr)
+
+/* Function maps kernel and programs given by space separated lists, one syspage entry per program name */
+static int image_map(image_t *img, char *kernel, char *initrd, char *console, char *append)
 {
-	int i = 0, j = 0, pfd, cnt;
-	char *progs, *prog;
+	char *prog;
+
+	if (image_add(img, kernel, NULL) < 0)
+		return -1;
 
-	if (asprintf(&progs, "%s %s %s", console ? console : " ", initrd ? initrd : " ",  append ? append : " ") < 0) {
+	if (asprintf(&img->progs, "%s %s %s", console ? console : " ", initrd ? initrd : " ",  append ? append : " ") < 0) {
+		img->progs = NULL;
 		return -1; /* memalloc in asprintf has failed */
 	}
 
-	prog = strtok(progs, " ");
-
-	while (prog) {
-		if (!strlen(prog))
-			goto next;
-		syspage->progs[i].start = offset + addr;
-
-		if ((pfd = open(prog, O_RDONLY)) < 0) {
-			fprintf(stderr, "Could not open file %s\n", prog);
-			goto next;
-		}
+	for (prog = strtok(img->progs, " "); prog != NULL; prog = strtok(NULL, " ")) {
+		if (image_add(img, prog, prog) < 0)
+			return -1;
+	}
 
-		while (1) {
-			cnt = read(pfd, image + offset, 256);
-			if (!cnt)
-				break;
-			offset += cnt;
-		}
+	return 0;
+}
 
-		syspage->progs[i].end = offset + addr;
 
-		for (j = strlen(prog); j >= 0 && prog[j] != '/'; --j);
+/* Function writes whole scatter list, iov is consumed */
+static int image_write(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
 
-		strncpy(syspage->progs[i].cmdline, prog + j + 1, sizeof(syspage->progs[i].cmdline) - 1);
+	while (iovcnt > 0) {
+		if ((n = writev(fd, iov, (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
 
-		printf("Processed \"%s\" (%u bytes)\n", prog, syspage->progs[i].end - syspage->progs[i].start);
+		for (; (iovcnt > 0) && ((size_t)n >= iov->iov_len); iov++, iovcnt--)
+			n -= iov->iov_len;
 
-		close(pfd);
-next:
-		prog = strtok(NULL, " ");
-		i++;
+		if (iovcnt > 0) {
+			iov->iov_base = (unsigned char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
 	}
-	free(progs);
-	return offset;
+
+	return 0;
 }
 
+
 int boot_image(char *kernel, char *initrd, char *console, char *append, char *output, int plugin)
 {
-	int kfd, ifd;
+	int ifd;
 	int err = 0;
-	void *image;
-	ssize_t size;
-	struct stat kstat;
-	size_t cnt, offset = 0;
+	image_t img = { 0 };
+	struct iovec *kmap, plugin_iov;
+	size_t cnt, ksize, headsz, offset;
 	uint32_t jump_addr, load_addr;
-	char *arg = NULL;
+	char *arg = NULL, *name;
 	int plugin_sz = 0;
 	syspage_t *syspage;
-	int sysprogs_cnt = 0, sysprogs_sz = 0;
+	int i, j, sysprogs_cnt;
 	unsigned int addr = plugin ? ADDR_DDR : ADDR_OCRAM;
 
 
 	kernel = strtok(kernel, "=");
 	arg = strtok(NULL, "=");
 
-	if ((kfd = open(kernel, O_RDONLY)) < 0) {
-		fprintf(stderr, "Could not open kernel binary %s\n", kernel);
+	if (image_map(&img, kernel, initrd, console, append) < 0) {
+		if ((img.nmaps > 0) || (errno == ENOMEM))
+			printf("Memory allocation failed\n");
+		image_free(&img);
 		return -1;
 	}
 
-	if (fstat(kfd, &kstat) != 0) {
-		printf("File stat error: %s\n", strerror(errno));
-		close(kfd);
-		return -1;
-	}
-
-	if ((sysprogs_cnt = count_sysprogs(initrd, console, append, &sysprogs_sz)) < 0) {
-		printf("Memory allocation failed\n");
-		close(kfd);
-		return -1;
-	}
+	kmap = &img.maps[0];
+	ksize = kmap->iov_len;
+	sysprogs_cnt = img.nmaps - 1;
 
-	size = kstat.st_size + sysprogs_sz;
+	printf("Processed kernel image (%zu bytes)\n", ksize);
 
-	image = malloc(size);
-
-	if (image == NULL) {
-		fprintf(stderr, "Could not allocate %lu bytes for image\n", size);
+	if (ksize < IMG_MINSZ) {
+		fprintf(stderr, "Kernel's too small\n");
+		image_free(&img);
 		return -1;
 	}
 
-	while (1) {
-		cnt = read(kfd, image + offset, 256);
-		if (!cnt)
-			break;
-		if (offset == 0x400) {
-			jump_addr = *(uint32_t *)(image + offset + 20); //ivt self ptr
-			load_addr = *(uint32_t *)(image + offset + 32); //ivt load address
+	jump_addr = *(uint32_t *)(kmap->iov_base + IMG_IVT + 20); //ivt self ptr
+	load_addr = *(uint32_t *)(kmap->iov_base + IMG_IVT + 32); //ivt load address
+
+	/* Plugin is sent alone first, it has to be in the header */
+	headsz = IMG_HEADSZ;
+	if (plugin) {
+		plugin_sz = *(int *)(kmap->iov_base + 0x424);
+		if ((plugin_sz < (int)IMG_MINSZ) || ((size_t)plugin_sz > ksize)) {
+			fprintf(stderr, "Invalid plugin size (%d bytes)\n", plugin_sz);
+			image_free(&img);
+			return -1;
 		}
-		offset += cnt;
+		if ((size_t)plugin_sz > headsz)
+			headsz = plugin_sz;
 	}
+	if (headsz > ksize)
+		headsz = ksize;
 
-	close(kfd);
-
-	printf("Processed kernel image (%lu bytes)\n", offset);
+	cnt = sizeof(syspage_t) + (sysprogs_cnt * sizeof(syspage_program_t));
 
-	if (offset < SYSPAGESZ_MAX) {
-		fprintf(stderr, "Kernel's too small\n");
-		free(image);
+	img.head = malloc(headsz);
+	img.iov = malloc((img.nmaps + 1) * sizeof(*img.iov));
+	syspage = calloc(1, cnt);
+	if ((img.head == NULL) || (img.iov == NULL) || (syspage == NULL)) {
+		fprintf(stderr, "Could not allocate %zu bytes for syspage\n", cnt);
+		free(syspage);
+		image_free(&img);
 		return -1;
 	}
 
-	if ((syspage = malloc(sizeof(syspage_t) + (sysprogs_cnt * sizeof(syspage_program_t)))) == NULL) {
-		fprintf(stderr, "Could not allocate %lu bytes for syspage\n", sizeof(syspage_t) + sizeof(syspage_program_t));
-		free(image);
-		return -1;
-	}
+	memcpy(img.head, kmap->iov_base, headsz);
+	img.iov[0].iov_base = img.head;
+	img.iov[0].iov_len = headsz;
+	img.iov[1].iov_base = kmap->iov_base + headsz;
+	img.iov[1].iov_len = ksize - headsz;
+	img.iovcnt = 2;
 
 	syspage->pbegin = PADDR_BEGIN;
 	syspage->pend = PADDR_END;
 	syspage->kernel = 0;
-	syspage->kernelsize = offset;
+	syspage->kernelsize = ksize;
 	syspage->console = 0;
 	strncpy(syspage->arg, arg ? arg : "", sizeof(syspage->arg));
 	syspage->progssz = sysprogs_cnt;
 
-	if ((offset = append_sysprogs(image, initrd, console, append, syspage, offset, addr)) < 0) {
-		printf("Memory allocation failed\n");
-		free(syspage);
-		free(image);
-		return -1;
-	};
+	/* Programs follow the kernel directly */
+	offset = ksize;
+	for (i = 0; i < sysprogs_cnt; i++) {
+		syspage->progs[i].start = offset + addr;
+		offset += img.maps[i + 1].iov_len;
+		syspage->progs[i].end = offset + addr;
+		img.iov[img.iovcnt++] = img.maps[i + 1];
+
+		if ((name = img.names[i + 1]) == NULL)
+			continue;
+
+		for (j = strlen(name); j >= 0 && name[j] != '/'; --j);
+
+		strncpy(syspage->progs[i].cmdline, name + j + 1, sizeof(syspage->progs[i].cmdline) - 1);
+
+		printf("Processed \"%s\" (%u bytes)\n", name, syspage->progs[i].end - syspage->progs[i].start);
+	}
+
+	img.size = offset;
 
 	if (plugin) {
-		plugin_sz = *(int *)(image + 0x424);
-		*(int *)(image + 0x424) = (plugin_sz + 0x199) & ~0x1ff;
-		memcpy(image + plugin_sz - 0xc, &offset, sizeof(offset));
+		*(int *)(img.head + 0x424) = (plugin_sz + 0x199) & ~0x1ff;
+		memcpy(img.head + plugin_sz - 0xc, &offset, sizeof(offset));
 	} else
-		memcpy(image + 0x400 + 36, &offset, sizeof(offset));
+		memcpy(img.head + IMG_IVT + 36, &offset, sizeof(offset));
 
 	printf("Writing syspage...\n");
 
-	cnt = sizeof(syspage_t) + (sysprogs_cnt * sizeof(syspage_program_t));
-
 	if (cnt > 0x380) {
 		printf("Syspage is too big (too many modules?)\n");
+		free(syspage);
+		image_free(&img);
 		return -1;
 	}
-	memcpy(image + 0x20, (void *)syspage, cnt);
+	memcpy(img.head + 0x20, (void *)syspage, cnt);
 
 	syspage_dump(syspage);
 
 	free(syspage);
 
-	printf("\nTotal image size: %lu bytes.\n\n", offset);
+	printf("\nTotal image size: %zu bytes.\n\n", offset);
 
 	if (output == NULL) {
 		if (plugin) {
 			silent = 1;
 			printf("Waiting for USB connection...");
 			fflush(stdout);
-			err = usb_vybrid_dispatch(NULL, (char *)&load_addr, (char *)&jump_addr, image, plugin_sz);
+			plugin_iov.iov_base = img.head;
+			plugin_iov.iov_len = plugin_sz;
+			err = usb_vybrid_dispatchv(NULL, (char *)&load_addr, (char *)&jump_addr, &plugin_iov, 1);
 			load_addr = 0x80000000;
 			jump_addr = 0x80000000 + plugin_sz - 0x30;
 			usleep(500000);
@@ -582,57 +514,37 @@ int boot_image(char *kernel, char *initrd, char *console, char *append, char *ou
 			if (err)
 				goto out;
 		}
-		usb_vybrid_dispatch(NULL, (char *)&load_addr, (char *)&jump_addr, image, offset);
+		usb_vybrid_dispatchv(NULL, (char *)&load_addr, (char *)&jump_addr, img.iov, img.iovcnt);
 	} else {
 		ifd = open(output, O_RDWR | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
 
 		if (ifd < 0) {
 			printf("Output file open error\n");
+			image_free(&img);
 			return -1;
 		}
 
-		cnt = 0;
-		while (size) {
-			cnt = write(ifd, (void *)image + cnt, size);
-			size -= cnt;
+		if (image_write(ifd, img.iov, img.iovcnt) < 0) {
+			printf("Output file write error: %s\n", strerror(errno));
+			err = -1;
 		}
 		close(ifd);
 		chmod(output, S_IRUSR | S_IWUSR);
 	}
 
 out:
-	free(image);
+	image_free(&img);
 	return err;
 }
 
 
-static hid_device* open_device_with_vid_pid(uint16_t vid, uint16_t pid)
-{
-    hid_device* h = NULL;
-	struct hid_device_info* list = hid_enumerate(vid, pid); // Find all devices with given vendor
-
-	for (struct hid_device_info* it = list; it != NULL; it = it->next) {
-		if ((h = hid_open_path(it->path)) == NULL) {
-			fprintf(stderr, "Failed to open device\n");
-			continue;
-		} else {
-			break;
-		}
-	}
-
-	if (list)
-		hid_free_enumeration(list);
-
-	return h;
-}
-
 int usb_imx_dispatch(char *kernel, char *console, char *initrd, char *append, int plugin)
 {
 	char *mod_tok, *arg_tok;
 	char *mod_p, *arg_p;
 	char *modules;
 	mod_t *mod;
-	hid_device *dev = NULL;
+	sdp_t sdp;
 	int len = 3;
 
 	if (boot_image(kernel, initrd, NULL, NULL, NULL, plugin)) {
@@ -642,7 +554,7 @@ int usb_imx_dispatch(char *kernel, char *console, char *initrd, char *append, in
 
 	printf("Waiting for the device to boot...");
 	fflush(stdout);
-	while ((dev = open_device_with_vid_pid(0x15a2, 0x007d)) == NULL);
+	while (sdp_open(&sdp, 0x15a2, 0x007d) < 0);
 
 	printf("\rDevice booted                    \n");
 
@@ -680,8 +592,8 @@ int usb_imx_dispatch(char *kernel, char *console, char *initrd, char *append, in
 
 		arg_tok = strtok_r(mod_tok, "=", &arg_p);
 		if ((mod = load_module(arg_tok)) == NULL) {
-			send_close_command(dev);
-			hid_close(dev);
+			send_close_command(&sdp);
+			sdp_close(&sdp);
 			hid_exit();
 			free(modules);
 			return 1;
@@ -689,24 +601,20 @@ int usb_imx_dispatch(char *kernel, char *console, char *initrd, char *append, in
 
 		mod->args = strtok_r(NULL, " ", &arg_p);
 		printf("Sending module '%s'\n", mod->name + 1);
-		if (send_module(dev, mod, 0)) {
-			send_close_command(dev);
-			hid_close(dev);
+		if (send_module(&sdp, mod, 0)) {
+			send_close_command(&sdp);
+			sdp_close(&sdp);
 			hid_exit();
 			free(modules);
-			free(mod->data);
-			free(mod->name);
-			free(mod);
+			free_module(mod);
 			return 1;
 		}
-		free(mod->data);
-		free(mod->name);
-		free(mod);
+		free_module(mod);
 		mod_tok = strtok_r(NULL, " ", &mod_p);
 	}
 
-	send_close_command(dev);
-	hid_close(dev);
+	send_close_command(&sdp);
+	sdp_close(&sdp);
 	hid_exit();
 	free(modules);
 	printf("Transfer complete\n");
@@ -21,6 +21,10 @@
 #include <stdlib.h>
 #include <termios.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <hostutils-common/errors.h>
+#include <hostutils-common/serial.h>
 
 /* clang-format off */
 #define TTY_DEBUG(fmt, ...) if (0)  { printf(fmt, ##__VA_ARGS__); }
@@ -29,10 +33,14 @@
 #define FRAME_SIZE  6
 #define FRAME_START 0x5a
 
-#define FLASH_PAGE_SIZE 128
-#define FLASH_MEM_ID    0
+#define FLASH_PAGE_SIZE   128
+#define FLASH_SECTOR_SIZE 0x2000 /* used if target doesn't report it */
+#define FLASH_MEM_ID      0
+
+/* Maximum data packet of streaming mode */
+#define DATA_PACKET_MAX 512
 
-#define TTY_TIMEOUT  10
+#define TTY_TIMEOUT  1000 /* ms */
 #define TTY_BAUDRATE B576000
 
 /* Frame types */
@@ -44,10 +52,20 @@
 #define kFramingPacketType_Ping         0xa6
 #define kFramingPacketType_PingResponse 0xa7
 
+/* Response tags */
+#define kResponseTag_Generic     0xa0
+#define kResponseTag_ReadMemory  0xa3
+#define kResponseTag_GetProperty 0xa7
+
+/* Property tags */
+#define kPropertyTag_FlashSectorSize 0x05
+#define kPropertyTag_MaxPacketSize   0x0b
+
 /* Response lengths */
 #define RESPONSE_PING_LENGTH    10
 #define RESPONSE_ACK_LENGTH     2
 #define RESPONSE_GENERIC_LENGTH 18
+#define RESPONSE_MAX_LENGTH     (FRAME_SIZE + 32)
 
 
 static struct {
@@ -55,6 +73,19 @@ static struct {
 	int file;
 	size_t filesz;
 	struct termios orig;
+
+	/* tty input buffer */
+	serial_t rx;
+
+	/* streaming mode */
+	int stream;
+	const uint8_t *image;
+	size_t packetsz;
+	size_t sectorsz;
+
+	/* differential mode */
+	int diff;
+	uint8_t *changed;   /* sectors differing from image (NULL - every sector with data) */
 } common;
 
 
@@ -86,6 +117,12 @@ static size_t serialize32(uint8_t *buff, uint32_t v)
 }
 
 
+static uint32_t deserialize32(const uint8_t *buff)
+{
+	return buff[0] | ((uint32_t)buff[1] << 8) | ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24);
+}
+
+
 /* CRC16 */
 
 
@@ -150,6 +187,59 @@ static size_t cmd_flashEraseAll(uint8_t *buff, int memid)
 }
 
 
+static size_t cmd_flashEraseRegion(uint8_t *buff, uint32_t address, size_t len, int memid)
+{
+	size_t pos = FRAME_SIZE; /* Skip frame for now */
+
+	pos += serialize8(buff + pos, 0x02);     /* Tag */
+	pos += serialize8(buff + pos, 0x00);     /* Flags */
+	pos += serialize8(buff + pos, 0x00);     /* Reserved */
+	pos += serialize8(buff + pos, 0x03);     /* Parameter count */
+	pos += serialize32(buff + pos, address); /* Start address */
+	pos += serialize32(buff + pos, len);     /* Byte count */
+	pos += serialize32(buff + pos, memid);   /* Memory id */
+
+	cmd_constructFrame(buff, kFramingPacketType_Command, pos - FRAME_SIZE);
+
+	return pos;
+}
+
+
+static size_t cmd_getProperty(uint8_t *buff, uint32_t tag, int memid)
+{
+	size_t pos = FRAME_SIZE; /* Skip frame for now */
+
+	pos += serialize8(buff + pos, 0x07);   /* Tag */
+	pos += serialize8(buff + pos, 0x00);   /* Flags */
+	pos += serialize8(buff + pos, 0x00);   /* Reserved */
+	pos += serialize8(buff + pos, 0x02);   /* Parameter count */
+	pos += serialize32(buff + pos, tag);   /* Property tag */
+	pos += serialize32(buff + pos, memid); /* Memory id */
+
+	cmd_constructFrame(buff, kFramingPacketType_Command, pos - FRAME_SIZE);
+
+	return pos;
+}
+
+
+static size_t cmd_readMemory(uint8_t *buff, uint32_t address, size_t len, int memid)
+{
+	size_t pos = FRAME_SIZE; /* Skip frame for now */
+
+	pos += serialize8(buff + pos, 0x03);     /* Tag */
+	pos += serialize8(buff + pos, 0x00);     /* Flags */
+	pos += serialize8(buff + pos, 0x00);     /* Reserved */
+	pos += serialize8(buff + pos, 0x03);     /* Parameter count */
+	pos += serialize32(buff + pos, address); /* Start address */
+	pos += serialize32(buff + pos, len);     /* Byte count */
+	pos += serialize32(buff + pos, memid);   /* Memory id */
+
+	cmd_constructFrame(buff, kFramingPacketType_Command, pos - FRAME_SIZE);
+
+	return pos;
+}
+
+
 static size_t cmd_flashWriteMemory(uint8_t *buff, uint32_t address, size_t len, int memid)
 {
 	size_t pos = FRAME_SIZE; /* Skip frame for now */
@@ -215,6 +305,45 @@ static int cmd_expectGenericResponse(const uint8_t *buff)
 }
 
 
+/* Function checks type, length and CRC of received frame */
+static int cmd_expectFrame(const uint8_t *buff, size_t len, uint8_t type)
+{
+	uint16_t crc = 0;
+	uint16_t plen;
+
+	if ((len < FRAME_SIZE) || (buff[0] != 0x5a) || (buff[1] != type)) {
+		fprintf(stderr, "target invalid response\n");
+		return -1;
+	}
+
+	plen = buff[2] | (buff[3] << 8);
+	crc16(&crc, buff, 4);
+	crc16(&crc, buff + FRAME_SIZE, plen);
+	if ((FRAME_SIZE + (size_t)plen != len) || (crc != (buff[4] | (buff[5] << 8)))) {
+		fprintf(stderr, "target invalid response\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function checks response frame, returns status of command */
+static int64_t cmd_responseStatus(const uint8_t *buff, size_t len, uint8_t tag)
+{
+	if ((cmd_expectFrame(buff, len, kFramingPacketType_Command) < 0) || (len < FRAME_SIZE + 8)) {
+		return -1;
+	}
+
+	if (buff[FRAME_SIZE] != tag) {
+		fprintf(stderr, "target invalid response\n");
+		return -1;
+	}
+
+	return deserialize32(buff + FRAME_SIZE + 4);
+}
+
+
 static int cmd_expectPingResponse(const uint8_t *buff)
 {
 	if ((buff[0] != 0x5a) || (buff[1] != 0xa7)) {
@@ -237,27 +366,28 @@ static void tty_dump(const uint8_t *buff, size_t len)
 
 static int tty_write(const uint8_t *buff, size_t len)
 {
-	int count = 0;
-
 	TTY_DEBUG("Sending: ");
 	tty_dump(buff, len);
 	TTY_DEBUG("\n");
 
-	while (count < (int)len) {
-		int ret = write(common.tty, buff + count, len - count);
-		if (ret < 0) {
-			fprintf(stderr, "tty write error: %s\n", strerror(errno));
-			return -1;
-		}
+	if (serial_write(common.tty, buff, len) < 0) {
+		fprintf(stderr, "tty write error: %s\n", strerror(errno));
+		return -1;
+	}
 
-		if (ret == 0) {
-			break;
-		}
+	return len;
+}
 
-		count += ret;
+
+/* Function returns the next received byte, 0 on timeout of current operation */
+static int tty_getByte(uint8_t *byte)
+{
+	int ret = serial_getc(&common.rx, byte);
+	if (ret == ERR_SERIAL_TIMEOUT) {
+		return 0;
 	}
 
-	return count;
+	return (ret < 0) ? -1 : 1;
 }
 
 
@@ -268,9 +398,11 @@ static int tty_read(uint8_t *buff, size_t bufflen)
 
 	TTY_DEBUG("Received: ");
 
+	serial_timeout(&common.rx, TTY_TIMEOUT);
+
 	while (count < (int)bufflen) {
 		uint8_t byte;
-		int ret = read(common.tty, &byte, 1);
+		int ret = tty_getByte(&byte);
 
 		if (ret < 0) {
 			return -1;
@@ -477,21 +609,70 @@ static int target_reset(void)
 }
 
 
-static int tty_setup(void)
+/* Function receives response frame (header first, then its payload), returns frame length */
+static int tty_readFrame(uint8_t *buff, size_t bufflen, int retries)
+{
+	int ret;
+	size_t len;
+
+	do {
+		ret = tty_read(buff, FRAME_SIZE);
+	} while ((ret == 0) && (--retries > 0));
+
+	if (ret < FRAME_SIZE) {
+		return -1;
+	}
+
+	len = buff[2] | (buff[3] << 8);
+	if (FRAME_SIZE + len > bufflen) {
+		fprintf(stderr, "target response too long\n");
+		return -1;
+	}
+
+	/* Payload may start with any byte, it isn't synchronized on start marker */
+	serial_timeout(&common.rx, TTY_TIMEOUT);
+	if (serial_bread(&common.rx, buff + FRAME_SIZE, len) < 0) {
+		return -1;
+	}
+
+	return FRAME_SIZE + len;
+}
+
+
+/* Function receives and acknowledges response of given tag, returns status of command */
+static int64_t target_response(uint8_t *buff, size_t bufflen, uint8_t tag, int retries)
 {
-	struct termios raw;
+	int len = tty_readFrame(buff, bufflen, retries);
+	if (len < 0) {
+		return -1;
+	}
 
-	if (tcgetattr(common.tty, &raw) < 0) {
+	if (tty_ack() < 0) {
 		return -1;
 	}
-	common.orig = raw;
 
-	cfmakeraw(&raw);
-	cfsetspeed(&raw, TTY_BAUDRATE);
-	raw.c_cc[VMIN] = 0;
-	raw.c_cc[VTIME] = TTY_TIMEOUT;
+	return cmd_responseStatus(buff, len, tag);
+}
+
 
-	if (tcsetattr(common.tty, TCSANOW, &raw) < 0) {
+/* Function sends command and waits for its ACK and generic response (retries - timeouts of response) */
+static int target_command(const uint8_t *cmd, size_t len, int retries)
+{
+	uint8_t buff[RESPONSE_MAX_LENGTH];
+	int64_t status;
+
+	if (tty_write(cmd, len) < 0) {
+		return -1;
+	}
+
+	if ((tty_read(buff, RESPONSE_ACK_LENGTH) < 2) || (cmd_expectAck(buff) < 0)) {
+		return -1;
+	}
+
+	if ((status = target_response(buff, sizeof(buff), kResponseTag_Generic, retries)) != 0) {
+		if (status > 0) {
+			fprintf(stderr, "target command 0x%02x failed (status %u)\n", cmd[FRAME_SIZE], (unsigned int)status);
+		}
 		return -1;
 	}
 
@@ -499,28 +680,347 @@ static int tty_setup(void)
 }
 
 
+static int target_getProperty(uint32_t tag, uint32_t *value)
+{
+	uint8_t buff[RESPONSE_MAX_LENGTH];
+	size_t len = cmd_getProperty(buff, tag, FLASH_MEM_ID);
+	int64_t status;
+	int rlen;
+
+	if (tty_write(buff, len) < 0) {
+		return -1;
+	}
+
+	if ((tty_read(buff, RESPONSE_ACK_LENGTH) < 2) || (cmd_expectAck(buff) < 0)) {
+		return -1;
+	}
+
+	/* Not target_response(), length is needed to check that the value is present */
+	if (((rlen = tty_readFrame(buff, sizeof(buff), 1)) < 0) || (tty_ack() < 0)) {
+		return -1;
+	}
+
+	if ((status = cmd_responseStatus(buff, rlen, kResponseTag_GetProperty)) != 0) {
+		return -1;
+	}
+
+	if (rlen < FRAME_SIZE + 12) {
+		fprintf(stderr, "target invalid response\n");
+		return -1;
+	}
+
+	*value = deserialize32(buff + FRAME_SIZE + 8);
+
+	return 0;
+}
+
+
+/* Function reads packet and sector size, defaults are used if target doesn't report them */
+static void target_flashProperties(void)
+{
+	uint32_t value;
+
+	common.packetsz = FLASH_PAGE_SIZE;
+	if ((target_getProperty(kPropertyTag_MaxPacketSize, &value) == 0) && (value > 0)) {
+		common.packetsz = (value > DATA_PACKET_MAX) ? DATA_PACKET_MAX : value;
+	}
+
+	common.sectorsz = FLASH_SECTOR_SIZE;
+	if ((target_getProperty(kPropertyTag_FlashSectorSize, &value) == 0) && (value >= FLASH_PAGE_SIZE) && ((value % FLASH_PAGE_SIZE) == 0)) {
+		common.sectorsz = value;
+	}
+}
+
+
+/* Function checks if image has anything but erased flash (0xff) in range */
+static int image_used(size_t offs, size_t len)
+{
+	if (offs >= common.filesz) {
+		return 0;
+	}
+
+	if (len > common.filesz - offs) {
+		len = common.filesz - offs;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		if (common.image[offs + i] != 0xff) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Function checks if sector has to be erased and programmed */
+static int sector_dirty(size_t offs)
+{
+	if (common.changed != NULL) {
+		return common.changed[offs / common.sectorsz];
+	}
+
+	return image_used(offs, common.sectorsz);
+}
+
+
+/* Function erases sectors which have data to be programmed, consecutive sectors at once */
+static int target_streamErase(void)
+{
+	uint8_t buff[32 + FRAME_SIZE];
+	size_t start = 0, end = 0, erased = 0;
+	size_t filesz = (common.filesz + common.sectorsz - 1) / common.sectorsz * common.sectorsz;
+
+	/* Loop goes one sector past the image to flush the last run */
+	for (size_t offs = 0; offs <= filesz; offs += common.sectorsz) {
+		if ((offs < filesz) && sector_dirty(offs)) {
+			if (start == end) {
+				start = offs;
+			}
+			end = offs + common.sectorsz;
+			continue;
+		}
+
+		if (start == end) {
+			continue;
+		}
+
+		size_t len = cmd_flashEraseRegion(buff, start, end - start, FLASH_MEM_ID);
+		/* This can take a while */
+		if (target_command(buff, len, 30) < 0) {
+			return -1;
+		}
+
+		erased += end - start;
+		start = end;
+	}
+
+	printf("Erased %zu KiB.\n", erased / 1024);
+
+	return 0;
+}
+
+
+/* Function programs range of pages with one write-memory command, data packets are acknowledged one by one */
+static int target_streamWrite(size_t offs, size_t len, size_t *total)
+{
+	uint8_t buff[DATA_PACKET_MAX + FRAME_SIZE];
+	uint8_t data[DATA_PACKET_MAX];
+	size_t pos, chunk;
+
+	size_t cmdlen = cmd_flashWriteMemory(buff, offs, len, FLASH_MEM_ID);
+	if (target_command(buff, cmdlen, 1) < 0) {
+		return -1;
+	}
+
+	for (pos = offs; pos < offs + len; pos += chunk) {
+		chunk = offs + len - pos;
+		if (chunk > common.packetsz) {
+			chunk = common.packetsz;
+		}
+
+		/* The last page is padded with erased flash value */
+		memset(data, 0xff, chunk);
+		if (pos < common.filesz) {
+			memcpy(data, common.image + pos, (common.filesz - pos < chunk) ? common.filesz - pos : chunk);
+		}
+
+		size_t datalen = cmd_data(buff, data, chunk);
+		if (tty_write(buff, datalen) < 0) {
+			return -1;
+		}
+
+		if ((tty_read(buff, RESPONSE_ACK_LENGTH) < 2) || (cmd_expectAck(buff) < 0)) {
+			return -1;
+		}
+
+		*total += chunk;
+		printf("Progress: %zu/%zu KiB\r", (*total + 512) / 1024, (common.filesz + 512) / 1024);
+		fflush(stdout);
+	}
+
+	/* Final response after data is programmed */
+	if (target_response(buff, sizeof(buff), kResponseTag_Generic, 10) != 0) {
+		fprintf(stderr, "\ntarget write at 0x%zx failed\n", offs);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Function reads memory back, data packets are acknowledged one by one */
+static int target_readMemory(uint32_t address, uint8_t *data, size_t len)
+{
+	uint8_t buff[DATA_PACKET_MAX + FRAME_SIZE];
+	size_t cmdlen = cmd_readMemory(buff, address, len, FLASH_MEM_ID);
+	size_t pos = 0;
+	int ret;
+
+	if (tty_write(buff, cmdlen) < 0) {
+		return -1;
+	}
+
+	if ((tty_read(buff, RESPONSE_ACK_LENGTH) < 2) || (cmd_expectAck(buff) < 0)) {
+		return -1;
+	}
+
+	if (target_response(buff, sizeof(buff), kResponseTag_ReadMemory, 1) != 0) {
+		return -1;
+	}
+
+	while (pos < len) {
+		if (((ret = tty_readFrame(buff, sizeof(buff), 1)) < 0) || (cmd_expectFrame(buff, ret, kFramingPacketType_Data) < 0)) {
+			return -1;
+		}
+
+		ret -= FRAME_SIZE;
+		if (ret > (int)(len - pos)) {
+			ret = len - pos;
+		}
+		memcpy(data + pos, buff + FRAME_SIZE, ret);
+		pos += ret;
+
+		if (tty_ack() < 0) {
+			return -1;
+		}
+	}
+
+	return (target_response(buff, sizeof(buff), kResponseTag_Generic, 1) != 0) ? -1 : 0;
+}
+
+
+/* Function reads back sectors covered by image and marks ones differing from it */
+static int target_compare(void)
+{
+	size_t nsectors = (common.filesz + common.sectorsz - 1) / common.sectorsz;
+	size_t nchanged = 0;
+	uint8_t *sector, *expected;
+	int err = -1;
+
+	common.changed = calloc(nsectors + 1, 1);
+	sector = malloc(common.sectorsz);
+	expected = malloc(common.sectorsz);
+	if ((common.changed == NULL) || (sector == NULL) || (expected == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+
+	for (size_t i = 0; i < nsectors; ++i) {
+		size_t offs = i * common.sectorsz;
+		size_t len = (common.filesz - offs < common.sectorsz) ? common.filesz - offs : common.sectorsz;
+
+		if (target_readMemory(offs, sector, common.sectorsz) < 0) {
+			fprintf(stderr, "\ntarget read at 0x%zx failed\n", offs);
+			goto out;
+		}
+
+		/* Rest of the last sector is expected to be erased */
+		memset(expected, 0xff, common.sectorsz);
+		memcpy(expected, common.image + offs, len);
+
+		if (memcmp(sector, expected, common.sectorsz) != 0) {
+			common.changed[i] = 1;
+			nchanged++;
+		}
+
+		printf("Comparing: %zu/%zu KiB\r", (offs + len + 512) / 1024, (common.filesz + 512) / 1024);
+		fflush(stdout);
+	}
+
+	printf("\n%zu of %zu sectors changed.\n", nchanged, nsectors);
+	err = nchanged;
+
+out:
+	if (err < 0) {
+		free(common.changed);
+		common.changed = NULL;
+	}
+	free(sector);
+	free(expected);
+
+	return err;
+}
+
+
+/* Function programs runs of pages, pages of erased flash value are skipped, number of programmed bytes is returned in total */
+static int target_streamFile(size_t *total)
+{
+	size_t start = 0, end = 0;
+	size_t filesz = (common.filesz + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+
+	if (target_streamErase() < 0) {
+		return -1;
+	}
+
+	printf("Uploading file...\n");
+
+	*total = 0;
+	for (size_t offs = 0; offs <= filesz; offs += FLASH_PAGE_SIZE) {
+		if ((offs < filesz) && image_used(offs, FLASH_PAGE_SIZE) && ((common.changed == NULL) || common.changed[offs / common.sectorsz])) {
+			/* Page has to be in a sector erased by target_streamErase() */
+			if (!sector_dirty(offs / common.sectorsz * common.sectorsz)) {
+				fprintf(stderr, "page at 0x%zx not erased\n", offs);
+				return -1;
+			}
+			if (start == end) {
+				start = offs;
+			}
+			end = offs + FLASH_PAGE_SIZE;
+			continue;
+		}
+
+		if (start == end) {
+			continue;
+		}
+
+		if (target_streamWrite(start, end - start, total) < 0) {
+			return -1;
+		}
+		start = end;
+	}
+
+	return 0;
+}
+
+
+static int tty_setup(void)
+{
+	if (serial_setup(common.tty, TTY_BAUDRATE, &common.orig) < 0) {
+		return -1;
+	}
+
+	serial_init(&common.rx, common.tty);
+
+	return 0;
+}
+
+
 static void tty_restore(void)
 {
-	tcsetattr(common.tty, TCSANOW, &common.orig);
+	serial_restore(common.tty, &common.orig);
 }
 
 
 static void usage(const char *progname)
 {
 	printf("MCX N94x series UART ISP util\n");
-	printf("Usage: %s -f program file -t ISP tty\n", progname);
+	printf("Usage: %s -f program file -t ISP tty [-s | -d]\n", progname);
+	printf("\t-s  streaming mode: erase only used sectors, skip erased pages\n");
+	printf("\t-d  differential mode: read flash back, reprogram only sectors differing from file\n");
 }
 
 
 int main(int argc, char *argv[])
 {
 	struct stat st;
+	size_t total;
 
 	common.tty = -1;
 	common.file = -1;
 
 	for (;;) {
-		int opt = getopt(argc, argv, "hf:t:");
+		int opt = getopt(argc, argv, "hf:t:sd");
 		if (opt == -1) {
 			break;
 		}
@@ -530,6 +1030,15 @@ int main(int argc, char *argv[])
 				usage(argv[0]);
 				return EXIT_SUCCESS;
 
+			case 's':
+				common.stream = 1;
+				break;
+
+			case 'd':
+				common.stream = 1;
+				common.diff = 1;
+				break;
+
 			case 'f':
 				common.file = open(optarg, O_RDONLY);
 				if (common.file < 0) {
@@ -567,6 +1076,14 @@ int main(int argc, char *argv[])
 
 	common.filesz = st.st_size;
 
+	if (common.stream && (common.filesz > 0)) {
+		common.image = mmap(NULL, common.filesz, PROT_READ, MAP_PRIVATE, common.file, 0);
+		if (common.image == MAP_FAILED) {
+			fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
 	printf("Connecting to the target...\n");
 	if (tty_setup() < 0) {
 		fprintf(stderr, "tty setup failed\n");
@@ -579,18 +1096,42 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	printf("Connected.\nFlash erase...\n");
-	if (target_flashEraseAll() < 0) {
-		fprintf(stderr, "failed\n");
-		tty_restore();
-		return EXIT_FAILURE;
+	if (common.stream) {
+		target_flashProperties();
+
+		printf("Connected (%zu B sectors, %zu B packets).\n", common.sectorsz, common.packetsz);
+		if (common.diff) {
+			printf("Reading flash back...\n");
+			if (target_compare() < 0) {
+				fprintf(stderr, "failed\n");
+				tty_restore();
+				return EXIT_FAILURE;
+			}
+		}
+
+		printf("Flash erase...\n");
+		if (target_streamFile(&total) < 0) {
+			fprintf(stderr, "failed\n");
+			tty_restore();
+			return EXIT_FAILURE;
+		}
+
+		printf("\nProgrammed %zu of %zu KiB.\n", (total + 512) / 1024, (common.filesz + 512) / 1024);
 	}
+	else {
+		printf("Connected.\nFlash erase...\n");
+		if (target_flashEraseAll() < 0) {
+			fprintf(stderr, "failed\n");
+			tty_restore();
+			return EXIT_FAILURE;
+		}
 
-	printf("Erased.\nUploading file...\n");
-	if (target_sendFile() < 0) {
-		fprintf(stderr, "failed\n");
-		tty_restore();
-		return EXIT_FAILURE;
+		printf("Erased.\nUploading file...\n");
+		if (target_sendFile() < 0) {
+			fprintf(stderr, "failed\n");
+			tty_restore();
+			return EXIT_FAILURE;
+		}
 	}
 
 	printf("Done.\nReseting target...\n");
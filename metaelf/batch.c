@@ -0,0 +1,443 @@
+/*
+ * Phoenix-RTOS
+ *
+ * metaELF - Checksum and metadata ELF embedder
+ *
+ * Batch processing of many files with manifest
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#define _GNU_SOURCE /* nftw() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "crc32.h"
+
+
+#ifdef __APPLE__
+#define st_mtim_nsec(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define st_mtim_nsec(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+#define _log_prefix         "metaELF: "
+#define log_error(fmt, ...) fprintf(stderr, _log_prefix fmt "\n", ##__VA_ARGS__);
+
+#define BATCH_THREADS_MAX 64
+
+/* Number of manifest hash table buckets (must be a power of 2) */
+#define MANIFEST_BUCKETS 4096
+#define MANIFEST_HEADER  "# metaelf manifest v1"
+
+
+typedef struct _manifest_entry_t {
+	struct _manifest_entry_t *next;  /* hash chain */
+	metaelf_result_t res;
+	char path[];
+} manifest_entry_t;
+
+
+static const char *const batch_status[] = { "ok", "error", "invalid", "nocrc", "unsupported", "notelf" };
+
+
+static struct {
+	batch_opts_t *opts;              /* nftw() callback target */
+	manifest_entry_t *buckets[MANIFEST_BUCKETS];
+
+	pthread_mutex_t lock;
+	size_t next;
+	int mode;
+	int flags;
+} batch_common = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+static unsigned int manifest_hash(const char *path)
+{
+	unsigned int h = 2166136261u;
+
+	for (; *path != '\0'; path++)
+		h = (h ^ (unsigned char)*path) * 16777619u;
+
+	return h & (MANIFEST_BUCKETS - 1);
+}
+
+
+static manifest_entry_t *manifest_find(const char *path)
+{
+	manifest_entry_t *e;
+
+	for (e = batch_common.buckets[manifest_hash(path)]; e != NULL; e = e->next) {
+		if (strcmp(e->path, path) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+
+static int manifest_status(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(batch_status) / sizeof(batch_status[0])); i++) {
+		if (strcmp(batch_status[i], name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+/* Loads previous manifest, missing file is not an error */
+static int manifest_load(const char *path)
+{
+	char *line = NULL, status[16];
+	size_t sz = 0, len;
+	ssize_t n;
+	unsigned int h, crc;
+	long long size, mtime;
+	long nsec;
+	int ofs;
+	manifest_entry_t *e;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		if (errno == ENOENT)
+			return 0;
+		log_error("Unable to open manifest %s", path);
+		return -1;
+	}
+
+	while ((n = getline(&line, &sz, f)) > 0) {
+		if (line[n - 1] == '\n')
+			line[--n] = '\0';
+
+		if ((line[0] == '#') || (line[0] == '\0'))
+			continue;
+
+		ofs = 0;
+		if ((sscanf(line, "%15s %x %lld %lld.%ld%n", status, &crc, &size, &mtime, &nsec, &ofs) != 5) ||
+				(line[ofs] != '\t') || (line[ofs + 1] == '\0')) {
+			log_error("Malformed manifest line, ignoring: %s", line);
+			continue;
+		}
+
+		len = strlen(line + ofs + 1);
+		if ((e = malloc(sizeof(*e) + len + 1)) == NULL)
+			break;
+
+		memcpy(e->path, line + ofs + 1, len + 1);
+		e->res.status = manifest_status(status);
+		e->res.crc = crc;
+		e->res.size = size;
+		e->res.mtime = mtime;
+		e->res.mtime_nsec = nsec;
+
+		h = manifest_hash(e->path);
+		e->next = batch_common.buckets[h];
+		batch_common.buckets[h] = e;
+	}
+
+	free(line);
+	fclose(f);
+
+	return 0;
+}
+
+
+static void manifest_free(void)
+{
+	manifest_entry_t *e, *next;
+	unsigned int i;
+
+	for (i = 0; i < MANIFEST_BUCKETS; i++) {
+		for (e = batch_common.buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			free(e);
+		}
+		batch_common.buckets[i] = NULL;
+	}
+}
+
+
+static void manifest_print(FILE *f, batch_opts_t *opts)
+{
+	batch_file_t *bf;
+	size_t i;
+
+	fprintf(f, MANIFEST_HEADER "\n");
+	for (i = 0; i < opts->nfiles; i++) {
+		bf = &opts->files[i];
+		if (bf->res.status == METAELF_NOTELF)
+			continue;
+
+		fprintf(f, "%s\t%08X\t%lld\t%lld.%09ld\t%s\n", batch_status[bf->res.status], bf->res.crc,
+			(long long)bf->res.size, (long long)bf->res.mtime, bf->res.mtime_nsec, bf->path);
+	}
+}
+
+
+/* Manifest is replaced atomically so that interrupted run doesn't leave it truncated */
+static int manifest_save(const char *path, batch_opts_t *opts)
+{
+	char *tmp;
+	FILE *f;
+	int err;
+
+	if ((tmp = malloc(strlen(path) + 5)) == NULL)
+		return -1;
+	sprintf(tmp, "%s.tmp", path);
+
+	if ((f = fopen(tmp, "w")) == NULL) {
+		log_error("Unable to create manifest %s", tmp);
+		free(tmp);
+		return -1;
+	}
+
+	manifest_print(f, opts);
+	err = ferror(f);
+	if ((fclose(f) != 0) || (err != 0) || (rename(tmp, path) != 0)) {
+		log_error("Unable to write manifest %s", path);
+		(void)unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+
+	free(tmp);
+
+	return 0;
+}
+
+
+static int batch_add(batch_opts_t *opts, const char *path, int probe)
+{
+	batch_file_t *files;
+	size_t sz;
+
+	if (opts->nfiles == opts->szfiles) {
+		sz = (opts->szfiles == 0) ? 64 : opts->szfiles * 2;
+		if ((files = realloc(opts->files, sz * sizeof(*files))) == NULL) {
+			log_error("Out of memory");
+			return -1;
+		}
+		opts->files = files;
+		opts->szfiles = sz;
+	}
+
+	files = &opts->files[opts->nfiles];
+	memset(files, 0, sizeof(*files));
+	if ((files->path = strdup(path)) == NULL) {
+		log_error("Out of memory");
+		return -1;
+	}
+	files->probe = probe;
+	opts->nfiles++;
+
+	return 0;
+}
+
+
+int batch_addArg(batch_opts_t *opts, const char *arg)
+{
+	char *line = NULL;
+	size_t sz = 0;
+	ssize_t n;
+	int ret = 0;
+
+	if (strcmp(arg, "-") != 0)
+		return batch_add(opts, arg, 0);
+
+	while ((ret == 0) && ((n = getline(&line, &sz, stdin)) > 0)) {
+		while ((n > 0) && ((line[n - 1] == '\n') || (line[n - 1] == '\r')))
+			line[--n] = '\0';
+
+		if (n > 0)
+			ret = batch_add(opts, line, 0);
+	}
+	free(line);
+
+	return ret;
+}
+
+
+static int batch_walk(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	(void)ftw;
+
+	if ((type != FTW_F) || !S_ISREG(st->st_mode))
+		return 0;
+
+	return batch_add(batch_common.opts, path, 1);
+}
+
+
+static int batch_cmp(const void *a, const void *b)
+{
+	return strcmp(((const batch_file_t *)a)->path, ((const batch_file_t *)b)->path);
+}
+
+
+int batch_addDir(batch_opts_t *opts, const char *dir)
+{
+	size_t first = opts->nfiles;
+
+	batch_common.opts = opts;
+	if (nftw(dir, batch_walk, 32, FTW_PHYS) != 0) {
+		log_error("Unable to scan directory %s", dir);
+		return -1;
+	}
+
+	/* Directory order is arbitrary, sort to get reproducible manifest */
+	qsort(opts->files + first, opts->nfiles - first, sizeof(*opts->files), batch_cmp);
+
+	return 0;
+}
+
+
+/* Returns nonzero if file didn't change since it was successfully processed */
+static int batch_unchanged(batch_file_t *bf)
+{
+	manifest_entry_t *e;
+	struct stat st;
+
+	e = manifest_find(bf->path);
+	if ((e == NULL) || (e->res.status != METAELF_OK) || (stat(bf->path, &st) != 0))
+		return 0;
+
+	if ((st.st_size != e->res.size) || (st.st_mtime != e->res.mtime) || (st_mtim_nsec(&st) != e->res.mtime_nsec))
+		return 0;
+
+	bf->res = e->res;
+	bf->cached = 1;
+
+	return 1;
+}
+
+
+static void *batch_worker(void *arg)
+{
+	batch_opts_t *opts = arg;
+	batch_file_t *bf;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&batch_common.lock);
+		i = batch_common.next++;
+		pthread_mutex_unlock(&batch_common.lock);
+
+		if (i >= opts->nfiles)
+			break;
+
+		bf = &opts->files[i];
+		if (batch_unchanged(bf) == 0)
+			metaelf_file(bf->path, batch_common.mode, batch_common.flags | ((bf->probe != 0) ? METAELF_PROBE : 0), &bf->res);
+	}
+
+	return NULL;
+}
+
+
+int batch_run(batch_opts_t *opts, int mode, int quiet)
+{
+	pthread_t tids[BATCH_THREADS_MAX];
+	size_t i, nthreads, started, cached = 0, failed = 0;
+	long ncpu;
+	int ret = METAELF_OK;
+	batch_file_t *bf;
+
+	if (opts->nfiles == 0) {
+		log_error("No input file");
+		return METAELF_ERROR;
+	}
+
+	if ((opts->manifest != NULL) && (manifest_load(opts->manifest) < 0))
+		return METAELF_ERROR;
+
+	nthreads = opts->jobs;
+	if (nthreads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpu > 0) ? ncpu : 1;
+	}
+	if (nthreads > BATCH_THREADS_MAX)
+		nthreads = BATCH_THREADS_MAX;
+	if (nthreads > opts->nfiles)
+		nthreads = opts->nfiles;
+
+	batch_common.next = 0;
+	batch_common.mode = mode;
+
+	/* Files are processed concurrently, with single worker large files are split between threads instead */
+	batch_common.flags = METAELF_QUIET | ((nthreads == 1) ? METAELF_PARALLEL : 0);
+
+	for (started = 0; started + 1 < nthreads; started++) {
+		if (pthread_create(&tids[started], NULL, batch_worker, opts) != 0)
+			break;
+	}
+
+	/* Calling thread is also a worker */
+	batch_worker(opts);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	for (i = 0; i < opts->nfiles; i++) {
+		bf = &opts->files[i];
+		if (bf->cached != 0)
+			cached++;
+
+		if ((bf->res.status == METAELF_OK) || (bf->res.status == METAELF_NOTELF))
+			continue;
+
+		if (ret == METAELF_OK)
+			ret = bf->res.status;
+		failed++;
+
+		if (quiet == 0)
+			fprintf(stderr, _log_prefix "%s: %s\n", bf->path, batch_status[bf->res.status]);
+	}
+
+	if (opts->manifest != NULL) {
+		if ((manifest_save(opts->manifest, opts) < 0) && (ret == METAELF_OK))
+			ret = METAELF_ERROR;
+	}
+	else {
+		manifest_print(stdout, opts);
+	}
+
+	if (quiet == 0) {
+		fprintf(stderr, _log_prefix "%zu files, %zu processed, %zu unchanged, %zu failed (%zu threads, %s)\n",
+			opts->nfiles, opts->nfiles - cached, cached, failed, started + 1, crc32_engine());
+	}
+
+	manifest_free();
+
+	return ret;
+}
+
+
+void batch_done(batch_opts_t *opts)
+{
+	size_t i;
+
+	for (i = 0; i < opts->nfiles; i++)
+		free(opts->files[i].path);
+
+	free(opts->files);
+	opts->files = NULL;
+	opts->nfiles = 0;
+	opts->szfiles = 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Phoenix-RTOS
+ *
+ * metaELF - Checksum and metadata ELF embedder
+ *
+ * Batch processing of many files with manifest
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+#include "metaelf.h"
+
+
+typedef struct {
+	char *path;
+	int probe;               /* found in directory, skipped silently if not an ELF */
+	int cached;              /* unchanged since last run, result taken from manifest */
+	metaelf_result_t res;
+} batch_file_t;
+
+
+typedef struct {
+	int enabled;
+	unsigned long jobs;      /* 0 - number of online CPUs */
+	const char *manifest;
+	batch_file_t *files;
+	size_t nfiles;
+	size_t szfiles;
+} batch_opts_t;
+
+
+/* Adds file to process, "-" adds files listed on stdin (one per line) */
+extern int batch_addArg(batch_opts_t *opts, const char *arg);
+
+
+/* Adds all regular files found recursively in dir, in lexical order */
+extern int batch_addDir(batch_opts_t *opts, const char *dir);
+
+
+/* Processes files on a thread pool and writes manifest, returns METAELF_* code of the first failed file */
+extern int batch_run(batch_opts_t *opts, int mode, int quiet);
+
+
+extern void batch_done(batch_opts_t *opts);
+
+
+#endif
@@ -3,7 +3,7 @@
  *
  * metaELF - Checksum and metadata ELF embedder
  *
- * Copyright 2022 Phoenix Systems
+ * Copyright 2022, 2026 Phoenix Systems
  * Author: Gerard Swiderski
  *
  * This file is part of Phoenix-RTOS.
@@ -12,80 +12,396 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32_ARMV8
+#endif
 
-/* TODO: provide alternate version if this tool should work on big-endian host */
+#include "crc32.h"
 
-#define CRC32POLY_LE 0xedb88320
 
+#define CRC32POLY_LE 0xedb88320
 
-#ifdef USE_CRC32_TAB
-static const uint32_t crc32_tab[256] = {
-	/* Polynomial 0xedb88320 */
-	0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-	0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-	0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-	0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-	0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
-	0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-	0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
-	0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-	0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-	0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-	0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
-	0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-	0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-	0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-	0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-	0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-	0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-	0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-	0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-	0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-	0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-	0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-	0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-	0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-	0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-	0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-	0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-	0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-	0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-	0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-	0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-	0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-	0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-	0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-	0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-	0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-	0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-	0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-	0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-	0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-	0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-	0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
-};
+/* Slicing reads words in host byte order, big-endian hosts use byte-wise loop */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CRC32_SLICING
 #endif
 
+/* Smallest chunk worth starting a thread for */
+#define CRC32_CHUNK_MIN (4 << 20)
+#define CRC32_THREADS_MAX 32
+
+
+typedef uint32_t (*crc32_fn_t)(const uint8_t *buf, size_t len, uint32_t crc);
 
-uint32_t crc32_calc(const uint8_t *buf, uint32_t len, uint32_t base)
+
+static struct {
+	uint32_t tab[16][256];
+	uint32_t x2n[32];
+	crc32_fn_t calc;
+	const char *engine;
+} crc32_common;
+
+
+static uint32_t crc32_bytes(const uint8_t *buf, size_t len, uint32_t crc)
 {
-	uint32_t crc = base;
-#ifdef USE_CRC32_TAB
-	const uint32_t *tab = crc32_tab;
+	const uint32_t *tab = crc32_common.tab[0];
+
 	while (len--) {
 		crc = (crc >> 8) ^ tab[(crc ^ *buf++) & 0xff];
 	}
-#else
-	int i;
+
+	return crc;
+}
+
+
+#ifdef CRC32_SLICING
+
+static inline uint32_t crc32_load32(const uint8_t *buf)
+{
+	uint32_t v;
+
+	memcpy(&v, buf, sizeof(v));
+	return v;
+}
+
+
+static uint32_t crc32_slice8(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	uint32_t (*t)[256] = crc32_common.tab;
+	uint32_t a, b;
+
+	while (len >= 8) {
+		a = crc32_load32(buf) ^ crc;
+		b = crc32_load32(buf + 4);
+		crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^
+			t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+		buf += 8;
+		len -= 8;
+	}
+
+	return crc32_bytes(buf, len, crc);
+}
+
+
+static uint32_t crc32_slice16(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	uint32_t (*t)[256] = crc32_common.tab;
+	uint32_t a, b, c, d;
+
+	while (len >= 16) {
+		a = crc32_load32(buf) ^ crc;
+		b = crc32_load32(buf + 4);
+		c = crc32_load32(buf + 8);
+		d = crc32_load32(buf + 12);
+		crc = t[15][a & 0xff] ^ t[14][(a >> 8) & 0xff] ^ t[13][(a >> 16) & 0xff] ^ t[12][a >> 24] ^
+			t[11][b & 0xff] ^ t[10][(b >> 8) & 0xff] ^ t[9][(b >> 16) & 0xff] ^ t[8][b >> 24] ^
+			t[7][c & 0xff] ^ t[6][(c >> 8) & 0xff] ^ t[5][(c >> 16) & 0xff] ^ t[4][c >> 24] ^
+			t[3][d & 0xff] ^ t[2][(d >> 8) & 0xff] ^ t[1][(d >> 16) & 0xff] ^ t[0][d >> 24];
+		buf += 16;
+		len -= 16;
+	}
+
+	return crc32_slice8(buf, len, crc);
+}
+
+#endif
+
+
+#ifdef CRC32_PCLMUL
+
+/* Folding constants x^n mod P (bit-reflected), see Intel "Fast CRC Computation Using PCLMULQDQ" */
+#define CRC32_R1 0x154442bd4ULL /* x^(4*128+32) */
+#define CRC32_R2 0x1c6e41596ULL /* x^(4*128-32) */
+#define CRC32_R3 0x1751997d0ULL /* x^(128+32) */
+#define CRC32_R4 0x0ccaa009eULL /* x^(128-32) */
+#define CRC32_R5 0x163cd6124ULL /* x^64 */
+#define CRC32_P  0x1db710641ULL /* P' */
+#define CRC32_U  0x1f7011641ULL /* floor(x^64 / P)' */
+
+
+__attribute__((target("pclmul")))
+static inline __m128i crc32_fold(__m128i x, __m128i k, __m128i next)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	const __m128i mask = _mm_set_epi32(0, 0, 0, -1);
+	__m128i x1, x2, x3, x4, k, t;
+
+	if (len < 64) {
+		return crc32_slice16(buf, len, crc);
+	}
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf), _mm_cvtsi32_si128((int)crc));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 32));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 48));
+	buf += 64;
+	len -= 64;
+
+	/* Fold 4 x 128 bits in parallel */
+	k = _mm_set_epi64x(CRC32_R2, CRC32_R1);
+	while (len >= 64) {
+		x1 = crc32_fold(x1, k, _mm_loadu_si128((const __m128i *)buf));
+		x2 = crc32_fold(x2, k, _mm_loadu_si128((const __m128i *)(buf + 16)));
+		x3 = crc32_fold(x3, k, _mm_loadu_si128((const __m128i *)(buf + 32)));
+		x4 = crc32_fold(x4, k, _mm_loadu_si128((const __m128i *)(buf + 48)));
+		buf += 64;
+		len -= 64;
+	}
+
+	/* Fold into single 128 bits */
+	k = _mm_set_epi64x(CRC32_R4, CRC32_R3);
+	x1 = crc32_fold(x1, k, x2);
+	x1 = crc32_fold(x1, k, x3);
+	x1 = crc32_fold(x1, k, x4);
+
+	while (len >= 16) {
+		x1 = crc32_fold(x1, k, _mm_loadu_si128((const __m128i *)buf));
+		buf += 16;
+		len -= 16;
+	}
+
+	/* 128 -> 64 bits */
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x10), _mm_srli_si128(x1, 8));
+
+	/* 64 -> 32 bits */
+	k = _mm_set_epi64x(0, CRC32_R5);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00), _mm_srli_si128(x1, 4));
+
+	/* Barrett reduction */
+	k = _mm_set_epi64x(CRC32_U, CRC32_P);
+	t = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10), mask);
+	t = _mm_xor_si128(_mm_clmulepi64_si128(t, k, 0x00), x1);
+	crc = (uint32_t)_mm_extract_epi32(t, 1);
+
+	return crc32_slice16(buf, len, crc);
+}
+
+#endif
+
+
+#ifdef CRC32_ARMV8
+
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	uint64_t v;
+
+	while ((len > 0) && (((uintptr_t)buf & 7) != 0)) {
+		crc = __crc32b(crc, *buf++);
+		len--;
+	}
+
+	while (len >= 32) {
+		memcpy(&v, buf, 8);
+		crc = __crc32d(crc, v);
+		memcpy(&v, buf + 8, 8);
+		crc = __crc32d(crc, v);
+		memcpy(&v, buf + 16, 8);
+		crc = __crc32d(crc, v);
+		memcpy(&v, buf + 24, 8);
+		crc = __crc32d(crc, v);
+		buf += 32;
+		len -= 32;
+	}
+
+	while (len >= 8) {
+		memcpy(&v, buf, 8);
+		crc = __crc32d(crc, v);
+		buf += 8;
+		len -= 8;
+	}
+
 	while (len--) {
-		crc = (crc ^ (*buf++ & 0xFF));
-		for (i = 0; i < 8; i++) {
+		crc = __crc32b(crc, *buf++);
+	}
+
+	return crc;
+}
+
+#endif
+
+
+/* Returns a * b mod P (bit-reflected, x^0 is MSB) */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31, p = 0;
+
+	while (m != 0) {
+		if ((a & m) != 0) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = (b >> 1) ^ ((b & 1) ? CRC32POLY_LE : 0);
+	}
+
+	return p;
+}
+
+
+/* Returns x^(n * 2^k) mod P */
+static uint32_t crc32_x2nmodp(size_t n, unsigned int k)
+{
+	uint32_t p = (uint32_t)1 << 31;
+
+	while (n != 0) {
+		if ((n & 1) != 0) {
+			p = crc32_multmodp(crc32_common.x2n[k & 31], p);
+		}
+		n >>= 1;
+		k++;
+	}
+
+	return p;
+}
+
+
+void crc32_init(void)
+{
+	uint32_t crc, i, k;
+
+	if (crc32_common.calc != NULL) {
+		return;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (k = 0; k < 8; k++) {
 			crc = (crc >> 1) ^ ((crc & 1) ? CRC32POLY_LE : 0);
 		}
+		crc32_common.tab[0][i] = crc;
+	}
+
+	for (k = 1; k < 16; k++) {
+		for (i = 0; i < 256; i++) {
+			crc = crc32_common.tab[k - 1][i];
+			crc32_common.tab[k][i] = (crc >> 8) ^ crc32_common.tab[0][crc & 0xff];
+		}
+	}
+
+	/* x^1, x^2, x^4, ... */
+	crc32_common.x2n[0] = (uint32_t)1 << 30;
+	for (k = 1; k < 32; k++) {
+		crc32_common.x2n[k] = crc32_multmodp(crc32_common.x2n[k - 1], crc32_common.x2n[k - 1]);
 	}
+
+	crc32_common.calc = crc32_bytes;
+	crc32_common.engine = "table";
+#ifdef CRC32_SLICING
+	crc32_common.calc = crc32_slice16;
+	crc32_common.engine = "slice-by-16";
 #endif
+#ifdef CRC32_PCLMUL
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		crc32_common.calc = crc32_pclmul;
+		crc32_common.engine = "pclmulqdq";
+	}
+#endif
+#ifdef CRC32_ARMV8
+	if ((getauxval(AT_HWCAP) & HWCAP_CRC32) != 0) {
+		crc32_common.calc = crc32_armv8;
+		crc32_common.engine = "armv8-crc32";
+	}
+#endif
+}
+
+
+const char *crc32_engine(void)
+{
+	return crc32_common.engine;
+}
+
+
+uint32_t crc32_calc(const uint8_t *buf, size_t len, uint32_t base)
+{
+	return crc32_common.calc(buf, len, base);
+}
+
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	return crc32_multmodp(crc32_x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+
+typedef struct {
+	pthread_t tid;
+	const uint8_t *buf;
+	size_t len;
+	uint32_t crc;
+} crc32_chunk_t;
+
+
+static void *crc32_chunkThread(void *arg)
+{
+	crc32_chunk_t *chunk = arg;
+
+	chunk->crc = crc32_calc(chunk->buf, chunk->len, 0);
+
+	return NULL;
+}
+
+
+uint32_t crc32_calcParallel(const uint8_t *buf, size_t len, uint32_t base)
+{
+	crc32_chunk_t chunks[CRC32_THREADS_MAX];
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t n, i, started, chunksz;
+	uint32_t crc;
+
+	n = len / CRC32_CHUNK_MIN;
+	if ((ncpu > 0) && (n > (size_t)ncpu)) {
+		n = ncpu;
+	}
+	if (n > CRC32_THREADS_MAX) {
+		n = CRC32_THREADS_MAX;
+	}
+	if ((ncpu <= 1) || (n <= 1)) {
+		return crc32_calc(buf, len, base);
+	}
+
+	chunksz = len / n;
+	for (i = 0; i < n; i++) {
+		chunks[i].buf = buf + i * chunksz;
+		chunks[i].len = (i == n - 1) ? len - i * chunksz : chunksz;
+	}
+
+	/* First chunk is computed in the calling thread */
+	for (started = 1; started < n; started++) {
+		if (pthread_create(&chunks[started].tid, NULL, crc32_chunkThread, &chunks[started]) != 0) {
+			break;
+		}
+	}
+
+	crc = crc32_calc(chunks[0].buf, chunks[0].len, base);
+	for (i = 1; i < n; i++) {
+		if (i < started) {
+			pthread_join(chunks[i].tid, NULL);
+			crc = crc32_combine(crc, chunks[i].crc, chunks[i].len);
+		}
+		else {
+			crc = crc32_calc(chunks[i].buf, chunks[i].len, crc);
+		}
+	}
 
 	return crc;
 }
@@ -0,0 +1,42 @@
+/*
+ * Phoenix-RTOS
+ *
+ * metaELF - Checksum and metadata ELF embedder
+ *
+ * CRC32 engine
+ *
+ * Copyright 2022, 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Selects the fastest implementation supported by the CPU, has to be called before other functions */
+extern void crc32_init(void);
+
+
+/* Returns name of selected implementation */
+extern const char *crc32_engine(void);
+
+
+/* Updates CRC register (no pre/post inversion) with buffer contents */
+extern uint32_t crc32_calc(const uint8_t *buf, size_t len, uint32_t base);
+
+
+/* Same as crc32_calc(), large buffers are split between threads and partial results combined */
+extern uint32_t crc32_calcParallel(const uint8_t *buf, size_t len, uint32_t base);
+
+
+/* Returns CRC of two concatenated blocks, crc2 is CRC of the second block (len2 bytes) calculated from base 0 */
+extern uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+
+#endif
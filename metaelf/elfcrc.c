@@ -0,0 +1,294 @@
+/*
+ * Phoenix-RTOS
+ *
+ * metaELF - Checksum and metadata ELF embedder
+ *
+ * Checksum of ELF files and memory images
+ *
+ * Copyright 2022, 2026 Phoenix Systems
+ * Author: Gerard Swiderski
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <libelf/libelf.h>
+#else
+#include <elf.h>
+#endif
+
+#include "bswap.h"
+#include "crc32.h"
+#include "metaelf.h"
+
+
+/* Place signature on unused pad bytes */
+#define EI_SIGNATURE_VALUE  (EI_PAD)
+#define EI_SIGNATURE_METHOD (EI_NIDENT - 1)
+
+/* Supported signatures */
+#define SIGNATURE_CRC32 0
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ENDIANNESS ELFDATA2LSB
+#elif __BYTE_ORDER == __BIG_ENDIAN
+#define ENDIANNESS ELFDATA2MSB
+#else
+#error "Invalid host endianness"
+#endif
+
+
+#ifdef __APPLE__
+#define st_mtim_nsec(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define st_mtim_nsec(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+
+#define _log_prefix         "metaELF: "
+#define log_error(fmt, ...) fprintf(stderr, _log_prefix fmt "\n", ##__VA_ARGS__);
+#define log_info(fmt, ...)  (((flags & METAELF_QUIET) == 0) ? printf(_log_prefix fmt "\n", ##__VA_ARGS__) : (void)0);
+
+
+typedef union {
+	void *memptr;
+	unsigned char *ident;
+	Elf32_Ehdr *hdr32;
+	Elf64_Ehdr *hdr64;
+} elf_ptr_t;
+
+
+static uint16_t uint16(elf_ptr_t elf, uint16_t val)
+{
+	return (elf.ident[EI_DATA] == ENDIANNESS) ? val : bswap_16(val);
+}
+
+
+static uint32_t uint32(elf_ptr_t elf, uint32_t val)
+{
+	return (elf.ident[EI_DATA] == ENDIANNESS) ? val : bswap_32(val);
+}
+
+
+static uint64_t uint64(elf_ptr_t elf, uint64_t val)
+{
+	return (elf.ident[EI_DATA] == ENDIANNESS) ? val : bswap_64(val);
+}
+
+
+static size_t elf32_size(elf_ptr_t elf)
+{
+	return uint32(elf, elf.hdr32->e_shoff) + uint16(elf, elf.hdr32->e_shentsize) * uint16(elf, elf.hdr32->e_shnum);
+}
+
+
+static size_t elf64_size(elf_ptr_t elf)
+{
+	return uint64(elf, elf.hdr64->e_shoff) + uint16(elf, elf.hdr64->e_shentsize) * uint16(elf, elf.hdr64->e_shnum);
+}
+
+
+/* Returns ELF file size based on its metadata */
+static ssize_t elf_size(elf_ptr_t elf)
+{
+	const int elf_class = elf.ident[EI_CLASS];
+
+	if (elf_class == ELFCLASS32) {
+		return elf32_size(elf);
+	}
+	else if (elf_class == ELFCLASS64) {
+		return elf64_size(elf);
+	}
+
+	return -1;
+}
+
+
+/* Calculate ELF file checksum in host's byte order */
+static uint32_t elf_calc_crc32(uint8_t *ptr, size_t sz, size_t ofs, int parallel)
+{
+	uint8_t zero[4] = { 0 };
+	uint32_t crc = (uint32_t)-1;
+	size_t rest = sz - (ofs + 4);
+
+	crc = crc32_calc(ptr, ofs, crc);
+	crc = crc32_calc(zero, 4, crc);
+
+	if (parallel == 0) {
+		return ~crc32_calc(ptr + ofs + 4, rest, crc);
+	}
+
+	/* Remaining part is calculated independently and appended to the header CRC */
+	crc = crc32_combine(crc, crc32_calcParallel(ptr + ofs + 4, rest, 0), rest);
+
+	return ~crc;
+}
+
+
+ssize_t metaelf_size(const void *mem, size_t len)
+{
+	elf_ptr_t elf;
+
+	elf.memptr = (void *)mem;
+	if ((len < EI_NIDENT) || (memcmp(elf.ident, ELFMAG, SELFMAG) != 0)) {
+		return -1;
+	}
+
+	if (((elf.ident[EI_CLASS] == ELFCLASS32) && (len < sizeof(Elf32_Ehdr))) ||
+			((elf.ident[EI_CLASS] == ELFCLASS64) && (len < sizeof(Elf64_Ehdr)))) {
+		return -1;
+	}
+
+	return elf_size(elf);
+}
+
+
+int metaelf_mem(const char *name, void *mem, size_t size, int mode, int flags, metaelf_result_t *res)
+{
+	uint32_t crcOut, crcIn = 0;
+	elf_ptr_t elf;
+	int ret;
+
+	elf.memptr = mem;
+	memset(res, 0, sizeof(*res));
+	res->status = METAELF_ERROR;
+
+	if (metaelf_size(mem, size) != (ssize_t)size) {
+		if (memcmp(elf.ident, ELFMAG, SELFMAG) != 0) {
+			if ((flags & METAELF_PROBE) != 0) {
+				res->status = METAELF_NOTELF;
+			}
+			else {
+				log_error("%s: Not an ELF file", name);
+			}
+		}
+		else {
+			log_error("%s: The ELF file size on disk does not match its header info", name);
+		}
+		return res->status;
+	}
+
+	memcpy(&crcIn, &elf.ident[EI_SIGNATURE_VALUE], sizeof(uint32_t));
+
+	/* Convert ELF to host byte order */
+	crcIn = uint32(elf, crcIn);
+
+	crcOut = elf_calc_crc32(mem, size, EI_SIGNATURE_VALUE, (flags & METAELF_PARALLEL) != 0);
+	res->crc = crcIn;
+
+	if (mode == mode_checkCRC) {
+		if (elf.ident[EI_SIGNATURE_METHOD] != SIGNATURE_CRC32) {
+			log_info("ELF file contains unsupported signature");
+			ret = METAELF_UNSUPPORTED;
+		}
+		if (crcIn == 0 && crcOut != 0) {
+			log_info("ELF file does not contain CRC");
+			ret = METAELF_NOCRC;
+		}
+		else if (crcIn != crcOut) {
+			log_info("Integrity error, checksum %08X is invalid", crcIn);
+			ret = METAELF_INVALID;
+		}
+		else {
+			log_info("Checksum correct %08X", crcIn);
+			ret = METAELF_OK;
+		}
+	}
+	else if (mode == mode_writeCRC) {
+		/* Pages are written only if needed, so that unchanged files keep their mtime */
+		if ((crcIn != crcOut) || (elf.ident[EI_SIGNATURE_METHOD] != SIGNATURE_CRC32)) {
+			log_info("Embedding CRC32=%08X", crcOut);
+
+			/* From host to ELF byte order */
+			crcIn = uint32(elf, crcOut);
+			memcpy(&elf.ident[EI_SIGNATURE_VALUE], &crcIn, sizeof(uint32_t));
+			elf.ident[EI_SIGNATURE_METHOD] = SIGNATURE_CRC32;
+			res->modified = 1;
+		}
+		else {
+			log_info("Already embedded CRC32=%08X", crcOut);
+		}
+
+		res->crc = crcOut;
+		ret = METAELF_OK;
+	}
+	else {
+		log_info("Calculated CRC is %08X", crcOut);
+		ret = METAELF_OK;
+	}
+
+	res->status = ret;
+
+	return ret;
+}
+
+
+int metaelf_file(const char *path, int mode, int flags, metaelf_result_t *res)
+{
+	struct stat st = { 0 };
+	void *mem = MAP_FAILED;
+	int fd, ret = METAELF_ERROR;
+
+	memset(res, 0, sizeof(*res));
+
+	fd = open(path, (mode == mode_writeCRC) ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		log_error("Unable to open file %s", path);
+		res->status = ret;
+		return ret;
+	}
+
+	do {
+		if (fstat(fd, &st) == -1) {
+			break;
+		}
+
+		if (st.st_size < EI_NIDENT) {
+			if ((flags & METAELF_PROBE) != 0) {
+				ret = METAELF_NOTELF;
+			}
+			else if (st.st_size == 0) {
+				log_error("%s: File has a zero size", path);
+			}
+			else {
+				log_error("%s: Not an ELF file", path);
+			}
+			break;
+		}
+
+		mem = mmap(NULL, st.st_size, (mode == mode_writeCRC) ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+		if (mem == MAP_FAILED) {
+			log_error("Unable to mmap file: %s", path);
+			break;
+		}
+
+		ret = metaelf_mem(path, mem, st.st_size, mode, flags, res);
+	} while (0);
+
+	if (mem != MAP_FAILED) {
+		(void)munmap(mem, st.st_size);
+	}
+
+	/* Modification through the mapping updates mtime, report the final one */
+	if (res->modified != 0) {
+		(void)fstat(fd, &st);
+	}
+	(void)close(fd);
+
+	res->status = ret;
+	res->size = st.st_size;
+	res->mtime = st.st_mtime;
+	res->mtime_nsec = st_mtim_nsec(&st);
+
+	return ret;
+}
@@ -0,0 +1,65 @@
+/*
+ * Phoenix-RTOS
+ *
+ * metaELF - Checksum and metadata ELF embedder
+ *
+ * Copyright 2022, 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef METAELF_H
+#define METAELF_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+
+/* Processing modes */
+enum {
+	mode_checkCRC,
+	mode_writeCRC,
+};
+
+
+/* Result codes (also process exit codes) */
+#define METAELF_OK          0
+#define METAELF_ERROR       1
+#define METAELF_INVALID     2
+#define METAELF_NOCRC       3
+#define METAELF_UNSUPPORTED 4
+#define METAELF_NOTELF      5
+
+
+typedef struct {
+	int status;        /* METAELF_* result code */
+	uint32_t crc;      /* CRC embedded in the file after processing (host byte order) */
+	off_t size;        /* file size and modification time after processing */
+	time_t mtime;
+	long mtime_nsec;
+	int modified;      /* CRC was written */
+} metaelf_result_t;
+
+
+/* Flags of metaelf_file() */
+#define METAELF_QUIET    (1 << 0)  /* don't print informational messages */
+#define METAELF_PARALLEL (1 << 1)  /* split CRC calculation of large files between threads */
+#define METAELF_PROBE    (1 << 2)  /* non-ELF file is not an error, METAELF_NOTELF is returned silently */
+
+
+/* Returns size of ELF stored in memory based on its header, -1 if it's not an ELF */
+extern ssize_t metaelf_size(const void *mem, size_t len);
+
+
+/* Checks or embeds CRC of ELF stored in memory (e.g. mapped image), name is used in messages, returns METAELF_* result code */
+extern int metaelf_mem(const char *name, void *mem, size_t size, int mode, int flags, metaelf_result_t *res);
+
+
+/* Checks or embeds CRC of single ELF file, crc32_init() has to be called first, returns METAELF_* result code */
+extern int metaelf_file(const char *path, int mode, int flags, metaelf_result_t *res);
+
+
+#endif
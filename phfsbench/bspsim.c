@@ -0,0 +1,156 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Target side of BSP kernel loading
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <string.h>
+
+#include <hostutils-common/errors.h>
+#include "bspsim.h"
+
+
+static int bspsim_send(link_t *l, u8 t, const u8 *data, unsigned int len)
+{
+	u8 frame[2 * BSPSIM_MSGSZ + 4];
+	unsigned int k, i = 3;
+	s16 fcs = t;
+
+	frame[0] = t;
+	for (k = 0; k < len; k++) {
+		if ((data[k] == BSPSIM_ESC) || (data[k] == BSPSIM_END))
+			frame[i++] = BSPSIM_ESC;
+		else
+			fcs += (s8)data[k];
+		frame[i++] = data[k];
+	}
+	frame[i++] = BSPSIM_END;
+	memcpy(&frame[1], &fcs, sizeof(fcs));
+
+	return link_write(l, frame, i);
+}
+
+
+static int bspsim_ack(link_t *l, u8 t, u16 num)
+{
+	u8 buff[2] = { num & 0xff, num >> 8 };
+
+	return bspsim_send(l, t, buff, sizeof(buff));
+}
+
+
+/* Function receives frame, returns data length */
+static int bspsim_recv(link_t *l, u8 *t, u8 *data, int timeout)
+{
+	unsigned int n = 0, k = 0;
+	int escfl = 0, res;
+	s16 fcs, sum = 0;
+	u8 hdr[3], c;
+
+	for (;;) {
+		if ((res = link_read(l, &c, 1, timeout)) < 0)
+			return res;
+		timeout = BSPSIM_TIMEOUT;
+
+		/* Type and checksum aren't escaped */
+		if (k < sizeof(hdr)) {
+			hdr[k++] = c;
+			continue;
+		}
+
+		if (!escfl && (c == BSPSIM_ESC)) {
+			escfl = 1;
+			continue;
+		}
+		if (!escfl && (c == BSPSIM_END))
+			break;
+		if (!escfl)
+			sum += (s8)c;
+		escfl = 0;
+
+		if (n >= BSPSIM_MSGSZ)
+			return ERR_MSG_IO;
+		data[n++] = c;
+	}
+
+	*t = hdr[0];
+	memcpy(&fcs, &hdr[1], sizeof(fcs));
+	if ((s16)(sum + hdr[0]) != fcs)
+		return ERR_MSG_IO;
+
+	return n;
+}
+
+
+int bspsim_kernel(link_t *l, unsigned int window, u8 *buff, size_t size, size_t *len, stats_t *lat)
+{
+	u8 req[3] = { 0, BSPSIM_WINMAGIC, window }, data[BSPSIM_MSGSZ], t;
+	unsigned long long last;
+	unsigned int retries = LINK_STARTUP / BSPSIM_RETRY, off;
+	int n, err, started = 0;
+	u16 cnt = 0, seq;
+
+	*len = 0;
+
+	if ((err = bspsim_send(l, BSPSIM_KDATA, req, (window > 1) ? 3 : 1)) < 0)
+		return err;
+	last = stats_now();
+
+	for (;;) {
+		/* Request is repeated until phoenixd opens device */
+		if ((n = bspsim_recv(l, &t, data, started ? BSPSIM_TIMEOUT : BSPSIM_RETRY)) == ERR_SERIAL_TIMEOUT) {
+			if (started || (retries-- == 0))
+				return n;
+			if ((err = bspsim_send(l, BSPSIM_KDATA, req, (window > 1) ? 3 : 1)) < 0)
+				return err;
+			continue;
+		}
+		if (n < 0)
+			return n;
+
+		if (t == BSPSIM_GO)
+			return ERR_NONE;
+
+		/* Retransmission requests of idle phoenixd */
+		if ((t == BSPSIM_ACK) || (t == BSPSIM_RETR))
+			continue;
+
+		started = 1;
+		stats_add(lat, stats_now() - last);
+		off = 0;
+
+		if (t & BSPSIM_SEQ) {
+			if (n < 2)
+				return ERR_MSG_IO;
+			seq = data[0] | (data[1] << 8);
+
+			/* Frames aren't lost on loopback, duplicates are acknowledged again */
+			if (seq != cnt) {
+				if ((err = bspsim_ack(l, (((seq - cnt) & 0xffff) >= 0x8000) ? BSPSIM_ACK : BSPSIM_RETR, cnt)) < 0)
+					return err;
+				continue;
+			}
+			off = 2;
+		}
+
+		if ((t & ~BSPSIM_SEQ) == BSPSIM_KDATA) {
+			if (*len + n - off > size)
+				return ERR_MSG_IO;
+			memcpy(buff + *len, data + off, n - off);
+			*len += n - off;
+		}
+
+		/* Legacy loader acknowledges with its counter, windowed one with next expected number */
+		if ((err = bspsim_ack(l, BSPSIM_ACK, ++cnt)) < 0)
+			return err;
+		last = stats_now();
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Target side of BSP kernel loading
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BSPSIM_H_
+#define _BSPSIM_H_
+
+#include <stddef.h>
+#include "link.h"
+#include "stats.h"
+
+
+/* BSP framing and types used by target (same as phoenixd bsp.h) */
+#define BSPSIM_ESC      0xaa
+#define BSPSIM_END      0xdd
+#define BSPSIM_MSGSZ    1024
+#define BSPSIM_ACK      1
+#define BSPSIM_RETR     2
+#define BSPSIM_SHDR     4
+#define BSPSIM_KDATA    5
+#define BSPSIM_GO       6
+#define BSPSIM_SEQ      0x80
+#define BSPSIM_WINMAGIC 0x57
+
+/* Timeouts (ms) */
+#define BSPSIM_TIMEOUT  5000
+#define BSPSIM_RETRY    1000
+
+
+/*
+ * Function requests kernel (window 1 - legacy stop-and-wait loader) and receives it until BSP_TYPE_GO.
+ * Kernel data is stored in buff, its length in len, time of each frame exchange goes to lat.
+ */
+extern int bspsim_kernel(link_t *l, unsigned int window, u8 *buff, size_t size, size_t *len, stats_t *lat);
+
+
+#endif
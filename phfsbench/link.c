@@ -0,0 +1,743 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Target side of phoenixd transports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <hostutils-common/errors.h>
+#include "link.h"
+
+
+static const char *link_names[LINK_TYPES] = { "pipe", "tcp", "udp", "pty", "qemu" };
+
+
+const char *link_name(int type)
+{
+	return ((type >= 0) && (type < LINK_TYPES)) ? link_names[type] : "?";
+}
+
+
+int link_type(const char *name)
+{
+	int k;
+
+	for (k = 0; k < LINK_TYPES; k++) {
+		if (strcmp(name, link_names[k]) == 0)
+			return k;
+	}
+
+	return -1;
+}
+
+
+static unsigned long long link_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+
+/* Function starts phoenixd in its own process group, output goes to dir/phoenixd.log */
+static int link_spawn(link_t *l, const char *phoenixd, const char *dir, char *const *argv, const char *opt, const char *addr)
+{
+	char log[PATH_MAX], **args;
+	unsigned int n, k;
+	int fd;
+
+	for (n = 0; argv[n] != NULL; n++)
+		;
+
+	if ((args = calloc(n + 4, sizeof(*args))) == NULL)
+		return ERR_MEM;
+
+	args[0] = (char *)phoenixd;
+	for (k = 0; k < n; k++)
+		args[k + 1] = argv[k];
+	args[n + 1] = (char *)opt;
+	args[n + 2] = (char *)addr;
+
+	snprintf(log, sizeof(log), "%s/phoenixd.log", dir);
+
+	if ((l->pid = fork()) < 0) {
+		free(args);
+		return ERR_ARG;
+	}
+
+	if (l->pid == 0) {
+		setpgid(0, 0);
+		if ((fd = open(log, O_WRONLY | O_CREAT | O_APPEND, 0644)) >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		execvp(phoenixd, args);
+		_exit(127);
+	}
+
+	free(args);
+
+	return ERR_NONE;
+}
+
+
+static int link_wait(int fd, short events, int timeout)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	int res;
+
+	while (((res = poll(&pfd, 1, timeout)) < 0) && (errno == EINTR))
+		;
+
+	return res;
+}
+
+
+static int link_openpipe(link_t *l, const char *phoenixd, const char *dir, char *const *argv)
+{
+	char in[PATH_MAX + 4], out[PATH_MAX + 4];
+	unsigned long long end;
+	int err;
+
+	snprintf(l->path, sizeof(l->path), "%s/phfs", dir);
+	snprintf(in, sizeof(in), "%s.in", l->path);
+	snprintf(out, sizeof(out), "%s.out", l->path);
+
+	if (((mkfifo(in, 0600) < 0) && (errno != EEXIST)) || ((mkfifo(out, 0600) < 0) && (errno != EEXIST)))
+		return ERR_FILE;
+
+	if ((err = link_spawn(l, phoenixd, dir, argv, "-m", l->path)) < 0)
+		return err;
+
+	/* phoenixd reads target output (.out) first, open fails until it does */
+	for (end = link_now() + LINK_STARTUP; (l->fd_out = open(out, O_WRONLY | O_NONBLOCK)) < 0; usleep(10000)) {
+		if ((errno != ENXIO) || (link_now() > end))
+			return ERR_FILE;
+	}
+
+	if ((l->fd = open(in, O_RDONLY)) < 0)
+		return ERR_FILE;
+
+	return ERR_NONE;
+}
+
+
+static int link_opentcp(link_t *l, const char *phoenixd, const char *dir, char *const *argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd, err, nodelay = 1;
+
+	if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return ERR_FILE;
+
+	/* phoenixd connects to the target, which listens on free port */
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(lfd, 1) < 0) ||
+		(getsockname(lfd, (struct sockaddr *)&addr, &len) < 0)) {
+		close(lfd);
+		return ERR_FILE;
+	}
+
+	l->port = ntohs(addr.sin_port);
+	snprintf(l->path, sizeof(l->path), "127.0.0.1:%u", l->port);
+
+	if ((err = link_spawn(l, phoenixd, dir, argv, "-t", l->path)) < 0) {
+		close(lfd);
+		return err;
+	}
+
+	if ((link_wait(lfd, POLLIN, LINK_STARTUP) <= 0) || ((l->fd = accept(lfd, NULL, NULL)) < 0)) {
+		close(lfd);
+		return ERR_FILE;
+	}
+
+	close(lfd);
+	setsockopt(l->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+	return ERR_NONE;
+}
+
+
+static int link_openudp(link_t *l, const char *phoenixd, const char *dir, char *const *argv)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	unsigned long long end;
+	int fd, err, rcvbuf = 4 << 20;
+
+	/* Free port is found by binding temporary socket */
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return ERR_FILE;
+
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (getsockname(fd, (struct sockaddr *)&addr, &len) < 0)) {
+		close(fd);
+		return ERR_FILE;
+	}
+	close(fd);
+
+	l->port = ntohs(addr.sin_port);
+	snprintf(l->path, sizeof(l->path), "127.0.0.1:%u", l->port);
+
+	if ((err = link_spawn(l, phoenixd, dir, argv, "-i", l->path)) < 0)
+		return err;
+
+	/* Port is taken when phoenixd binds it, requests sent before are lost */
+	for (end = link_now() + LINK_STARTUP; link_now() < end; usleep(10000)) {
+		if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+			return ERR_FILE;
+		err = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+		close(fd);
+		if ((err < 0) && (errno == EADDRINUSE))
+			break;
+	}
+
+	if ((l->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return ERR_FILE;
+
+	setsockopt(l->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if (connect(l->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		return ERR_FILE;
+
+	return ERR_NONE;
+}
+
+
+/* Function checks whether process has file open */
+static int link_holds(pid_t pid, const char *path)
+{
+	char dir[64], fd[PATH_MAX], target[PATH_MAX];
+	struct dirent *de;
+	ssize_t len;
+	int res = 0;
+	DIR *d;
+
+	snprintf(dir, sizeof(dir), "/proc/%d/fd", (int)pid);
+	if ((d = opendir(dir)) == NULL)
+		return 0;
+
+	while ((res == 0) && ((de = readdir(d)) != NULL)) {
+		snprintf(fd, sizeof(fd), "%s/%s", dir, de->d_name);
+		if ((len = readlink(fd, target, sizeof(target) - 1)) > 0) {
+			target[len] = '\0';
+			res = (strcmp(target, path) == 0);
+		}
+	}
+	closedir(d);
+
+	return res;
+}
+
+
+/* Function calls fn for phoenixd and its children until it returns non-zero */
+static int link_foreach(link_t *l, int (*fn)(pid_t, void *), void *arg)
+{
+	char path[64];
+	int pid, res;
+	FILE *f;
+
+	if ((res = fn(l->pid, arg)) != 0)
+		return res;
+
+	/* Devices may be served by forked children */
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)l->pid, (int)l->pid);
+	if ((f = fopen(path, "r")) == NULL)
+		return 0;
+
+	while ((res == 0) && (fscanf(f, "%d", &pid) == 1))
+		res = fn(pid, arg);
+	fclose(f);
+
+	return res;
+}
+
+
+static int link_ptyopened(pid_t pid, void *arg)
+{
+	return link_holds(pid, arg);
+}
+
+
+static int link_openpty(link_t *l, const char *phoenixd, const char *dir, char *const *argv)
+{
+	unsigned long long end;
+	struct termios tio;
+	char *name;
+	int err;
+
+	if (((l->fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) || (grantpt(l->fd) < 0) || (unlockpt(l->fd) < 0))
+		return ERR_FILE;
+
+	if ((name = ptsname(l->fd)) == NULL)
+		return ERR_FILE;
+	snprintf(l->path, sizeof(l->path), "%s", name);
+
+	if (tcgetattr(l->fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(l->fd, TCSANOW, &tio);
+	}
+
+	/* Slave is kept open, so master doesn't report hangup between phoenixd sessions */
+	if ((l->fd_out = open(l->path, O_RDWR | O_NOCTTY)) < 0)
+		return ERR_FILE;
+
+	if ((err = link_spawn(l, phoenixd, dir, argv, "-p", l->path)) < 0)
+		return err;
+
+	/* Data written before phoenixd configures device is flushed */
+	for (end = link_now() + LINK_STARTUP; !link_foreach(l, link_ptyopened, l->path); usleep(10000)) {
+		if (link_now() > end)
+			break;
+	}
+	usleep(LINK_PTYSETTLE * 1000);
+
+	return ERR_NONE;
+}
+
+
+static int link_openqemu(link_t *l, const char *phoenixd, const char *dir, char *const *argv)
+{
+	struct sockaddr_un addr;
+	unsigned long long end;
+	int err;
+
+	snprintf(l->path, sizeof(l->path), "%s/phfs.sock", dir);
+	if (strlen(l->path) >= sizeof(addr.sun_path))
+		return ERR_ARG;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, l->path);
+
+	if ((err = link_spawn(l, phoenixd, dir, argv, "-q", l->path)) < 0)
+		return err;
+
+	/* Connection is retried like QEMU does with reconnect option */
+	for (end = link_now() + LINK_STARTUP;; usleep(10000)) {
+		if ((l->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			return ERR_FILE;
+
+		if (connect(l->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			break;
+
+		close(l->fd);
+		l->fd = -1;
+		if (link_now() > end)
+			return ERR_FILE;
+	}
+
+	return ERR_NONE;
+}
+
+
+int link_open(link_t *l, int type, const char *phoenixd, const char *dir, char *const *argv)
+{
+	int err;
+
+	memset(l, 0, sizeof(*l));
+	l->type = type;
+	l->fd = -1;
+	l->fd_out = -1;
+	l->pid = -1;
+
+	if (((l->frame = malloc(LINK_HDRSZ + LINK_MAXLEN)) == NULL) || ((l->tbuff = malloc(2 * (LINK_HDRSZ + LINK_MAXLEN) + 1)) == NULL)) {
+		link_close(l);
+		return ERR_MEM;
+	}
+
+	switch (type) {
+		case LINK_PIPE:
+			err = link_openpipe(l, phoenixd, dir, argv);
+			break;
+		case LINK_TCP:
+			err = link_opentcp(l, phoenixd, dir, argv);
+			break;
+		case LINK_UDP:
+			err = link_openudp(l, phoenixd, dir, argv);
+			break;
+		case LINK_PTY:
+			err = link_openpty(l, phoenixd, dir, argv);
+			break;
+		case LINK_QEMU:
+			err = link_openqemu(l, phoenixd, dir, argv);
+			break;
+		default:
+			err = ERR_ARG;
+			break;
+	}
+
+	if (err < 0) {
+		link_close(l);
+		return err;
+	}
+
+	/* pty slave descriptor only keeps it open */
+	if ((l->fd_out < 0) || (type == LINK_PTY))
+		l->fd_out = l->fd;
+
+	/* Streams transmit without blocking, see link_stall() */
+	if (type != LINK_UDP)
+		fcntl(l->fd_out, F_SETFL, fcntl(l->fd_out, F_GETFL) | O_NONBLOCK);
+
+	return ERR_NONE;
+}
+
+
+/* Function waits until transmission is possible, phoenixd output is stored meanwhile to avoid deadlock */
+static int link_stall(link_t *l)
+{
+	struct pollfd pfd[2] = { { .fd = l->fd_out, .events = POLLOUT }, { .fd = l->fd, .events = POLLIN } };
+	nfds_t n = (l->fd == l->fd_out) ? 1 : 2;
+	ssize_t res;
+	u8 *p;
+
+	if (n == 1)
+		pfd[0].events |= POLLIN;
+
+	if ((poll(pfd, n, -1) < 0) && (errno != EINTR))
+		return ERR_MSG_IO;
+
+	if (!(pfd[n - 1].revents & (POLLIN | POLLHUP)))
+		return ERR_NONE;
+
+	if (l->szbacklog - l->nbacklog < LINK_RXBUFSZ) {
+		if ((p = realloc(l->backlog, l->szbacklog + 4 * LINK_RXBUFSZ)) == NULL)
+			return ERR_MEM;
+		l->backlog = p;
+		l->szbacklog += 4 * LINK_RXBUFSZ;
+	}
+
+	if ((res = read(l->fd, l->backlog + l->nbacklog, LINK_RXBUFSZ)) > 0) {
+		l->nbacklog += res;
+		l->rxbytes += res;
+	}
+	else if ((res == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+		return ERR_MSG_CLOSED;
+
+	return ERR_NONE;
+}
+
+
+int link_write(link_t *l, const u8 *buff, unsigned int len)
+{
+	ssize_t res;
+	int err;
+
+	l->txbytes += len;
+
+	while (len > 0) {
+		if ((res = write(l->fd_out, buff, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				if ((err = link_stall(l)) < 0)
+					return err;
+				continue;
+			}
+			return ERR_MSG_IO;
+		}
+		buff += res;
+		len -= res;
+	}
+
+	return ERR_NONE;
+}
+
+
+int link_send(link_t *l, u16 type, u16 seq, const void *data, unsigned int len)
+{
+	u32 csum = 0, t, k, n = 0;
+	u8 c;
+
+	if (len > LINK_MAXLEN)
+		return ERR_MSG_ARG;
+
+	t = type | (len << 16);
+	memcpy(l->frame + 4, &t, sizeof(t));
+	memcpy(l->frame + LINK_HDRSZ, data, len);
+
+	for (k = 4; k < LINK_HDRSZ + len; k++)
+		csum += l->frame[k];
+	csum = ((csum + seq) & 0xffff) | ((u32)seq << 16);
+	memcpy(l->frame, &csum, sizeof(csum));
+
+	/* Datagrams carry raw frames */
+	if (l->type == LINK_UDP) {
+		l->txbytes += LINK_HDRSZ + len;
+		return (send(l->fd, l->frame, LINK_HDRSZ + len, 0) < 0) ? ERR_MSG_IO : ERR_NONE;
+	}
+
+	l->tbuff[n++] = LINK_MARK;
+	for (k = 0; k < LINK_HDRSZ + len; k++) {
+		c = l->frame[k];
+		if (c == LINK_MARK) {
+			l->tbuff[n++] = LINK_ESC;
+			c = LINK_ESCMARK;
+		}
+		else if (c == LINK_ESC) {
+			l->tbuff[n++] = LINK_ESC;
+			c = LINK_ESCESC;
+		}
+		l->tbuff[n++] = c;
+	}
+
+	return link_write(l, l->tbuff, n);
+}
+
+
+/* Function fills receive buffer, returns number of bytes or ERR_SERIAL_TIMEOUT */
+static int link_fill(link_t *l, unsigned long long end)
+{
+	long long tmo;
+	ssize_t res;
+
+	if (l->nbacklog > 0) {
+		res = (l->nbacklog < sizeof(l->rbuff)) ? l->nbacklog : sizeof(l->rbuff);
+		memcpy(l->rbuff, l->backlog, res);
+		memmove(l->backlog, l->backlog + res, l->nbacklog - res);
+		l->nbacklog -= res;
+		l->rd = 0;
+		l->wr = res;
+
+		return res;
+	}
+
+	for (;;) {
+		tmo = (end == 0) ? -1 : (long long)end - (long long)link_now();
+		if ((end != 0) && (tmo < 0))
+			return ERR_SERIAL_TIMEOUT;
+
+		if (link_wait(l->fd, POLLIN, (int)tmo) == 0)
+			return ERR_SERIAL_TIMEOUT;
+
+		if ((res = read(l->fd, l->rbuff, sizeof(l->rbuff))) < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			return ERR_MSG_IO;
+		}
+		if (res == 0)
+			return ERR_MSG_CLOSED;
+		l->rxbytes += res;
+		l->rd = 0;
+		l->wr = res;
+
+		return res;
+	}
+}
+
+
+static int link_parse(link_t *l, u16 *type, u16 *seq, void *data, unsigned int size, unsigned int flen)
+{
+	u32 csum, t, len;
+
+	memcpy(&csum, l->frame, sizeof(csum));
+	memcpy(&t, l->frame + 4, sizeof(t));
+
+	len = t >> 16;
+	if (flen != LINK_HDRSZ + len)
+		return ERR_MSG_IO;
+
+	*type = t & 0xffff;
+	*seq = csum >> 16;
+	memcpy(data, l->frame + LINK_HDRSZ, (len < size) ? len : size);
+
+	return len;
+}
+
+
+int link_recv(link_t *l, u16 *type, u16 *seq, void *data, unsigned int size, int timeout)
+{
+	unsigned long long end = (timeout < 0) ? 0 : link_now() + timeout;
+	ssize_t res;
+	u32 t;
+	int err;
+	u8 c;
+
+	if (l->type == LINK_UDP) {
+		for (;;) {
+			if (link_wait(l->fd, POLLIN, timeout) == 0)
+				return ERR_SERIAL_TIMEOUT;
+
+			if ((res = recv(l->fd, l->frame, LINK_HDRSZ + LINK_MAXLEN, 0)) < 0) {
+				/* Endpoint isn't bound yet */
+				if ((errno == EINTR) || (errno == ECONNREFUSED))
+					continue;
+				return ERR_MSG_IO;
+			}
+			l->rxbytes += res;
+
+			if ((res >= LINK_HDRSZ) && ((err = link_parse(l, type, seq, data, size, res)) >= 0))
+				return err;
+		}
+	}
+
+	for (;;) {
+		if ((l->rd == l->wr) && ((err = link_fill(l, end)) < 0))
+			return err;
+
+		c = l->rbuff[l->rd++];
+
+		if (c == LINK_MARK) {
+			l->sync = 1;
+			l->l = 0;
+			l->escfl = 0;
+			continue;
+		}
+		if (!l->sync)
+			continue;
+
+		if (l->escfl) {
+			c = (c == LINK_ESCMARK) ? LINK_MARK : (c == LINK_ESCESC) ? LINK_ESC : c;
+			l->escfl = 0;
+		}
+		else if (c == LINK_ESC) {
+			l->escfl = 1;
+			continue;
+		}
+
+		l->frame[l->l++] = c;
+
+		if (l->l < LINK_HDRSZ)
+			continue;
+
+		memcpy(&t, l->frame + 4, sizeof(t));
+		if (l->l == LINK_HDRSZ + (t >> 16)) {
+			l->sync = 0;
+			return link_parse(l, type, seq, data, size, l->l);
+		}
+	}
+}
+
+
+int link_read(link_t *l, u8 *buff, unsigned int size, int timeout)
+{
+	unsigned long long end = (timeout < 0) ? 0 : link_now() + timeout;
+	unsigned int n;
+	int err;
+
+	if ((l->rd == l->wr) && ((err = link_fill(l, end)) < 0))
+		return err;
+
+	n = l->wr - l->rd;
+	if (n > size)
+		n = size;
+	memcpy(buff, l->rbuff + l->rd, n);
+	l->rd += n;
+
+	return n;
+}
+
+
+static int link_procio(pid_t pid, void *arg)
+{
+	unsigned long long v, *n = arg;
+	char path[64], line[128];
+	FILE *f;
+
+	/* Process may have exited meanwhile */
+	snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+	if ((f = fopen(path, "r")) == NULL)
+		return 0;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((sscanf(line, "syscr: %llu", &v) == 1) || (sscanf(line, "syscw: %llu", &v) == 1))
+			*n += v;
+	}
+	fclose(f);
+
+	return 0;
+}
+
+
+int link_syscalls(link_t *l, unsigned long long *n)
+{
+	char path[64];
+
+	*n = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/io", (int)l->pid);
+	if (access(path, R_OK) < 0)
+		return ERR_FILE;
+
+	link_foreach(l, link_procio, n);
+
+	return ERR_NONE;
+}
+
+
+void link_close(link_t *l)
+{
+	char path[PATH_MAX + 4];
+	int st;
+
+	if (l->pid > 0) {
+		kill(-l->pid, SIGTERM);
+		while ((waitpid(l->pid, &st, 0) < 0) && (errno == EINTR))
+			;
+		l->pid = -1;
+	}
+
+	if ((l->fd_out >= 0) && (l->fd_out != l->fd))
+		close(l->fd_out);
+	if (l->fd >= 0)
+		close(l->fd);
+	l->fd = -1;
+	l->fd_out = -1;
+
+	if (l->type == LINK_PIPE) {
+		snprintf(path, sizeof(path), "%s.in", l->path);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s.out", l->path);
+		unlink(path);
+	}
+	else if (l->type == LINK_QEMU) {
+		unlink(l->path);
+	}
+
+	free(l->frame);
+	free(l->tbuff);
+	free(l->backlog);
+	l->frame = NULL;
+	l->tbuff = NULL;
+	l->backlog = NULL;
+}
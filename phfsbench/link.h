@@ -0,0 +1,112 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Target side of phoenixd transports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include <limits.h>
+#include <sys/types.h>
+#include <hostutils-common/types.h>
+
+
+/* Transports */
+#define LINK_PIPE  0
+#define LINK_TCP   1
+#define LINK_UDP   2
+#define LINK_PTY   3
+#define LINK_QEMU  4
+#define LINK_TYPES 5
+
+/* Message framing (same as phoenixd msg_t) */
+#define LINK_MARK     0x7e
+#define LINK_ESC      0x7d
+#define LINK_ESCMARK  0x5e
+#define LINK_ESCESC   0x5d
+#define LINK_HDRSZ    8
+#define LINK_MAXLEN   0xfffc
+
+#define LINK_RXBUFSZ  (64 * 1024)
+
+/* Time given to phoenixd to set up transport (ms) */
+#define LINK_STARTUP  5000
+
+/* Time given to phoenixd to configure pty after opening it (ms) */
+#define LINK_PTYSETTLE 50
+
+
+typedef struct _link_t {
+	int type;
+	int fd;                   /* target side descriptor */
+	int fd_out;               /* differs from fd for pipes only */
+	pid_t pid;                /* phoenixd process */
+	char path[PATH_MAX];      /* pipe, pty or socket path passed to phoenixd */
+	unsigned int port;
+
+	u8 rbuff[LINK_RXBUFSZ];   /* received raw data (streams) */
+	unsigned int rd;
+	unsigned int wr;
+	u8 *frame;                /* frame being decoded / sent (LINK_HDRSZ + LINK_MAXLEN) */
+	u8 *tbuff;                /* escaped frame */
+	u8 *backlog;              /* data received while transmission was blocked */
+	size_t nbacklog;
+	size_t szbacklog;
+	unsigned int l;
+	int escfl;
+	int sync;
+
+	unsigned long long txbytes; /* bytes written by target */
+	unsigned long long rxbytes; /* bytes received by target */
+} link_t;
+
+
+/* Function returns transport name */
+extern const char *link_name(int type);
+
+
+/* Function returns transport by name or -1 */
+extern int link_type(const char *name);
+
+
+/* Function starts phoenixd (argv - its arguments after transport options) and connects to it */
+extern int link_open(link_t *l, int type, const char *phoenixd, const char *dir, char *const *argv);
+
+
+/* Function sends PHFS message */
+extern int link_send(link_t *l, u16 type, u16 seq, const void *data, unsigned int len);
+
+
+/* Function receives PHFS message, returns payload length or ERR_SERIAL_TIMEOUT */
+extern int link_recv(link_t *l, u16 *type, u16 *seq, void *data, unsigned int size, int timeout);
+
+
+/* Function reads raw data (BSP), returns number of bytes or ERR_SERIAL_TIMEOUT */
+extern int link_read(link_t *l, u8 *buff, unsigned int size, int timeout);
+
+
+/* Function writes raw data (BSP) */
+extern int link_write(link_t *l, const u8 *buff, unsigned int len);
+
+
+/*
+ * Function returns number of read and write class system calls made by phoenixd and its children
+ * (Linux /proc/<pid>/io, socket calls of sendmsg/recvmsg family aren't counted there)
+ */
+extern int link_syscalls(link_t *l, unsigned long long *n);
+
+
+/* Function stops phoenixd and closes transport */
+extern void link_close(link_t *l);
+
+
+#endif
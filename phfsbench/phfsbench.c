@@ -0,0 +1,1147 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Starts phoenixd on every transport, plays target role and measures throughput, request
+ * latency and number of system calls made by phoenixd per transferred megabyte.
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#include <libelf/libelf.h>
+#else
+#include <elf.h>
+#endif
+
+#include <hostutils-common/errors.h>
+#include "link.h"
+#include "bspsim.h"
+#include "stats.h"
+#include "replay.h"
+
+
+/* PHFS messages (same as phoenixd msg.h and phfs.h) */
+#define MSG_OPEN   1
+#define MSG_READ   2
+#define MSG_WRITE  3
+#define MSG_CLOSE  4
+#define MSG_HELLO  7
+
+#define PHFS_HELLO_MAGIC  0x53464850
+#define PHFS_CAP_WINDOW   (1u << 0)
+#define PHFS_CAP_LZ4      (1u << 1)
+#define PHFS_IO_LZ4       (1u << 31)
+#define PHFS_RDONLY       0
+#define PHFS_RDWR         1
+#define PHFS_CREATE       2
+#define PHFS_WINDOW_MAX   32
+#define PHFS_IOHDRSZ      12
+#define PHFS_LEGACYLEN    512
+
+/* Timeout after which outstanding requests are sent again (ms) */
+#define BENCH_TIMEOUT     1000
+#define BENCH_RETRIES     5
+
+#define BENCH_SMALLSZ     1024
+#define BENCH_KERNELBASE  0xc0001000
+#define BENCH_KERNELOFFS  0x1000
+
+#define BENCH_MAXRESULTS  64
+
+/* Tests */
+#define TEST_SEQ     (1u << 0)
+#define TEST_RAND    (1u << 1)
+#define TEST_OPEN    (1u << 2)
+#define TEST_WRITE   (1u << 3)
+#define TEST_KERNEL  (1u << 4)
+#define TEST_SHARED  (1u << 5)
+
+
+typedef struct {
+	u32 handle;
+	u32 pos;
+	s32 len;
+} bench_io_t;
+
+
+typedef struct {
+	u32 magic;
+	u32 version;
+	u32 maxlen;
+	u32 caps;
+	u32 window;
+} bench_hello_t;
+
+
+typedef struct {
+	char name[32];
+	double mbps;
+	double rps;
+	unsigned int p50;
+	unsigned int p90;
+	unsigned int p99;
+	unsigned int max;
+	double sysmb;
+} result_t;
+
+
+typedef struct {
+	link_t l;
+	unsigned int maxlen;      /* negotiated frame payload */
+	unsigned int window;
+	unsigned int caps;
+	u16 seq;
+	u8 *rbuff;
+	u8 *sbuff;
+} client_t;
+
+
+typedef struct {
+	u16 seq;
+	int busy;
+	u32 pos;
+	unsigned int len;
+	unsigned long long t;
+} slot_t;
+
+
+static struct {
+	const char *phoenixd;
+	char dir[32];             /* temporary directory with sysdir, pipes and sockets */
+	char sysdir[64];          /* dir/sys, short enough for any path built from it to fit in PATH_MAX */
+	int forked;
+
+	u8 *blob;
+	size_t blobsz;
+	u8 *kernel;
+	size_t kernelsz;
+	unsigned int nfiles;
+
+	unsigned int maxlen;      /* 0 - legacy target without MSG_HELLO */
+	unsigned int window;
+	unsigned int caps;
+	unsigned int bspwin;
+
+	result_t results[BENCH_MAXRESULTS];
+	unsigned int nresults;
+} bench_common;
+
+
+static void bench_path(char *buff, size_t size, const char *name)
+{
+	snprintf(buff, size, "%s/%s", bench_common.sysdir, name);
+}
+
+
+/*
+ * Sysdir preparation
+ */
+
+
+static int bench_writefile(const char *name, const void *data, size_t len)
+{
+	char path[PATH_MAX];
+	int fd, err = ERR_NONE;
+
+	bench_path(path, sizeof(path), name);
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return ERR_FILE;
+
+	if (write(fd, data, len) != (ssize_t)len)
+		err = ERR_FILE;
+	close(fd);
+
+	return err;
+}
+
+
+static void bench_fill(u8 *buff, size_t len, u32 seed)
+{
+	static const char words[] = "phoenix rtos kernel loader target host syspage memory ";
+	size_t k;
+
+	/* Half of every block is random, the other one compresses well */
+	for (k = 0; k < len; k++) {
+		seed = seed * 1103515245u + 12345u;
+		buff[k] = ((k & 4095) < 2048) ? (u8)(seed >> 16) : (u8)words[(k + (seed >> 28)) % (sizeof(words) - 1)];
+	}
+}
+
+
+static int bench_mkkernel(void)
+{
+	Elf32_Ehdr *eh;
+	Elf32_Phdr *ph;
+	u8 *img;
+	int err;
+
+	if ((img = calloc(1, BENCH_KERNELOFFS + bench_common.kernelsz)) == NULL)
+		return ERR_MEM;
+
+	eh = (Elf32_Ehdr *)img;
+	ph = (Elf32_Phdr *)(img + sizeof(*eh));
+
+	memcpy(eh->e_ident, ELFMAG, SELFMAG);
+	eh->e_ident[EI_CLASS] = ELFCLASS32;
+	eh->e_ident[EI_DATA] = ELFDATA2LSB;
+	eh->e_ident[EI_VERSION] = EV_CURRENT;
+	eh->e_type = ET_EXEC;
+	eh->e_machine = EM_386;
+	eh->e_version = EV_CURRENT;
+	eh->e_entry = BENCH_KERNELBASE;
+	eh->e_phoff = sizeof(*eh);
+	eh->e_ehsize = sizeof(*eh);
+	eh->e_phentsize = sizeof(*ph);
+	eh->e_phnum = 1;
+
+	ph->p_type = PT_LOAD;
+	ph->p_offset = BENCH_KERNELOFFS;
+	ph->p_vaddr = BENCH_KERNELBASE;
+	ph->p_paddr = BENCH_KERNELBASE;
+	ph->p_filesz = bench_common.kernelsz;
+	ph->p_memsz = bench_common.kernelsz;
+	ph->p_flags = PF_R | PF_X;
+	ph->p_align = BENCH_KERNELOFFS;
+
+	memcpy(img + BENCH_KERNELOFFS, bench_common.kernel, bench_common.kernelsz);
+	err = bench_writefile("kernel", img, BENCH_KERNELOFFS + bench_common.kernelsz);
+	free(img);
+
+	return err;
+}
+
+
+static int bench_tmpdir(void)
+{
+	snprintf(bench_common.dir, sizeof(bench_common.dir), "/tmp/phfsbench.XXXXXX");
+	if (mkdtemp(bench_common.dir) == NULL) {
+		bench_common.dir[0] = '\0';
+		return ERR_FILE;
+	}
+
+	return ERR_NONE;
+}
+
+
+static int bench_prepare(void)
+{
+	char name[64], path[PATH_MAX];
+	u8 small[BENCH_SMALLSZ];
+	unsigned int k;
+	int err;
+
+	if ((err = bench_tmpdir()) < 0)
+		return err;
+
+	snprintf(bench_common.sysdir, sizeof(bench_common.sysdir), "%s/sys", bench_common.dir);
+	bench_path(path, sizeof(path), "small");
+	if ((mkdir(bench_common.sysdir, 0755) < 0) || (mkdir(path, 0755) < 0))
+		return ERR_FILE;
+
+	if (((bench_common.blob = malloc(bench_common.blobsz)) == NULL) || ((bench_common.kernel = malloc(bench_common.kernelsz)) == NULL))
+		return ERR_MEM;
+
+	bench_fill(bench_common.blob, bench_common.blobsz, 1);
+	bench_fill(bench_common.kernel, bench_common.kernelsz, 2);
+
+	if ((err = bench_writefile("blob", bench_common.blob, bench_common.blobsz)) < 0)
+		return err;
+
+	for (k = 0; k < bench_common.nfiles; k++) {
+		bench_fill(small, sizeof(small), k + 3);
+		snprintf(name, sizeof(name), "small/f%04u", k);
+		if ((err = bench_writefile(name, small, sizeof(small))) < 0)
+			return err;
+	}
+
+	return bench_mkkernel();
+}
+
+
+static void bench_cleanup(void)
+{
+	char name[64], path[PATH_MAX];
+	unsigned int k;
+
+	if (bench_common.dir[0] == '\0')
+		return;
+
+	/* Replay uses temporary directory only */
+	if (bench_common.sysdir[0] != '\0') {
+		for (k = 0; k < bench_common.nfiles; k++) {
+			snprintf(name, sizeof(name), "small/f%04u", k);
+			bench_path(path, sizeof(path), name);
+			unlink(path);
+		}
+
+		bench_path(path, sizeof(path), "small");
+		rmdir(path);
+		bench_path(path, sizeof(path), "blob");
+		unlink(path);
+		bench_path(path, sizeof(path), "out");
+		unlink(path);
+		bench_path(path, sizeof(path), "shared");
+		unlink(path);
+		bench_path(path, sizeof(path), "kernel");
+		unlink(path);
+		rmdir(bench_common.sysdir);
+	}
+
+	snprintf(path, sizeof(path), "%s/phoenixd.log", bench_common.dir);
+	unlink(path);
+	rmdir(bench_common.dir);
+}
+
+
+/*
+ * PHFS target
+ */
+
+
+/* Function decompresses LZ4 block, returns decompressed length or -1 */
+static int bench_unlz4(const u8 *src, unsigned int len, u8 *dst, unsigned int size)
+{
+	const u8 *end = src + len;
+	unsigned int n = 0, l, off;
+	u8 token;
+
+	while (src < end) {
+		token = *src++;
+
+		for (l = token >> 4; (token >> 4 == 15) && (src < end); src++) {
+			l += *src;
+			if (*src != 255) {
+				src++;
+				break;
+			}
+		}
+		if ((l > (unsigned int)(end - src)) || (n + l > size))
+			return -1;
+		memcpy(dst + n, src, l);
+		src += l;
+		n += l;
+
+		if (src == end)
+			break;
+
+		if (end - src < 2)
+			return -1;
+		off = src[0] | (src[1] << 8);
+		src += 2;
+
+		for (l = (token & 15) + 4; ((token & 15) == 15) && (src < end); src++) {
+			l += *src;
+			if (*src != 255) {
+				src++;
+				break;
+			}
+		}
+		if ((off == 0) || (off > n) || (n + l > size))
+			return -1;
+
+		/* Overlapping copy */
+		for (; l > 0; l--, n++)
+			dst[n] = dst[n - off];
+	}
+
+	return n;
+}
+
+
+static u16 client_seq(client_t *c)
+{
+	if (++c->seq == 0)
+		c->seq = 1;
+
+	return c->seq;
+}
+
+
+/* Function sends request and waits for answer, it's repeated after timeout (UDP, pty before phoenixd opens it) */
+static int client_call(client_t *c, u16 type, const void *req, unsigned int len, void *resp, unsigned int size)
+{
+	u16 seq = client_seq(c), rtype, rseq;
+	unsigned int k;
+	int n;
+
+	for (k = 0; k < BENCH_RETRIES; k++) {
+		if ((n = link_send(&c->l, type, seq, req, len)) < 0)
+			return n;
+
+		while ((n = link_recv(&c->l, &rtype, &rseq, resp, size, BENCH_TIMEOUT)) >= 0) {
+			if ((rseq == seq) && (rtype == type))
+				return n;
+		}
+
+		if (n != ERR_SERIAL_TIMEOUT)
+			return n;
+	}
+
+	return ERR_SERIAL_TIMEOUT;
+}
+
+
+static int client_hello(client_t *c)
+{
+	bench_hello_t hello = { PHFS_HELLO_MAGIC, 2, bench_common.maxlen, PHFS_CAP_WINDOW | bench_common.caps, bench_common.window };
+	int n;
+
+	if (bench_common.maxlen == 0) {
+		c->maxlen = PHFS_LEGACYLEN;
+		c->window = 1;
+		c->caps = 0;
+		return ERR_NONE;
+	}
+
+	if ((n = client_call(c, MSG_HELLO, &hello, sizeof(hello), &hello, sizeof(hello))) < 0)
+		return n;
+
+	if (n < (int)sizeof(hello))
+		return ERR_MSG_IO;
+
+	c->maxlen = hello.maxlen;
+	c->caps = hello.caps;
+	c->window = (hello.caps & PHFS_CAP_WINDOW) ? hello.window : 1;
+	if (c->window > PHFS_WINDOW_MAX)
+		c->window = PHFS_WINDOW_MAX;
+	if (c->window == 0)
+		c->window = 1;
+
+	return ERR_NONE;
+}
+
+
+static int client_open(client_t *c, const char *path, u32 flags, u32 *h)
+{
+	unsigned int len = strlen(path) + 1;
+	int n;
+
+	memcpy(c->sbuff, &flags, sizeof(flags));
+	memcpy(c->sbuff + sizeof(flags), path, len);
+
+	if ((n = client_call(c, MSG_OPEN, c->sbuff, sizeof(flags) + len, h, sizeof(*h))) < 0)
+		return n;
+
+	return ((n < (int)sizeof(*h)) || (*h == 0)) ? ERR_FILE : ERR_NONE;
+}
+
+
+static int client_close(client_t *c, u32 h)
+{
+	int n;
+
+	n = client_call(c, MSG_CLOSE, &h, sizeof(h), c->rbuff, LINK_MAXLEN);
+
+	return (n < 0) ? n : ERR_NONE;
+}
+
+
+static int client_io(client_t *c, u16 type, u32 h, slot_t *s)
+{
+	bench_io_t *io = (bench_io_t *)c->sbuff;
+	unsigned int len = PHFS_IOHDRSZ;
+
+	io->handle = h;
+	io->pos = s->pos;
+	io->len = s->len;
+
+	if (type == MSG_WRITE) {
+		memcpy(c->sbuff + PHFS_IOHDRSZ, bench_common.blob + s->pos, s->len);
+		len += s->len;
+	}
+
+	s->t = stats_now();
+
+	return link_send(&c->l, type, s->seq, c->sbuff, len);
+}
+
+
+/* Function checks answer, read data is compared with sysdir content */
+static int client_check(client_t *c, u16 type, slot_t *s, const u8 *ref, int n)
+{
+	static u8 plain[LINK_MAXLEN];
+	bench_io_t io;
+	const u8 *data = c->rbuff + PHFS_IOHDRSZ;
+
+	if (n < PHFS_IOHDRSZ)
+		return ERR_MSG_IO;
+
+	memcpy(&io, c->rbuff, sizeof(io));
+	if (io.len != (s32)s->len)
+		return ERR_MSG_IO;
+
+	if (type != MSG_READ)
+		return ERR_NONE;
+
+	if (io.handle & PHFS_IO_LZ4) {
+		if (bench_unlz4(data, n - PHFS_IOHDRSZ, plain, sizeof(plain)) != (int)s->len)
+			return ERR_MSG_IO;
+		data = plain;
+	}
+	else if (n - PHFS_IOHDRSZ != (int)s->len) {
+		return ERR_MSG_IO;
+	}
+
+	return (memcmp(data, ref + s->pos, s->len) == 0) ? ERR_NONE : ERR_MSG_IO;
+}
+
+
+/* Function transfers chunks at given positions keeping window of requests outstanding */
+static int client_pipeline(client_t *c, u16 type, u32 h, const u32 *pos, unsigned int count, unsigned int chunk, stats_t *lat, unsigned long long *bytes)
+{
+	slot_t slots[PHFS_WINDOW_MAX];
+	unsigned int next = 0, done = 0, pending = 0, retries = 0, k;
+	u16 rtype, rseq;
+	int n, err;
+
+	memset(slots, 0, sizeof(slots));
+
+	while (done < count) {
+		for (k = 0; (k < c->window) && (next < count); k++) {
+			if (slots[k].busy)
+				continue;
+
+			slots[k].busy = 1;
+			slots[k].seq = client_seq(c);
+			slots[k].pos = pos[next++];
+			slots[k].len = (bench_common.blobsz - slots[k].pos < chunk) ? bench_common.blobsz - slots[k].pos : chunk;
+			pending++;
+
+			if ((err = client_io(c, type, h, &slots[k])) < 0)
+				return err;
+		}
+
+		if ((n = link_recv(&c->l, &rtype, &rseq, c->rbuff, LINK_MAXLEN, BENCH_TIMEOUT)) == ERR_SERIAL_TIMEOUT) {
+			if (++retries > BENCH_RETRIES)
+				return n;
+
+			for (k = 0; k < c->window; k++) {
+				if (slots[k].busy && ((err = client_io(c, type, h, &slots[k])) < 0))
+					return err;
+			}
+			continue;
+		}
+		if (n < 0)
+			return n;
+
+		for (k = 0; k < c->window; k++) {
+			if (slots[k].busy && (slots[k].seq == rseq))
+				break;
+		}
+
+		/* Duplicated answers and beacons */
+		if ((k == c->window) || (rtype != type))
+			continue;
+
+		if ((err = client_check(c, type, &slots[k], bench_common.blob, n)) < 0)
+			return err;
+
+		stats_add(lat, stats_now() - slots[k].t);
+		*bytes += slots[k].len;
+		slots[k].busy = 0;
+		pending--;
+		done++;
+		retries = 0;
+	}
+
+	return ERR_NONE;
+}
+
+
+static int bench_transfer(client_t *c, u32 test, stats_t *lat, unsigned long long *bytes, unsigned long long *reqs)
+{
+	unsigned int chunk = c->maxlen - PHFS_IOHDRSZ, count, k;
+	u32 h, *pos, seed = 7;
+	u16 type = MSG_READ;
+	int err;
+
+	count = (bench_common.blobsz + chunk - 1) / chunk;
+	if ((pos = malloc(count * sizeof(*pos))) == NULL)
+		return ERR_MEM;
+
+	for (k = 0; k < count; k++) {
+		pos[k] = k * chunk;
+		if (test == TEST_RAND) {
+			seed = seed * 1103515245u + 12345u;
+			pos[k] = ((seed >> 8) % count) * chunk;
+		}
+	}
+
+	if (test == TEST_WRITE) {
+		type = MSG_WRITE;
+		err = client_open(c, "out", PHFS_RDWR | PHFS_CREATE, &h);
+	}
+	else {
+		err = client_open(c, "blob", PHFS_RDONLY, &h);
+	}
+
+	if (err == ERR_NONE) {
+		err = client_pipeline(c, type, h, pos, count, chunk, lat, bytes);
+		client_close(c, h);
+	}
+
+	*reqs = count;
+	free(pos);
+
+	return err;
+}
+
+
+static int bench_open(client_t *c, stats_t *lat, unsigned long long *bytes, unsigned long long *reqs)
+{
+	unsigned int chunk = c->maxlen - PHFS_IOHDRSZ, k;
+	u8 ref[BENCH_SMALLSZ];
+	slot_t s = { 0 };
+	char path[64];
+	unsigned long long t;
+	bench_io_t io;
+	u32 h;
+	int n, err;
+
+	/* Small files are opened, read and closed one by one as during target boot */
+	for (k = 0; k < bench_common.nfiles; k++) {
+		snprintf(path, sizeof(path), "small/f%04u", k);
+		bench_fill(ref, sizeof(ref), k + 3);
+		t = stats_now();
+
+		if ((err = client_open(c, path, PHFS_RDONLY, &h)) < 0)
+			return err;
+
+		for (s.pos = 0; s.pos < sizeof(ref); s.pos += s.len) {
+			s.len = (sizeof(ref) - s.pos < chunk) ? sizeof(ref) - s.pos : chunk;
+			io.handle = h;
+			io.pos = s.pos;
+			io.len = s.len;
+
+			if ((n = client_call(c, MSG_READ, &io, sizeof(io), c->rbuff, LINK_MAXLEN)) < 0)
+				return n;
+			if ((err = client_check(c, MSG_READ, &s, ref, n)) < 0)
+				return err;
+			(*reqs)++;
+		}
+
+		if ((err = client_close(c, h)) < 0)
+			return err;
+
+		stats_add(lat, stats_now() - t);
+		*bytes += sizeof(ref);
+		*reqs += 2;
+	}
+
+	return ERR_NONE;
+}
+
+
+/* Function writes file through one handle and reads it back through another one opened before */
+static int bench_shared(client_t *c, stats_t *lat, unsigned long long *bytes, unsigned long long *reqs)
+{
+	unsigned int chunk = c->maxlen - PHFS_IOHDRSZ, count, k;
+	bench_io_t *io = (bench_io_t *)c->sbuff;
+	slot_t s = { 0 };
+	unsigned long long t;
+	u32 hw, hr;
+	int n, err;
+
+	count = (bench_common.blobsz + chunk - 1) / chunk;
+	if (count > 256)
+		count = 256;
+
+	if ((err = client_open(c, "shared", PHFS_RDWR | PHFS_CREATE, &hw)) < 0)
+		return err;
+
+	if ((err = client_open(c, "shared", PHFS_RDONLY, &hr)) < 0) {
+		client_close(c, hw);
+		return err;
+	}
+
+	for (k = 0; (err == ERR_NONE) && (k < count); k++) {
+		s.pos = k * chunk;
+		s.len = (bench_common.blobsz - s.pos < chunk) ? bench_common.blobsz - s.pos : chunk;
+		t = stats_now();
+
+		/* Write is acknowledged from write-behind buffer, read has to see it anyway */
+		io->handle = hw;
+		io->pos = s.pos;
+		io->len = s.len;
+		memcpy(c->sbuff + PHFS_IOHDRSZ, bench_common.blob + s.pos, s.len);
+		if ((n = client_call(c, MSG_WRITE, c->sbuff, PHFS_IOHDRSZ + s.len, c->rbuff, LINK_MAXLEN)) < 0)
+			err = n;
+		else
+			err = client_check(c, MSG_WRITE, &s, bench_common.blob, n);
+
+		if (err == ERR_NONE) {
+			io->handle = hr;
+			io->pos = s.pos;
+			io->len = s.len;
+			if ((n = client_call(c, MSG_READ, c->sbuff, PHFS_IOHDRSZ, c->rbuff, LINK_MAXLEN)) < 0)
+				err = n;
+			else
+				err = client_check(c, MSG_READ, &s, bench_common.blob, n);
+		}
+
+		stats_add(lat, stats_now() - t);
+		*bytes += 2 * s.len;
+		*reqs += 2;
+	}
+
+	client_close(c, hr);
+	client_close(c, hw);
+	*reqs += 4;
+
+	return err;
+}
+
+
+/*
+ * Results
+ */
+
+
+static void bench_result(const char *transport, const char *test, stats_t *lat, unsigned long long bytes, unsigned long long reqs,
+	unsigned long long us, unsigned long long sys)
+{
+	result_t *r;
+
+	if (bench_common.nresults == BENCH_MAXRESULTS)
+		return;
+
+	r = &bench_common.results[bench_common.nresults++];
+	snprintf(r->name, sizeof(r->name), "%s.%s", transport, test);
+
+	if (us == 0)
+		us = 1;
+
+	r->mbps = (double)bytes / us;
+	r->rps = reqs * 1000000.0 / us;
+	r->p50 = stats_pct(lat, 50);
+	r->p90 = stats_pct(lat, 90);
+	r->p99 = stats_pct(lat, 99);
+	r->max = stats_pct(lat, 100);
+	r->sysmb = (bytes == 0) ? 0 : sys * 1048576.0 / bytes;
+
+	printf("%-16s %10.2f %10.0f %8u %8u %8u %8u %10.1f\n", r->name, r->mbps, r->rps, r->p50, r->p90, r->p99, r->max, r->sysmb);
+	fflush(stdout);
+}
+
+
+static int bench_phfs(int type, unsigned int tests)
+{
+	static const struct {
+		u32 test;
+		const char *name;
+	} phfstests[] = { { TEST_SEQ, "seq" }, { TEST_RAND, "rand" }, { TEST_OPEN, "open" }, { TEST_WRITE, "write" },
+		{ TEST_SHARED, "shared" } };
+
+	char *argv[] = { "-e", "-s", bench_common.sysdir, NULL };
+	unsigned long long t, bytes, reqs, sys0, sys1;
+	stats_t lat = { 0 };
+	unsigned int k;
+	client_t c;
+	int err;
+
+	memset(&c, 0, sizeof(c));
+
+	if (((c.rbuff = malloc(LINK_MAXLEN)) == NULL) || ((c.sbuff = malloc(LINK_MAXLEN)) == NULL)) {
+		free(c.rbuff);
+		return ERR_MEM;
+	}
+
+	if ((err = link_open(&c.l, type, bench_common.phoenixd, bench_common.dir, bench_common.forked ? argv + 1 : argv)) < 0) {
+		fprintf(stderr, "phfsbench: can't start phoenixd on %s [%d]\n", link_name(type), err);
+	}
+	else if ((err = client_hello(&c)) < 0) {
+		fprintf(stderr, "phfsbench: %s MSG_HELLO failed [%d]\n", link_name(type), err);
+	}
+
+	for (k = 0; (err == ERR_NONE) && (k < sizeof(phfstests) / sizeof(phfstests[0])); k++) {
+		if (!(tests & phfstests[k].test))
+			continue;
+
+		bytes = 0;
+		reqs = 0;
+		sys0 = sys1 = 0;
+		link_syscalls(&c.l, &sys0);
+		t = stats_now();
+
+		if (phfstests[k].test == TEST_OPEN)
+			err = bench_open(&c, &lat, &bytes, &reqs);
+		else if (phfstests[k].test == TEST_SHARED)
+			err = bench_shared(&c, &lat, &bytes, &reqs);
+		else
+			err = bench_transfer(&c, phfstests[k].test, &lat, &bytes, &reqs);
+
+		t = stats_now() - t;
+		link_syscalls(&c.l, &sys1);
+
+		if (err < 0)
+			fprintf(stderr, "phfsbench: %s.%s failed [%d]\n", link_name(type), phfstests[k].name, err);
+		else
+			bench_result(link_name(type), phfstests[k].name, &lat, bytes, reqs, t, sys1 - sys0);
+
+		stats_free(&lat);
+	}
+
+	if (c.l.frame != NULL)
+		link_close(&c.l);
+	free(c.rbuff);
+	free(c.sbuff);
+
+	return err;
+}
+
+
+static int bench_bsp(unsigned int window)
+{
+	char kernel[PATH_MAX], name[16];
+	char *argv[] = { "-1", "-k", kernel, "-s", bench_common.sysdir, NULL };
+	unsigned long long t, sys0 = 0, sys1 = 0;
+	stats_t lat = { 0 };
+	size_t len;
+	u8 *buff;
+	link_t l;
+	int err;
+
+	bench_path(kernel, sizeof(kernel), "kernel");
+
+	if ((buff = malloc(bench_common.kernelsz)) == NULL)
+		return ERR_MEM;
+
+	/* BSP is served on serial devices only */
+	if ((err = link_open(&l, LINK_PTY, bench_common.phoenixd, bench_common.dir, argv)) < 0) {
+		fprintf(stderr, "phfsbench: can't start phoenixd on pty [%d]\n", err);
+		free(buff);
+		return err;
+	}
+
+	link_syscalls(&l, &sys0);
+	t = stats_now();
+
+	if (((err = bspsim_kernel(&l, window, buff, bench_common.kernelsz, &len, &lat)) == ERR_NONE) &&
+		((len != bench_common.kernelsz) || (memcmp(buff, bench_common.kernel, len) != 0)))
+		err = ERR_MSG_IO;
+
+	t = stats_now() - t;
+	link_syscalls(&l, &sys1);
+
+	snprintf(name, sizeof(name), "bsp%u", window);
+	if (err < 0)
+		fprintf(stderr, "phfsbench: pty.%s failed [%d]\n", name, err);
+	else
+		bench_result("pty", name, &lat, len, lat.n, t, sys1 - sys0);
+
+	stats_free(&lat);
+	link_close(&l);
+	free(buff);
+
+	return err;
+}
+
+
+static int bench_save(const char *path)
+{
+	unsigned int k;
+	result_t *r;
+	FILE *f;
+
+	if ((f = fopen(path, "w")) == NULL)
+		return ERR_FILE;
+
+	fprintf(f, "# name MB/s req/s p50 p90 p99 max sys/MB\n");
+	for (k = 0; k < bench_common.nresults; k++) {
+		r = &bench_common.results[k];
+		fprintf(f, "%s %.3f %.1f %u %u %u %u %.2f\n", r->name, r->mbps, r->rps, r->p50, r->p90, r->p99, r->max, r->sysmb);
+	}
+
+	return (fclose(f) == 0) ? ERR_NONE : ERR_FILE;
+}
+
+
+/* Function compares results with baseline, returns number of regressions */
+static int bench_compare(const char *path, double tolerance)
+{
+	char line[256];
+	unsigned int k;
+	int regressions = 0;
+	result_t b, *r;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return ERR_FILE;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((line[0] == '#') || (sscanf(line, "%31s %lf %lf %u %u %u %u %lf", b.name, &b.mbps, &b.rps, &b.p50, &b.p90, &b.p99, &b.max, &b.sysmb) != 8))
+			continue;
+
+		for (k = 0; (k < bench_common.nresults) && (strcmp(bench_common.results[k].name, b.name) != 0); k++)
+			;
+		if (k == bench_common.nresults)
+			continue;
+		r = &bench_common.results[k];
+
+		/* Throughput is what regresses, latency and system calls follow it */
+		if (r->mbps < b.mbps * (1 - tolerance / 100)) {
+			printf("REGRESSION %s: %.2f MB/s, baseline %.2f MB/s\n", r->name, r->mbps, b.mbps);
+			regressions++;
+		}
+		else if ((b.sysmb > 0) && (r->sysmb > b.sysmb * (1 + tolerance / 100))) {
+			printf("REGRESSION %s: %.1f syscalls/MB, baseline %.1f\n", r->name, r->sysmb, b.sysmb);
+			regressions++;
+		}
+	}
+
+	fclose(f);
+
+	return regressions;
+}
+
+
+static int bench_tests(char *list, unsigned int *tests)
+{
+	static const char *names[] = { "seq", "rand", "open", "write", "kernel", "shared" };
+	unsigned int k;
+	char *tok;
+
+	*tests = 0;
+	for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		for (k = 0; (k < sizeof(names) / sizeof(names[0])) && (strcmp(tok, names[k]) != 0); k++)
+			;
+		if (k == sizeof(names) / sizeof(names[0]))
+			return ERR_ARG;
+		*tests |= 1u << k;
+	}
+
+	return ERR_NONE;
+}
+
+
+static int bench_transports(char *list, unsigned int *transports)
+{
+	char *tok;
+	int type;
+
+	*transports = 0;
+	for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if ((type = link_type(tok)) < 0)
+			return ERR_ARG;
+		*transports |= 1u << type;
+	}
+
+	return ERR_NONE;
+}
+
+
+static void usage(char *progname)
+{
+	fprintf(stderr, "usage: %s [-d phoenixd] [-x transports] [-t tests] [-s size_MB] [-n files] [-k kernel_KB]\n"
+		"\t[-M maxlen] [-w window] [-z] [-W bsp_window] [-f] [-o results] [-c baseline] [-T tolerance]\n"
+		"       %s [-d phoenixd] [-x transport] -r capture -D sysdir [-N session] [-R]\n\n"
+		"\t-d, --phoenixd     phoenixd binary (default: phoenixd from PATH)\n"
+		"\t-x, --transports   comma separated list of pipe, tcp, udp, pty, qemu (default: all)\n"
+		"\t-t, --tests        comma separated list of seq, rand, open, write, kernel, shared (default: all)\n"
+		"\t-s, --size         size of file read and written by target in MB (default: 16)\n"
+		"\t-n, --files        number of small files opened by target (default: 1000)\n"
+		"\t-k, --kernel       size of kernel loaded with BSP in KB (default: 1024)\n"
+		"\t-M, --maxlen       frame payload requested with MSG_HELLO, 0 - legacy target (default: 65532)\n"
+		"\t-w, --window       number of outstanding requests (default: 8)\n"
+		"\t-z, --lz4          request compressed reads\n"
+		"\t-W, --bspwindow    BSP window of fast kernel test (default: 8)\n"
+		"\t-f, --forked       run phoenixd sessions in child processes instead of event loop\n"
+		"\t-o, --output       save results to file\n"
+		"\t-c, --compare      compare results with saved baseline, exit status is non-zero on regression\n"
+		"\t-T, --tolerance    allowed regression in percent (default: 10)\n"
+		"\t-r, --replay       replay session captured with phoenixd -C against sysdir\n"
+		"\t-D, --sysdir       sysdir served during replay\n"
+		"\t-N, --session      number of replayed session (default: 1)\n"
+		"\t-R, --realtime     keep captured timing of requests\n"
+		"\t-h, --help         this help\n", progname, progname);
+}
+
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "phoenixd", required_argument, 0, 'd' },
+		{ "transports", required_argument, 0, 'x' },
+		{ "tests", required_argument, 0, 't' },
+		{ "size", required_argument, 0, 's' },
+		{ "files", required_argument, 0, 'n' },
+		{ "kernel", required_argument, 0, 'k' },
+		{ "maxlen", required_argument, 0, 'M' },
+		{ "window", required_argument, 0, 'w' },
+		{ "lz4", no_argument, 0, 'z' },
+		{ "bspwindow", required_argument, 0, 'W' },
+		{ "forked", no_argument, 0, 'f' },
+		{ "output", required_argument, 0, 'o' },
+		{ "compare", required_argument, 0, 'c' },
+		{ "tolerance", required_argument, 0, 'T' },
+		{ "replay", required_argument, 0, 'r' },
+		{ "sysdir", required_argument, 0, 'D' },
+		{ "session", required_argument, 0, 'N' },
+		{ "realtime", no_argument, 0, 'R' },
+		{ "help", no_argument, 0, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+	unsigned int transports = (1u << LINK_TYPES) - 1, tests = TEST_SEQ | TEST_RAND | TEST_OPEN | TEST_WRITE | TEST_KERNEL | TEST_SHARED;
+	const char *output = NULL, *baseline = NULL, *capture = NULL;
+	char *sysdir = NULL;
+	unsigned int session = 1;
+	double tolerance = 10;
+	int realtime = 0;
+	int c, type, err, failed = 0;
+
+	bench_common.phoenixd = "phoenixd";
+	bench_common.blobsz = 16 << 20;
+	bench_common.kernelsz = 1 << 20;
+	bench_common.nfiles = 1000;
+	bench_common.maxlen = LINK_MAXLEN;
+	bench_common.window = 8;
+	bench_common.bspwin = 8;
+
+	while ((c = getopt_long(argc, argv, "d:x:t:s:n:k:M:w:zW:fo:c:T:r:D:N:Rh", opts, NULL)) != -1) {
+		switch (c) {
+			case 'd':
+				bench_common.phoenixd = optarg;
+				break;
+			case 'x':
+				if (bench_transports(optarg, &transports) < 0) {
+					fprintf(stderr, "phfsbench: unknown transport\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't':
+				if (bench_tests(optarg, &tests) < 0) {
+					fprintf(stderr, "phfsbench: unknown test\n");
+					return EXIT_FAILURE;
+				}
+				break;
+			case 's':
+				bench_common.blobsz = strtoul(optarg, NULL, 0) << 20;
+				break;
+			case 'n':
+				bench_common.nfiles = strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				bench_common.kernelsz = strtoul(optarg, NULL, 0) << 10;
+				break;
+			case 'M':
+				bench_common.maxlen = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				bench_common.window = strtoul(optarg, NULL, 0);
+				break;
+			case 'z':
+				bench_common.caps |= PHFS_CAP_LZ4;
+				break;
+			case 'W':
+				bench_common.bspwin = strtoul(optarg, NULL, 0);
+				break;
+			case 'f':
+				bench_common.forked = 1;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'c':
+				baseline = optarg;
+				break;
+			case 'T':
+				tolerance = strtod(optarg, NULL);
+				break;
+			case 'r':
+				capture = optarg;
+				break;
+			case 'D':
+				sysdir = optarg;
+				break;
+			case 'N':
+				session = strtoul(optarg, NULL, 0);
+				break;
+			case 'R':
+				realtime = 1;
+				break;
+			case 'h':
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if ((bench_common.blobsz == 0) || (bench_common.kernelsz == 0) || (bench_common.nfiles > 10000) ||
+		((bench_common.maxlen != 0) && ((bench_common.maxlen <= PHFS_IOHDRSZ) || (bench_common.maxlen > LINK_MAXLEN)))) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Captured session is replayed on first selected transport */
+	if (capture != NULL) {
+		if (sysdir == NULL) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		for (type = 0; (type < LINK_TYPES - 1) && !(transports & (1u << type)); type++)
+			;
+
+		if ((err = bench_tmpdir()) == ERR_NONE)
+			err = replay_run(capture, session, type, bench_common.phoenixd, bench_common.dir, sysdir, realtime);
+		bench_cleanup();
+
+		return (err == ERR_NONE) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if ((err = bench_prepare()) < 0) {
+		fprintf(stderr, "phfsbench: can't prepare sysdir [%d]\n", err);
+		bench_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	printf("%-16s %10s %10s %8s %8s %8s %8s %10s\n", "test", "MB/s", "req/s", "p50us", "p90us", "p99us", "maxus", "sys/MB");
+
+	for (type = 0; type < LINK_TYPES; type++) {
+		if ((transports & (1u << type)) && (tests & ~TEST_KERNEL) && (bench_phfs(type, tests) < 0))
+			failed++;
+	}
+
+	if ((transports & (1u << LINK_PTY)) && (tests & TEST_KERNEL)) {
+		if (bench_bsp(1) < 0)
+			failed++;
+		if ((bench_common.bspwin > 1) && (bench_bsp(bench_common.bspwin) < 0))
+			failed++;
+	}
+
+	bench_cleanup();
+	free(bench_common.blob);
+	free(bench_common.kernel);
+
+	if ((output != NULL) && (bench_save(output) < 0)) {
+		fprintf(stderr, "phfsbench: can't save results to %s\n", output);
+		failed++;
+	}
+
+	if ((baseline != NULL) && ((err = bench_compare(baseline, tolerance)) != 0)) {
+		if (err < 0)
+			fprintf(stderr, "phfsbench: can't read baseline %s\n", baseline);
+		failed++;
+	}
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,282 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Replay of sessions captured by phoenixd
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hostutils-common/errors.h>
+#include "replay.h"
+#include "link.h"
+#include "stats.h"
+
+
+#define PCAPNG_SHB      0x0a0d0d0a
+#define PCAPNG_IDB      0x00000001
+#define PCAPNG_EPB      0x00000006
+#define PCAPNG_BOM      0x1a2b3c4d
+#define PCAPNG_COMMENT  1
+
+#define REPLAY_MAXSESSIONS 256
+
+
+typedef struct {
+	const replay_hdr_t *h;
+	const u8 *data;
+	unsigned int len;
+	unsigned long long t;
+} replay_frame_t;
+
+
+typedef struct {
+	u32 pid;
+	u16 session;
+	u8 mode;
+	char addr[64];
+	unsigned int nframes;
+} replay_session_t;
+
+
+static u32 replay_get32(const u8 *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+
+static u8 *replay_load(const char *path, size_t *size)
+{
+	size_t sz = 0, n;
+	u8 *buff = NULL, *p;
+	FILE *f;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return NULL;
+
+	for (*size = 0; !feof(f) && !ferror(f); *size += n) {
+		if (*size == sz) {
+			if ((p = realloc(buff, sz + (1 << 20))) == NULL)
+				break;
+			buff = p;
+			sz += 1 << 20;
+		}
+		n = fread(buff + *size, 1, sz - *size, f);
+	}
+
+	if (ferror(f) || !feof(f)) {
+		free(buff);
+		buff = NULL;
+	}
+	fclose(f);
+
+	return buff;
+}
+
+
+/* Function parses capture, returns number of frames of selected session stored in frames (NULL - sessions are listed) */
+static int replay_parse(const u8 *buff, size_t size, replay_session_t *sessions, unsigned int *nsessions, unsigned int n, replay_frame_t *frames)
+{
+	unsigned int nframes = 0, k, olen;
+	size_t offs = 0;
+	u32 type, len, caplen;
+	const replay_hdr_t *h;
+	const u8 *opt;
+	u16 code, l;
+
+	if ((size < 12) || (replay_get32(buff) != PCAPNG_SHB) || (replay_get32(buff + 8) != PCAPNG_BOM)) {
+		fprintf(stderr, "phfsbench: not a little endian pcapng file\n");
+		return ERR_FILE;
+	}
+
+	for (; offs + 12 <= size; offs += len) {
+		type = replay_get32(buff + offs);
+		len = replay_get32(buff + offs + 4);
+		if ((len < 12) || (len & 3) || (len > size - offs))
+			return ERR_FILE;
+
+		if ((type == PCAPNG_IDB) && ((replay_get32(buff + offs + 8) & 0xffff) != REPLAY_LINKTYPE)) {
+			fprintf(stderr, "phfsbench: capture doesn't come from phoenixd\n");
+			return ERR_FILE;
+		}
+
+		if ((type != PCAPNG_EPB) || (len < 32))
+			continue;
+
+		caplen = replay_get32(buff + offs + 20);
+		if ((caplen < sizeof(*h)) || (caplen > len - 32))
+			return ERR_FILE;
+		h = (const replay_hdr_t *)(buff + offs + 28);
+
+		for (k = 0; k < *nsessions; k++) {
+			if ((sessions[k].pid == h->pid) && (sessions[k].session == h->session))
+				break;
+		}
+
+		if (k == *nsessions) {
+			if (k == REPLAY_MAXSESSIONS)
+				continue;
+
+			memset(&sessions[k], 0, sizeof(sessions[k]));
+			sessions[k].pid = h->pid;
+			sessions[k].session = h->session;
+			sessions[k].mode = h->mode;
+			(*nsessions)++;
+
+			/* Session address is stored in comment of its first frame */
+			for (opt = buff + offs + 28 + ((caplen + 3) & ~3u); opt + 4 <= buff + offs + len - 4; opt += 4 + ((l + 3) & ~3u)) {
+				memcpy(&code, opt, sizeof(code));
+				memcpy(&l, opt + 2, sizeof(l));
+				if ((code == 0) || (opt + 4 + l > buff + offs + len - 4))
+					break;
+				if (code == PCAPNG_COMMENT) {
+					olen = (l < sizeof(sessions[k].addr)) ? l : sizeof(sessions[k].addr) - 1;
+					memcpy(sessions[k].addr, opt + 4, olen);
+				}
+			}
+		}
+		sessions[k].nframes++;
+
+		if ((frames != NULL) && (k + 1 == n)) {
+			frames[nframes].h = h;
+			frames[nframes].data = (const u8 *)(h + 1);
+			frames[nframes].len = caplen - sizeof(*h);
+			frames[nframes].t = ((unsigned long long)replay_get32(buff + offs + 12) << 32) | replay_get32(buff + offs + 16);
+			nframes++;
+		}
+	}
+
+	return nframes;
+}
+
+
+static int replay_session(link_t *l, replay_frame_t *frames, unsigned int nframes, int realtime)
+{
+	unsigned long long t0, t, *sent, captured;
+	unsigned int k, requests = 0, lost = 0, mismatched = 0;
+	stats_t lat = { 0 };
+	u16 type, seq;
+	u8 *buff;
+	int n, err = ERR_NONE;
+
+	if (((sent = calloc(0x10000, sizeof(*sent))) == NULL) || ((buff = malloc(LINK_MAXLEN)) == NULL)) {
+		free(sent);
+		return ERR_MEM;
+	}
+
+	t0 = stats_now();
+
+	for (k = 0; k < nframes; k++) {
+		/* Request is sent, reply which followed it in capture is awaited */
+		if (frames[k].h->dir == REPLAY_RX) {
+			if (realtime && ((t = t0 + frames[k].t - frames[0].t) > stats_now()))
+				usleep(t - stats_now());
+
+			sent[frames[k].h->seq] = stats_now();
+			if ((err = link_send(l, frames[k].h->type, frames[k].h->seq, frames[k].data, frames[k].len)) < 0)
+				break;
+			requests++;
+			continue;
+		}
+
+		if ((n = link_recv(l, &type, &seq, buff, LINK_MAXLEN, REPLAY_TIMEOUT)) == ERR_SERIAL_TIMEOUT) {
+			lost++;
+			continue;
+		}
+		if ((err = n) < 0)
+			break;
+		err = ERR_NONE;
+
+		/* Contents may differ (handles, changed files), only shape of traffic is compared */
+		if ((type != frames[k].h->type) || (seq != frames[k].h->seq) || (n != (int)frames[k].len))
+			mismatched++;
+
+		if (sent[seq] != 0)
+			stats_add(&lat, stats_now() - sent[seq]);
+	}
+
+	t = stats_now() - t0;
+	captured = (nframes > 0) ? frames[nframes - 1].t - frames[0].t : 0;
+
+	printf("replayed %u requests in %llu ms (captured %llu ms), latency p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+		requests, t / 1000, captured / 1000, stats_pct(&lat, 50), stats_pct(&lat, 90), stats_pct(&lat, 99), stats_pct(&lat, 100));
+	printf("replies: %u received, %u lost, %u differ from capture\n", lat.n, lost, mismatched);
+
+	stats_free(&lat);
+	free(sent);
+	free(buff);
+
+	if (err < 0)
+		return err;
+
+	return (lost == 0) ? ERR_NONE : ERR_MSG_IO;
+}
+
+
+int replay_run(const char *path, unsigned int n, int type, const char *phoenixd, const char *dir, char *sysdir, int realtime)
+{
+	replay_session_t sessions[REPLAY_MAXSESSIONS];
+	char *argv[] = { "-e", "-s", sysdir, NULL };
+	unsigned int nsessions = 0, k;
+	replay_frame_t *frames;
+	size_t size;
+	link_t l;
+	u8 *buff;
+	int err;
+
+	if ((buff = replay_load(path, &size)) == NULL) {
+		fprintf(stderr, "phfsbench: can't read %s\n", path);
+		return ERR_FILE;
+	}
+
+	if ((err = replay_parse(buff, size, sessions, &nsessions, 0, NULL)) < 0) {
+		free(buff);
+		return err;
+	}
+
+	for (k = 0; k < nsessions; k++) {
+		printf("%c session %u: pid %u #%u %s, %u frames\n", (k + 1 == n) ? '*' : ' ', k + 1, sessions[k].pid, sessions[k].session,
+			sessions[k].addr, sessions[k].nframes);
+	}
+
+	if ((n == 0) || (n > nsessions)) {
+		fprintf(stderr, "phfsbench: no session %u in capture\n", n);
+		free(buff);
+		return ERR_ARG;
+	}
+
+	if ((frames = malloc(sessions[n - 1].nframes * sizeof(*frames))) == NULL) {
+		free(buff);
+		return ERR_MEM;
+	}
+
+	nsessions = 0;
+	k = replay_parse(buff, size, sessions, &nsessions, n, frames);
+
+	if ((err = link_open(&l, type, phoenixd, dir, argv)) < 0) {
+		fprintf(stderr, "phfsbench: can't start phoenixd on %s [%d]\n", link_name(type), err);
+	}
+	else {
+		err = replay_session(&l, frames, k, realtime);
+		link_close(&l);
+	}
+
+	free(frames);
+	free(buff);
+
+	return err;
+}
@@ -0,0 +1,47 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Replay of sessions captured by phoenixd
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <hostutils-common/types.h>
+
+
+/* Capture format (same as phoenixd capture.h) */
+#define REPLAY_LINKTYPE  147
+#define REPLAY_RX        1
+#define REPLAY_TX        2
+
+/* Time waited for reply which was captured (ms) */
+#define REPLAY_TIMEOUT   2000
+
+
+typedef struct _replay_hdr_t {
+	u32 pid;
+	u16 session;
+	u8 mode;
+	u8 dir;
+	u16 type;
+	u16 seq;
+} replay_hdr_t;
+
+
+/*
+ * Function plays target side of n-th captured session (1 - first one) against phoenixd serving sysdir,
+ * requests are sent as fast as captured replies arrive or with original timing (realtime)
+ */
+extern int replay_run(const char *path, unsigned int n, int type, const char *phoenixd, const char *dir, char *sysdir, int realtime);
+
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Latency statistics
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <hostutils-common/errors.h>
+#include "stats.h"
+
+
+unsigned long long stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+int stats_add(stats_t *s, unsigned int us)
+{
+	unsigned int *p;
+
+	if (s->n == s->size) {
+		if ((p = realloc(s->us, ((s->size == 0) ? 1024 : 2 * s->size) * sizeof(*p))) == NULL)
+			return ERR_MEM;
+		s->us = p;
+		s->size = (s->size == 0) ? 1024 : 2 * s->size;
+	}
+
+	s->us[s->n++] = us;
+	s->sorted = 0;
+
+	return ERR_NONE;
+}
+
+
+static int stats_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+unsigned int stats_pct(stats_t *s, unsigned int p)
+{
+	if (s->n == 0)
+		return 0;
+
+	if (!s->sorted) {
+		qsort(s->us, s->n, sizeof(*s->us), stats_cmp);
+		s->sorted = 1;
+	}
+
+	/* Nearest rank */
+	return s->us[(p >= 100) ? s->n - 1 : (unsigned long long)s->n * p / 100];
+}
+
+
+void stats_free(stats_t *s)
+{
+	free(s->us);
+	s->us = NULL;
+	s->n = 0;
+	s->size = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phfsbench - PHFS/BSP benchmark with simulated target
+ *
+ * Latency statistics
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+
+typedef struct _stats_t {
+	unsigned int n;
+	unsigned int size;
+	unsigned int *us;         /* samples in microseconds */
+	int sorted;
+} stats_t;
+
+
+/* Function returns monotonic time in microseconds */
+extern unsigned long long stats_now(void);
+
+
+/* Function records sample */
+extern int stats_add(stats_t *s, unsigned int us);
+
+
+/* Function returns percentile (0 - 100) of recorded samples */
+extern unsigned int stats_pct(stats_t *s, unsigned int p);
+
+
+/* Function releases samples */
+extern void stats_free(stats_t *s);
+
+
+#endif
@@ -0,0 +1,558 @@
+/*
+ * Phoenix-RTOS
+ *
+ * phimg - one-pass image pipeline
+ *
+ * Generates syspage, embeds ELF checksums and writes partition table
+ * into a single mapping of the image, then optionally uploads it via SDP
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <hostutils-common/sdp.h>
+
+#include "../syspagen/sysgen.h"
+#include "../metaelf/crc32.h"
+#include "../metaelf/metaelf.h"
+#include "../psdisk/ptab.h"
+
+
+/* Explicitly declared ELF region, size 0 - taken from ELF header */
+typedef struct {
+	unsigned long long offs;
+	unsigned long long size;
+} phimg_elf_t;
+
+
+static struct {
+	const char *imgName;
+	int fd;
+	uint8_t *img;
+	size_t imgsz;
+	int quiet;
+
+	/* Syspage */
+	sysgen_opts_t sysgen;
+	int syspage;
+
+	/* ELF checksums */
+	int crcAliases;
+	phimg_elf_t *elfs;
+	unsigned int nelfs;
+	unsigned int ncrc;
+
+	/* Partition table */
+	long long ptoffs;
+	uint32_t memsz;
+	uint32_t blksz;
+	ptable_part_t *parts;
+	uint32_t nparts;
+
+	/* SDP upload */
+	int upload;
+	uint16_t vid;
+	uint16_t pid;
+	uint32_t addr;
+	int jump;
+	uint32_t jaddr;
+} phimg_common;
+
+
+static void phimg_help(const char *prog)
+{
+	printf("Usage: %s -i <image> [options]\n", prog);
+	printf("Syspage (as in syspagen):\n");
+	printf("\t-a <arch>                  - target architecture (32 or 64)\n");
+	printf("\t-s <pimg:offs:sz>          - syspage properties\n");
+	printf("\t-p <path>                  - path to preinit script\n");
+	printf("\t-u <path>                  - path to user script\n");
+	printf("ELF checksums (as in metaelf -w):\n");
+	printf("\t-c                         - embed CRC32 into ELF files placed at aliases of user script\n");
+	printf("\t-e <offs[:size]>           - embed CRC32 into ELF file placed at image offset\n");
+	printf("Partition table (as in psdisk):\n");
+	printf("\t-t <offs>                  - partition table offset in image\n");
+	printf("\t-m <mem-size,block-size>   - memory parameters\n");
+	printf("\t-P <name,offset,size,type> - declare partition\n");
+	printf("Upload:\n");
+	printf("\t-U <vid:pid:addr>          - send image to device with SDP WRITE_FILE\n");
+	printf("\t-x <addr>                  - jump to address after upload\n");
+	printf("Options:\n");
+	printf("\t-q                         - quiet mode\n");
+	printf("\t-h                         - print help message\n");
+}
+
+
+static int phimg_parseNum(const char *arg, char term, unsigned long long *val, char **end)
+{
+	char *endptr;
+
+	errno = 0;
+	*val = strtoull(arg, &endptr, 0);
+	if ((errno != 0) || (endptr == arg) || (*endptr != term)) {
+		return -1;
+	}
+
+	if (end != NULL) {
+		*end = endptr;
+	}
+
+	return 0;
+}
+
+
+static int phimg_addElf(const char *arg)
+{
+	phimg_elf_t *elfs;
+	unsigned long long offs, size = 0;
+	char *end;
+
+	if ((phimg_parseNum(arg, ':', &offs, &end) < 0) || (phimg_parseNum(end + 1, '\0', &size, NULL) < 0)) {
+		if (phimg_parseNum(arg, '\0', &offs, NULL) < 0) {
+			fprintf(stderr, "Invalid ELF region - %s\n", arg);
+			return -1;
+		}
+	}
+
+	elfs = realloc(phimg_common.elfs, (phimg_common.nelfs + 1) * sizeof(*elfs));
+	if (elfs == NULL) {
+		return -1;
+	}
+
+	elfs[phimg_common.nelfs].offs = offs;
+	elfs[phimg_common.nelfs].size = size;
+	phimg_common.elfs = elfs;
+	phimg_common.nelfs++;
+
+	return 0;
+}
+
+
+static int phimg_addPart(const char *arg)
+{
+	ptable_part_t *parts;
+
+	parts = realloc(phimg_common.parts, (phimg_common.nparts + 1) * sizeof(*parts));
+	if (parts == NULL) {
+		return -1;
+	}
+	phimg_common.parts = parts;
+
+	if (ptab_parsePart(arg, &parts[phimg_common.nparts]) < 0) {
+		return -1;
+	}
+	phimg_common.nparts++;
+
+	return 0;
+}
+
+
+static int phimg_parseArgs(int argc, char *argv[])
+{
+	unsigned long long val, val2, val3;
+	char *end;
+	int opt;
+
+	phimg_common.ptoffs = -1;
+
+	while ((opt = getopt(argc, argv, "i:a:s:p:u:ce:t:m:P:U:x:qh")) != -1) {
+		switch (opt) {
+			case 'i':
+				phimg_common.imgName = optarg;
+				break;
+
+			case 'a':
+				phimg_common.sysgen.arch = optarg;
+				phimg_common.syspage = 1;
+				break;
+
+			case 's':
+				if (sysgen_parseProps(optarg, &phimg_common.sysgen) < 0) {
+					return -1;
+				}
+				phimg_common.syspage = 1;
+				break;
+
+			case 'p':
+				phimg_common.sysgen.preinitScript = optarg;
+				phimg_common.syspage = 1;
+				break;
+
+			case 'u':
+				phimg_common.sysgen.userScript = optarg;
+				phimg_common.syspage = 1;
+				break;
+
+			case 'c':
+				phimg_common.crcAliases = 1;
+				break;
+
+			case 'e':
+				if (phimg_addElf(optarg) < 0) {
+					return -1;
+				}
+				break;
+
+			case 't':
+				if (phimg_parseNum(optarg, '\0', &val, NULL) < 0) {
+					fprintf(stderr, "Invalid partition table offset - %s\n", optarg);
+					return -1;
+				}
+				phimg_common.ptoffs = val;
+				break;
+
+			case 'm':
+				if ((phimg_parseNum(optarg, ',', &val, &end) < 0) || (phimg_parseNum(end + 1, '\0', &val2, NULL) < 0) ||
+						(val > UINT32_MAX) || (val2 > UINT32_MAX) || (val2 == 0)) {
+					fprintf(stderr, "Invalid memory parameters - %s\n", optarg);
+					return -1;
+				}
+				phimg_common.memsz = val;
+				phimg_common.blksz = val2;
+				break;
+
+			case 'P':
+				if (phimg_addPart(optarg) < 0) {
+					return -1;
+				}
+				break;
+
+			case 'U':
+				if ((phimg_parseNum(optarg, ':', &val, &end) < 0) || (phimg_parseNum(end + 1, ':', &val2, &end) < 0) ||
+						(phimg_parseNum(end + 1, '\0', &val3, NULL) < 0) || (val > UINT16_MAX) || (val2 > UINT16_MAX) || (val3 > UINT32_MAX)) {
+					fprintf(stderr, "Invalid upload parameters - %s\n", optarg);
+					return -1;
+				}
+				phimg_common.vid = val;
+				phimg_common.pid = val2;
+				phimg_common.addr = val3;
+				phimg_common.upload = 1;
+				break;
+
+			case 'x':
+				if ((phimg_parseNum(optarg, '\0', &val, NULL) < 0) || (val > UINT32_MAX)) {
+					fprintf(stderr, "Invalid jump address - %s\n", optarg);
+					return -1;
+				}
+				phimg_common.jaddr = val;
+				phimg_common.jump = 1;
+				break;
+
+			case 'q':
+				phimg_common.quiet = 1;
+				break;
+
+			case 'h':
+			default:
+				phimg_help(argv[0]);
+				return -1;
+		}
+	}
+
+	if (phimg_common.imgName == NULL) {
+		fprintf(stderr, "Missing image path\n");
+		return -1;
+	}
+
+	if (phimg_common.syspage && ((phimg_common.sysgen.arch == NULL) || (phimg_common.sysgen.maxsz == 0) ||
+			(phimg_common.sysgen.preinitScript == NULL) || (phimg_common.sysgen.userScript == NULL))) {
+		fprintf(stderr, "Syspage requires -a, -s, -p and -u\n");
+		return -1;
+	}
+
+	if (phimg_common.crcAliases && !phimg_common.syspage) {
+		fprintf(stderr, "Aliases are defined by syspage scripts, -c requires syspage options\n");
+		return -1;
+	}
+
+	if ((phimg_common.ptoffs >= 0) && ((phimg_common.blksz == 0) || (phimg_common.nparts == 0))) {
+		fprintf(stderr, "Partition table requires -m and at least one -P\n");
+		return -1;
+	}
+
+	if (phimg_common.jump && !phimg_common.upload) {
+		fprintf(stderr, "Jump requires -U\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Maps the whole image once, it is extended if syspage or partition table doesn't fit */
+static int phimg_map(void)
+{
+	struct stat st;
+	unsigned long long need = 0;
+
+	phimg_common.fd = open(phimg_common.imgName, O_RDWR);
+	if (phimg_common.fd < 0) {
+		fprintf(stderr, "Cannot open image %s, err: %s\n", phimg_common.imgName, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(phimg_common.fd, &st) < 0) {
+		fprintf(stderr, "Cannot stat image %s, err: %s\n", phimg_common.imgName, strerror(errno));
+		return -1;
+	}
+
+	if (phimg_common.syspage) {
+		need = phimg_common.sysgen.offs + sysgen_size();
+	}
+
+	if (phimg_common.ptoffs >= 0) {
+		unsigned long long ptend = (unsigned long long)phimg_common.ptoffs + ptable_size(phimg_common.nparts);
+
+		if (need < ptend) {
+			need = ptend;
+		}
+	}
+
+	if ((st.st_size < (off_t)need) && (ftruncate(phimg_common.fd, need) < 0)) {
+		fprintf(stderr, "Cannot extend image %s, err: %s\n", phimg_common.imgName, strerror(errno));
+		return -1;
+	}
+
+	phimg_common.imgsz = (st.st_size < (off_t)need) ? need : (size_t)st.st_size;
+	if (phimg_common.imgsz == 0) {
+		fprintf(stderr, "Image %s is empty\n", phimg_common.imgName);
+		return -1;
+	}
+
+	phimg_common.img = mmap(NULL, phimg_common.imgsz, PROT_READ | PROT_WRITE, MAP_SHARED, phimg_common.fd, 0);
+	if (phimg_common.img == MAP_FAILED) {
+		phimg_common.img = NULL;
+		fprintf(stderr, "Cannot map image %s, err: %s\n", phimg_common.imgName, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static void phimg_unmap(void)
+{
+	if (phimg_common.img != NULL) {
+		munmap(phimg_common.img, phimg_common.imgsz);
+		phimg_common.img = NULL;
+	}
+
+	if (phimg_common.fd >= 0) {
+		close(phimg_common.fd);
+		phimg_common.fd = -1;
+	}
+}
+
+
+/* Embeds CRC into ELF placed in image region, probe - region may hold other data */
+static int phimg_crc(const char *name, unsigned long long offs, unsigned long long size, int probe)
+{
+	metaelf_result_t res;
+	ssize_t elfsz;
+
+	if ((offs >= phimg_common.imgsz) || ((size != 0) && (size > phimg_common.imgsz - offs))) {
+		fprintf(stderr, "ELF region %s (0x%llx, 0x%llx) lies outside image\n", name, offs, size);
+		return -1;
+	}
+
+	if (size == 0) {
+		size = phimg_common.imgsz - offs;
+	}
+
+	elfsz = metaelf_size(phimg_common.img + offs, size);
+	if (elfsz < 0) {
+		if (probe) {
+			return 0;
+		}
+		fprintf(stderr, "%s: Not an ELF file\n", name);
+		return -1;
+	}
+
+	if ((unsigned long long)elfsz > size) {
+		fprintf(stderr, "%s: ELF size 0x%zx exceeds its region\n", name, (size_t)elfsz);
+		return -1;
+	}
+
+	if (metaelf_mem(name, phimg_common.img + offs, elfsz, mode_writeCRC, METAELF_QUIET | METAELF_PARALLEL, &res) != METAELF_OK) {
+		return -1;
+	}
+
+	if (!phimg_common.quiet) {
+		printf(" - %s: CRC32=%08X%s\n", name, res.crc, res.modified ? "" : " (already embedded)");
+	}
+	phimg_common.ncrc++;
+
+	return 0;
+}
+
+
+static int phimg_crcAlias(void *arg, const char *name, unsigned long long offs, unsigned long long size)
+{
+	(void)arg;
+
+	return phimg_crc(name, offs, size, 1);
+}
+
+
+static int phimg_crcAll(void)
+{
+	char name[32];
+	unsigned int i;
+
+	if (phimg_common.crcAliases && (sysgen_aliasForeach(phimg_crcAlias, NULL) < 0)) {
+		return -1;
+	}
+
+	for (i = 0; i < phimg_common.nelfs; i++) {
+		snprintf(name, sizeof(name), "ELF at 0x%llx", phimg_common.elfs[i].offs);
+		if (phimg_crc(name, phimg_common.elfs[i].offs, phimg_common.elfs[i].size, 0) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int phimg_upload(void)
+{
+	sdp_t sdp;
+	int res = -1, waiting = 0;
+
+	if (hid_init() != 0) {
+		fprintf(stderr, "Cannot initialize hidapi\n");
+		return -1;
+	}
+
+	while (sdp_open(&sdp, phimg_common.vid, phimg_common.pid) < 0) {
+		if (!waiting) {
+			printf("Waiting for USB device %04x:%04x\n", phimg_common.vid, phimg_common.pid);
+			waiting = 1;
+		}
+		usleep(100000);
+	}
+
+	/* Mapping is sent directly, pages written above are still in memory */
+	do {
+		if (!phimg_common.quiet) {
+			printf("Uploading %zu bytes to 0x%08x\n", phimg_common.imgsz, phimg_common.addr);
+		}
+
+		if (sdp_writeFile(&sdp, phimg_common.addr, 0, phimg_common.img, phimg_common.imgsz, SDP_F_STATUS | (phimg_common.quiet ? 0 : SDP_F_PROGRESS)) < 0) {
+			fprintf(stderr, "Cannot upload image\n");
+			break;
+		}
+
+		if (phimg_common.jump) {
+			if (!phimg_common.quiet) {
+				printf("Jumping to 0x%08x\n", phimg_common.jaddr);
+			}
+
+			if (sdp_jump(&sdp, phimg_common.jaddr) < 0) {
+				fprintf(stderr, "Cannot jump to 0x%08x\n", phimg_common.jaddr);
+				break;
+			}
+		}
+
+		res = 0;
+	} while (0);
+
+	sdp_close(&sdp);
+	hid_exit();
+
+	return res;
+}
+
+
+static int phimg_run(void)
+{
+	ssize_t len;
+
+	if (phimg_common.syspage && (sysgen_build(&phimg_common.sysgen) < 0)) {
+		return -1;
+	}
+
+	if (phimg_map() < 0) {
+		return -1;
+	}
+
+	if (phimg_common.syspage) {
+		if (sysgen_store(phimg_common.img + phimg_common.sysgen.offs, phimg_common.imgsz - phimg_common.sysgen.offs) < 0) {
+			fprintf(stderr, "Cannot write syspage to image\n");
+			return -1;
+		}
+
+		if (!phimg_common.quiet) {
+			printf("Syspage written at offset 0x%llx (%zu bytes)\n", phimg_common.sysgen.offs, sysgen_size());
+		}
+	}
+
+	/* Checksums are calculated after syspage is in place */
+	if (phimg_crcAll() < 0) {
+		return -1;
+	}
+
+	if (!phimg_common.quiet && (phimg_common.ncrc > 0)) {
+		printf("CRC32 embedded into %u ELF file(s)\n", phimg_common.ncrc);
+	}
+
+	if (phimg_common.ptoffs >= 0) {
+		unsigned long long ptoffs = (unsigned long long)phimg_common.ptoffs;
+
+		len = ptab_build(phimg_common.img + ptoffs, phimg_common.imgsz - ptoffs,
+			phimg_common.parts, phimg_common.nparts, phimg_common.memsz, phimg_common.blksz);
+		if (len < 0) {
+			fprintf(stderr, "Cannot write partition table, it may exceed block size\n");
+			return -1;
+		}
+
+		if (!phimg_common.quiet) {
+			printf("Partition table written at offset 0x%llx (%u partitions)\n", ptoffs, phimg_common.nparts);
+		}
+	}
+
+	if (phimg_common.upload && (phimg_upload() < 0)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int res;
+
+	phimg_common.fd = -1;
+
+	if (phimg_parseArgs(argc, argv) < 0) {
+		free(phimg_common.elfs);
+		free(phimg_common.parts);
+		return EXIT_FAILURE;
+	}
+
+	crc32_init();
+
+	res = phimg_run();
+
+	phimg_unmap();
+	sysgen_cleanup();
+	free(phimg_common.elfs);
+	free(phimg_common.parts);
+
+	return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -23,15 +23,22 @@
 
 #include <hostutils-common/errors.h>
 #include <hostutils-common/serial.h>
+#include <hostutils-common/log.h>
 #include "bsp.h"
 #include "elf.h"
+#include "elfplan.h"
 
 
 #define KERNEL_BASE  0xc0000000
 
 
+static struct {
+	serial_t rx;
+} bsp_common;
+
+
 /* Function sends BSP message */
-int bsp_send(int fd, u8 t, char *buffer, uint len)
+int bsp_send(int fd, u8 t, const char *buffer, uint len)
 {
 	s16 fcs;
 	uint k, i;
@@ -64,6 +71,7 @@ int bsp_send(int fd, u8 t, char *buffer, uint len)
 /* Function receives BSP message */
 int bsp_recv(int fd, u8 *t, char *buffer, uint len, uint timeout)
 {
+	serial_t *rx = &bsp_common.rx;
 	u8 c;
 	uint i, escfl = 0;
 	s16 fcs, sfcs;
@@ -72,13 +80,20 @@ int bsp_recv(int fd, u8 *t, char *buffer, uint len, uint timeout)
 	if (len < BSP_MSGSZ)
 		return ERR_ARG;
 
-	if ((err = serial_read(fd, t, 1, timeout)) < 0)
+	/* Session serves single port, input read ahead is kept between messages */
+	if (rx->fd != fd)
+		serial_init(rx, fd);
+
+	/* Timeout applies to the whole message */
+	serial_timeout(rx, timeout);
+
+	if ((err = serial_getc(rx, t)) < 0)
 		return err;
-	if ((err = serial_read(fd, (u8 *)&sfcs, 2, timeout)) < 0)
+	if ((err = serial_bread(rx, (u8 *)&sfcs, 2)) < 0)
 		return err;
 
 	for (fcs = *t, i = 0, escfl = 0;;) {
-		if ((err = serial_read(fd, &c, 1, timeout)) < 0)
+		if ((err = serial_getc(rx, &c)) < 0)
 			return err;
 		if (i == BSP_MSGSZ)
 			return ERR_SIZE;
@@ -108,7 +123,7 @@ int bsp_recv(int fd, u8 *t, char *buffer, uint len, uint timeout)
 
 
 /* Function sends BSP request (sends message and waits for answer) */
-int bsp_req(int fd, u8 st, char *sbuff, uint slen, u8 *rt, u8 *rbuff, uint rlen, u16 num, u16 *rnum)
+int bsp_req(int fd, u8 st, const char *sbuff, uint slen, u8 *rt, u8 *rbuff, uint rlen, u16 num, u16 *rnum)
 {
 	int err;
 	uint fails;
@@ -135,177 +150,277 @@ int bsp_req(int fd, u8 st, char *sbuff, uint slen, u8 *rt, u8 *rbuff, uint rlen,
 
 
 /*
- * Complex routines
+ * Windowed transfer
  */
 
 
-/* Functions sends kernel to Phoenix node */
-int bsp_sendkernel(int fd, char *kernel)
+unsigned int bsp_window(const u8 *ext, int len)
+{
+	/* Legacy loaders don't send request extension */
+	if ((len < 2) || (ext[0] != BSP_WINMAGIC) || (ext[1] <= 1))
+		return 1;
+
+	return (ext[1] > BSP_WINDOW_MAX) ? BSP_WINDOW_MAX : ext[1];
+}
+
+
+static int bsp_tx_init(bsp_tx_t *tx, int fd, unsigned int window)
+{
+	tx->fd = fd;
+	tx->window = window;
+	tx->num = 0;
+	tx->ack = 0;
+	tx->fails = 0;
+	tx->frames = NULL;
+	tx->chunk = BSP_MSGSZ;
+
+	if (window > 1) {
+		if ((tx->frames = malloc(window * sizeof(bsp_frame_t))) == NULL)
+			return ERR_MEM;
+		tx->chunk = BSP_SEQDATASZ;
+	}
+
+	return ERR_NONE;
+}
+
+
+static void bsp_tx_done(bsp_tx_t *tx)
+{
+	free(tx->frames);
+	tx->frames = NULL;
+}
+
+
+/* Function resends all unacknowledged frames starting from seq (go-back-N, see bsp.h) */
+static int bsp_tx_rewind(bsp_tx_t *tx, u16 seq)
+{
+	bsp_frame_t *fr;
+	int err;
+
+	for (; seq != tx->num; seq++) {
+		fr = &tx->frames[seq % tx->window];
+		if ((err = bsp_send(tx->fd, fr->t | BSP_TYPE_SEQ, fr->buff, fr->len)) < 0)
+			return err;
+	}
+
+	return ERR_NONE;
+}
+
+
+/* Function counts exchange which didn't move the window, transfer fails after BSP_MAXREP in a row */
+static int bsp_tx_fail(bsp_tx_t *tx)
 {
-	FILE *f;
-	char sbuff[BSP_MSGSZ], rbuff[BSP_MSGSZ];
-	Elf32_Ehdr hdr;
-	Elf32_Phdr phdr;
-	Elf32_Half k, i;
-	Elf32_Half seg, offs;
-	int size, l, err;
+	return (++tx->fails >= BSP_MAXREP) ? ERR_BSP_RETR : ERR_NONE;
+}
+
+
+/* Function waits for single acknowledgment and slides window */
+static int bsp_tx_wait(bsp_tx_t *tx)
+{
+	char rbuff[BSP_MSGSZ];
+	u16 ack;
 	u8 t;
-	u16 num = 0;
-
-	/* Open kernel file and read ELF header */
-	if ((f = fopen(kernel, "r")) == NULL)
-		return ERR_FILE;
-	if (fread(&hdr, sizeof(Elf32_Ehdr), 1, f) != 1) {
-		fclose(f);
-		return ERR_FILE;
+	int err;
+
+	if ((err = bsp_recv(tx->fd, &t, rbuff, BSP_MSGSZ, BSP_TIMEOUT)) == ERR_SERIAL_TIMEOUT) {
+		if ((err = bsp_tx_fail(tx)) < 0)
+			return err;
+
+		/* Acknowledgment has been lost or nothing got through */
+		return bsp_tx_rewind(tx, tx->ack);
 	}
 
-	/* Read program headers and send segments */
-	for (k = 0; k < hdr.e_phnum; k++) {
-		fseek(f, hdr.e_phoff + k * sizeof(Elf32_Phdr), SEEK_SET);
-		if (fread(&phdr, sizeof(Elf32_Phdr), 1, f) != 1) {
-			fclose(f);
-			return ERR_FILE;
-		}
+	/* Corrupted reply, the next one carries cumulative acknowledgment too */
+	if (err < 0)
+		return ((err == ERR_BSP_FCS) || (err == ERR_SIZE)) ? bsp_tx_fail(tx) : err;
 
-		if ((phdr.p_type == PT_LOAD) && (phdr.p_vaddr != 0)) {
+	if ((err < (int)sizeof(u16)) || ((t != BSP_TYPE_ACK) && (t != BSP_TYPE_RETR)))
+		return bsp_tx_fail(tx);
 
-			/* Calculate realmode address */
-			seg = (phdr.p_vaddr - KERNEL_BASE) / 16;
-			offs = (phdr.p_vaddr - KERNEL_BASE) % 16;
+	/* Ignore acknowledgments outside of the window */
+	ack = *(u16 *)rbuff;
+	if ((u16)(ack - tx->ack) > (u16)(tx->num - tx->ack))
+		return bsp_tx_fail(tx);
 
-			*(u16 *)sbuff = seg;
-			*(u16 *)&sbuff[2] = offs;
+	if (ack != tx->ack) {
+		tx->ack = ack;
+		tx->fails = 0;
+	}
+	else if (t == BSP_TYPE_RETR) {
+		if ((err = bsp_tx_fail(tx)) < 0)
+			return err;
+	}
 
-			if ((err = bsp_req(fd, BSP_TYPE_SHDR, sbuff, 4, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-				fclose(f);
-				return err;
-			}
+	/*
+	 * Target requests retransmission once per gap and drops following frames until it is filled.
+	 * Repeated ACK isn't counted, target acknowledges every resent duplicate and their number is
+	 * bounded by the window per counted rewind.
+	 */
+	if ((t == BSP_TYPE_RETR) && (ack != tx->num))
+		return bsp_tx_rewind(tx, ack);
 
-			/* Send segment data */
-			fseek(f, phdr.p_offset, SEEK_SET);
-			for (i = 0; i < phdr.p_filesz / BSP_MSGSZ; i++) {
-				if (fread(sbuff, 1, BSP_MSGSZ, f) != BSP_MSGSZ) {
-					fclose(f);
-					return ERR_FILE;
-				}
-
-				if ((err = bsp_req(fd, BSP_TYPE_KDATA, sbuff, BSP_MSGSZ, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-					fclose(f);
-					return err;
-				}
-			}
+	return ERR_NONE;
+}
 
-			size = phdr.p_filesz % BSP_MSGSZ;
-			if (size != 0) {
-				if ((l = fread(sbuff, 1, size, f)) != size) {
-					fclose(f);
-					return ERR_FILE;
-				}
-				if ((err = bsp_req(fd, BSP_TYPE_KDATA, sbuff, size, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-					fclose(f);
-					return err;
-				}
-			}
-		}
+
+/* Function sends frame, in windowed mode it returns when frame fits in the window */
+static int bsp_tx_put(bsp_tx_t *tx, u8 t, const char *buff, uint len)
+{
+	char rbuff[BSP_MSGSZ];
+	bsp_frame_t *fr;
+	u8 rt;
+	int err;
+
+	if (tx->window == 1)
+		return bsp_req(tx->fd, t, buff, len, &rt, (u8 *)rbuff, BSP_MSGSZ, tx->num, &tx->num);
+
+	if (len > BSP_SEQDATASZ)
+		return ERR_ARG;
+
+	while ((u16)(tx->num - tx->ack) >= tx->window) {
+		if ((err = bsp_tx_wait(tx)) < 0)
+			return err;
+	}
+
+	fr = &tx->frames[tx->num % tx->window];
+	fr->t = t;
+	fr->len = len + sizeof(u16);
+	*(u16 *)fr->buff = tx->num;
+	memcpy(fr->buff + sizeof(u16), buff, len);
+
+	tx->num++;
+
+	return bsp_send(tx->fd, fr->t | BSP_TYPE_SEQ, fr->buff, fr->len);
+}
+
+
+/* Function waits until all frames are acknowledged */
+static int bsp_tx_drain(bsp_tx_t *tx)
+{
+	int err;
+
+	while ((tx->window > 1) && (tx->ack != tx->num)) {
+		if ((err = bsp_tx_wait(tx)) < 0)
+			return err;
+	}
+
+	return ERR_NONE;
+}
+
+
+/* Function sends segment data in chunks fitting in single frame */
+static int bsp_tx_data(bsp_tx_t *tx, u8 t, const char *data, uint64_t size)
+{
+	uint l;
+	int err;
+
+	for (; size > 0; size -= l, data += l) {
+		l = (size > tx->chunk) ? tx->chunk : size;
+		if ((err = bsp_tx_put(tx, t, data, l)) < 0)
+			return err;
 	}
 
-	/* Last message */
-	if ((err = bsp_send(fd, BSP_TYPE_GO, sbuff, 1)) < 0) {
-		fclose(f);
+	return ERR_NONE;
+}
+
+
+/*
+ * Complex routines
+ */
+
+
+/* Functions sends kernel to Phoenix node */
+int bsp_sendkernel(int fd, char *kernel, unsigned int window)
+{
+	char sbuff[BSP_MSGSZ];
+	elfplan_t *plan;
+	elfplan_seg_t *seg;
+	unsigned int k;
+	bsp_tx_t tx;
+	int err;
+
+	if ((err = elfplan_get(kernel, &plan)) < 0)
+		return err;
+
+	if ((err = bsp_tx_init(&tx, fd, window)) < 0)
 		return err;
+
+	for (k = 0; k < plan->nsegs; k++) {
+		seg = &plan->segs[k];
+
+		/* Calculate realmode address */
+		*(u16 *)sbuff = (seg->vaddr - KERNEL_BASE) / 16;
+		*(u16 *)&sbuff[2] = (seg->vaddr - KERNEL_BASE) % 16;
+
+		if ((err = bsp_tx_put(&tx, BSP_TYPE_SHDR, sbuff, 4)) < 0)
+			break;
+
+		/* Send segment data */
+		if ((err = bsp_tx_data(&tx, BSP_TYPE_KDATA, seg->data, seg->filesz)) < 0)
+			break;
 	}
-	fclose(f);
-	fprintf(stderr, "[%d] System started\n", getpid());
+
+	/* Last message is sent when whole kernel is acknowledged */
+	if ((err >= 0) && ((err = bsp_tx_drain(&tx)) >= 0))
+		err = bsp_send(fd, BSP_TYPE_GO, sbuff, 1);
+
+	bsp_tx_done(&tx);
+
+	if (err < 0)
+		return err;
+
+	log_info(NULL, "System started");
 
 	return 0;
 }
 
 
 /* Function sends user program to Phoenix node */
-int bsp_sendprogram(int fd, char *name, char *sysdir)
+int bsp_sendprogram(int fd, char *name, char *sysdir, unsigned int window)
 {
-	FILE *f;
-	char sbuff[BSP_MSGSZ], rbuff[BSP_MSGSZ];
-	Elf32_Ehdr hdr;
-	Elf32_Phdr phdr;
-	Elf32_Half k, i;
-	uint size, l;
-	u8 t;
-	u16 num = 0;
+	char sbuff[BSP_MSGSZ];
+	elfplan_t *plan;
+	unsigned int k;
+	bsp_tx_t tx;
 	char *tname;
 	int err;
 
-	if ((tname = (char *)malloc(strlen(sysdir) + 1 + strlen(name) + 1)) == NULL)
+	if ((err = bsp_tx_init(&tx, fd, window)) < 0)
+		return err;
+
+	if ((tname = (char *)malloc(strlen(sysdir) + 1 + strlen(name) + 1)) == NULL) {
+		bsp_tx_done(&tx);
 		return ERR_MEM;
+	}
 
 	sprintf(tname, "%s/%s", sysdir, name);
-
-	if ((f = fopen(tname, "r")) == NULL) {
-		bsp_req(fd, BSP_TYPE_ERR, sbuff, 1, &t, (u8*)rbuff, BSP_MSGSZ, num, &num);
-		free(tname);
-		return ERR_FILE;
-	}
+	err = elfplan_get(tname, &plan);
 	free(tname);
 
-	if (fread(&hdr, sizeof(Elf32_Ehdr), 1, f) != 1) {
-		bsp_req(fd, BSP_TYPE_ERR, sbuff, 1, &t, (u8*)rbuff, BSP_MSGSZ, num, &num);
-		fclose(f);
-		return ERR_FILE;
-	}
-
-	/* Send ELF header */
-	if ((err = bsp_req(fd, BSP_TYPE_EHDR, (char *)&hdr, sizeof(Elf32_Ehdr), &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-		fclose(f);
+	if (err < 0) {
+		if (bsp_tx_put(&tx, BSP_TYPE_ERR, sbuff, 1) >= 0)
+			bsp_tx_drain(&tx);
+		bsp_tx_done(&tx);
 		return err;
 	}
 
-	/* Send program segments */
-	for (k = 0; k < hdr.e_phnum; k++) {
-		fseek(f, hdr.e_phoff + k * sizeof(Elf32_Phdr), SEEK_SET);
-		if (fread(&phdr, sizeof(Elf32_Phdr), 1, f) != 1) {
-			fclose(f);
-			return ERR_FILE;
-		}
-
-		if ((phdr.p_type == PT_LOAD) && (phdr.p_vaddr != 0)) {
-			if ((err = bsp_req(fd, BSP_TYPE_PHDR, (char *)&phdr, sizeof(Elf32_Phdr), &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-				fclose(f);
-				return err;
-			}
+	/* Headers are sent in format of the file class */
+	err = bsp_tx_put(&tx, BSP_TYPE_EHDR, plan->ehdr, plan->ehdrsz);
 
-			fseek(f, phdr.p_offset, SEEK_SET);
-			for (i = 0; i < phdr.p_filesz / BSP_MSGSZ; i++) {
-				if (fread(sbuff, 1, BSP_MSGSZ, f) != BSP_MSGSZ) {
-					fclose(f);
-					return ERR_FILE;
-				}
-				if ((err = bsp_req(fd, BSP_TYPE_PDATA, sbuff, BSP_MSGSZ, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-					fclose(f);
-					return err;
-				}
-			}
+	for (k = 0; (err >= 0) && (k < plan->nsegs); k++) {
+		if ((err = bsp_tx_put(&tx, BSP_TYPE_PHDR, plan->segs[k].phdr, plan->phdrsz)) < 0)
+			break;
 
-			size = phdr.p_filesz % BSP_MSGSZ;
-			if (size != 0) {
-				if ((l = fread(sbuff, 1, size, f)) != size) {
-					fclose(f);
-					return ERR_FILE;
-				}
-				if ((err = bsp_req(fd, BSP_TYPE_PDATA, sbuff, size, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-					fclose(f);
-					return err;
-				}
-			}
-		}
+		err = bsp_tx_data(&tx, BSP_TYPE_PDATA, plan->segs[k].data, plan->segs[k].filesz);
 	}
 
 	/* Last frame, which finishes transaction */
-	if ((err = bsp_req(fd, BSP_TYPE_GO, sbuff, 1, &t, (u8*)rbuff, BSP_MSGSZ, num, &num)) < 0) {
-		fclose(f);
-		return err;
-	}
+	if (err >= 0)
+		err = bsp_tx_put(&tx, BSP_TYPE_GO, sbuff, 1);
+	if (err >= 0)
+		err = bsp_tx_drain(&tx);
 
-	fclose(f);
-	return ERR_NONE;
+	bsp_tx_done(&tx);
+
+	return (err < 0) ? err : ERR_NONE;
 }
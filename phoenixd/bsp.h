@@ -45,6 +45,25 @@
 #define BSP_TYPE_ERR       10
 
 
+/*
+ * Windowed transfer, requested by loader with extension appended to kernel or program request.
+ * Target accepts frames in order and replies with BSP_TYPE_ACK carrying u16 number of the next
+ * expected frame (cumulative) or BSP_TYPE_RETR with number of the first missing frame, which is
+ * resent together with the following unacknowledged frames. RETR is sent once per gap and again
+ * when retransmission restarts, frames received out of order are dropped, lost replies are
+ * recovered by timeout.
+ *
+ * Retransmission is go-back-N on purpose: loaders don't buffer frames following a gap, they drop
+ * them. Resending only the missing frame (selective repeat) would make every frame
+ * after it time out too. With BSP_WINDOW_MAX frames in flight, one lost frame costs at most one
+ * window of resent data.
+ */
+#define BSP_TYPE_SEQ     0x80    /* type flag, payload starts with u16 sequence number */
+#define BSP_WINMAGIC     0x57    /* request extension marker, followed by u8 window size */
+#define BSP_WINDOW_MAX   16
+#define BSP_SEQDATASZ    (BSP_MSGSZ - sizeof(u16))
+
+
 /* BSP timings */
 #define BSP_INF        0
 #define BSP_TIMEOUT    3 * 1000
@@ -52,7 +71,7 @@
 
 
 /* Function sends BSP message */
-extern int bsp_send(int fd, u8 t, char *buffer, uint len);
+extern int bsp_send(int fd, u8 t, const char *buffer, uint len);
 
 
 /* Function receives BSP message */
@@ -60,15 +79,39 @@ extern int bsp_recv(int fd, u8 *t, char *in_buffer, uint len, uint timeout);
 
 
 /* Function sends BSP request (sends message and waits for answer) */
-extern int bsp_req(int fd, u8 st, char *sbuff, uint slen, u8 *rt, u8 *rbuff, uint rlen, u16 num, u16 *rnum);
+extern int bsp_req(int fd, u8 st, const char *sbuff, uint slen, u8 *rt, u8 *rbuff, uint rlen, u16 num, u16 *rnum);
+
+
+/* Unacknowledged frame of windowed transfer */
+typedef struct _bsp_frame_t {
+	u8 t;
+	uint len;
+	char buff[BSP_MSGSZ]; /* sequence number and data */
+} bsp_frame_t;
+
+
+/* Transfer context, window 1 means legacy stop-and-wait transfer */
+typedef struct _bsp_tx_t {
+	int fd;
+	unsigned int window;
+	unsigned int chunk;   /* segment data sent in single frame */
+	u16 num;              /* legacy - target counter, windowed - next sequence number */
+	u16 ack;              /* oldest unacknowledged sequence number */
+	unsigned int fails;
+	bsp_frame_t *frames;
+} bsp_tx_t;
+
+
+/* Function returns window size requested with request extension (1 for legacy loaders) */
+extern unsigned int bsp_window(const u8 *ext, int len);
 
 
 /* Functions sends kernel to Phoenix node */
-extern int bsp_sendkernel(int fd, char *kernel);
+extern int bsp_sendkernel(int fd, char *kernel, unsigned int window);
 
 
 /* Function sends user program to Phoenix node */
-extern int bsp_sendprogram(int fd, char *name, char *sysdir);
+extern int bsp_sendprogram(int fd, char *name, char *sysdir, unsigned int window);
 
 
 #endif
@@ -0,0 +1,177 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Capture of PHFS frames to pcapng file
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+#include <hostutils-common/errors.h>
+#include "capture.h"
+#include "dispatch.h"
+#include "metrics.h"
+
+
+/* pcapng blocks and options */
+#define PCAPNG_SHB        0x0a0d0d0a
+#define PCAPNG_IDB        0x00000001
+#define PCAPNG_EPB        0x00000006
+#define PCAPNG_BOM        0x1a2b3c4d
+#define PCAPNG_ENDOFOPT   0
+#define PCAPNG_COMMENT    1
+#define PCAPNG_SHBAPPL    4
+#define PCAPNG_IFNAME     2
+#define PCAPNG_IFTSRESOL  9
+#define PCAPNG_EPBFLAGS   2
+
+#define PCAPNG_ALIGN(n)   (((n) + 3) & ~3u)
+
+
+static struct {
+	int fd;
+	unsigned int sessions;
+} capture_common = { .fd = -1 };
+
+
+/* Function appends option to buffer, returns new offset */
+static unsigned int capture_opt(u8 *buff, unsigned int offs, u16 code, const void *val, u16 len)
+{
+	memcpy(buff + offs, &code, sizeof(code));
+	memcpy(buff + offs + 2, &len, sizeof(len));
+	memcpy(buff + offs + 4, val, len);
+	memset(buff + offs + 4 + len, 0, PCAPNG_ALIGN(len) - len);
+
+	return offs + 4 + PCAPNG_ALIGN(len);
+}
+
+
+/* Function finishes block of given type in buff (body starts at offset 8) */
+static int capture_block(u8 *buff, u32 type, unsigned int offs)
+{
+	u32 len = offs + 4;
+
+	memcpy(buff, &type, sizeof(type));
+	memcpy(buff + 4, &len, sizeof(len));
+	memcpy(buff + offs, &len, sizeof(len));
+
+	return (write(capture_common.fd, buff, len) == (ssize_t)len) ? ERR_NONE : ERR_FILE;
+}
+
+
+int capture_init(const char *path)
+{
+	static const char appl[] = "phoenixd", ifname[] = "phfs";
+	static const char comment[] = "PHFS frames, timestamps are monotonic";
+	u8 buff[256], tsresol = 6;
+	u32 bom = PCAPNG_BOM, ver = 1, snaplen = 0, linktype = CAPTURE_LINKTYPE;
+	int64_t seclen = -1;
+	unsigned int offs;
+	int err;
+
+	/* Blocks are written by single write() of forked sessions sharing descriptor */
+	if ((capture_common.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) < 0)
+		return ERR_FILE;
+
+	offs = 8;
+	memcpy(buff + offs, &bom, sizeof(bom));
+	memcpy(buff + offs + 4, &ver, sizeof(ver));
+	memcpy(buff + offs + 8, &seclen, sizeof(seclen));
+	offs = capture_opt(buff, offs + 16, PCAPNG_SHBAPPL, appl, sizeof(appl) - 1);
+	offs = capture_opt(buff, offs, PCAPNG_COMMENT, comment, sizeof(comment) - 1);
+	offs = capture_opt(buff, offs, PCAPNG_ENDOFOPT, NULL, 0);
+
+	if ((err = capture_block(buff, PCAPNG_SHB, offs)) == ERR_NONE) {
+		offs = 8;
+		memcpy(buff + offs, &linktype, sizeof(linktype));
+		memcpy(buff + offs + 4, &snaplen, sizeof(snaplen));
+		offs = capture_opt(buff, offs + 8, PCAPNG_IFNAME, ifname, sizeof(ifname) - 1);
+		offs = capture_opt(buff, offs, PCAPNG_IFTSRESOL, &tsresol, sizeof(tsresol));
+		offs = capture_opt(buff, offs, PCAPNG_ENDOFOPT, NULL, 0);
+		err = capture_block(buff, PCAPNG_IDB, offs);
+	}
+
+	if (err < 0) {
+		close(capture_common.fd);
+		capture_common.fd = -1;
+	}
+
+	return err;
+}
+
+
+void capture_frame(session_t *s, int dir, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	static const u8 pad[4];
+	u8 head[28 + sizeof(capture_hdr_t)], tail[512];
+	unsigned int plen, total, offs = 0;
+	unsigned long long t;
+	struct iovec iov[5];
+	capture_hdr_t *h;
+	u32 v, flags = dir;
+	const char *addr;
+
+	if (capture_common.fd < 0)
+		return;
+
+	/* Sessions are numbered when they send first frame */
+	if (s->capid == 0) {
+		s->capid = ++capture_common.sessions;
+		addr = (s->dev_addr != NULL) ? s->dev_addr : "";
+		offs = capture_opt(tail, offs, PCAPNG_COMMENT, addr, (strlen(addr) < 256) ? strlen(addr) : 256);
+	}
+	offs = capture_opt(tail, offs, PCAPNG_EPBFLAGS, &flags, sizeof(flags));
+	offs = capture_opt(tail, offs, PCAPNG_ENDOFOPT, NULL, 0);
+
+	plen = sizeof(*h) + msg_getlen(msg);
+	total = sizeof(head) - sizeof(*h) + PCAPNG_ALIGN(plen) + offs + 4;
+	t = metrics_now();
+
+	v = PCAPNG_EPB;
+	memcpy(head, &v, 4);
+	memcpy(head + 4, &total, 4);
+	v = 0;
+	memcpy(head + 8, &v, 4);
+	v = t >> 32;
+	memcpy(head + 12, &v, 4);
+	v = (u32)t;
+	memcpy(head + 16, &v, 4);
+	memcpy(head + 20, &plen, 4);
+	memcpy(head + 24, &plen, 4);
+
+	h = (capture_hdr_t *)(head + 28);
+	h->pid = getpid();
+	h->session = s->capid;
+	h->mode = s->mode;
+	h->dir = dir;
+	h->type = msg_gettype(msg);
+	h->seq = seq;
+
+	memcpy(tail + offs, &total, 4);
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(head);
+	iov[1].iov_base = msg->data;
+	iov[1].iov_len = msg_getlen(msg) - len;
+	iov[2].iov_base = (void *)data;
+	iov[2].iov_len = len;
+	iov[3].iov_base = (void *)pad;
+	iov[3].iov_len = PCAPNG_ALIGN(plen) - plen;
+	iov[4].iov_base = tail;
+	iov[4].iov_len = offs + 4;
+
+	/* Capture is diagnostic, failed write only loses the frame */
+	if (writev(capture_common.fd, iov, 5) < 0)
+		return;
+}
@@ -0,0 +1,52 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Capture of PHFS frames to pcapng file
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <hostutils-common/types.h>
+#include "msg.h"
+
+
+/* Frames are stored on single interface with user link type, timestamps are CLOCK_MONOTONIC in us */
+#define CAPTURE_LINKTYPE  147     /* LINKTYPE_USER0 */
+
+/* Direction (same values as pcapng epb_flags) */
+#define CAPTURE_RX  1             /* request received from target */
+#define CAPTURE_TX  2             /* reply sent to target */
+
+
+/* Packet data, frame payload follows, first packet of every session carries its address in comment */
+typedef struct _capture_hdr_t {
+	u32 pid;                  /* phoenixd process serving session */
+	u16 session;              /* session number in process */
+	u8 mode;                  /* dmode_t */
+	u8 dir;
+	u16 type;                 /* msg_t type and sequence number */
+	u16 seq;
+} capture_hdr_t;
+
+
+struct _session_t;
+
+
+/* Function starts capture to path, it's shared by forked sessions */
+extern int capture_init(const char *path);
+
+
+/* Function stores frame, replies may have last len bytes of payload in data */
+extern void capture_frame(struct _session_t *s, int dir, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+
+
+#endif
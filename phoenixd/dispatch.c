@@ -20,6 +20,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <poll.h>
 
 #include <hostutils-common/errors.h>
 #include <hostutils-common/serial.h>
@@ -28,9 +30,15 @@
 #include "phfs.h"
 #include "msg_udp.h"
 #include "msg_tcp.h"
+#include "msg_unix.h"
+#include "reactor.h"
+#include "udpsrv.h"
+#include "replay.h"
+#include "capture.h"
 
-int (*msg_send)(int fd, msg_t *msg, u16 seq);
-int (*msg_recv)(int fd, msg_t *msg, int *state);
+
+/* Interval of attempts to open output FIFO until QEMU opens it for reading (ms) */
+#define PIPE_RETRY 100
 
 
 static char *concat(char *s1, char *s2)
@@ -42,116 +50,654 @@ static char *concat(char *s1, char *s2)
 }
 
 
-static int connect_pipes(const char *dev_in, const char *dev_out, int *fd_in, int *fd_out)
+/* Function opens output FIFO without blocking, *fd_out stays -1 until the other end is opened for reading */
+static int open_pipeout(const char *dev_out, int *fd_out)
 {
-	if ((*fd_in = open(dev_in, O_RDONLY)) < 0) {
-		fprintf(stderr, "[%d] dispatch: Can't open pipe '%s'\n", getpid(), dev_in);
+	if (((*fd_out = open(dev_out, O_WRONLY | O_NONBLOCK)) < 0) && (errno != ENXIO)) {
+		log_error(NULL, "dispatch: Can't open pipe '%s'", dev_out);
 		return ERR_DISPATCH_IO;
 	}
 
-	if ((*fd_out = open(dev_out, O_WRONLY)) < 0) {
-		fprintf(stderr, "[%d] dispatch: Can't open pipe '%s'\n", getpid(), dev_out);
+	return 0;
+}
+
+
+/* Function opens FIFOs without blocking, QEMU which hasn't started yet doesn't stop other sessions */
+static int connect_pipes(const char *dev_in, const char *dev_out, int *fd_in, int *fd_out)
+{
+	if ((*fd_in = open(dev_in, O_RDONLY | O_NONBLOCK)) < 0) {
+		log_error(NULL, "dispatch: Can't open pipe '%s'", dev_in);
 		return ERR_DISPATCH_IO;
 	}
-	return 0;
+
+	return open_pipeout(dev_out, fd_out);
 }
 
 
-/* Function reads and dispatches messages */
-int dispatch(char *dev_addr, dmode_t mode, char *sysdir, void *data)
+int session_open(session_t *s, char *dev_addr, dmode_t mode, char *sysdir, void *data)
 {
-	int fd = -1;
-	int fd_out = -1;
-	int retries = 128;
 	int baudrate;
-	msg_t msg;
-	int state, err;
-	char *dev_in = 0;
-	char *dev_out = 0;
 
+	memset(s, 0, sizeof(*s));
+	s->dev_addr = dev_addr;
+	s->mode = mode;
+	s->sysdir = sysdir;
+	s->data = data;
+	s->fd = -1;
+	s->fd_out = -1;
+	s->lfd = -1;
+	s->state = MSGRECV_DESYN;
+	s->retries = 128;
+	s->maxlen = (mode == UDP) ? PHFS_UDPMAXLEN : MSG_MAXLEN_EXT;
+	s->window = 1;
 
 	if (mode == SERIAL) {
 		if (serial_speed2int(*(speed_t *)data, &baudrate) < 0) {
-			fprintf(stderr, "[%d] dispatch: Wrong speed port\n", getpid());
+			log_error(dev_addr, "dispatch: Wrong speed port");
 			return ERR_DISPATCH_IO;
 		}
-		printf("[%d] dispatch: Starting message dispatcher on [%s] (speed=%d)\n", getpid(), dev_addr, baudrate);
-		if ((fd = serial_open(dev_addr, *(speed_t *)data)) < 0) {
-			fprintf(stderr, "[%d] dispatch: Can't open serial port '%s'\n", getpid(), dev_addr);
+		log_info(NULL, "dispatch: Starting message dispatcher on [%s] (speed=%d)", dev_addr, baudrate);
+		if ((s->fd = serial_open(dev_addr, *(speed_t *)data)) < 0) {
+			log_error(NULL, "dispatch: Can't open serial port '%s'", dev_addr);
 			return ERR_DISPATCH_IO;
 		}
-		msg_send = msg_serial_send;
-		msg_recv = msg_serial_recv;
+		s->send = msg_serial_send;
+		s->flush = msg_stream_flush;
+		s->recv = msg_serial_recv;
+		s->baudrate = baudrate;
+		s->safebaud = baudrate;
 	}
 	else if (mode == UDP) {
-		if ((fd = udp_open(dev_addr, *(uint *)data)) < 0) {
-			fprintf(stderr, "[%d] dispatch: Can't open connection at '%s:%u'\n", getpid(), dev_addr, *(uint *)data);
+		/* Datagrams are received by endpoint in batches, there is no recv() */
+		if (udpsrv_open(s, dev_addr, *(uint *)data) < 0) {
+			log_error(NULL, "dispatch: Can't open connection at '%s:%u'", dev_addr, *(uint *)data);
 			return ERR_DISPATCH_IO;
 		}
-		msg_send = msg_udp_send;
-		msg_recv = msg_udp_recv;
+		s->send = msg_udp_send;
+		s->flush = msg_udp_flush;
 	}
 	else if (mode == TCP) {
-		fd = tcp_open(dev_addr, *(uint *)data);
-		if (fd < 0) {
-			fprintf(stderr, "[%d] dispatch: Can't open connection at '%s:%u'\n",
-				getpid(), dev_addr, *(uint *)data);
+		s->fd = tcp_open(dev_addr, *(uint *)data);
+		if (s->fd < 0) {
+			log_error(NULL, "dispatch: Can't open connection at '%s:%u'", dev_addr, *(uint *)data);
 			return ERR_DISPATCH_IO;
 		}
-		msg_send = msg_tcp_send;
-		msg_recv = msg_tcp_recv;
+		s->send = msg_tcp_send;
+		s->flush = msg_stream_flush;
+		s->recv = msg_tcp_recv;
 	}
 	else if (mode == PIPE) {
-		dev_in = concat(dev_addr, ".out"); // because output from quemu is our input
-		dev_out = concat(dev_addr, ".in"); // same logic
+		s->dev_in = concat(dev_addr, ".out"); // because output from quemu is our input
+		s->dev_out = concat(dev_addr, ".in"); // same logic
 
-		if (connect_pipes(dev_in, dev_out, &fd, &fd_out)) {
-			free(dev_in);
-			free(dev_out);
+		if (connect_pipes(s->dev_in, s->dev_out, &s->fd, &s->fd_out)) {
+			session_close(s);
+			return ERR_DISPATCH_IO;
+		}
+		s->send = msg_serial_send;
+		s->flush = msg_stream_flush;
+		s->recv = msg_serial_recv;
+	}
+	else if (mode == QEMU) {
+		/* QEMU connects as socket chardev client, the session waits for it on listening socket */
+		if ((s->lfd = unix_listen(dev_addr)) < 0) {
+			log_error(NULL, "dispatch: Can't listen on '%s'", dev_addr);
 			return ERR_DISPATCH_IO;
 		}
-		msg_send = msg_serial_send;
-		msg_recv = msg_serial_recv;
+		log_info(NULL, "dispatch: Waiting for QEMU on [%s]", dev_addr);
+		s->fd = s->lfd;
+		s->send = msg_unix_send;
+		s->flush = msg_stream_flush;
+		s->recv = msg_unix_recv;
+	}
+	else {
+		return ERR_ARG;
 	}
 
-	for (state = MSGRECV_DESYN;;) {
-		err = msg_recv(fd, &msg, &state);
-		if (err < 0) {
-			if (err == ERR_MSG_CLOSED) {
-				fprintf(stderr, "[%d] dispatch: Connection closed by the remote end (%s:%u)\n",
-					getpid(), dev_addr, *(uint *)data);
-			}
-			else {
-				fprintf(stderr, "[%d] dispatch: Message receiving error on %s, state=%d!\n",
-					getpid(), dev_addr, state);
-			}
-			// if this is pipe - try to reconnect - it's because qemu closes pipe
-			if (mode == PIPE && --retries) {
-				usleep(100000);
-				(void) connect_pipes(dev_in, dev_out, &fd, &fd_out);
-			}
+	/* FIFO output is opened later if QEMU isn't running yet */
+	if ((s->fd_out < 0) && (mode != PIPE))
+		s->fd_out = s->fd;
+
+	if (msg_rx_init(&s->rx) < 0) {
+		session_close(s);
+		return ERR_MEM;
+	}
+
+	return ERR_NONE;
+}
+
+
+int session_send(session_t *s, msg_t *msg, u16 seq)
+{
+	return session_senddata(s, msg, seq, NULL, 0);
+}
+
+
+int session_senddata(session_t *s, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	int err;
+
+	metrics_tx(&s->metrics, msg_gettype(msg), MSG_HDRSZ + msg_getlen(msg));
+	capture_frame(s, CAPTURE_TX, msg, seq, data, len);
+
+	if (s->replay != NULL)
+		replay_store(s->replay, msg, data, len);
+
+	/* Each write to stalled peer would block other sessions for SERIAL_TXTIMEOUT */
+	if (s->stalled)
+		return ERR_MSG_STALL;
+
+	if ((err = s->send(s->fd_out, &s->tx, msg, seq, data, len)) == ERR_MSG_STALL)
+		s->stalled = 1;
+
+	return err;
+}
+
+
+int session_flush(session_t *s)
+{
+	int err;
+
+	if (s->stalled)
+		return ERR_MSG_STALL;
+
+	if (s->tx.niov == 0)
+		return ERR_NONE;
+
+	if ((err = s->flush(s->fd_out, &s->tx)) == ERR_MSG_STALL)
+		s->stalled = 1;
+
+	return err;
+}
+
+
+static unsigned long long session_junk(session_t *s)
+{
+	return s->rx.dropped + s->rx.desync + s->rx.escerr;
+}
+
+
+int session_setbaud(session_t *s, int baudrate)
+{
+	speed_t speed;
+	int err;
+
+	if ((s->mode != SERIAL) || (baudrate == s->baudrate))
+		return ERR_NONE;
+
+	if (serial_int2speed(baudrate, &speed) < 0)
+		return ERR_ARG;
+
+	/* Queued replies are sent with previous speed */
+	if ((err = session_flush(s)) < 0)
+		return err;
+
+	if (serial_setspeed(s->fd, speed) < 0) {
+		log_warn(s->dev_addr, "dispatch: Can't switch serial link speed to %d", baudrate);
+
+		/* Driver may have kept any speed, previous one is set again */
+		if ((s->badbaud == 0) || (baudrate < s->badbaud))
+			s->badbaud = baudrate;
+		if (serial_int2speed(s->baudrate, &speed) == 0)
+			serial_setspeed(s->fd, speed);
+
+		return ERR_DISPATCH_IO;
+	}
+
+	log_info(s->dev_addr, "dispatch: Serial link speed %d -> %d", s->baudrate, baudrate);
+	s->baudrate = baudrate;
+	s->rxjunk = session_junk(s);
+
+	return ERR_NONE;
+}
+
+
+/* Function returns to initial speed if target sends only garbage at negotiated one (e.g. after reboot) */
+static int session_checkbaud(session_t *s, int err)
+{
+	if ((s->baudrate == s->safebaud) || ((err == ERR_NONE) && (session_junk(s) - s->rxjunk < PHFS_BAUD_JUNK)))
+		return err;
+
+	log_warn(s->dev_addr, "dispatch: Garbage received at %d, returning to initial speed", s->baudrate);
+
+	msg_rx_reset(&s->rx);
+	msg_tx_reset(&s->tx);
+	s->state = MSGRECV_DESYN;
+
+	return (session_setbaud(s, s->safebaud) < 0) ? ERR_DISPATCH_IO : ERR_NONE;
+}
+
+
+/* Function tries to open output FIFO, input is read only once both ends are up (QEMU opens them together) */
+static int session_reopen(session_t *s)
+{
+	if (s->fd_out >= 0)
+		return ERR_NONE;
+
+	if (open_pipeout(s->dev_out, &s->fd_out) < 0)
+		return ERR_DISPATCH_IO;
+
+	if (s->fd_out >= 0)
+		log_info(s->dev_addr, "dispatch: Pipe '%s' connected", s->dev_out);
+
+	return ERR_NONE;
+}
+
+
+static int session_accept(session_t *s)
+{
+	struct pollfd pfd = { .fd = s->lfd, .events = POLLIN };
+	int fd;
+
+	/* Blocking dispatcher waits for connection, event loop calls it when connection is pending */
+	if (!s->evloop && (poll(&pfd, 1, -1) < 0) && (errno != EINTR))
+		return ERR_DISPATCH_IO;
+
+	if ((fd = unix_accept(s->lfd)) < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) || (errno == ECONNABORTED))
+			return ERR_NONE;
+
+		log_error(s->dev_addr, "dispatch: Can't accept connection");
+		return ERR_DISPATCH_IO;
+	}
+
+	log_info(s->dev_addr, "dispatch: QEMU connected");
+	s->fd = fd;
+	s->fd_out = fd;
+
+	return ERR_NONE;
+}
+
+
+/* Function drops QEMU connection, the next one belongs to new target */
+static int session_disconnect(session_t *s)
+{
+	log_info(s->dev_addr, "dispatch: QEMU disconnected, waiting for new connection");
+
+	phfs_closeall(s);
+	msg_rx_reset(&s->rx);
+	msg_tx_reset(&s->tx);
+	s->state = MSGRECV_DESYN;
+	s->caps = 0;
+	s->window = 1;
+
+	if (s->fd != s->lfd)
+		close(s->fd);
+	s->fd = s->lfd;
+	s->fd_out = s->lfd;
+
+	if ((s->rx.maxlen != MSG_MAXLEN) && (msg_rx_resize(&s->rx, MSG_MAXLEN) < 0))
+		return ERR_MEM;
+
+	return ERR_NONE;
+}
+
+
+static int session_error(session_t *s, int err)
+{
+	/* Recovery resets the link, it is written again */
+	s->stalled = 0;
+
+	if (s->mode == QEMU)
+		return session_disconnect(s);
+
+	if (err == ERR_MSG_CLOSED) {
+		log_warn(s->dev_addr, "dispatch: Connection closed by the remote end (%s:%u)",
+			s->dev_addr, *(uint *)s->data);
+	}
+	else if (err == ERR_MSG_STALL) {
+		log_warn(s->dev_addr, "dispatch: Remote end of %s doesn't receive data", s->dev_addr);
+	}
+	else {
+		log_warn(s->dev_addr, "dispatch: Message receiving error on %s, state=%d!",
+			s->dev_addr, s->state);
+	}
+
+	if (s->mode == SERIAL)
+		return session_checkbaud(s, err);
+
+	if (s->mode != PIPE)
+		return err;
+
+	// if this is pipe - try to reconnect - it's because qemu closes pipe
+	msg_rx_reset(&s->rx);
+	msg_tx_reset(&s->tx);
+	s->state = MSGRECV_DESYN;
+
+	if (s->evloop) {
+		/* Don't block event loop, input is registered again once output is reopened */
+		close(s->fd);
+		close(s->fd_out);
+		s->fd_out = -1;
+		if ((s->fd = open(s->dev_in, O_RDONLY | O_NONBLOCK)) >= 0)
+			return ERR_NONE;
+	}
+	else if (--s->retries) {
+		usleep(100000);
+		close(s->fd);
+		close(s->fd_out);
+		s->fd = -1;
+		s->fd_out = -1;
+		if (connect_pipes(s->dev_in, s->dev_out, &s->fd, &s->fd_out) == 0)
+			return ERR_NONE;
+	}
+
+	return err;
+}
+
+
+void session_handle(session_t *s, msg_t *msg)
+{
+	unsigned long long t;
+	msg_t *reply;
+	u16 seq;
+	int res;
+
+	log_trace(s->dev_addr, "dispatch: Message received");
+	s->rxjunk = session_junk(s);
+	metrics_rx(&s->metrics, msg_gettype(msg), MSG_HDRSZ + msg_getlen(msg));
+
+	seq = msg_getseq(msg);
+	capture_frame(s, CAPTURE_RX, msg, seq, NULL, 0);
+
+	/* Retransmitted request isn't handled again, target gets the same reply */
+	if ((s->replay != NULL) && ((reply = replay_find(s->replay, msg)) != NULL)) {
+		log_trace(s->dev_addr, "dispatch: Replaying reply to seq=%u", seq);
+		s->metrics.replays++;
+		session_send(s, reply, seq);
+		return;
+	}
+
+	if (s->replay != NULL)
+		replay_begin(s->replay, msg);
+
+	t = metrics_now();
+	res = phfs_handlemsg(s, msg);
+	metrics_latency(&s->metrics, metrics_now() - t);
+
+	if (!res) {
+		switch (msg_gettype(msg)) {
+		case MSG_ERR:
+			msg_settype(msg, MSG_ERR);
+			msg_setlen(msg, MSG_MAXLEN);
+			session_send(s, msg, seq);
 			break;
 		}
-		fprintf(stderr, "[%d] dispatch: Message received\n", getpid());
+	}
 
-		u16 seq = msg_getseq(&msg);
-		if ((err = phfs_handlemsg((mode == PIPE ? fd_out : fd), &msg, sysdir)))
-			continue;
+	if (s->replay != NULL)
+		replay_end(s->replay);
+}
 
-		switch (msg_gettype(&msg)) {
-		case MSG_ERR:
-			msg_settype(&msg, MSG_ERR);
-			msg_setlen(&msg, MSG_MAXLEN);
-			msg_send((mode == PIPE ? fd_out : fd), &msg, seq);
+
+int session_process(session_t *s)
+{
+	int err;
+
+	/* Blocking dispatcher waits for QEMU, event loop registers FIFO only after it's connected */
+	while ((s->mode == PIPE) && (s->fd_out < 0)) {
+		if ((err = session_reopen(s)) < 0)
+			return err;
+		if (s->fd_out < 0)
+			usleep(PIPE_RETRY * 1000);
+	}
+
+	if ((s->mode == QEMU) && (s->fd == s->lfd))
+		return session_accept(s);
+
+	if ((err = s->recv(s->fd, &s->rx, &s->state)) < 0)
+		return (err == ERR_MSG_INTR) ? err : session_error(s, err);
+
+	session_handle(s, s->rx.msg);
+
+	return s->stalled ? session_error(s, ERR_MSG_STALL) : ERR_NONE;
+}
+
+
+int session_ready(session_t *s)
+{
+	int err;
+
+	/* Endpoint corks and flushes peer sessions itself */
+	if (s->udp != NULL)
+		return udpsrv_ready(s);
+
+	if ((s->mode == QEMU) && (s->fd == s->lfd))
+		return session_accept(s);
+
+	s->tx.cork = 1;
+
+	if ((err = msg_rx_read(&s->rx, s->fd)) < 0) {
+		s->state = MSGRECV_DESYN;
+		err = session_error(s, err);
+	}
+	else {
+		/* Single read may contain several frames */
+		while ((err = msg_rx_decode(&s->rx, &s->state)) > 0)
+			session_handle(s, s->rx.msg);
+
+		if (err < 0)
+			err = session_error(s, err);
+		else if (s->mode == SERIAL)
+			err = session_checkbaud(s, err);
+	}
+
+	s->tx.cork = 0;
+	if ((session_flush(s) < 0) && (err == ERR_NONE))
+		err = s->stalled ? session_error(s, ERR_MSG_STALL) : (s->mode == QEMU) ? session_disconnect(s) : ERR_DISPATCH_IO;
+
+	return err;
+}
+
+
+void session_close(session_t *s)
+{
+	phfs_closeall(s);
+	free(s->files);
+	s->files = NULL;
+	s->nfiles = 0;
+
+	if (s->udp != NULL)
+		udpsrv_close(s);
+
+	replay_free(s->replay);
+	s->replay = NULL;
+
+	/* Listening socket is removed together with its path */
+	if (s->lfd >= 0) {
+		if (s->fd != s->lfd)
+			close(s->lfd);
+		unlink(s->dev_addr);
+		s->lfd = -1;
+	}
+
+	/* Socket of peer session is closed by endpoint */
+	if (!s->peer) {
+		if ((s->fd_out >= 0) && (s->fd_out != s->fd))
+			close(s->fd_out);
+		if (s->fd >= 0)
+			close(s->fd);
+	}
+	s->fd = -1;
+	s->fd_out = -1;
+
+	free(s->dev_in);
+	free(s->dev_out);
+	s->dev_in = NULL;
+	s->dev_out = NULL;
+
+	msg_rx_done(&s->rx);
+}
+
+
+/* Function waits for next request while write-behind buffers are pending, they expire when target is idle */
+static void session_idle(session_t *s)
+{
+	struct pollfd pfd;
+	int tmo;
+
+	while ((s->fd >= 0) && (s->rx.rd == s->rx.wr) && ((tmo = phfs_timer(s)) >= 0)) {
+		pfd.fd = s->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, tmo) != 0)
 			break;
+	}
+}
+
+
+/* Function checks whether FIFO session has both ends opened, other sessions are always connected */
+static int session_connected(session_t *s)
+{
+	return (s->mode != PIPE) || (s->fd_out >= 0);
+}
+
+
+/* Function returns ms until next timer of session (UDP endpoint includes its peers) or -1 */
+static int session_timer(session_t *s)
+{
+	session_t *peers[UDPSRV_MAXPEERS];
+	unsigned int k, n;
+	int tmo, t;
+
+	/* FIFO output is opened again after interval */
+	if ((s->mode == PIPE) && (s->fd_out < 0))
+		return PIPE_RETRY;
+
+	if (s->udp == NULL)
+		return phfs_timer(s);
+
+	tmo = udpsrv_timer(s);
+	for (k = 0, n = udpsrv_sessions(s, peers, UDPSRV_MAXPEERS); k < n; k++) {
+		if (((t = phfs_timer(peers[k])) >= 0) && ((tmo < 0) || (t < tmo)))
+			tmo = t;
+	}
+
+	return tmo;
+}
+
+
+/* Function reads and dispatches messages */
+int dispatch(char *dev_addr, dmode_t mode, char *sysdir, void *data)
+{
+	session_t s;
+	int err;
+
+	if (session_open(&s, dev_addr, mode, sysdir, data) < 0)
+		return ERR_DISPATCH_IO;
+
+	/* UDP endpoint serves all peers and broadcasts beacon from event loop */
+	if (mode == UDP)
+		return dispatch_sessions(&s, 1);
+
+	/* Buffered log is written once per frame (nothing is written if traces are aggregated) */
+	for (;;) {
+		session_idle(&s);
+
+		/* Interrupted wait lets metrics be exported for idle or stuck link */
+		err = session_process(&s);
+		if ((err != ERR_NONE) && (err != ERR_MSG_INTR))
+			break;
+
+		log_flush();
+		if (metrics_pending())
+			metrics_export(&s, 1);
+	}
+
+	metrics_export(&s, 1);
+
+	session_close(&s);
+
+	return 0;
+}
+
+
+int dispatch_sessions(session_t *sessions, unsigned int n)
+{
+	reactor_t r;
+	session_t *s, *ready[REACTOR_MAXEVENTS];
+	unsigned int k, active = 0;
+	int i, cnt, fd, timeout, tmo;
+
+	if (reactor_init(&r) < 0) {
+		log_error(NULL, "dispatch: Can't create event loop");
+		return ERR_DISPATCH_IO;
+	}
+
+	for (k = 0; k < n; k++) {
+		if (sessions[k].fd < 0)
+			continue;
+
+		sessions[k].evloop = 1;
+		if (!session_connected(&sessions[k])) {
+			active++;
+			continue;
 		}
 
+		if (reactor_add(&r, sessions[k].fd, &sessions[k]) < 0) {
+			log_error(NULL, "dispatch: Can't register %s in event loop", sessions[k].dev_addr);
+			session_close(&sessions[k]);
+			continue;
+		}
+		active++;
 	}
 
-	if (mode == PIPE) {
-		free(dev_in);
-		free(dev_out);
+	log_info(NULL, "dispatch: Serving %u session(s) from single event loop", active);
+
+	while (active > 0) {
+		if (metrics_pending())
+			metrics_export(sessions, n);
+
+		/* FIFO session is registered once QEMU opens both ends */
+		for (k = 0; k < n; k++) {
+			s = &sessions[k];
+			if ((s->fd < 0) || session_connected(s))
+				continue;
+
+			if ((session_reopen(s) == ERR_NONE) && (!session_connected(s) || (reactor_add(&r, s->fd, s) == 0)))
+				continue;
+
+			log_error(NULL, "dispatch: Can't register %s in event loop", s->dev_addr);
+			session_close(s);
+			active--;
+		}
+
+		/* Beacons of UDP endpoints and write-behind buffers */
+		timeout = -1;
+		for (k = 0; k < n; k++) {
+			if ((sessions[k].fd >= 0) && ((tmo = session_timer(&sessions[k])) >= 0) && ((tmo < timeout) || (timeout < 0)))
+				timeout = tmo;
+		}
+
+		log_flush();
+		if ((cnt = reactor_wait(&r, (void **)ready, REACTOR_MAXEVENTS, timeout)) < 0) {
+			log_error(NULL, "dispatch: Event loop error");
+			break;
+		}
+
+		for (i = 0; i < cnt; i++) {
+			s = ready[i];
+			fd = s->fd;
+
+			if (session_ready(s) == ERR_NONE) {
+				/* Pipe may have been reopened with new descriptors (registered when connected), QEMU socket (dis)connected */
+				if (s->fd != fd) {
+					if (fd == s->lfd)
+						reactor_del(&r, fd);
+					if (session_connected(s))
+						reactor_add(&r, s->fd, s);
+				}
+				continue;
+			}
+
+			if (s->fd == fd)
+				reactor_del(&r, fd);
+			session_close(s);
+			active--;
+		}
 	}
 
+	metrics_export(sessions, n);
+	reactor_done(&r);
+
 	return 0;
 }
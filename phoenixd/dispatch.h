@@ -15,7 +15,11 @@
 
 #ifndef _DISPATCH_H_
 #define _DISPATCH_H_
+
+#include <sys/stat.h>
+#include <hostutils-common/log.h>
 #include "msg.h"
+#include "metrics.h"
 
 
 typedef enum {
@@ -24,14 +28,110 @@ typedef enum {
 	UDP,
 	TCP,
 	USB_VYBRID,
-	USB_IMX
+	USB_IMX,
+	QEMU
 } dmode_t;
 
 
+/* File opened by the target (PHFS handle is slot index + 1) */
+typedef struct _session_file_t {
+	int fd;                  /* host descriptor, -1 for free slot */
+	struct stat st;          /* metadata fetched at open, updated by writes */
+	struct _fcache_t *cache; /* shared content mapping, NULL if file is not cached */
+	u8 *wbuff;               /* write-behind buffer (PHFS_WB_SIZE), allocated by first write */
+	size_t wlen;             /* buffered bytes */
+	off_t wpos;              /* file position of buffered data */
+	unsigned long long wtime; /* time of first buffered write (us) */
+	int werr;                /* buffered write failed, not reported yet */
+} session_file_t;
+
+
+/* Single PHFS session (serial port, pipe pair, UDP or TCP endpoint, QEMU socket) */
+typedef struct _session_t {
+	char *dev_addr;
+	dmode_t mode;
+	char *sysdir;
+	void *data;
+
+	int fd;            /* receive descriptor */
+	int fd_out;        /* send descriptor (differs from fd for pipes only) */
+	int lfd;           /* listening socket (QEMU), fd is set to it until connection is accepted */
+	int state;         /* receiver state */
+	msg_rx_t rx;       /* receive context, holds negotiated frame size */
+	msg_tx_t tx;       /* transmit queue, replies are coalesced while tx.cork is set */
+	unsigned int maxlen; /* largest frame payload supported by transport */
+	u32 caps;          /* negotiated PHFS capabilities */
+	unsigned int window; /* negotiated number of outstanding requests */
+	int retries;       /* pipe reconnection attempts left */
+	int evloop;        /* session is served from event loop, reconnect without blocking */
+	int baudrate;      /* current serial link speed */
+	int safebaud;      /* initial serial link speed, target uses it after reboot */
+	int badbaud;       /* lowest speed rejected by port driver, it isn't negotiated again (0 - none) */
+	int stalled;       /* peer stopped reading, nothing is sent until session recovers from error */
+	unsigned long long rxjunk; /* receive errors counted until last valid frame */
+	int peer;          /* UDP peer session, socket belongs to endpoint */
+	struct _udpsrv_t *udp; /* UDP endpoint, peers are demultiplexed to their own sessions */
+	struct _replay_t *replay; /* replies to recent requests, resent to retransmitted ones (UDP peers) */
+	unsigned int capid; /* session number in frame capture, 0 until first frame */
+	char *dev_in;
+	char *dev_out;
+
+	int (*send)(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+	int (*flush)(int fd, msg_tx_t *tx);
+	int (*recv)(int fd, msg_rx_t *rx, int *state);
+
+	metrics_t metrics;
+	log_sum_t rsum;    /* aggregated MSG_READ traces */
+	log_sum_t wsum;    /* aggregated MSG_WRITE traces */
+
+	session_file_t *files; /* handle table of files opened by the target */
+	unsigned int nfiles;   /* number of table slots */
+	unsigned int wbusy;    /* files with pending write-behind data */
+} session_t;
+
+
+/* Function opens session transport */
+extern int session_open(session_t *s, char *dev_addr, dmode_t mode, char *sysdir, void *data);
+
+
+/* Function sends message to the session peer */
+extern int session_send(session_t *s, msg_t *msg, u16 seq);
+
+
+/* Function sends message with last len bytes of payload stored in data (data must be valid until flush) */
+extern int session_senddata(session_t *s, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+
+
+/* Function writes replies queued by corked session */
+extern int session_flush(session_t *s);
+
+
+/* Function switches serial link speed once queued replies are sent */
+extern int session_setbaud(session_t *s, int baudrate);
+
+
+/* Function handles received message (msg must be valid until replies are flushed) */
+extern void session_handle(session_t *s, msg_t *msg);
+
+
+/* Function receives and handles single message, returns error if session should be closed (ERR_MSG_INTR - wait interrupted by signal) */
+extern int session_process(session_t *s);
+
+
+/* Function handles all messages available on ready session descriptor without blocking */
+extern int session_ready(session_t *s);
+
+
+/* Function closes session transport and files opened by the target */
+extern void session_close(session_t *s);
+
+
 /* Function reads and dispatches messages */
 extern int dispatch(char *dev_addr, dmode_t mode, char *sysdir, void *data);
-extern int (*msg_send)(int fd, msg_t *msg, u16 seq);
-extern int (*msg_recv)(int fd, msg_t *msg, int *state);
+
+
+/* Function dispatches messages for all sessions from single event loop */
+extern int dispatch_sessions(session_t *sessions, unsigned int n);
 
 extern int boot_image(char *kernel, char *initrd, char *console, char *append, char *output, int plugin);
 
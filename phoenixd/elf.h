@@ -25,8 +25,21 @@ typedef u32 Elf32_Addr;
 typedef u32 Elf32_Off;
 typedef int Elf32_Sword;
 
+typedef uint16_t Elf64_Half;
+typedef uint32_t Elf64_Word;
+typedef uint64_t Elf64_Xword;
+typedef uint64_t Elf64_Addr;
+typedef uint64_t Elf64_Off;
+
 
 #define EI_NIDENT     16
+#define EI_CLASS      4
+
+#define ELFMAG        "\177ELF"
+#define SELFMAG       4
+
+#define ELFCLASS32    1
+#define ELFCLASS64    2
 
 #define SHT_SYMTAB    2
 #define SHT_STRTAB    3
@@ -103,6 +116,36 @@ typedef struct {
 	Elf32_Half    st_shndx;
 } Elf32_Sym;
 
+
+typedef struct {
+	unsigned char e_ident[EI_NIDENT];
+	Elf64_Half e_type;
+	Elf64_Half e_machine;
+	Elf64_Word e_version;
+	Elf64_Addr e_entry;
+	Elf64_Off  e_phoff;
+	Elf64_Off  e_shoff;
+	Elf64_Word e_flags;
+	Elf64_Half e_hsize;
+	Elf64_Half e_phentsize;
+	Elf64_Half e_phnum;
+	Elf64_Half e_shentsize;
+	Elf64_Half e_shnum;
+	Elf64_Half e_shstrndx;
+} Elf64_Ehdr;
+
+
+typedef struct {
+	Elf64_Word  p_type;
+	Elf64_Word  p_flags;
+	Elf64_Off   p_offset;
+	Elf64_Addr  p_vaddr;
+	Elf64_Addr  p_paddr;
+	Elf64_Xword p_filesz;
+	Elf64_Xword p_memsz;
+	Elf64_Xword p_align;
+} Elf64_Phdr;
+
 #pragma pack(pop)
 
 
@@ -0,0 +1,206 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of preparsed ELF load plans
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <hostutils-common/errors.h>
+#include "elf.h"
+#include "elfplan.h"
+
+
+static struct {
+	elfplan_t *plans;         /* most recently used first */
+	unsigned int count;
+} elfplan_common;
+
+
+static void elfplan_free(elfplan_t *plan)
+{
+	fcache_put(plan->file);
+	free(plan);
+}
+
+
+/* Function checks if [offs, offs + size) lies within file */
+static int elfplan_inside(fcache_t *e, uint64_t offs, uint64_t size)
+{
+	return (offs <= (uint64_t)e->size) && (size <= (uint64_t)e->size - offs);
+}
+
+
+/* Function reads program header fields independently of file class */
+static void elfplan_phdr(int cls, const void *p, uint32_t *type, uint64_t *offs, uint64_t *vaddr, uint64_t *filesz)
+{
+	const Elf32_Phdr *p32;
+	const Elf64_Phdr *p64;
+
+	if (cls == ELFCLASS64) {
+		p64 = p;
+		*type = p64->p_type;
+		*offs = p64->p_offset;
+		*vaddr = p64->p_vaddr;
+		*filesz = p64->p_filesz;
+	}
+	else {
+		p32 = p;
+		*type = p32->p_type;
+		*offs = p32->p_offset;
+		*vaddr = p32->p_vaddr;
+		*filesz = p32->p_filesz;
+	}
+}
+
+
+static int elfplan_parse(fcache_t *e, elfplan_t **res)
+{
+	const unsigned char *data = e->data;
+	const Elf32_Ehdr *h32;
+	const Elf64_Ehdr *h64;
+	uint64_t phoff, offs, vaddr, filesz;
+	unsigned int phnum, phentsize, k;
+	elfplan_t *plan;
+	size_t ehdrsz, phdrsz;
+	uint32_t type;
+	int cls;
+
+	if ((e->size < EI_NIDENT) || (memcmp(data, ELFMAG, SELFMAG) != 0))
+		return ERR_FILE;
+
+	if ((cls = data[EI_CLASS]) == ELFCLASS64) {
+		ehdrsz = sizeof(Elf64_Ehdr);
+		phdrsz = sizeof(Elf64_Phdr);
+	}
+	else if (cls == ELFCLASS32) {
+		ehdrsz = sizeof(Elf32_Ehdr);
+		phdrsz = sizeof(Elf32_Phdr);
+	}
+	else {
+		return ERR_FILE;
+	}
+
+	if (!elfplan_inside(e, 0, ehdrsz))
+		return ERR_FILE;
+
+	if (cls == ELFCLASS64) {
+		h64 = (const Elf64_Ehdr *)data;
+		phoff = h64->e_phoff;
+		phnum = h64->e_phnum;
+		phentsize = h64->e_phentsize;
+	}
+	else {
+		h32 = (const Elf32_Ehdr *)data;
+		phoff = h32->e_phoff;
+		phnum = h32->e_phnum;
+		phentsize = h32->e_phentsize;
+	}
+
+	if ((phnum > 0) && ((phentsize < phdrsz) || !elfplan_inside(e, phoff, (uint64_t)phnum * phentsize)))
+		return ERR_FILE;
+
+	if ((plan = malloc(sizeof(*plan) + phnum * sizeof(elfplan_seg_t))) == NULL)
+		return ERR_MEM;
+
+	plan->next = NULL;
+	plan->file = e;
+	plan->cls = cls;
+	plan->ehdr = data;
+	plan->ehdrsz = ehdrsz;
+	plan->phdrsz = phdrsz;
+	plan->nsegs = 0;
+
+	for (k = 0; k < phnum; k++) {
+		elfplan_phdr(cls, data + phoff + k * phentsize, &type, &offs, &vaddr, &filesz);
+
+		if ((type != PT_LOAD) || (vaddr == 0))
+			continue;
+
+		if (!elfplan_inside(e, offs, filesz)) {
+			free(plan);
+			return ERR_FILE;
+		}
+
+		plan->segs[plan->nsegs].vaddr = vaddr;
+		plan->segs[plan->nsegs].filesz = filesz;
+		plan->segs[plan->nsegs].phdr = data + phoff + k * phentsize;
+		plan->segs[plan->nsegs].data = data + offs;
+		plan->nsegs++;
+	}
+
+	*res = plan;
+
+	return ERR_NONE;
+}
+
+
+int elfplan_get(const char *path, elfplan_t **plan)
+{
+	elfplan_t **p, *pl;
+	struct stat st;
+	fcache_t *e;
+	int fd, err;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return ERR_FILE;
+
+	/* Mapping outlives descriptor, cache entry changes when the file is modified */
+	e = (fstat(fd, &st) < 0) ? NULL : fcache_get(path, fd, &st);
+	close(fd);
+
+	if (e == NULL)
+		return ERR_FILE;
+
+	for (p = &elfplan_common.plans; (pl = *p) != NULL; p = &pl->next) {
+		if (strcmp(pl->file->path, path) != 0)
+			continue;
+
+		*p = pl->next;
+
+		if (pl->file == e) {
+			fcache_put(e);
+			pl->next = elfplan_common.plans;
+			elfplan_common.plans = pl;
+			*plan = pl;
+			return ERR_NONE;
+		}
+
+		/* File has been modified */
+		elfplan_free(pl);
+		elfplan_common.count--;
+		break;
+	}
+
+	if ((err = elfplan_parse(e, &pl)) < 0) {
+		fcache_put(e);
+		return err;
+	}
+
+	if (elfplan_common.count >= ELFPLAN_MAXPLANS) {
+		for (p = &elfplan_common.plans; (*p)->next != NULL; p = &(*p)->next)
+			;
+		elfplan_free(*p);
+		*p = NULL;
+		elfplan_common.count--;
+	}
+
+	pl->next = elfplan_common.plans;
+	elfplan_common.plans = pl;
+	elfplan_common.count++;
+	*plan = pl;
+
+	return ERR_NONE;
+}
@@ -0,0 +1,53 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of preparsed ELF load plans
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _ELFPLAN_H_
+#define _ELFPLAN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "fcache.h"
+
+
+/* Maximum number of cached plans (least recently used one is dropped above it) */
+#define ELFPLAN_MAXPLANS  32
+
+
+/* Loadable segment (PT_LOAD with non-zero address) */
+typedef struct _elfplan_seg_t {
+	uint64_t vaddr;
+	uint64_t filesz;
+	const void *phdr;         /* program header in file class format */
+	const void *data;         /* segment content */
+} elfplan_seg_t;
+
+
+typedef struct _elfplan_t {
+	struct _elfplan_t *next;
+	fcache_t *file;           /* mapping of the file, plan is valid as long as the entry matches the file */
+	int cls;                  /* ELFCLASS32 or ELFCLASS64 */
+	const void *ehdr;         /* ELF header in file class format */
+	size_t ehdrsz;
+	size_t phdrsz;
+	unsigned int nsegs;
+	elfplan_seg_t segs[];
+} elfplan_t;
+
+
+/* Function returns load plan of ELF file, it is valid until next elfplan_get() call */
+extern int elfplan_get(const char *path, elfplan_t **plan);
+
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Shared cache of memory mapped sysdir files
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fcache.h"
+#include "lz4.h"
+
+
+#ifdef __APPLE__
+#define st_mtim_nsec(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define st_mtim_nsec(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+
+static struct {
+	fcache_t *buckets[FCACHE_BUCKETS];
+	unsigned int count;
+	unsigned long long hits;
+	unsigned long long misses;
+} fcache_common;
+
+
+static unsigned int fcache_hash(const char *path)
+{
+	unsigned int h = 2166136261u;
+
+	for (; *path != '\0'; path++)
+		h = (h ^ (unsigned char)*path) * 16777619u;
+
+	return h & (FCACHE_BUCKETS - 1);
+}
+
+
+static int fcache_match(fcache_t *e, struct stat *st)
+{
+	return (e->dev == st->st_dev) && (e->ino == st->st_ino) && (e->size == st->st_size) &&
+		(e->mtime == st->st_mtime) && (e->mtime_nsec == st_mtim_nsec(st));
+}
+
+
+static void fcache_free(fcache_t *e)
+{
+	fcache_chunk_t *c, *next;
+	unsigned int i;
+
+	if (e->chunks != NULL) {
+		for (i = 0; i < FCACHE_CHUNKS; i++) {
+			for (c = e->chunks[i]; c != NULL; c = next) {
+				next = c->next;
+				free(c);
+			}
+		}
+		free(e->chunks);
+	}
+
+	if (e->data != NULL)
+		munmap(e->data, e->size);
+	free(e->path);
+	free(e);
+}
+
+
+/* Function removes entry from hash table, it is freed when last user releases it */
+static void fcache_unlink(fcache_t *e)
+{
+	fcache_t **p;
+
+	for (p = &fcache_common.buckets[fcache_hash(e->path)]; *p != NULL; p = &(*p)->next) {
+		if (*p == e) {
+			*p = e->next;
+			break;
+		}
+	}
+
+	e->next = NULL;
+	e->stale = 1;
+	fcache_common.count--;
+
+	if (e->refs == 0)
+		fcache_free(e);
+}
+
+
+static void fcache_evict(void)
+{
+	fcache_t *e, *next;
+	unsigned int i;
+
+	for (i = 0; (i < FCACHE_BUCKETS) && (fcache_common.count >= FCACHE_MAXFILES); i++) {
+		for (e = fcache_common.buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			if (e->refs == 0)
+				fcache_unlink(e);
+		}
+	}
+}
+
+
+fcache_t *fcache_get(const char *path, int fd, struct stat *st)
+{
+	fcache_t *e;
+	unsigned int h = fcache_hash(path);
+
+	if (!S_ISREG(st->st_mode))
+		return NULL;
+
+	for (e = fcache_common.buckets[h]; e != NULL; e = e->next) {
+		if (strcmp(e->path, path) != 0)
+			continue;
+
+		if (fcache_match(e, st)) {
+			fcache_common.hits++;
+			e->refs++;
+			return e;
+		}
+
+		/* File has been replaced or modified */
+		fcache_unlink(e);
+		break;
+	}
+
+	fcache_common.misses++;
+
+	if (fcache_common.count >= FCACHE_MAXFILES)
+		fcache_evict();
+
+	if ((e = calloc(1, sizeof(*e))) == NULL)
+		return NULL;
+
+	if ((e->path = strdup(path)) == NULL) {
+		free(e);
+		return NULL;
+	}
+
+	e->dev = st->st_dev;
+	e->ino = st->st_ino;
+	e->size = st->st_size;
+	e->mtime = st->st_mtime;
+	e->mtime_nsec = st_mtim_nsec(st);
+
+	if (e->size > 0) {
+		if ((e->data = mmap(NULL, e->size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+			free(e->path);
+			free(e);
+			return NULL;
+		}
+		madvise(e->data, e->size, MADV_WILLNEED);
+	}
+
+	e->refs = 1;
+	e->next = fcache_common.buckets[h];
+	fcache_common.buckets[h] = e;
+	fcache_common.count++;
+
+	return e;
+}
+
+
+void fcache_put(fcache_t *e)
+{
+	if (--e->refs > 0)
+		return;
+
+	if (e->stale)
+		fcache_free(e);
+}
+
+
+int fcache_valid(fcache_t *e, int fd)
+{
+	struct stat st;
+
+	if (e->stale)
+		return 0;
+
+	/* Reading mapping of truncated file would raise SIGBUS */
+	if ((fstat(fd, &st) < 0) || !fcache_match(e, &st)) {
+		fcache_unlink(e);
+		return 0;
+	}
+
+	return 1;
+}
+
+
+const void *fcache_ptr(fcache_t *e, off_t pos, size_t *len)
+{
+	if ((pos < 0) || (pos >= e->size)) {
+		*len = 0;
+		return NULL;
+	}
+
+	if (*len > (size_t)(e->size - pos))
+		*len = e->size - pos;
+
+	return (char *)e->data + pos;
+}
+
+
+const void *fcache_lz4(fcache_t *e, off_t pos, size_t len, size_t *zlen)
+{
+	fcache_chunk_t *c, *next;
+	const void *src;
+	unsigned int h;
+
+	if ((src = fcache_ptr(e, pos, &len)) == NULL)
+		return NULL;
+
+	if ((e->chunks == NULL) && ((e->chunks = calloc(FCACHE_CHUNKS, sizeof(*e->chunks))) == NULL))
+		return NULL;
+
+	h = (unsigned int)((pos / (len + 1)) ^ len) & (FCACHE_CHUNKS - 1);
+	for (c = e->chunks[h]; c != NULL; c = c->next) {
+		if ((c->pos == pos) && (c->len == len))
+			break;
+	}
+
+	if (c == NULL) {
+		/* Compressed chunks of all read patterns shouldn't take more than the file itself */
+		if (e->zbytes + len > (size_t)e->size)
+			return NULL;
+
+		if ((c = malloc(sizeof(*c) + len)) == NULL)
+			return NULL;
+
+		c->pos = pos;
+		c->len = len;
+		c->zlen = lz4_compress(src, len, c->data, len - 1);
+
+		/* Incompressible chunk is remembered without data */
+		if (c->zlen == 0) {
+			free(c);
+			if ((c = calloc(1, sizeof(*c))) == NULL)
+				return NULL;
+			c->pos = pos;
+			c->len = len;
+		}
+		else if ((next = realloc(c, sizeof(*c) + c->zlen)) != NULL) {
+			c = next;
+		}
+
+		e->zbytes += c->zlen;
+		c->next = e->chunks[h];
+		e->chunks[h] = c;
+	}
+
+	if (c->zlen == 0)
+		return NULL;
+
+	*zlen = c->zlen;
+
+	return c->data;
+}
+
+
+void fcache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+	*hits = fcache_common.hits;
+	*misses = fcache_common.misses;
+}
@@ -0,0 +1,82 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Shared cache of memory mapped sysdir files
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _FCACHE_H_
+#define _FCACHE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+/* Maximum number of cached files (unused entries are evicted above it) */
+#define FCACHE_MAXFILES  256
+
+/* Number of hash table buckets (must be a power of 2) */
+#define FCACHE_BUCKETS   256
+
+/* Number of compressed chunk buckets of single file (must be a power of 2) */
+#define FCACHE_CHUNKS    64
+
+
+/* Compressed file chunk */
+typedef struct _fcache_chunk_t {
+	struct _fcache_chunk_t *next;
+	off_t pos;
+	size_t len;
+	size_t zlen;              /* compressed size, 0 - chunk doesn't compress */
+	unsigned char data[];
+} fcache_chunk_t;
+
+
+typedef struct _fcache_t {
+	struct _fcache_t *next;   /* hash chain */
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	void *data;               /* mapped content, NULL for empty files */
+	unsigned int refs;
+	int stale;                /* file changed, entry is not in hash table anymore */
+	fcache_chunk_t **chunks;  /* chunks compressed so far (allocated on first use) */
+	size_t zbytes;            /* size of stored compressed chunks */
+} fcache_t;
+
+
+/* Function returns cached mapping of file opened as fd (st - its fstat result), mapping is created if needed */
+extern fcache_t *fcache_get(const char *path, int fd, struct stat *st);
+
+
+/* Function releases entry obtained by fcache_get() */
+extern void fcache_put(fcache_t *e);
+
+
+/* Function checks if file opened as fd still matches cached content, stale entries are invalidated */
+extern int fcache_valid(fcache_t *e, int fd);
+
+
+/* Function returns pointer to cached content at pos, len is clipped to the end of file */
+extern const void *fcache_ptr(fcache_t *e, off_t pos, size_t *len);
+
+
+/* Function returns LZ4 compressed content of len bytes at pos (NULL if it doesn't compress), chunks are compressed once */
+extern const void *fcache_lz4(fcache_t *e, off_t pos, size_t len, size_t *zlen);
+
+
+/* Function returns number of lookups which found valid mapping (hits) and which had to map the file */
+extern void fcache_stats(unsigned long long *hits, unsigned long long *misses);
+
+
+#endif
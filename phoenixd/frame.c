@@ -0,0 +1,251 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * BSP2 framing kernels (escaping and checksum)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRAME_NEON
+#endif
+
+#include "msg.h"
+#include "frame.h"
+
+
+static size_t frame_scan_select(const u8 *p, size_t len);
+static u32 frame_sum_select(const u8 *p, size_t len);
+
+
+/* Kernels are selected on first use */
+static struct {
+	size_t (*scan)(const u8 *p, size_t len);
+	u32 (*sum)(const u8 *p, size_t len);
+} frame_common = { frame_scan_select, frame_sum_select };
+
+
+/* Scalar kernels, used for tails and on CPUs without vector unit */
+
+static size_t frame_scan_scalar(const u8 *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((p[i] == MSG_MARK) || (p[i] == MSG_ESC))
+			break;
+	}
+
+	return i;
+}
+
+
+static u32 frame_sum_scalar(const u8 *p, size_t len)
+{
+	u32 sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sum += p[i];
+
+	return sum;
+}
+
+
+#ifdef FRAME_X86
+
+#ifdef __SSE2__
+
+static size_t frame_scan_sse2(const u8 *p, size_t len)
+{
+	const __m128i mark = _mm_set1_epi8(MSG_MARK), esc = _mm_set1_epi8(MSG_ESC);
+	__m128i v;
+	size_t i;
+	int mask;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(p + i));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, mark), _mm_cmpeq_epi8(v, esc)));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + frame_scan_scalar(p + i, len - i);
+}
+
+
+static u32 frame_sum_sse2(const u8 *p, size_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	size_t i;
+
+	/* psadbw against zero sums each 8 bytes into 64-bit lane */
+	for (i = 0; i + 16 <= len; i += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(p + i)), zero));
+
+	acc = _mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc));
+
+	return (u32)_mm_cvtsi128_si32(acc) + frame_sum_scalar(p + i, len - i);
+}
+
+#endif
+
+
+__attribute__((target("avx2"))) static size_t frame_scan_avx2(const u8 *p, size_t len)
+{
+	const __m256i mark = _mm256_set1_epi8(MSG_MARK), esc = _mm256_set1_epi8(MSG_ESC);
+	__m256i v;
+	size_t i;
+	unsigned int mask;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(p + i));
+		mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, mark), _mm256_cmpeq_epi8(v, esc)));
+		if (mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + frame_scan_scalar(p + i, len - i);
+}
+
+
+__attribute__((target("avx2"))) static u32 frame_sum_avx2(const u8 *p, size_t len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	__m128i s;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32)
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(p + i)), zero));
+
+	s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+
+	return (u32)_mm_cvtsi128_si32(s) + frame_sum_scalar(p + i, len - i);
+}
+
+#endif
+
+
+#ifdef FRAME_NEON
+
+static size_t frame_scan_neon(const u8 *p, size_t len)
+{
+	const uint8x16_t mark = vdupq_n_u8(MSG_MARK), esc = vdupq_n_u8(MSG_ESC);
+	uint8x16_t v, m;
+	uint64_t mask;
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = vld1q_u8(p + i);
+		m = vorrq_u8(vceqq_u8(v, mark), vceqq_u8(v, esc));
+
+		/* Narrow comparison result to 4 bits per byte */
+		mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (mask != 0)
+			return i + (__builtin_ctzll(mask) >> 2);
+	}
+
+	return i + frame_scan_scalar(p + i, len - i);
+}
+
+
+static u32 frame_sum_neon(const u8 *p, size_t len)
+{
+	uint32x4_t acc = vdupq_n_u32(0);
+	size_t i;
+
+	for (i = 0; i + 16 <= len; i += 16)
+		acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(p + i)));
+
+	return vaddvq_u32(acc) + frame_sum_scalar(p + i, len - i);
+}
+
+#endif
+
+
+static void frame_select(void)
+{
+	frame_common.scan = frame_scan_scalar;
+	frame_common.sum = frame_sum_scalar;
+
+#ifdef FRAME_X86
+#ifdef __SSE2__
+	frame_common.scan = frame_scan_sse2;
+	frame_common.sum = frame_sum_sse2;
+#endif
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		frame_common.scan = frame_scan_avx2;
+		frame_common.sum = frame_sum_avx2;
+	}
+#endif
+
+#ifdef FRAME_NEON
+	frame_common.scan = frame_scan_neon;
+	frame_common.sum = frame_sum_neon;
+#endif
+}
+
+
+static size_t frame_scan_select(const u8 *p, size_t len)
+{
+	frame_select();
+	return frame_common.scan(p, len);
+}
+
+
+static u32 frame_sum_select(const u8 *p, size_t len)
+{
+	frame_select();
+	return frame_common.sum(p, len);
+}
+
+
+size_t frame_scan(const u8 *p, size_t len)
+{
+	return frame_common.scan(p, len);
+}
+
+
+size_t frame_escape(u8 *dst, const u8 *src, size_t len)
+{
+	size_t i = 0, n;
+	u8 *d = dst;
+
+	while (i < len) {
+		/* Clean runs are copied as a whole */
+		n = frame_common.scan(src + i, len - i);
+		memcpy(d, src + i, n);
+		d += n;
+		i += n;
+
+		if (i < len) {
+			*d++ = MSG_ESC;
+			*d++ = (src[i] == MSG_MARK) ? MSG_ESCMARK : MSG_ESCESC;
+			i++;
+		}
+	}
+
+	return d - dst;
+}
+
+
+u32 frame_sum(const u8 *p, size_t len)
+{
+	return frame_common.sum(p, len);
+}
@@ -0,0 +1,34 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * BSP2 framing kernels (escaping and checksum)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include <stddef.h>
+#include <hostutils-common/types.h>
+
+
+/* Function returns offset of the first MSG_MARK or MSG_ESC byte, len if there is none */
+extern size_t frame_scan(const u8 *p, size_t len);
+
+
+/* Function escapes len bytes (dst must hold 2 * len bytes), returns number of bytes stored */
+extern size_t frame_escape(u8 *dst, const u8 *src, size_t len);
+
+
+/* Function returns sum of len bytes */
+extern u32 frame_sum(const u8 *p, size_t len);
+
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * LZ4 block format compressor
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <string.h>
+
+#include "lz4.h"
+
+
+/* Block format constraints */
+#define LZ4_MINMATCH      4
+#define LZ4_LASTLITERALS  5   /* block ends with literals */
+#define LZ4_MFLIMIT       12  /* last match starts at least this far before the end */
+#define LZ4_MAXOFFSET     65535
+
+#define LZ4_HASHLOG       12
+
+
+static inline u32 lz4_read32(const u8 *p)
+{
+	u32 v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+
+static inline unsigned int lz4_hash(const u8 *p)
+{
+	return (lz4_read32(p) * 2654435761u) >> (32 - LZ4_HASHLOG);
+}
+
+
+/* Function writes length continuation bytes */
+static u8 *lz4_putlen(u8 *op, size_t n)
+{
+	for (; n >= 255; n -= 255)
+		*op++ = 255;
+	*op++ = (u8)n;
+
+	return op;
+}
+
+
+/* Function writes sequence (literals followed by match, mlen 0 - last literals) */
+static u8 *lz4_sequence(u8 *op, u8 *oend, const u8 *lit, size_t litlen, size_t off, size_t mlen)
+{
+	u8 *token;
+
+	/* Worst case of token, length bytes, literals and offset */
+	if ((size_t)(oend - op) < 1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1)
+		return NULL;
+
+	token = op++;
+	if (litlen >= 15) {
+		*token = 15 << 4;
+		op = lz4_putlen(op, litlen - 15);
+	}
+	else {
+		*token = (u8)(litlen << 4);
+	}
+
+	memcpy(op, lit, litlen);
+	op += litlen;
+
+	if (mlen == 0)
+		return op;
+
+	*op++ = (u8)off;
+	*op++ = (u8)(off >> 8);
+
+	mlen -= LZ4_MINMATCH;
+	if (mlen >= 15) {
+		*token |= 15;
+		op = lz4_putlen(op, mlen - 15);
+	}
+	else {
+		*token |= (u8)mlen;
+	}
+
+	return op;
+}
+
+
+size_t lz4_compress(const u8 *src, size_t len, u8 *dst, size_t dstsz)
+{
+	u32 table[1 << LZ4_HASHLOG];
+	const u8 *ip = src, *anchor = src, *ref, *end = src + len;
+	const u8 *mflimit = end - LZ4_MFLIMIT, *matchlimit = end - LZ4_LASTLITERALS;
+	u8 *op = dst, *oend = dst + dstsz;
+	unsigned int h;
+	size_t mlen;
+
+	if (len > LZ4_MFLIMIT) {
+		/* Stale positions are rejected by comparing data */
+		memset(table, 0, sizeof(table));
+
+		for (ip++; ip < mflimit;) {
+			h = lz4_hash(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+
+			if ((ref >= ip) || (ip - ref > LZ4_MAXOFFSET) || (lz4_read32(ref) != lz4_read32(ip))) {
+				ip++;
+				continue;
+			}
+
+			while ((ip > anchor) && (ref > src) && (ip[-1] == ref[-1])) {
+				ip--;
+				ref--;
+			}
+
+			for (mlen = LZ4_MINMATCH; (ip + mlen < matchlimit) && (ip[mlen] == ref[mlen]); mlen++)
+				;
+
+			if ((op = lz4_sequence(op, oend, anchor, ip - anchor, ip - ref, mlen)) == NULL)
+				return 0;
+
+			ip += mlen;
+			anchor = ip;
+
+			if (ip < mflimit)
+				table[lz4_hash(ip - 2)] = ip - 2 - src;
+		}
+	}
+
+	if ((op = lz4_sequence(op, oend, anchor, end - anchor, 0, 0)) == NULL)
+		return 0;
+
+	return op - dst;
+}
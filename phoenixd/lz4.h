@@ -0,0 +1,26 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * LZ4 block format compressor
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include <stddef.h>
+#include <hostutils-common/types.h>
+
+
+/* Function compresses src into LZ4 block, returns compressed size or 0 if it doesn't fit in dstsz bytes */
+extern size_t lz4_compress(const u8 *src, size_t len, u8 *dst, size_t dstsz);
+
+
+#endif
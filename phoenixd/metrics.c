@@ -0,0 +1,313 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Per-session metrics (Prometheus text export)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include <hostutils-common/errors.h>
+#include <hostutils-common/log.h>
+#include "dispatch.h"
+#include "fcache.h"
+#include "vcache.h"
+#include "metrics.h"
+#include "udpsrv.h"
+
+
+static const char *metrics_types[METRICS_TYPES] = {
+	"err", "open", "read", "write", "close", "reset", "fstat", "hello", "lookup", "readdir", "other"
+};
+
+
+static struct {
+	const char *dir;
+	volatile sig_atomic_t pending;
+} metrics_common;
+
+
+unsigned long long metrics_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void metrics_rx(metrics_t *m, unsigned int type, unsigned int len)
+{
+	if (type >= METRICS_TYPES)
+		type = METRICS_TYPES - 1;
+
+	m->rxframes[type]++;
+	m->rxbytes[type] += len;
+}
+
+
+void metrics_tx(metrics_t *m, unsigned int type, unsigned int len)
+{
+	if (type >= METRICS_TYPES)
+		type = METRICS_TYPES - 1;
+
+	m->txframes[type]++;
+	m->txbytes[type] += len;
+}
+
+
+void metrics_latency(metrics_t *m, unsigned long long us)
+{
+	unsigned int k;
+
+	for (k = 0; (k < METRICS_BUCKETS) && (us > (1ULL << k)); k++)
+		;
+
+	m->latency[k]++;
+	m->latsum += us;
+}
+
+
+static void metrics_signal(int sig)
+{
+	(void)sig;
+
+	metrics_common.pending = 1;
+}
+
+
+int metrics_init(const char *dir)
+{
+	struct sigaction sa;
+
+	metrics_common.dir = dir;
+
+	/* Handler interrupts event loop wait, so export isn't delayed by idle sessions */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = metrics_signal;
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGUSR1, &sa, NULL) < 0)
+		return ERR_ARG;
+
+	return ERR_NONE;
+}
+
+
+int metrics_pending(void)
+{
+	if (!metrics_common.pending)
+		return 0;
+
+	metrics_common.pending = 0;
+
+	return 1;
+}
+
+
+static void metrics_label(FILE *f, const char *s)
+{
+	for (; *s != '\0'; s++) {
+		if ((*s == '"') || (*s == '\\'))
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+}
+
+
+static void metrics_family(FILE *f, const char *name, const char *type, const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+/* Function starts sample with session label */
+static void metrics_sample(FILE *f, const char *name, session_t *s)
+{
+	fprintf(f, "%s{session=\"", name);
+	metrics_label(f, s->dev_addr);
+	fputc('"', f);
+}
+
+
+static void metrics_types_write(FILE *f, const char *name, session_t **sessions, unsigned int n, size_t offs)
+{
+	unsigned long long *v;
+	unsigned int k, t;
+
+	for (k = 0; k < n; k++) {
+		v = (unsigned long long *)((char *)&sessions[k]->metrics + offs);
+		for (t = 0; t < METRICS_TYPES; t++) {
+			metrics_sample(f, name, sessions[k]);
+			fprintf(f, ",type=\"%s\"} %llu\n", metrics_types[t], v[t]);
+		}
+	}
+}
+
+
+static void metrics_write(FILE *f, session_t **sessions, unsigned int n)
+{
+	unsigned long long hits, misses, cnt;
+	unsigned int k, b;
+	metrics_t *m;
+
+	metrics_family(f, "phoenixd_frames_received_total", "counter", "Frames received by message type.");
+	metrics_types_write(f, "phoenixd_frames_received_total", sessions, n, offsetof(metrics_t, rxframes));
+	metrics_family(f, "phoenixd_bytes_received_total", "counter", "Unescaped bytes received by message type.");
+	metrics_types_write(f, "phoenixd_bytes_received_total", sessions, n, offsetof(metrics_t, rxbytes));
+	metrics_family(f, "phoenixd_frames_sent_total", "counter", "Frames sent by message type.");
+	metrics_types_write(f, "phoenixd_frames_sent_total", sessions, n, offsetof(metrics_t, txframes));
+	metrics_family(f, "phoenixd_bytes_sent_total", "counter", "Unescaped bytes sent by message type.");
+	metrics_types_write(f, "phoenixd_bytes_sent_total", sessions, n, offsetof(metrics_t, txbytes));
+
+	metrics_family(f, "phoenixd_desync_errors_total", "counter", "Frames discarded due to bad length or unexpected frame mark.");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_desync_errors_total", sessions[k]);
+		fprintf(f, "} %lu\n", sessions[k]->rx.desync);
+	}
+
+	metrics_family(f, "phoenixd_escape_errors_total", "counter", "Invalid escape sequences.");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_escape_errors_total", sessions[k]);
+		fprintf(f, "} %lu\n", sessions[k]->rx.escerr);
+	}
+
+	metrics_family(f, "phoenixd_dropped_bytes_total", "counter", "Bytes skipped while synchronizing to frame mark.");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_dropped_bytes_total", sessions[k]);
+		fprintf(f, "} %llu\n", sessions[k]->rx.dropped);
+	}
+
+	metrics_family(f, "phoenixd_request_latency_seconds", "histogram", "Time from decoded request to reply handed to transport.");
+	for (k = 0; k < n; k++) {
+		m = &sessions[k]->metrics;
+		for (b = 0, cnt = 0; b <= METRICS_BUCKETS; b++) {
+			cnt += m->latency[b];
+			metrics_sample(f, "phoenixd_request_latency_seconds_bucket", sessions[k]);
+			if (b < METRICS_BUCKETS)
+				fprintf(f, ",le=\"%g\"} %llu\n", (double)(1ULL << b) / 1000000, cnt);
+			else
+				fprintf(f, ",le=\"+Inf\"} %llu\n", cnt);
+		}
+		metrics_sample(f, "phoenixd_request_latency_seconds_sum", sessions[k]);
+		fprintf(f, "} %.6f\n", (double)m->latsum / 1000000);
+		metrics_sample(f, "phoenixd_request_latency_seconds_count", sessions[k]);
+		fprintf(f, "} %llu\n", cnt);
+	}
+
+	metrics_family(f, "phoenixd_reads_total", "counter", "MSG_READ requests served from file cache (hit) or disk (miss).");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_reads_total", sessions[k]);
+		fprintf(f, ",result=\"hit\"} %llu\n", sessions[k]->metrics.hits);
+		metrics_sample(f, "phoenixd_reads_total", sessions[k]);
+		fprintf(f, ",result=\"miss\"} %llu\n", sessions[k]->metrics.misses);
+	}
+
+	metrics_family(f, "phoenixd_replayed_requests_total", "counter", "Retransmitted requests answered with remembered reply.");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_replayed_requests_total", sessions[k]);
+		fprintf(f, "} %llu\n", sessions[k]->metrics.replays);
+	}
+
+	metrics_family(f, "phoenixd_compression_saved_bytes_total", "counter", "MSG_READ payload bytes saved by LZ4 compression.");
+	for (k = 0; k < n; k++) {
+		metrics_sample(f, "phoenixd_compression_saved_bytes_total", sessions[k]);
+		fprintf(f, "} %llu\n", sessions[k]->metrics.zbytes);
+	}
+
+	fcache_stats(&hits, &misses);
+	metrics_family(f, "phoenixd_fcache_lookups_total", "counter", "Shared file cache lookups (miss maps the file).");
+	fprintf(f, "phoenixd_fcache_lookups_total{result=\"hit\"} %llu\n", hits);
+	fprintf(f, "phoenixd_fcache_lookups_total{result=\"miss\"} %llu\n", misses);
+
+	vcache_stats(&hits, &misses);
+	metrics_family(f, "phoenixd_vcache_lookups_total", "counter", "Path lookups answered from metadata cache (miss reads directory).");
+	fprintf(f, "phoenixd_vcache_lookups_total{result=\"hit\"} %llu\n", hits);
+	fprintf(f, "phoenixd_vcache_lookups_total{result=\"miss\"} %llu\n", misses);
+}
+
+
+/* Function returns sessions together with peer sessions of UDP endpoints */
+static session_t **metrics_collect(session_t *sessions, unsigned int n, unsigned int *cnt)
+{
+	session_t **all;
+	unsigned int k, total = n;
+
+	for (k = 0; k < n; k++) {
+		if (sessions[k].udp != NULL)
+			total += sessions[k].udp->npeers;
+	}
+
+	if ((all = malloc((total + 1) * sizeof(*all))) == NULL)
+		return NULL;
+
+	for (k = 0, *cnt = 0; k < n; k++) {
+		all[(*cnt)++] = &sessions[k];
+		if (sessions[k].udp != NULL)
+			*cnt += udpsrv_sessions(&sessions[k], all + *cnt, total - *cnt);
+	}
+
+	return all;
+}
+
+
+int metrics_export(session_t *sessions, unsigned int n)
+{
+	char *path, *tmp;
+	session_t **all;
+	unsigned int cnt;
+	size_t len;
+	FILE *f;
+	int err = ERR_NONE;
+
+	if (metrics_common.dir == NULL)
+		return ERR_NONE;
+
+	len = strlen(metrics_common.dir) + 32;
+	if ((path = malloc(2 * len)) == NULL)
+		return ERR_MEM;
+	tmp = path + len;
+
+	if ((all = metrics_collect(sessions, n, &cnt)) == NULL) {
+		free(path);
+		return ERR_MEM;
+	}
+
+	/* Collectors read *.prom files, temporary file is renamed when complete */
+	snprintf(path, len, "%s/phoenixd-%d.prom", metrics_common.dir, (int)getpid());
+	snprintf(tmp, len, "%s/phoenixd-%d.prom.tmp", metrics_common.dir, (int)getpid());
+
+	if ((f = fopen(tmp, "w")) == NULL) {
+		log_error(NULL, "metrics: Can't create '%s'", tmp);
+		free(all);
+		free(path);
+		return ERR_ARG;
+	}
+
+	metrics_write(f, all, cnt);
+
+	if ((fclose(f) != 0) || (rename(tmp, path) < 0)) {
+		log_error(NULL, "metrics: Can't write '%s'", path);
+		unlink(tmp);
+		err = ERR_ARG;
+	}
+
+	free(all);
+	free(path);
+
+	return err;
+}
@@ -0,0 +1,73 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Per-session metrics (Prometheus text export)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+
+/* Number of accounted message types (MSG_ERR .. MSG_READDIR, last one counts other types) */
+#define METRICS_TYPES    11
+
+/* Number of latency histogram buckets (upper bounds 1 us .. 2^(METRICS_BUCKETS - 1) us) */
+#define METRICS_BUCKETS  24
+
+
+typedef struct _metrics_t {
+	unsigned long long rxframes[METRICS_TYPES];
+	unsigned long long rxbytes[METRICS_TYPES];
+	unsigned long long txframes[METRICS_TYPES];
+	unsigned long long txbytes[METRICS_TYPES];
+
+	unsigned long long latency[METRICS_BUCKETS + 1]; /* request to reply latency (last bucket - +Inf) */
+	unsigned long long latsum;                       /* sum of latencies (us) */
+
+	unsigned long long hits;   /* reads served from file cache */
+	unsigned long long misses; /* reads served by pread() */
+	unsigned long long replays; /* retransmitted requests answered with remembered reply */
+	unsigned long long zbytes; /* MSG_READ payload bytes saved by compression */
+} metrics_t;
+
+
+struct _session_t;
+
+
+/* Function returns monotonic time in us */
+extern unsigned long long metrics_now(void);
+
+
+/* Function accounts received frame */
+extern void metrics_rx(metrics_t *m, unsigned int type, unsigned int len);
+
+
+/* Function accounts sent frame */
+extern void metrics_tx(metrics_t *m, unsigned int type, unsigned int len);
+
+
+/* Function accounts request handled in us */
+extern void metrics_latency(metrics_t *m, unsigned long long us);
+
+
+/* Function enables export to dir/phoenixd-<pid>.prom requested by SIGUSR1 */
+extern int metrics_init(const char *dir);
+
+
+/* Function returns non-zero once after export was requested */
+extern int metrics_pending(void);
+
+
+/* Function writes metrics of all sessions and UDP peers (file is replaced atomically) */
+extern int metrics_export(struct _session_t *sessions, unsigned int n);
+
+
+#endif
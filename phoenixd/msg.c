@@ -13,123 +13,379 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #include <hostutils-common/errors.h>
 #include <hostutils-common/serial.h>
 #include "msg.h"
+#include "frame.h"
 
 
-u32 msg_csum(msg_t *msg)
+u32 msg_csumv(msg_t *msg, const u8 *data, unsigned int len)
 {
-	unsigned int k;
 	u16 csum;
 
-	csum = 0;
-	for (k = 0; k < MSG_HDRSZ + msg_getlen(msg); k++) {
-		if (k >= sizeof(msg->csum)) {
-			csum += *((u8 *)msg + k);
-		}
-	}
+	csum = frame_sum((u8 *)msg + sizeof(msg->csum), MSG_HDRSZ - sizeof(msg->csum) + msg_getlen(msg) - len);
+	if (len > 0)
+		csum += frame_sum(data, len);
 	csum += msg_getseq(msg);
 	return csum;
 }
 
 
-int msg_serial_send(int fd, msg_t *msg, u16 seq)
+u32 msg_csum(msg_t *msg)
 {
-	u8 *p = (u8 *)msg;
-	u8 cs[2];
-	unsigned int k;
-	u8 buff[MSG_MAXLEN * 2 + MSG_HDRSZ * 2];
-	unsigned int i = 0;
+	return msg_csumv(msg, NULL, 0);
+}
 
-	msg_setseq(msg, seq);
-	msg_setcsum(msg, msg_csum(msg));
-	cs[0] = MSG_MARK;
 
-	if (msg_getlen(msg) > MSG_MAXLEN)
-		return ERR_MSG_ARG;
+void msg_tx_reset(msg_tx_t *tx)
+{
+	tx->niov = 0;
+	tx->nframes = 0;
+	tx->l = 0;
+}
+
+
+int msg_stream_flush(int fd, msg_tx_t *tx)
+{
+	int err;
 
-	buff[i++] = cs[0];
+	/* Descriptors are non-blocking, serial_writev() waits for output buffer space until peer stalls */
+	err = serial_writev(fd, tx->iov, tx->niov);
+	msg_tx_reset(tx);
 
-	for (k = 0; k < MSG_HDRSZ + msg_getlen(msg); k++) {
+	if (err == ERR_SERIAL_TIMEOUT)
+		return ERR_MSG_STALL;
 
-		if ((p[k] == MSG_MARK) || (p[k] == MSG_ESC)) {
-			cs[0] = MSG_ESC;
-			if (p[k] == MSG_MARK)
-				cs[1] = MSG_ESCMARK;
-			else
-				cs[1] = MSG_ESCESC;
-			memcpy(&buff[i], cs, 2);
-			i += 2;
+	return (err < 0) ? ERR_MSG_IO : ERR_NONE;
+}
+
+
+/* Function queues data, copied data is stored in tx buffer, otherwise it is referenced */
+static int msg_tx_put(int fd, msg_tx_t *tx, const u8 *p, size_t len, int copy)
+{
+	struct iovec *last;
+	size_t n;
+	int err;
+
+	while (len > 0) {
+		if ((tx->niov == MSG_TXIOV) || (copy && (tx->l == sizeof(tx->buff)))) {
+			if ((err = msg_stream_flush(fd, tx)) < 0)
+				return err;
+		}
+
+		if (!copy) {
+			tx->iov[tx->niov].iov_base = (void *)p;
+			tx->iov[tx->niov++].iov_len = len;
+			break;
+		}
+
+		n = sizeof(tx->buff) - tx->l;
+		if (n > len)
+			n = len;
+
+		/* Extend last iovec if it ends at current buffer position */
+		last = (tx->niov > 0) ? &tx->iov[tx->niov - 1] : NULL;
+		if ((last != NULL) && ((u8 *)last->iov_base + last->iov_len == &tx->buff[tx->l])) {
+			last->iov_len += n;
+		}
+		else {
+			tx->iov[tx->niov].iov_base = &tx->buff[tx->l];
+			tx->iov[tx->niov++].iov_len = n;
 		}
-		else
-			buff[i++] = p[k];
+
+		memcpy(&tx->buff[tx->l], p, n);
+		tx->l += n;
+		p += n;
+		len -= n;
 	}
-	if (serial_write(fd, buff, i) < 0)
-		return ERR_MSG_IO;
 
-	return k;
+	return ERR_NONE;
 }
 
 
-int msg_serial_recv(int fd, msg_t *msg, int *state)
+static int msg_tx_escape(int fd, msg_tx_t *tx, const u8 *p, size_t len, int copy)
 {
-	int escfl = 0;
-	unsigned int l = 0;
-	u8 c;
+	u8 esc[2] = { MSG_ESC, 0 };
+	size_t n;
+	int err;
 
-	for (;;) {
-		if (serial_read(fd, &c, 1, 0) < 0) {
-			*state = MSGRECV_DESYN;
-			return ERR_MSG_IO;
+	while (len > 0) {
+		n = frame_scan(p, len);
+		if ((err = msg_tx_put(fd, tx, p, n, copy || (n < MSG_TXMINREF))) < 0)
+			return err;
+
+		if (n < len) {
+			esc[1] = (p[n] == MSG_MARK) ? MSG_ESCMARK : MSG_ESCESC;
+			if ((err = msg_tx_put(fd, tx, esc, sizeof(esc), 1)) < 0)
+				return err;
+			n++;
 		}
 
-		if (*state == MSGRECV_FRAME) {
+		p += n;
+		len -= n;
+	}
+
+	return ERR_NONE;
+}
+
+
+int msg_stream_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	u8 mark = MSG_MARK;
+	unsigned int hlen;
+	int err;
+
+	if ((msg_getlen(msg) > MSG_MAXLEN_EXT) || (len > msg_getlen(msg)))
+		return ERR_MSG_ARG;
+
+	hlen = MSG_HDRSZ + msg_getlen(msg) - len;
+
+	msg_setseq(msg, seq);
+	msg_setcsum(msg, msg_csumv(msg, data, len));
+
+	/* Message buffer is reused by the caller, only payload data is referenced */
+	if ((err = msg_tx_put(fd, tx, &mark, 1, 1)) < 0)
+		return err;
+	if ((err = msg_tx_escape(fd, tx, (u8 *)msg, hlen, 1)) < 0)
+		return err;
+	if ((err = msg_tx_escape(fd, tx, data, len, 0)) < 0)
+		return err;
+
+	if (!tx->cork && ((err = msg_stream_flush(fd, tx)) < 0))
+		return err;
+
+	return hlen + len;
+}
+
+
+int msg_serial_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	return msg_stream_send(fd, tx, msg, seq, data, len);
+}
+
+
+int msg_rx_init(msg_rx_t *rx)
+{
+	rx->maxlen = 0;
+	rx->msg = NULL;
+	rx->desync = 0;
+	rx->escerr = 0;
+	rx->dropped = 0;
+	msg_rx_reset(rx);
+
+	return msg_rx_resize(rx, MSG_MAXLEN);
+}
+
+
+int msg_rx_resize(msg_rx_t *rx, unsigned int maxlen)
+{
+	msg_t *msg;
+
+	if (maxlen > MSG_MAXLEN_EXT)
+		return ERR_MSG_ARG;
+
+	/* msg_t may be used for MSG_MAXLEN frames also by fixed size code */
+	if ((msg = realloc(rx->msg, MSG_HDRSZ + ((maxlen > MSG_MAXLEN) ? maxlen : MSG_MAXLEN))) == NULL)
+		return ERR_MEM;
+
+	rx->msg = msg;
+	rx->maxlen = maxlen;
+	rx->l = 0;
+	rx->escfl = 0;
+
+	return ERR_NONE;
+}
+
+
+void msg_rx_reset(msg_rx_t *rx)
+{
+	rx->rd = 0;
+	rx->wr = 0;
+	rx->l = 0;
+	rx->escfl = 0;
+}
+
+
+void msg_rx_done(msg_rx_t *rx)
+{
+	free(rx->msg);
+	rx->msg = NULL;
+	rx->maxlen = 0;
+}
+
+
+int msg_rx_read(msg_rx_t *rx, int fd)
+{
+	unsigned int pos = rx->wr & (MSG_RXBUFSZ - 1);
+	unsigned int len = MSG_RXBUFSZ - (rx->wr - rx->rd);
+	ssize_t res;
+
+	/* Read up to the end of the ring, the rest is read by the next call */
+	if (len > MSG_RXBUFSZ - pos)
+		len = MSG_RXBUFSZ - pos;
 
+	if (len == 0)
+		return 0;
+
+	do
+		res = read(fd, &rx->buff[pos], len);
+	while ((res < 0) && (errno == EINTR));
+
+	if (res < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			return 0;
+		return ERR_MSG_IO;
+	}
+
+	if (res == 0)
+		return ERR_MSG_CLOSED;
+
+	rx->wr += res;
+
+	return res;
+}
+
+
+int msg_rx_decode(msg_rx_t *rx, int *state)
+{
+	u8 *frame = (u8 *)rx->msg, *p, c;
+	unsigned int pos, len, n, need;
+
+	while (rx->rd != rx->wr) {
+		pos = rx->rd & (MSG_RXBUFSZ - 1);
+		len = rx->wr - rx->rd;
+		if (len > MSG_RXBUFSZ - pos)
+			len = MSG_RXBUFSZ - pos;
+		p = &rx->buff[pos];
+
+		if (*state != MSGRECV_FRAME) {
+			/* Synchronize */
+			if ((p = memchr(p, MSG_MARK, len)) == NULL) {
+				rx->dropped += len;
+				rx->rd += len;
+				continue;
+			}
+			rx->dropped += p - &rx->buff[pos];
+			rx->rd += p - &rx->buff[pos] + 1;
+			rx->l = 0;
+			rx->escfl = 0;
+			*state = MSGRECV_FRAME;
+			continue;
+		}
+
+		/* Number of bytes needed to complete header or frame */
+		if (rx->l < MSG_HDRSZ) {
+			need = MSG_HDRSZ - rx->l;
+		}
+		else {
 			/* Return error if frame is to long */
-			if (l == MSG_HDRSZ + MSG_MAXLEN) {
+			if (msg_getlen(rx->msg) > rx->maxlen) {
+				rx->desync++;
 				*state = MSGRECV_DESYN;
 				return ERR_MSG_IO;
 			}
+			need = MSG_HDRSZ + msg_getlen(rx->msg) - rx->l;
+		}
+
+		if (!rx->escfl) {
+			/* Copy run of bytes which don't need unescaping */
+			if (len > need)
+				len = need;
+			n = frame_scan(p, len);
+			memcpy(frame + rx->l, p, n);
+			rx->l += n;
+			rx->rd += n;
+			need -= n;
+
+			if ((n == len) && (need > 0))
+				continue;
+		}
+
+		if (need > 0) {
+			c = rx->buff[rx->rd++ & (MSG_RXBUFSZ - 1)];
 
 			/* Return error if terminator discovered */
 			if (c == MSG_MARK) {
+				rx->desync++;
+				rx->l = 0;
+				rx->escfl = 0;
 				return ERR_MSG_IO;
 			}
 
-			if (!escfl && (c == MSG_ESC)) {
-				escfl = 1;
+			if (!rx->escfl && (c == MSG_ESC)) {
+				rx->escfl = 1;
 				continue;
 			}
-			if (escfl) {
+			if (rx->escfl) {
 				if (c == MSG_ESCMARK)
 					c = MSG_MARK;
-				if (c == MSG_ESCESC)
+				else if (c == MSG_ESCESC)
 					c = MSG_ESC;
-				escfl = 0;
+				else
+					rx->escerr++;
+				rx->escfl = 0;
 			}
-			*((u8 *)msg + l++) = c;
+			frame[rx->l++] = c;
+		}
+
+		/* Frame received */
+		if ((rx->l >= MSG_HDRSZ) && (rx->l == msg_getlen(rx->msg) + MSG_HDRSZ)) {
+			*state = MSGRECV_DESYN;
+			n = rx->l;
+			rx->l = 0;
+
+			/* Verify received message */
+			//if (rx->msg->csum != msg_csum(rx->msg)) {
+			//	return ERR_MSG_IO;
+			//}
+
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+
+int msg_stream_recv(int fd, msg_rx_t *rx, int *state)
+{
+	struct pollfd pfd;
+	int res;
+
+	for (;;) {
+		if ((res = msg_rx_decode(rx, state)) != 0)
+			return res;
+
+		if ((res = msg_rx_read(rx, fd)) < 0) {
+			*state = MSGRECV_DESYN;
+			return res;
+		}
+
+		/* Descriptor is non-blocking, wait for data */
+		if (res == 0) {
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, -1) < 0) {
+				/* Signal (e.g. metrics export request) is handled by the caller, partial frame is kept */
+				if (errno == EINTR)
+					return ERR_MSG_INTR;
 
-			/* Frame received */
-			if ((l >= MSG_HDRSZ) && (l == msg_getlen(msg) + MSG_HDRSZ)) {
 				*state = MSGRECV_DESYN;
-				break;
+				return ERR_MSG_IO;
 			}
 		}
-		else {
-			/* Synchronize */
-			if (c == MSG_MARK)
-				*state = MSGRECV_FRAME;
-		}
 	}
+}
 
-	/* Verify received message */
-	//if (msg->csum != msg_csum(msg)) {
-	//	return ERR_MSG_IO;
-	//}
 
-	return l;
+int msg_serial_recv(int fd, msg_rx_t *rx, int *state)
+{
+	return msg_stream_recv(fd, rx, state);
 }
@@ -15,6 +15,7 @@
 #ifndef _MSG_H_
 #define _MSG_H_
 
+#include <sys/uio.h>
 #include <hostutils-common/types.h>
 
 
@@ -37,6 +38,9 @@
 #define MSG_HDRSZ   2 * sizeof(u32)
 #define MSG_MAXLEN  512
 
+/* Largest frame payload which can be negotiated (limited by 16-bit length field) */
+#define MSG_MAXLEN_EXT  0xfffc
+
 
 typedef struct _msg_t {
 	u32 csum;
@@ -45,6 +49,50 @@ typedef struct _msg_t {
 } msg_t;
 
 
+/* Receive buffer size for stream transports (must be a power of 2) */
+#define MSG_RXBUFSZ 4096
+
+/* Transmit buffer size for copied data (frame headers, escape sequences, short runs) */
+#define MSG_TXBUFSZ 4096
+
+/* Maximum number of iovecs queued before flush */
+#define MSG_TXIOV   64
+
+/* Clean payload runs shorter than this are copied instead of referenced */
+#define MSG_TXMINREF 64
+
+
+/* Receive context, decoder state is used by stream transports (serial, pipe, TCP) only */
+typedef struct _msg_rx_t {
+	u8 buff[MSG_RXBUFSZ]; /* ring buffer of raw (escaped) data */
+	unsigned int rd;      /* ring read position (free running) */
+	unsigned int wr;      /* ring write position (free running) */
+	unsigned int l;       /* number of decoded bytes of current frame */
+	int escfl;            /* escape character received */
+	unsigned int maxlen;  /* maximum frame payload length */
+	msg_t *msg;           /* received frame (MSG_HDRSZ + maxlen bytes) */
+
+	/* Error counters, they are not cleared by reset */
+	unsigned long desync;        /* frames discarded due to bad length or unexpected MSG_MARK */
+	unsigned long escerr;        /* invalid escape sequences */
+	unsigned long long dropped;  /* bytes skipped while synchronizing */
+} msg_rx_t;
+
+
+/* Transmit queue, payload data is referenced by iovecs until flush */
+typedef struct _msg_tx_t {
+	struct iovec iov[MSG_TXIOV];
+	unsigned int niov;
+	unsigned int frames[MSG_TXIOV]; /* number of iovecs of each queued datagram (UDP only) */
+	unsigned int nframes;
+	unsigned int l;                 /* used bytes of buff */
+	int cork;                       /* queue frames until explicit flush */
+	const void *addr;               /* destination of queued datagrams (UDP only) */
+	unsigned int addrlen;
+	u8 buff[MSG_TXBUFSZ];
+} msg_tx_t;
+
+
 /* Macros for modifying message headers */
 #define msg_settype(m, t)  ((m)->type = ((m)->type & ~0xffff) | ((t) & 0xffff))
 #define msg_gettype(m)     ((m)->type & 0xffff)
@@ -58,9 +106,56 @@ typedef struct _msg_t {
 #define msg_setseq(m, s)   ((m)->csum = ((m)->csum & 0xffff) | ((s) << 16))
 #define msg_getseq(m)      ((m)->csum >> 16)
 
-extern int msg_serial_send(int fd, msg_t *msg, u16 seq);
+extern u32 msg_csum(msg_t *msg);
+
+
+/* Function computes checksum of frame with last len bytes of payload stored in data */
+extern u32 msg_csumv(msg_t *msg, const u8 *data, unsigned int len);
+
+
+/* Function discards queued data */
+extern void msg_tx_reset(msg_tx_t *tx);
+
+
+/* Function initializes receive context for MSG_MAXLEN frames */
+extern int msg_rx_init(msg_rx_t *rx);
+
+
+/* Function changes maximum frame payload length, current frame is discarded */
+extern int msg_rx_resize(msg_rx_t *rx, unsigned int maxlen);
+
+
+/* Function resets decoder state, buffered data is discarded */
+extern void msg_rx_reset(msg_rx_t *rx);
+
+
+/* Function releases receive context */
+extern void msg_rx_done(msg_rx_t *rx);
+
+
+/* Function reads available data into receive buffer, returns 0 if nothing could be read without blocking */
+extern int msg_rx_read(msg_rx_t *rx, int fd);
+
+
+/* Function decodes buffered data into rx->msg, returns frame length, 0 if more data is needed or error */
+extern int msg_rx_decode(msg_rx_t *rx, int *state);
+
+
+/* Function receives single frame from stream transport into rx->msg (blocking) */
+extern int msg_stream_recv(int fd, msg_rx_t *rx, int *state);
+
+
+/* Function escapes and queues frame for stream transport (data - last len bytes of payload, referenced until flush) */
+extern int msg_stream_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+
+
+/* Function writes queued data to stream transport */
+extern int msg_stream_flush(int fd, msg_tx_t *tx);
+
+
+extern int msg_serial_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
 
-extern int msg_serial_recv(int fd, msg_t *msg, int *state);
+extern int msg_serial_recv(int fd, msg_rx_t *rx, int *state);
 
 
 #endif
@@ -17,20 +17,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <hostutils-common/errors.h>
 #include "msg_tcp.h"
 
 
-extern u32 msg_csum(msg_t *msg);
-
-
 int tcp_open(char *addrstr, unsigned int port)
 {
 	struct sockaddr_in server;
-	int sock;
+	int sock, flags, nodelay = 1;
 
 	size_t cfgLen = 0;
 	const char *cfgString = getenv("PHOENIXD_TCP");
@@ -54,6 +54,9 @@ int tcp_open(char *addrstr, unsigned int port)
 		return -1;
 	}
 
+	/* Replies are coalesced by the dispatcher and flushed explicitly */
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
 	/* Send optional tunnel configuration string */
 	if ((cfgLen > 0) && (send(sock, cfgString, cfgLen, 0) <= 0)) {
 		perror("Failed to send configuration");
@@ -61,109 +64,24 @@ int tcp_open(char *addrstr, unsigned int port)
 		return -1;
 	}
 
+	/* Stalled peer can't block event loop serving other sessions, writes time out */
+	if (((flags = fcntl(sock, F_GETFL)) < 0) || (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0)) {
+		perror("Failed to set non-blocking mode");
+		close(sock);
+		return -1;
+	}
+
 	return sock;
 }
 
 
-int msg_tcp_send(int fd, msg_t *msg, u16 seq)
+int msg_tcp_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
 {
-	unsigned char buf[MSG_MAXLEN * 2 + MSG_HDRSZ * 2];
-	unsigned char *end = (unsigned char *)msg;
-	unsigned char *p = (unsigned char *)msg;
-	size_t i = 0;
-
-	msg_setseq(msg, seq);
-	msg_setcsum(msg, msg_csum(msg));
-	end += MSG_HDRSZ;
-
-	if (msg_getlen(msg) >= MSG_MAXLEN) {
-		return ERR_MSG_ARG;
-	}
-
-	buf[i++] = MSG_MARK;
-
-	end += msg_getlen(msg);
-	for (; p < end; p++) {
-		if ((*p == MSG_MARK) || (*p == MSG_ESC)) {
-			buf[i++] = MSG_ESC;
-			if (*p == MSG_MARK) {
-				buf[i++] = MSG_ESCMARK;
-			}
-			else {
-				buf[i++] = MSG_ESCESC;
-			}
-		}
-		else {
-			buf[i++] = *p;
-		}
-	}
-
-	if (send(fd, buf, i, 0) < 0) {
-		return ERR_MSG_IO;
-	}
-
-	return (int)(end - (unsigned char *)msg);
+	return msg_stream_send(fd, tx, msg, seq, data, len);
 }
 
 
-int msg_tcp_recv(int fd, msg_t *msg, int *state)
+int msg_tcp_recv(int fd, msg_rx_t *rx, int *state)
 {
-	ssize_t r;
-	unsigned char c;
-	unsigned char *buf = (unsigned char *)msg;
-	int l = 0;
-	int escfl = 0;
-
-	for (;;) {
-		r = recv(fd, &c, 1, 0);
-		if (r == 0) {
-			*state = MSGRECV_DESYN;
-			return ERR_MSG_CLOSED;
-		}
-		else if (r <= 0) {
-			*state = MSGRECV_DESYN;
-			return ERR_MSG_IO;
-		}
-		else if (*state == MSGRECV_FRAME) {
-			/* Return error if frame is to long */
-			if (l == MSG_HDRSZ + MSG_MAXLEN) {
-				*state = MSGRECV_DESYN;
-				return ERR_MSG_IO;
-			}
-
-			/* Return error if terminator discovered */
-			if (c == MSG_MARK) {
-				return ERR_MSG_IO;
-			}
-
-			if ((escfl == 0) && (c == MSG_ESC)) {
-				escfl = 1;
-				continue;
-			}
-
-			if (escfl != 0) {
-				escfl = 0;
-				switch (c) {
-					case MSG_ESCMARK: c = MSG_MARK; break;
-					case MSG_ESCESC: c = MSG_ESC; break;
-					default: break;
-				}
-			}
-			buf[l++] = c;
-
-			/* Frame received */
-			if ((l >= MSG_HDRSZ) && (l == msg_getlen(msg) + MSG_HDRSZ)) {
-				*state = MSGRECV_DESYN;
-				break;
-			}
-		}
-		else {
-			/* Synchronize */
-			if (c == MSG_MARK) {
-				*state = MSGRECV_FRAME;
-			}
-		}
-	}
-
-	return l;
+	return msg_stream_recv(fd, rx, state);
 }
@@ -22,7 +22,7 @@
 #define PHFS_TCPPORT 18022
 
 extern int tcp_open(char *node, uint port);
-extern int msg_tcp_send(int fd, msg_t *msg, u16 seq);
-extern int msg_tcp_recv(int fd, msg_t *msg, int *state);
+extern int msg_tcp_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+extern int msg_tcp_recv(int fd, msg_rx_t *rx, int *state);
 
 #endif
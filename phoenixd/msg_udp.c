@@ -13,12 +13,18 @@
  * %LICENSE%
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* sendmmsg(), recvmmsg() */
+#endif
+
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -26,16 +32,24 @@
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <hostutils-common/errors.h>
+#include <hostutils-common/log.h>
 #include "msg_udp.h"
+#include "frame.h"
 #include "phfs.h"
 
 #undef HEXDUMP
 
-static struct sockaddr_in addr;
-static socklen_t addrlen;
-
+/* Maximum time of waiting for space in socket send buffer (ms) */
+#define PHFS_UDPSNDWAIT  100
 
-extern u32 msg_csum(msg_t *msg);
+#ifdef __linux__
+typedef struct mmsghdr udp_mmsghdr_t;
+#else
+/* sendmmsg() and recvmmsg() are not available, datagrams are handled one by one */
+typedef struct {
+	struct msghdr msg_hdr;
+} udp_mmsghdr_t;
+#endif
 
 
 in_addr_t bcast_addr(in_addr_t in_addr)
@@ -69,18 +83,20 @@ in_addr_t bcast_addr(in_addr_t in_addr)
 }
 
 
-int udp_open(char *node, uint port)
+int udp_open(char *node, uint port, udp_beacon_t *beacon)
 {
-	int fd, result, so_enable = 1;
+	int fd, result, so_enable = 1, rcvbuf = PHFS_UDPRCVBUF;
 	struct addrinfo *servAddr;
-	struct sockaddr_in addr_in, bcast_in;
+	struct sockaddr_in addr_in;
+	msg_t bcast_msg;
 
 	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
 		return ERR_SERIAL_INIT;
 
 	if ((result = getaddrinfo(node, NULL, NULL, &servAddr)) != 0) {
-		fprintf(stderr, "Error opening %s:%d: %s\n", node, port, gai_strerror(result));
-		return result;
+		log_error(NULL, "udp: Error opening %s:%d: %s", node, port, gai_strerror(result));
+		close(fd);
+		return ERR_SERIAL_INIT;
 	}
 
 	addr_in = *(struct sockaddr_in *)servAddr->ai_addr;
@@ -90,70 +106,49 @@ int udp_open(char *node, uint port)
 	if (addr_in.sin_port == 0)
 		addr_in.sin_port = htons((unsigned short)port);
 
-	result = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &so_enable, sizeof(so_enable));
-	result = bind(fd, (struct sockaddr *)&addr_in, sizeof(addr_in));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &so_enable, sizeof(so_enable));
+	setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &so_enable, sizeof(so_enable));
 
-	bcast_in.sin_addr.s_addr = bcast_addr(addr_in.sin_addr.s_addr);
-	bcast_in.sin_port = htons(PHFS_UDPPORT);
-	bcast_in.sin_family = addr_in.sin_family;
+	/* Requests of all peers are queued in single socket */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
 
-	if (result < 0)
+	if ((bind(fd, (struct sockaddr *)&addr_in, sizeof(addr_in)) < 0) || (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)) {
+		close(fd);
 		return ERR_SERIAL_INIT;
+	}
 
-	if (!fork())
-	{
-		int bcastfd;
-		ssize_t len;
-		msg_t bcast_msg;
-		u8 buff[MSG_MAXLEN * 2 + MSG_HDRSZ * 2];
-		unsigned int i = 0;
+	memset(&beacon->addr, 0, sizeof(beacon->addr));
+	beacon->addr.sin_addr.s_addr = bcast_addr(addr_in.sin_addr.s_addr);
+	beacon->addr.sin_port = htons(PHFS_UDPPORT);
+	beacon->addr.sin_family = addr_in.sin_family;
 
-		memset(&bcast_msg, 0, sizeof(bcast_msg));
-		msg_settype(&bcast_msg, MSG_HELLO);
-		msg_setlen(&bcast_msg, sizeof(bcast_in));
-		memcpy(bcast_msg.data, &addr_in, sizeof(addr_in));
-		bcast_msg.csum = msg_csum(&bcast_msg);
+	memset(&bcast_msg, 0, sizeof(bcast_msg));
+	msg_settype(&bcast_msg, MSG_HELLO);
+	msg_setlen(&bcast_msg, sizeof(addr_in));
+	memcpy(bcast_msg.data, &addr_in, sizeof(addr_in));
+	bcast_msg.csum = msg_csum(&bcast_msg);
 
 #ifdef PHFS_UDPENCODE
-		{
-			u8 *p = (u8 *)&bcast_msg, cs[2];
-			unsigned k;
-
-			cs[0] = MSG_MARK;
-
-			buff[i++] = cs[0];
-
-			for (k = 0; k < MSG_HDRSZ + msg_getlen(&bcast_msg); k++) {
-
-				if ((p[k] == MSG_MARK) || (p[k] == MSG_ESC)) {
-					cs[0] = MSG_ESC;
-					if (p[k] == MSG_MARK)
-						cs[1] = MSG_ESCMARK;
-					else
-						cs[1] = MSG_ESCESC;
-					memcpy(&buff[i], cs, 2);
-					i += 2;
-				}
-				else
-					buff[i++] = p[k];
-			}
-		}
+	beacon->buff[0] = MSG_MARK;
+	beacon->len = 1 + frame_escape(&beacon->buff[1], (u8 *)&bcast_msg, MSG_HDRSZ + msg_getlen(&bcast_msg));
 #else
-		i = MSG_HDRSZ + msg_getlen(&bcast_msg);
-		memcpy(buff, &bcast_msg, i);
+	beacon->len = MSG_HDRSZ + msg_getlen(&bcast_msg);
+	memcpy(beacon->buff, &bcast_msg, beacon->len);
 #endif
-		bcastfd = dup(fd);
-		setsockopt(bcastfd, SOL_SOCKET, SO_BROADCAST, &so_enable, sizeof(so_enable));
-		for (;;) {
-			if ((len = sendto(bcastfd, buff, i, MSG_DONTROUTE, (struct sockaddr *)&bcast_in, sizeof(bcast_in))) < 0)
-				return ERR_MSG_IO;
-			sleep(3);
-		}
-	}
+
 	return fd;
 }
 
 
+int udp_beacon(int fd, udp_beacon_t *beacon)
+{
+	if (sendto(fd, beacon->buff, beacon->len, MSG_DONTROUTE, (struct sockaddr *)&beacon->addr, sizeof(beacon->addr)) < 0)
+		return ERR_MSG_IO;
+
+	return ERR_NONE;
+}
+
+
 #ifdef HEXDUMP
 static void hex_dump(void *data, int size)
 {
@@ -209,48 +204,178 @@ static void hex_dump(void *data, int size)
 #endif
 
 
-int msg_udp_send(int fd, msg_t *msg, u16 seq)
+/* Function sends n prepared datagrams, failed ones are dropped */
+static int msg_udp_sendv(int fd, udp_mmsghdr_t *msgs, unsigned int n)
 {
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
 	unsigned int k;
-	u8 buff[MSG_MAXLEN * 2 + MSG_HDRSZ * 2];
-	ssize_t len;
-	unsigned int i = 0;
+	int res, err = ERR_NONE;
 
-	msg_setseq(msg, seq);
-	msg_setcsum(msg, msg_csum(msg));
+	for (k = 0; k < n; k += res) {
+#ifdef __linux__
+		res = sendmmsg(fd, &msgs[k], n - k, 0);
+#else
+		res = (sendmsg(fd, &msgs[k].msg_hdr, 0) < 0) ? -1 : 1;
+#endif
+		if (res > 0)
+			continue;
+
+		/* Socket is non-blocking, wait a while for space in its buffer */
+		if ((res < 0) && ((errno == EINTR) || ((errno == EAGAIN) && (poll(&pfd, 1, PHFS_UDPSNDWAIT) > 0)))) {
+			res = 0;
+			continue;
+		}
+
+		/* Peer is unreachable or buffer is still full, datagram is lost like on the wire */
+		err = ERR_MSG_IO;
+		res = 1;
+	}
+
+	return err;
+}
+
+
+int msg_udp_flushv(int fd, msg_tx_t **txs, unsigned int n)
+{
+	udp_mmsghdr_t msgs[PHFS_UDPBATCH];
+	struct iovec *iov;
+	unsigned int i, k, cnt = 0;
+	int err = ERR_NONE;
+
+	/* All queued datagrams are sent with single syscall if possible */
+	for (i = 0; i < n; i++) {
+		iov = txs[i]->iov;
+		for (k = 0; k < txs[i]->nframes; k++) {
+			if ((cnt == PHFS_UDPBATCH) && (msg_udp_sendv(fd, msgs, cnt) < 0))
+				err = ERR_MSG_IO;
+			if (cnt == PHFS_UDPBATCH)
+				cnt = 0;
+
+			memset(&msgs[cnt], 0, sizeof(msgs[cnt]));
+			msgs[cnt].msg_hdr.msg_name = (void *)txs[i]->addr;
+			msgs[cnt].msg_hdr.msg_namelen = txs[i]->addrlen;
+			msgs[cnt].msg_hdr.msg_iov = iov;
+			msgs[cnt].msg_hdr.msg_iovlen = txs[i]->frames[k];
+			iov += txs[i]->frames[k];
+			cnt++;
+		}
+	}
+
+	if ((cnt > 0) && (msg_udp_sendv(fd, msgs, cnt) < 0))
+		err = ERR_MSG_IO;
+
+	for (i = 0; i < n; i++)
+		msg_tx_reset(txs[i]);
 
-	if (msg_getlen(msg) > MSG_MAXLEN)
+	return err;
+}
+
+
+int msg_udp_flush(int fd, msg_tx_t *tx)
+{
+	return msg_udp_flushv(fd, &tx, 1);
+}
+
+
+int msg_udp_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	unsigned int hlen, niov;
+	int err, direct;
+
+	if ((msg_getlen(msg) > PHFS_UDPMAXLEN) || (len > msg_getlen(msg)))
 		return ERR_MSG_ARG;
 
-	i = MSG_HDRSZ + msg_getlen(msg);
-	memcpy(buff, msg, i);
-	k = i;
+	hlen = MSG_HDRSZ + msg_getlen(msg) - len;
+
+	msg_setseq(msg, seq);
+	msg_setcsum(msg, msg_csumv(msg, data, len));
 
 #ifdef HEXDUMP
-	hex_dump(buff, i);
+	hex_dump(msg, hlen);
 #endif
-	if ((len = sendto(fd, buff, i, 0, (struct sockaddr *)&addr, addrlen)) < 0)
-		return ERR_MSG_IO;
 
-	if (len < i)
-		return ERR_MSG_IO;
+	if ((tx->niov + 2 > MSG_TXIOV) || (tx->l + hlen > sizeof(tx->buff))) {
+		if ((err = msg_udp_flush(fd, tx)) < 0)
+			return err;
+	}
+
+	/* Message buffer is reused by the caller, large ones are sent without queueing */
+	niov = tx->niov;
+	if ((direct = (hlen > sizeof(tx->buff))) != 0) {
+		tx->iov[tx->niov].iov_base = msg;
+	}
+	else {
+		tx->iov[tx->niov].iov_base = &tx->buff[tx->l];
+		memcpy(&tx->buff[tx->l], msg, hlen);
+		tx->l += hlen;
+	}
+	tx->iov[tx->niov++].iov_len = hlen;
+
+	if (len > 0) {
+		tx->iov[tx->niov].iov_base = (void *)data;
+		tx->iov[tx->niov++].iov_len = len;
+	}
+	tx->frames[tx->nframes++] = tx->niov - niov;
 
-	return k;
+	if ((direct || !tx->cork) && ((err = msg_udp_flush(fd, tx)) < 0))
+		return err;
+
+	return hlen + len;
 }
 
 
-int msg_udp_recv(int fd, msg_t *msg, int *state)
+int msg_udp_recvv(int fd, udp_dgram_t *dgrams, unsigned int n)
 {
-	u8 buff[2 * sizeof(msg_t)];
-	ssize_t bufflen;
+	struct iovec iov[PHFS_UDPBATCH];
+	unsigned int k;
+	int res;
+#ifdef __linux__
+	udp_mmsghdr_t msgs[PHFS_UDPBATCH];
+#else
+	socklen_t addrlen;
+	ssize_t len;
+#endif
 
-	addrlen = sizeof(addr);
-	if ((bufflen = recvfrom(fd, buff, sizeof(buff), 0, (struct sockaddr *)&addr, &addrlen)) < 0) {
-		*state = MSGRECV_DESYN;
-		return ERR_MSG_IO;
+	if (n > PHFS_UDPBATCH)
+		n = PHFS_UDPBATCH;
+
+	for (k = 0; k < n; k++) {
+		iov[k].iov_base = dgrams[k].msg;
+		iov[k].iov_len = MSG_HDRSZ + PHFS_UDPMAXLEN;
+	}
+
+#ifdef __linux__
+	memset(msgs, 0, n * sizeof(msgs[0]));
+	for (k = 0; k < n; k++) {
+		msgs[k].msg_hdr.msg_name = &dgrams[k].addr;
+		msgs[k].msg_hdr.msg_namelen = sizeof(dgrams[k].addr);
+		msgs[k].msg_hdr.msg_iov = &iov[k];
+		msgs[k].msg_hdr.msg_iovlen = 1;
 	}
 
+	while (((res = recvmmsg(fd, msgs, n, MSG_DONTWAIT, NULL)) < 0) && (errno == EINTR))
+		;
+
+	if (res < 0)
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : ERR_MSG_IO;
+
+	for (k = 0; k < (unsigned int)res; k++)
+		dgrams[k].len = msgs[k].msg_len;
+#else
+	for (res = 0; res < (int)n; res++) {
+		addrlen = sizeof(dgrams[res].addr);
+		if ((len = recvfrom(fd, iov[res].iov_base, iov[res].iov_len, MSG_DONTWAIT, (struct sockaddr *)&dgrams[res].addr, &addrlen)) < 0) {
+			if (errno == EINTR) {
+				res--;
+				continue;
+			}
+			if ((res == 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+				return ERR_MSG_IO;
+			break;
+		}
+		dgrams[res].len = len;
+	}
+#endif
 
-	memcpy(msg, buff, bufflen);
-	return bufflen;
+	return res;
 }
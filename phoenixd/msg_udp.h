@@ -16,13 +16,57 @@
 #ifndef _MSG_UDP_H_
 #define _MSG_UDP_H_
 
+#include <netinet/in.h>
 #include <hostutils-common/types.h>
 #include "msg.h"
 
 #define PHFS_UDPPORT 11520
 
-extern int udp_open(char *node, uint port);
-extern int msg_udp_send(int fd, msg_t *msg, u16 seq);
-extern int msg_udp_recv(int fd, msg_t *msg, int *state);
+/* Largest frame payload which fits in single UDP datagram */
+#define PHFS_UDPMAXLEN  (65507 - MSG_HDRSZ)
+
+/* Period of MSG_HELLO broadcast announcing server address (ms) */
+#define PHFS_UDPBEACON  3000
+
+/* Requested receive buffer of socket shared by all peers */
+#define PHFS_UDPRCVBUF  (4 << 20)
+
+/* Maximum number of datagrams sent or received with single syscall */
+#define PHFS_UDPBATCH   MSG_TXIOV
+
+
+/* Encoded MSG_HELLO broadcast */
+typedef struct _udp_beacon_t {
+	struct sockaddr_in addr;
+	unsigned int len;
+	u8 buff[MSG_MAXLEN * 2 + MSG_HDRSZ * 2];
+} udp_beacon_t;
+
+
+/* Received datagram */
+typedef struct _udp_dgram_t {
+	struct sockaddr_in addr;  /* source address */
+	msg_t *msg;               /* buffer of MSG_HDRSZ + PHFS_UDPMAXLEN bytes */
+	unsigned int len;         /* received length */
+} udp_dgram_t;
+
+
+/* Function opens non-blocking socket bound to node:port and prepares beacon for its network */
+extern int udp_open(char *node, uint port, udp_beacon_t *beacon);
+
+/* Function broadcasts beacon */
+extern int udp_beacon(int fd, udp_beacon_t *beacon);
+
+/* Function queues datagram to tx->addr (data - last len bytes of payload, referenced until flush) */
+extern int msg_udp_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+
+/* Function sends queued datagrams */
+extern int msg_udp_flush(int fd, msg_tx_t *tx);
+
+/* Function sends datagrams queued in several transmit queues together */
+extern int msg_udp_flushv(int fd, msg_tx_t **txs, unsigned int n);
+
+/* Function receives up to n datagrams without blocking, returns number of received ones */
+extern int msg_udp_recvv(int fd, udp_dgram_t *dgrams, unsigned int n);
 
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * PHFS over UNIX domain socket (QEMU socket chardev)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <hostutils-common/errors.h>
+#include "msg_unix.h"
+
+
+static int unix_nonblock(int fd)
+{
+	int fl;
+
+	if ((fl = fcntl(fd, F_GETFL)) < 0)
+		return -1;
+
+	if ((fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) || (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0))
+		return -1;
+
+	return 0;
+}
+
+
+int unix_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int sock;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* Socket left by previous instance is removed, other files are not touched */
+	if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("Could not create socket");
+		return -1;
+	}
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("Bind failed");
+		close(sock);
+		return -1;
+	}
+
+	/* Connections are accepted from event loop */
+	if ((listen(sock, PHFS_UNIXBACKLOG) < 0) || (unix_nonblock(sock) < 0)) {
+		perror("Listen failed");
+		close(sock);
+		unlink(path);
+		return -1;
+	}
+
+	return sock;
+}
+
+
+int unix_accept(int lfd)
+{
+	int sock;
+
+	if ((sock = accept(lfd, NULL, NULL)) < 0)
+		return -1;
+
+	if (unix_nonblock(sock) < 0) {
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+
+int msg_unix_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len)
+{
+	return msg_stream_send(fd, tx, msg, seq, data, len);
+}
+
+
+int msg_unix_recv(int fd, msg_rx_t *rx, int *state)
+{
+	return msg_stream_recv(fd, rx, state);
+}
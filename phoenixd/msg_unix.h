@@ -0,0 +1,40 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * PHFS over UNIX domain socket (QEMU socket chardev)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _MSG_UNIX_H_
+#define _MSG_UNIX_H_
+
+#include <hostutils-common/types.h>
+#include "msg.h"
+
+
+/* Number of QEMU connections waiting while previous one is served */
+#define PHFS_UNIXBACKLOG 4
+
+
+/* Function creates listening socket at path (stale socket is replaced) */
+extern int unix_listen(const char *path);
+
+
+/* Function accepts pending connection, returns non-blocking socket or -1 (errno is set) */
+extern int unix_accept(int lfd);
+
+
+extern int msg_unix_send(int fd, msg_tx_t *tx, msg_t *msg, u16 seq, const u8 *data, unsigned int len);
+
+
+extern int msg_unix_recv(int fd, msg_rx_t *rx, int *state);
+
+
+#endif
@@ -14,27 +14,214 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/resource.h>
+#include <sys/socket.h>
 
 #include <hostutils-common/errors.h>
+#include <hostutils-common/log.h>
+#include <hostutils-common/serial.h>
 #include "dispatch.h"
 #include "msg.h"
 #include "phfs.h"
+#include "fcache.h"
+#include "lz4.h"
+#include "vcache.h"
 
 
-int phfs_open(int fd, msg_t *msg, char *sysdir)
+/* MSG_HELLO of given length carries field, older targets send shorter prefix of msg_hello_t */
+#define PHFS_HELLO_HAS(len, field) ((len) >= offsetof(msg_hello_t, field) + sizeof(((msg_hello_t *)0)->field))
+
+
+static struct {
+	int maxbaud;
+} phfs_common = { .maxbaud = PHFS_BAUD_MAX };
+
+
+/* Function stores opened file in the first free slot, returns handle passed to the target */
+static unsigned int phfs_addfile(session_t *s, int ofd, struct stat *st, fcache_t *cache)
+{
+	session_file_t *files;
+	unsigned int i, sz;
+
+	for (i = 0; i < s->nfiles; i++) {
+		if (s->files[i].fd < 0)
+			break;
+	}
+
+	if (i == s->nfiles) {
+		sz = (s->nfiles == 0) ? 16 : 2 * s->nfiles;
+		if ((files = realloc(s->files, sz * sizeof(*files))) == NULL)
+			return 0;
+		s->files = files;
+		for (; s->nfiles < sz; s->nfiles++) {
+			s->files[s->nfiles].fd = -1;
+			s->files[s->nfiles].wbuff = NULL;
+		}
+	}
+
+	s->files[i].fd = ofd;
+	s->files[i].st = *st;
+	s->files[i].cache = cache;
+	s->files[i].wlen = 0;
+	s->files[i].werr = 0;
+
+	/* Handle 0 is reported to the target as an error */
+	return i + 1;
+}
+
+
+static session_file_t *phfs_getfile(session_t *s, u32 handle)
+{
+	if ((handle == 0) || (handle > s->nfiles) || (s->files[handle - 1].fd < 0))
+		return NULL;
+
+	return &s->files[handle - 1];
+}
+
+
+/* Function writes buffered data, failure is remembered until it's reported to the target */
+static int phfs_wflush(session_t *s, session_file_t *f)
+{
+	size_t done = 0;
+	ssize_t res;
+
+	while (done < f->wlen) {
+		if ((res = pwrite(f->fd, f->wbuff + done, f->wlen - done, f->wpos + done)) < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error(s->dev_addr, "phfs: Write-behind of %zu bytes at %lld failed", f->wlen - done, (long long)(f->wpos + done));
+			f->werr = 1;
+			break;
+		}
+		done += res;
+	}
+
+	if (f->wlen > 0)
+		s->wbusy--;
+	f->wlen = 0;
+
+	return f->werr ? ERR_PHFS_IO : ERR_NONE;
+}
+
+
+/* Function writes buffers of all files, another handle may refer to the same one */
+static void phfs_wflushall(session_t *s)
+{
+	unsigned int i;
+
+	for (i = 0; (s->wbusy > 0) && (i < s->nfiles); i++) {
+		if ((s->files[i].fd >= 0) && (s->files[i].wlen > 0))
+			phfs_wflush(s, &s->files[i]);
+	}
+}
+
+
+/* Function writes buffers of all handles of the file before it's accessed, metadata of f is refreshed */
+static void phfs_wflushfile(session_t *s, session_file_t *f)
+{
+	session_file_t *o;
+	unsigned int i, n = 0;
+
+	for (i = 0; (s->wbusy > 0) && (i < s->nfiles); i++) {
+		o = &s->files[i];
+		if ((o->fd < 0) || (o->wlen == 0) || (o->st.st_dev != f->st.st_dev) || (o->st.st_ino != f->st.st_ino))
+			continue;
+
+		phfs_wflush(s, o);
+		if (o != f)
+			n++;
+	}
+
+	/* Size cached by f doesn't include writes made through other handles */
+	if (n > 0)
+		fstat(f->fd, &f->st);
+}
+
+
+static void phfs_delfile(session_t *s, session_file_t *f)
+{
+	phfs_wflush(s, f);
+	free(f->wbuff);
+	f->wbuff = NULL;
+
+	if (f->cache != NULL) {
+		/* Queued replies may reference the mapping */
+		session_flush(s);
+		fcache_put(f->cache);
+	}
+	close(f->fd);
+	f->fd = -1;
+	f->cache = NULL;
+}
+
+
+static void phfs_summary(session_t *s)
+{
+	log_sumflush(LOGL_INFO, s->dev_addr, "phfs: MSG_READ", &s->rsum);
+	log_sumflush(LOGL_INFO, s->dev_addr, "phfs: MSG_WRITE", &s->wsum);
+}
+
+
+void phfs_closeall(session_t *s)
+{
+	unsigned int i;
+
+	phfs_summary(s);
+
+	for (i = 0; i < s->nfiles; i++) {
+		if (s->files[i].fd >= 0)
+			phfs_delfile(s, &s->files[i]);
+	}
+}
+
+
+int phfs_timer(session_t *s)
+{
+	unsigned long long now = 0, age;
+	unsigned int i;
+	int tmo = -1, t;
+
+	for (i = 0; (s->wbusy > 0) && (i < s->nfiles); i++) {
+		if ((s->files[i].fd < 0) || (s->files[i].wlen == 0))
+			continue;
+
+		if (now == 0)
+			now = metrics_now();
+
+		if ((age = (now - s->files[i].wtime) / 1000) >= PHFS_WB_TIMEOUT) {
+			phfs_wflush(s, &s->files[i]);
+			continue;
+		}
+
+		t = PHFS_WB_TIMEOUT - age;
+		if ((tmo < 0) || (t < tmo))
+			tmo = t;
+	}
+
+	return tmo;
+}
+
+
+int phfs_open(session_t *s, msg_t *msg)
 {
 	char *path = (char *)&msg->data[sizeof(u32)], *realpath;
 	int flags = *(u32 *)msg->data, f = 0, ofd;
 	u16 seq = msg_getseq(msg);
+	fcache_t *cache = NULL;
+	unsigned int handle = 0;
+	struct stat st;
+
+	msg->data[s->rx.maxlen - 1] = 0;
 
-	msg->data[MSG_MAXLEN - 1] = 0;
+	/* File may be opened again, it has to see buffered writes */
+	phfs_wflushall(s);
 
 	f = ((flags & 0x1) == PHFS_RDONLY) ? O_RDONLY : O_RDWR;
 	f = ((flags & 0x2) == PHFS_CREATE) ? (f | O_CREAT) : f;
@@ -42,141 +229,410 @@ int phfs_open(int fd, msg_t *msg, char *sysdir)
 	msg_settype(msg, MSG_OPEN);
 	msg_setlen(msg, sizeof(int));
 
-	if ((realpath = malloc(strlen(sysdir) + 1 + strlen(path) + 1)) == NULL)
+	if ((realpath = malloc(strlen(s->sysdir) + 1 + strlen(path) + 1)) == NULL)
 		*(u32 *)msg->data = 0;
 	else {
-		sprintf(realpath, "%s/%s", sysdir, path);
+		sprintf(realpath, "%s/%s", s->sysdir, path);
 
 		if (flags == PHFS_RDONLY)
 			ofd = open(realpath, f);
 		else
 			ofd = open(realpath, f, S_IRUSR | S_IWUSR);
 
-		printf("[%d] phfs: %s path='%s', realpath='%s', ofd=%d\n", getpid(), ((f & O_CREAT) == O_CREAT) ? "MSG_CREATE" : "MSG_OPEN", path, realpath, ofd);
-		*(u32 *)msg->data = ofd > 0 ? ofd : 0;
+		if ((ofd >= 0) && (fstat(ofd, &st) == 0)) {
+			/* Read-only files are served from shared cache */
+			if (flags == PHFS_RDONLY)
+				cache = fcache_get(realpath, ofd, &st);
+
+			if ((handle = phfs_addfile(s, ofd, &st, cache)) == 0) {
+				if (cache != NULL)
+					fcache_put(cache);
+			}
+		}
+
+		if ((ofd >= 0) && (handle == 0))
+			close(ofd);
+
+		log_info(s->dev_addr, "phfs: %s path='%s', realpath='%s', handle=%u", ((f & O_CREAT) == O_CREAT) ? "MSG_CREATE" : "MSG_OPEN", path, realpath, handle);
+		*(u32 *)msg->data = handle;
 		free(realpath);
 	}
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_send(s, msg, seq) < 0)
 		return ERR_PHFS_IO;
 	return 1;
 }
 
 
-int phfs_read(int fd, msg_t *msg, char *sysdir)
+int phfs_read(session_t *s, msg_t *msg)
 {
 	msg_phfsio_t *io = (msg_phfsio_t *)msg->data;
 	u16 seq = msg_getseq(msg);
+	static u8 zbuff[MSG_MAXLEN_EXT];
+	session_file_t *f;
+	const u8 *data = NULL;
+	size_t n, zlen = 0;
 	u32 hdrsz;
 	u32 l, pos, len;
 
 	hdrsz = (u32)((u8 *)io->buff - (u8 *)io);
-	if (io->len > MSG_MAXLEN - hdrsz)
-		io->len = MSG_MAXLEN - hdrsz;
+	if ((u32)io->len > s->rx.maxlen - hdrsz)
+		io->len = s->rx.maxlen - hdrsz;
 
 	len = io->len;
 	pos = io->pos;
-	lseek(io->handle, io->pos, SEEK_SET);
-	io->len = read(io->handle, io->buff, io->len);
+
+	/* Data written through any handle of the file has to be visible */
+	if ((f = phfs_getfile(s, io->handle)) != NULL)
+		phfs_wflushfile(s, f);
+
+	if ((f != NULL) && (f->cache != NULL) && !fcache_valid(f->cache, f->fd)) {
+		/* File changed, drop the mapping and refresh metadata */
+		session_flush(s);
+		fcache_put(f->cache);
+		f->cache = NULL;
+		fstat(f->fd, &f->st);
+	}
+
+	if (f == NULL)
+		io->len = -1;
+	else if (f->cache != NULL) {
+		/* Cached content is sent directly from the mapping */
+		n = io->len;
+		data = fcache_ptr(f->cache, io->pos, &n);
+		io->len = n;
+		s->metrics.hits++;
+	}
+	else {
+		io->len = pread(f->fd, io->buff, io->len, io->pos);
+		s->metrics.misses++;
+	}
 
 	l = (io->len > 0) ? io->len : 0;
+
+	/* Compressed data replaces plain one only if it's shorter, len keeps number of bytes read */
+	if ((s->caps & PHFS_CAP_LZ4) && (l >= PHFS_LZ4_MINLEN)) {
+		if (data != NULL) {
+			if ((data = fcache_lz4(f->cache, io->pos, l, &zlen)) == NULL)
+				data = fcache_ptr(f->cache, io->pos, &n);
+		}
+		else if ((zlen = lz4_compress(io->buff, l, zbuff, l - 1)) > 0) {
+			memcpy(io->buff, zbuff, zlen);
+		}
+
+		if (zlen > 0)
+			io->handle |= PHFS_IO_LZ4;
+	}
+
 	io->pos += l;
 
-	printf("[%d] phfs: MSG_READ ofd=%d, pos=%d, len=%d, ret=%d\n",
-		getpid(), io->handle, pos, len, io->len);
+	/* Reads are traced one by one only on request, summary is printed otherwise */
+	log_trace(s->dev_addr, "phfs: MSG_READ handle=%u, pos=%d, len=%d, ret=%d", io->handle, pos, len, io->len);
+	log_sum(LOGL_INFO, s->dev_addr, "phfs: MSG_READ", &s->rsum, l);
+
+	if (zlen > 0) {
+		s->metrics.zbytes += l - zlen;
+		l = zlen;
+	}
 
 	msg_settype(msg, MSG_READ);
 	msg_setlen(msg, l + hdrsz);
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_senddata(s, msg, seq, data, (data != NULL) ? l : 0) < 0)
 		return ERR_PHFS_IO;
 
 	return 1;
 }
 
 
-int phfs_write(int fd, msg_t *msg, char *sysdir)
+/* Function buffers write, returns number of acknowledged bytes or -1 if error has to be reported */
+static s32 phfs_wbuffer(session_t *s, session_file_t *f, const u8 *data, u32 len, u32 pos)
+{
+	/* Error of previous writes is reported once */
+	if (f->werr) {
+		f->werr = 0;
+		return -1;
+	}
+
+	if ((f->wlen > 0) && ((pos != f->wpos + f->wlen) || (f->wlen + len > PHFS_WB_SIZE)) && (phfs_wflush(s, f) < 0)) {
+		f->werr = 0;
+		return -1;
+	}
+
+	if ((f->wbuff == NULL) && ((f->wbuff = malloc(PHFS_WB_SIZE)) == NULL))
+		return pwrite(f->fd, data, len, pos);
+
+	if (f->wlen == 0) {
+		f->wpos = pos;
+		f->wtime = metrics_now();
+		s->wbusy++;
+	}
+
+	memcpy(f->wbuff + f->wlen, data, len);
+	f->wlen += len;
+
+	/* Buffer is written as soon as next frame wouldn't fit */
+	if ((f->wlen + s->rx.maxlen > PHFS_WB_SIZE) && (phfs_wflush(s, f) < 0)) {
+		f->werr = 0;
+		return -1;
+	}
+
+	return len;
+}
+
+
+int phfs_write(session_t *s, msg_t *msg)
 {
 	msg_phfsio_t *io = (msg_phfsio_t *)msg->data;
 	u32 hdrsz, l;
 	u16 seq = msg_getseq(msg);
+	session_file_t *f;
 
 	hdrsz = (u32)((u8 *)io->buff - (u8 *)io);
 
-	if (io->len > MSG_MAXLEN - hdrsz)
-		io->len = MSG_MAXLEN - hdrsz;
-
-	lseek(io->handle, io->pos, SEEK_SET);
-	io->len = write(io->handle, io->buff, io->len);
+	if ((u32)io->len > s->rx.maxlen - hdrsz)
+		io->len = s->rx.maxlen - hdrsz;
 
-	printf("[%d] phfs: MSG_WRITE fd=%d, pos=%d, ret=%d\n",
-		getpid(), io->handle, io->pos, io->len);
+	if ((f = phfs_getfile(s, io->handle)) == NULL)
+		io->len = -1;
+	else if (io->len > 0)
+		io->len = phfs_wbuffer(s, f, io->buff, io->len, io->pos);
 
 	l = (io->len > 0) ? io->len : 0;
+
+	log_trace(s->dev_addr, "phfs: MSG_WRITE handle=%u, pos=%d, ret=%d", io->handle, io->pos, io->len);
+	log_sum(LOGL_INFO, s->dev_addr, "phfs: MSG_WRITE", &s->wsum, l);
+
+	/* Keep cached metadata up to date */
+	if ((l > 0) && (io->pos + l > f->st.st_size))
+		f->st.st_size = io->pos + l;
+
 	io->pos += l;
 
 	msg_settype(msg, MSG_WRITE);
 	msg_setlen(msg, l + hdrsz);
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_send(s, msg, seq) < 0)
 		return ERR_PHFS_IO;
 
 	return 1;
 }
 
 
-int phfs_close(int fd, msg_t *msg, char *sysdir)
+int phfs_close(session_t *s, msg_t *msg)
 {
-	int ofd = *(int *)msg->data;
+	u32 handle = *(u32 *)msg->data;
 	u16 seq = msg_getseq(msg);
-
-	printf("[%d] phfs: MSG_CLOSE ofd=%d\n", getpid(), ofd);
-	close(ofd);
+	session_file_t *f;
+
+	phfs_summary(s);
+	log_info(s->dev_addr, "phfs: MSG_CLOSE handle=%u", handle);
+	if ((f = phfs_getfile(s, handle)) != NULL) {
+		/* Failed write-behind is reported instead of handle */
+		if (phfs_wflush(s, f) < 0)
+			*(s32 *)msg->data = -1;
+		phfs_delfile(s, f);
+	}
 	msg_settype(msg, MSG_CLOSE);
 	msg_setlen(msg, sizeof(int));
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_send(s, msg, seq) < 0)
 		return ERR_PHFS_IO;
 	return 1;
 }
 
 
-int phfs_reset(int fd, msg_t *msg, char *sysdir)
+int phfs_reset(session_t *s, msg_t *msg)
 {
-	int i;
-	struct rlimit rlim;
 	u16 seq = msg_getseq(msg);
 
-	printf("[%d] phfs: MSG_RESET\n", getpid());
-	getrlimit(RLIMIT_NOFILE, &rlim);
-	for (i = 3; i < rlim.rlim_cur; i++) {
-		if (i != fd)
-			close(i);
-	}
+	log_info(s->dev_addr, "phfs: MSG_RESET");
+	phfs_closeall(s);
 
 	msg_settype(msg, MSG_RESET);
 	msg_setlen(msg, 0);
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_send(s, msg, seq) < 0)
+		return ERR_PHFS_IO;
+
+	/* Rebooted target may be an old one, it has to negotiate again */
+	s->caps = 0;
+	s->window = 1;
+	if ((s->rx.maxlen != MSG_MAXLEN) && (msg_rx_resize(&s->rx, MSG_MAXLEN) < 0))
+		return ERR_MEM;
+
+	if (session_setbaud(s, s->safebaud) < 0)
 		return ERR_PHFS_IO;
+
 	return 1;
 }
 
 
-int phfs_stat(int fd, msg_t *msg, char *sysdir)
+static int phfs_rcvbuf(int fd)
+{
+	int rcvbuf;
+	socklen_t optlen = sizeof(rcvbuf);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen) < 0)
+		return -1;
+
+#ifdef __linux__
+	/* Linux reports doubled value, half of it is used for bookkeeping */
+	rcvbuf /= 2;
+#endif
+
+	return rcvbuf;
+}
+
+
+static unsigned int phfs_window(session_t *s, unsigned int window, unsigned int maxlen)
+{
+	int rcvbuf, frames;
+
+	if (window > PHFS_WINDOW_MAX)
+		window = PHFS_WINDOW_MAX;
+	if (window < 1)
+		window = 1;
+
+	if (s->mode != UDP)
+		return window;
+
+	/* Requests exceeding socket buffer would be dropped, so window is limited by its real size */
+	if ((rcvbuf = phfs_rcvbuf(s->fd)) < 0)
+		return 1;
+
+	/* Socket is shared by all peers of endpoint, its buffer is never shrunk */
+	if ((unsigned int)rcvbuf < window * (MSG_HDRSZ + maxlen)) {
+		rcvbuf = window * (MSG_HDRSZ + maxlen);
+		setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		if ((rcvbuf = phfs_rcvbuf(s->fd)) < 0)
+			return 1;
+	}
+
+	frames = rcvbuf / (MSG_HDRSZ + maxlen);
+	if ((unsigned int)frames < window)
+		window = (frames > 1) ? frames : 1;
+
+	return window;
+}
+
+
+/* Function returns highest baudrate supported by target, server and termios, driver rejects it only at switch */
+static int phfs_baudrate(session_t *s, u32 limit)
+{
+	static const int rates[] = { 4000000, 3500000, 3000000, 2500000, 2000000, 1500000, 1152000,
+		1000000, 921600, 576000, 500000, 460800, 230400, 115200 };
+	speed_t speed;
+	unsigned int k;
+
+	for (k = 0; k < sizeof(rates) / sizeof(rates[0]); k++) {
+		if (((u32)rates[k] > limit) || (rates[k] > phfs_common.maxbaud) || ((s->badbaud != 0) && (rates[k] >= s->badbaud)))
+			continue;
+
+		if (rates[k] <= s->baudrate)
+			break;
+
+		if ((serial_int2speed(rates[k], &speed) == 0) && (serial_probespeed(s->fd, speed) == 0))
+			return rates[k];
+	}
+
+	return s->baudrate;
+}
+
+
+int phfs_hello(session_t *s, msg_t *msg)
+{
+	msg_hello_t *hello = (msg_hello_t *)msg->data;
+	u16 seq = msg_getseq(msg);
+	u32 maxlen, caps, version, window = 1, len = msg_getlen(msg);
+	int baudrate;
+
+	/* Ignore UDP beacons, they use the same message type */
+	if (!PHFS_HELLO_HAS(len, caps) || (hello->magic != PHFS_HELLO_MAGIC))
+		return 0;
+
+	/* Fields are decoded and answered up to the last one target sent */
+	if (PHFS_HELLO_HAS(len, baudrate))
+		len = sizeof(msg_hello_t);
+	else if (PHFS_HELLO_HAS(len, window))
+		len = offsetof(msg_hello_t, baudrate);
+	else
+		len = offsetof(msg_hello_t, window);
+
+	version = (hello->version < PHFS_HELLO_VERSION) ? hello->version : PHFS_HELLO_VERSION;
+
+	maxlen = hello->maxlen;
+	if (maxlen > s->maxlen)
+		maxlen = s->maxlen;
+	if (maxlen < MSG_MAXLEN)
+		maxlen = MSG_MAXLEN;
+
+	caps = hello->caps & (PHFS_CAP_WINDOW | PHFS_CAP_LZ4 | PHFS_CAP_BAUD | PHFS_CAP_LOOKUP);
+	if (!PHFS_HELLO_HAS(len, window))
+		caps &= ~PHFS_CAP_WINDOW;
+	if (caps & PHFS_CAP_WINDOW)
+		window = phfs_window(s, hello->window, maxlen);
+
+	if ((s->mode != SERIAL) || !PHFS_HELLO_HAS(len, baudrate) || (phfs_common.maxbaud == 0))
+		caps &= ~PHFS_CAP_BAUD;
+
+	baudrate = s->baudrate;
+	if (caps & PHFS_CAP_BAUD)
+		baudrate = phfs_baudrate(s, hello->baudrate);
+
+	log_info(s->dev_addr, "phfs: MSG_HELLO maxlen=%u, caps=0x%x, window=%u, baudrate=%d", maxlen, caps, window, baudrate);
+
+	hello->magic = PHFS_HELLO_MAGIC;
+	hello->version = version;
+	hello->maxlen = maxlen;
+	hello->caps = caps;
+	if (PHFS_HELLO_HAS(len, window))
+		hello->window = window;
+	if (PHFS_HELLO_HAS(len, baudrate))
+		hello->baudrate = baudrate;
+
+	msg_settype(msg, MSG_HELLO);
+	msg_setlen(msg, len);
+
+	if (session_send(s, msg, seq) < 0)
+		return ERR_PHFS_IO;
+
+	/* Answer is sent with initial speed, target switches after receiving it */
+	if (session_setbaud(s, baudrate) < 0)
+		return ERR_PHFS_IO;
+
+	s->caps = caps;
+	s->window = window;
+
+	/* New size applies to frames following the answer, msg is no longer valid */
+	if (msg_rx_resize(&s->rx, maxlen) < 0)
+		return ERR_MEM;
+
+	return 1;
+}
+
+
+int phfs_stat(session_t *s, msg_t *msg)
 {
 	msg_phfsio_t *io = (msg_phfsio_t *)msg->data;
 	u16 seq = msg_getseq(msg);
 	u32 hdrsz;
 	u32 l;
 	hdrsz = (u32)((u8 *)io->buff - (u8 *)io);
-	if (io->len > MSG_MAXLEN - hdrsz)
-		io->len = MSG_MAXLEN - hdrsz;
+	if ((u32)io->len > s->rx.maxlen - hdrsz)
+		io->len = s->rx.maxlen - hdrsz;
 
 	struct pho_stat stat_send, test;
+	session_file_t *f;
 	struct stat st;
 
-	fstat(io->handle, &st);
+	/* Metadata is cached at open and updated by writes */
+	if ((f = phfs_getfile(s, io->handle)) != NULL) {
+		phfs_wflushfile(s, f);
+		st = f->st;
+	}
+	else
+		memset(&st, 0, sizeof(st));
 
 	stat_send.st_dev = st.st_dev;
 	stat_send.st_ino = st.st_ino;
@@ -197,96 +653,168 @@ int phfs_stat(int fd, msg_t *msg, char *sysdir)
 	memcpy(&test, io->buff, sizeof(stat_send));
 	io->pos = 0;
 	l = sizeof(stat_send);
-	msg->data[MSG_MAXLEN - 1] = 0;
+	msg->data[s->rx.maxlen - 1] = 0;
 	io->len = l;
 	msg_settype(msg, MSG_FSTAT);
 	msg_setlen(msg, l + hdrsz);
 
-	printf("[%d] phfs: MSG_STAT id:%d  \n", getpid(), io->handle);
+	log_debug(s->dev_addr, "phfs: MSG_STAT handle=%u", io->handle);
 
-	if (msg_send(fd, msg, seq) < 0)
+	if (session_send(s, msg, seq) < 0)
 		return ERR_PHFS_IO;
 	return 1;
 }
 
-#if 0
-int phfs_lookup(int fd, msg_t *msg, char *sysdir)
+/* Function answers request of capability which wasn't negotiated, answer starts with s32 error */
+static int phfs_nocap(session_t *s, msg_t *msg, unsigned int len)
 {
-	char *name; ;
-	int flags = *(u32 *)msg->data, f = 0, ofd;
+	u16 seq = msg_getseq(msg);
 
-	msg->data[MSG_MAXLEN] = 0;
+	log_warn(s->dev_addr, "phfs: Message type %u without negotiated capability", msg_gettype(msg));
 
-	name = &msg->data[sizeof(u32)];
+	memset(msg->data, 0, len);
+	*(s32 *)msg->data = -ENOSYS;
+	msg_setlen(msg, len);
 
-	msg_settype(msg, MSG_LOOKUP);
-	msg_setlen(msg, sizeof(int));
+	if (session_send(s, msg, seq) < 0)
+		return ERR_PHFS_IO;
+	return 1;
+}
 
-	if ((entry = cache_find(id)) == NULL) {
-		vnode = vnode_get(id);
-		if (id == 0)
-			vnode->path = sysdir;
-			vnode->type = vnodeDir;
-		}
 
-	if (!entry) {
-		vnode_get(id);
-		vnode->type = vnodeDir;
-		vnode->path =
+int phfs_lookup(session_t *s, msg_t *msg)
+{
+	msg_lookup_t *lk = (msg_lookup_t *)msg->data;
+	u16 seq = msg_getseq(msg);
+	vnode_t *v;
+
+	if (!(s->caps & PHFS_CAP_LOOKUP))
+		return phfs_nocap(s, msg, sizeof(*lk));
 
-if (entry->type != vnodeDir)
-		err = ERR_ARG;
+	msg->data[s->rx.maxlen - 1] = 0;
 
-	if (file->
+	/* Reported size has to include buffered writes */
+	phfs_wflushall(s);
 
-	if ((realpath = malloc(strlen(sysdir) + 1 + strlen(path) + 1)) == NULL)
-		*(u32 *)msg->data = 0;
+	/* Existence checks are answered from memory, host files are not opened */
+	v = vcache_lookup(s->sysdir, (char *)msg->data);
+	log_debug(s->dev_addr, "phfs: MSG_LOOKUP path='%s', found=%d", (char *)msg->data, v != NULL);
+
+	memset(lk, 0, sizeof(*lk));
+	if (v == NULL) {
+		lk->err = -1;
+	}
 	else {
-		sprintf(realpath, "%s/%s", sysdir, path);
+		lk->ino = v->ino;
+		lk->mode = v->mode;
+		lk->size = v->size;
+		lk->mtime = v->mtime;
+	}
 
-		if (flags == PHFS_RDONLY)
-			ofd = open(realpath, f);
-		else
-			ofd = open(realpath, f, S_IRUSR | S_IWUSR);
+	msg_settype(msg, MSG_LOOKUP);
+	msg_setlen(msg, sizeof(*lk));
 
-		printf("[%d] phfs: MSG_OPEN path='%s', realpath='%s', ofd=%d\n", getpid(), path, realpath, ofd);
-		*(u32 *)msg->data = ofd > 0 ? ofd : 0;
-		free(realpath);
+	if (session_send(s, msg, seq) < 0)
+		return ERR_PHFS_IO;
+	return 1;
+}
+
+
+int phfs_readdir(session_t *s, msg_t *msg)
+{
+	msg_readdir_t *rd = (msg_readdir_t *)msg->data;
+	u16 seq = msg_getseq(msg);
+	msg_dirent_t *de;
+	u32 cookie = rd->cookie, l = sizeof(*rd), reclen;
+	vnode_t *dir, *v;
+	size_t namelen;
+
+	if (!(s->caps & PHFS_CAP_LOOKUP))
+		return phfs_nocap(s, msg, sizeof(*rd));
+
+	msg->data[s->rx.maxlen - 1] = 0;
+
+	phfs_wflushall(s);
+
+	dir = vcache_lookup(s->sysdir, (char *)msg->data + sizeof(*rd));
+	log_debug(s->dev_addr, "phfs: MSG_READDIR path='%s', cookie=%u", (char *)msg->data + sizeof(*rd), cookie);
+
+	rd->err = ((dir == NULL) || !S_ISDIR(dir->mode)) ? -1 : 0;
+	rd->cookie = 0;
+
+	/* Entries are packed until the answer is full */
+	for (; (rd->err == 0) && ((v = vcache_entry(dir, cookie)) != NULL); cookie++) {
+		namelen = strlen(v->name);
+		reclen = (sizeof(*de) + namelen + 1 + 3) & ~3u;
+		if (l + reclen > s->rx.maxlen) {
+			/* Entry which doesn't fit in empty answer would be reported as end of directory or requested forever */
+			if (l == sizeof(*rd))
+				rd->err = -ENAMETOOLONG;
+			else
+				rd->cookie = cookie;
+			break;
+		}
+
+		de = (msg_dirent_t *)(msg->data + l);
+		de->ino = v->ino;
+		de->mode = v->mode;
+		de->size = v->size;
+		de->reclen = reclen;
+		de->namelen = namelen;
+		memcpy(de->name, v->name, namelen + 1);
+		l += reclen;
 	}
 
-	if (msg_send(fd, msg) < 0)
+	msg_settype(msg, MSG_READDIR);
+	msg_setlen(msg, l);
+
+	if (session_send(s, msg, seq) < 0)
 		return ERR_PHFS_IO;
 	return 1;
 }
-#endif
 
 
-int phfs_handlemsg(int fd, msg_t *msg, char *sysdir)
+void phfs_maxbaud(int baudrate)
+{
+	phfs_common.maxbaud = baudrate;
+}
+
+
+int phfs_handlemsg(session_t *s, msg_t *msg)
 {
 	int res = 0;
 
 	switch (msg_gettype(msg)) {
 		case MSG_OPEN:
-			res = phfs_open(fd, msg, sysdir);
+			res = phfs_open(s, msg);
 			break;
 		case MSG_READ:
-			res = phfs_read(fd, msg, sysdir);
+			res = phfs_read(s, msg);
 			break;
 		case MSG_WRITE:
-			res = phfs_write(fd, msg, sysdir);
+			res = phfs_write(s, msg);
 			break;
 		case MSG_CLOSE:
-			res = phfs_close(fd, msg, sysdir);
+			res = phfs_close(s, msg);
 			break;
 		case MSG_RESET:
-			res = phfs_reset(fd, msg, sysdir);
+			res = phfs_reset(s, msg);
 			break;
 		case MSG_FSTAT:
-			res = phfs_stat(fd, msg, sysdir);
+			res = phfs_stat(s, msg);
+			break;
+		case MSG_HELLO:
+			res = phfs_hello(s, msg);
+			break;
+		case MSG_LOOKUP:
+			res = phfs_lookup(s, msg);
+			break;
+		case MSG_READDIR:
+			res = phfs_readdir(s, msg);
 			break;
 	}
 	if (res < 0)
-		printf("[%d] phfs: msg error %d \n", getpid(), res);
+		log_error(s->dev_addr, "phfs: msg error %d", res);
 
 	return res;
 }
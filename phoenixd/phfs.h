@@ -16,6 +16,8 @@
 #ifndef _PHFS_H_
 #define _PHFS_H_
 
+#include "dispatch.h"
+
 
 #define MSG_OPEN   1
 #define MSG_READ   2
@@ -24,6 +26,47 @@
 #define MSG_RESET  5
 #define MSG_FSTAT   6
 #define MSG_HELLO	7
+#define MSG_LOOKUP  8
+#define MSG_READDIR 9
+
+/* MSG_HELLO sent by target starts capability exchange (msg_hello_t) */
+#define PHFS_HELLO_MAGIC    0x53464850  /* "PHFS" */
+#define PHFS_HELLO_VERSION  3
+
+/* Capabilities */
+#define PHFS_CAP_WINDOW  (1u << 0) /* several requests may be outstanding, answers are matched by seq */
+#define PHFS_CAP_LZ4     (1u << 1) /* MSG_READ answers may carry LZ4 compressed data */
+#define PHFS_CAP_BAUD    (1u << 2) /* serial link switches to negotiated baudrate after MSG_HELLO */
+#define PHFS_CAP_LOOKUP  (1u << 3) /* MSG_LOOKUP and MSG_READDIR are supported */
+
+/* MSG_READ answer handle flag, buff holds LZ4 block decompressing to len bytes */
+#define PHFS_IO_LZ4      (1u << 31)
+
+/* Shorter reads are never compressed */
+#define PHFS_LZ4_MINLEN  64
+
+/*
+ * Baudrate negotiation (PHFS_CAP_BAUD): target sends MSG_HELLO with highest baudrate it supports,
+ * server answers with the highest one supported by both sides (at current speed) and both sides
+ * switch to it once the answer is sent. Target starts again at initial speed after reboot, server
+ * returns to it on MSG_RESET or when it receives this many bytes of garbage without valid frame.
+ */
+#define PHFS_BAUD_JUNK   64
+
+/* Highest baudrate negotiated by default */
+#define PHFS_BAUD_MAX    3000000
+
+/* Maximum number of outstanding requests per session */
+#define PHFS_WINDOW_MAX  32
+
+/*
+ * Write-behind: contiguous MSG_WRITE payloads are acknowledged at once and written together when
+ * buffer fills, on MSG_CLOSE, MSG_RESET, access to the file through any handle, MSG_LOOKUP, MSG_READDIR
+ * or after timeout (ms). Failed write
+ * is reported by answer to the next MSG_WRITE or MSG_CLOSE of the handle.
+ */
+#define PHFS_WB_SIZE     (256 * 1024)
+#define PHFS_WB_TIMEOUT  200
 
 /* Opening flags */
 #define PHFS_RDONLY  0
@@ -39,7 +82,61 @@ typedef struct _msg_phfsio_t {
 } msg_phfsio_t;
 
 
-extern int phfs_handlemsg(int fd, msg_t *msg, char *sysdir);
+/*
+ * Capability exchange, server answers with negotiated values. Fields are only appended, each addition
+ * bumps PHFS_HELLO_VERSION. Server decodes fields present in received message and answers with the
+ * same prefix and lower of both versions.
+ */
+typedef struct _msg_hello_t {
+	u32 magic;
+	u32 version;
+	u32 maxlen; /* maximum frame payload length */
+	u32 caps;   /* optional features */
+	u32 window; /* maximum number of outstanding requests (PHFS_CAP_WINDOW), since version 2 */
+	u32 baudrate; /* serial link speed (PHFS_CAP_BAUD), since version 3 */
+} msg_hello_t;
+
+
+/* MSG_LOOKUP request carries path, answer describes file */
+typedef struct _msg_lookup_t {
+	s32 err;    /* 0 - file exists, -1 - it doesn't, -ENOSYS - PHFS_CAP_LOOKUP wasn't negotiated */
+	u32 ino;
+	u32 mode;
+	u32 size;
+	u32 mtime;
+} msg_lookup_t;
+
+
+/* MSG_READDIR request is followed by directory path, answer by entries (msg_dirent_t) */
+typedef struct _msg_readdir_t {
+	s32 err;    /* answer: 0, -1 if path isn't a directory, -ENAMETOOLONG if entry doesn't fit in frame, -ENOSYS (no PHFS_CAP_LOOKUP) */
+	u32 cookie; /* index of first entry, answer - index of next one (0 after the last entry) */
+} msg_readdir_t;
+
+
+typedef struct _msg_dirent_t {
+	u32 ino;
+	u32 mode;
+	u32 size;
+	u16 reclen; /* size of entry with name aligned to 4 bytes */
+	u16 namelen;
+	char name[]; /* NUL terminated */
+} msg_dirent_t;
+
+
+extern int phfs_handlemsg(session_t *s, msg_t *msg);
+
+
+/* Function limits negotiated serial baudrate (0 - negotiation is disabled) */
+extern void phfs_maxbaud(int baudrate);
+
+
+/* Function closes all files opened by the session target */
+extern void phfs_closeall(session_t *s);
+
+
+/* Function writes expired write-behind buffers, returns ms until next one expires or -1 */
+extern int phfs_timer(session_t *s);
 
 struct	pho_stat
 {
@@ -21,15 +21,20 @@
 #include <termios.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <errno.h>
+#include <signal.h>
 
 #include <hostutils-common/types.h>
 #include <hostutils-common/errors.h>
 #include <hostutils-common/serial.h>
 #include <hostutils-common/dispatch.h>
+#include <hostutils-common/log.h>
 #include "bsp.h"
 #include "msg_udp.h"
 #include "msg_tcp.h"
 #include "dispatch.h"
+#include "phfs.h"
+#include "capture.h"
 
 
 extern char *optarg;
@@ -40,13 +45,14 @@ extern char *optarg;
 int phoenixd_session(char *tty, char *kernel, char *sysdir, speed_t baudrate)
 {
 	u8 t;
-	int fd, count, err;
+	int fd, count, err, l;
+	unsigned int window;
 	u8 buff[BSP_MSGSZ];
 
-	fprintf(stderr, "[%d] Starting phoenixd-child on %s\n", getpid(), tty);
+	log_info(NULL, "Starting phoenixd-child on %s", tty);
 
 	if ((fd = serial_open(tty, baudrate)) < 0) {
-		fprintf(stderr, "[%d] Can't open %s [%d]!\n", getpid(), tty, fd);
+		log_error(NULL, "Can't open %s [%d]!", tty, fd);
 		return ERR_PHOENIXD_TTY;
 	}
 
@@ -61,22 +67,28 @@ int phoenixd_session(char *tty, char *kernel, char *sysdir, speed_t baudrate)
 		/* Handle kernel request */
 		case BSP_TYPE_KDATA:
 			if (*(u8 *)buff != 0) {
-				fprintf(stderr, "[%d] Bad kernel request on %s\n", getpid(), tty);
+				log_warn(NULL, "Bad kernel request on %s", tty);
 				break;
 			}
-			fprintf(stderr, "[%d] Sending kernel to %s\n", getpid(), tty);
+			window = bsp_window(&buff[1], count - 1);
+			log_info(NULL, "Sending kernel to %s (window=%u)", tty, window);
 
-			if ((err = bsp_sendkernel(fd, kernel)) < 0) {
-				fprintf(stderr, "[%d] Sending kernel error [%d]!\n", getpid(), err);
+			if ((err = bsp_sendkernel(fd, kernel, window)) < 0) {
+				log_error(NULL, "Sending kernel error [%d]!", err);
 				break;
 			}
 			break;
 
 		/* Handle program request */
 		case BSP_TYPE_PDATA:
-			fprintf(stderr, "[%d] Load program request on %s, program=%s\n", getpid(), tty, &buff[2]);
-			if ((err = bsp_sendprogram(fd, (char*)&buff[2], sysdir)) < 0)
-				fprintf(stderr, "[%d] Sending program error [%d]!\n", getpid(), err);
+			/* Window request follows program name */
+			buff[BSP_MSGSZ - 1] = 0;
+			l = 2 + strlen((char *)&buff[2]) + 1;
+			window = bsp_window(&buff[l], count - l);
+
+			log_info(NULL, "Load program request on %s, program=%s, window=%u", tty, &buff[2], window);
+			if ((err = bsp_sendprogram(fd, (char*)&buff[2], sysdir, window)) < 0)
+				log_error(NULL, "Sending program error [%d]!", err);
 			break;
 		}
 	}
@@ -84,14 +96,126 @@ int phoenixd_session(char *tty, char *kernel, char *sysdir, speed_t baudrate)
 }
 
 
+static int add_tty(char ***ttys, dmode_t **mode, int *n, char *dev, dmode_t m)
+{
+	char **t;
+	dmode_t *d;
+
+	if ((t = realloc(*ttys, (*n + 1) * sizeof(*t))) == NULL)
+		return ERR_MEM;
+	*ttys = t;
+
+	if ((d = realloc(*mode, (*n + 1) * sizeof(*d))) == NULL)
+		return ERR_MEM;
+	*mode = d;
+
+	t[*n] = dev;
+	d[*n] = m;
+	(*n)++;
+
+	return ERR_NONE;
+}
+
+
+static unsigned int parse_port(char *addr, unsigned int defport)
+{
+	char *port;
+	unsigned int res = 0;
+
+	port = strchr(addr, ':');
+	if (port != NULL) {
+		*port++ = '\0';
+		sscanf(port, "%u", &res);
+	}
+
+	if ((res == 0) || (res > 0xffff))
+		res = defport;
+
+	return res;
+}
+
+
+/* Function serves PHFS sessions from one process, USB loaders are still run in forked children */
+static int phoenixd_reactor(char **ttys, dmode_t *mode, int n, char *kernel, char *sysdir, speed_t *speed, int *children)
+{
+	session_t *sessions;
+	unsigned int *ports;
+	char *jumAddr;
+	int k, ns = 0, res;
+
+	*children = 0;
+
+	if ((sessions = calloc(n, sizeof(*sessions))) == NULL)
+		return ERR_MEM;
+
+	if ((ports = calloc(n, sizeof(*ports))) == NULL) {
+		free(sessions);
+		return ERR_MEM;
+	}
+
+	for (k = 0; k < n; k++) {
+		if (mode[k] == USB_VYBRID) {
+			log_flush();
+			if ((res = fork()) < 0) {
+				fprintf(stderr, "Fork error for %d child!\n", k);
+			}
+			else if (res == 0) {
+				if ((jumAddr = strchr(ttys[k], ':')) != NULL)
+					*jumAddr++ = '\0';
+
+				exit(usb_vybrid_dispatch(kernel, ttys[k], jumAddr, NULL, 0));
+			}
+			else {
+				(*children)++;
+			}
+			continue;
+		}
+
+		if (mode[k] == UDP)
+			ports[k] = parse_port(ttys[k], PHFS_UDPPORT);
+		else if (mode[k] == TCP)
+			ports[k] = parse_port(ttys[k], PHFS_TCPPORT);
+
+		if (session_open(&sessions[ns], ttys[k], mode[k], sysdir, (mode[k] == UDP || mode[k] == TCP) ? (void *)&ports[k] : (void *)speed) < 0)
+			continue;
+		ns++;
+	}
+
+	res = 0;
+	if (ns > 0)
+		res = dispatch_sessions(sessions, ns);
+
+	free(ports);
+	free(sessions);
+
+	return res;
+}
+
+
 void print_help(void)
 {
-	fprintf(stderr, "usage: phoenixd [-1] [-k kernel] [-s bindir]\n"
+	fprintf(stderr, "usage: phoenixd [-1] [-e] [-v] [-S statsdir] [-C capture] [-b baudrate] [-B max_baudrate] [-k kernel] [-s bindir]\n"
 			"\t\t-p serial_device [ [-p serial_device] ... ]\n"
 			"\t\t-m pipe_file [ [-m pipe_file] ... ]\n"
 			"\t\t-i udp_ip_addr:port [ [-i udp_ip_addr:port] ... ]\n"
 			"\t\t-t tcp_ip_addr:port [ [-t tcp_ip_addr:port] ... ]\n"
-			"\t\t-u load_addr[:jump_addr]\n");
+			"\t\t-q socket_path [ [-q socket_path] ... ]\n"
+			"\t\t-u load_addr[:jump_addr]\n"
+			"\n"
+			"-q\t\t- listen for QEMU socket chardev on UNIX socket, e.g.\n"
+			"\t\t  -chardev socket,id=phfs,path=socket_path,reconnect=1\n"
+			"\t\t  (next QEMU instance may connect after previous one exits)\n"
+			"-e, --event\t- serve all PHFS sessions from single event loop instead\n"
+			"\t\t  of forking one process per device\n"
+			"-v, --verbose\t- increase log level (repeat to trace every PHFS request)\n"
+			"-b, --baudrate\t- initial serial link speed (default 460800)\n"
+			"-B, --maxbaud\t- highest serial link speed negotiated with targets\n"
+			"\t\t  (default 3000000, 0 disables negotiation)\n"
+			"-S, --stats\t- on SIGUSR1 and on exit write per-session metrics in Prometheus\n"
+			"\t\t  text format to statsdir/phoenixd-<pid>.prom (signal the process\n"
+			"\t\t  group to collect metrics of all forked sessions)\n"
+			"-C, --capture\t- write received and sent PHFS frames with monotonic timestamps\n"
+			"\t\t  to pcapng file (replayed with phfsbench -r)\n");
 
 	fprintf(stderr, "\n"
 		"For imx6ull:\n"
@@ -140,10 +264,13 @@ int main(int argc, char *argv[])
 
 	speed_t speed;
 	char *sysdir = "../sys";
-	char *ttys[8];
-	mode_t mode[8] = {SERIAL};
+	char *statsdir = NULL;
+	char *capture = NULL;
+	char **ttys = NULL;
+	dmode_t *mode = NULL;
 	int k, i = 0;
 	int res, st;
+	int evfl = 0, children;
 
 	struct option long_opts[] = {
 		{"sdp", no_argument, &sdp, 1},
@@ -156,7 +283,12 @@ int main(int argc, char *argv[])
 		{"execute", required_argument, 0, 'x'},
 		{"help", no_argument, 0, 'h'},
 		{"baudrate", required_argument, 0, 'b'},
+		{"maxbaud", required_argument, 0, 'B'},
 		{"output", required_argument, 0, 'o'},
+		{"event", no_argument, 0, 'e'},
+		{"verbose", no_argument, 0, 'v'},
+		{"stats", required_argument, 0, 'S'},
+		{"capture", required_argument, 0, 'C'},
 		{0, 0, 0, 0}};
 
 	printf("-\\- Phoenix server, ver. " VERSION "\n"
@@ -170,7 +302,7 @@ int main(int argc, char *argv[])
 	}
 
 	while (1) {
-		c = getopt_long(argc, argv, "h1k:p:s:m:i:u:a:x:c:I:o:b:t:", long_opts, &opt_idx);
+		c = getopt_long(argc, argv, "h1evk:p:s:m:i:q:u:a:x:c:I:o:b:B:t:S:C:", long_opts, &opt_idx);
 		if (c < 0)
 			break;
 
@@ -190,42 +322,31 @@ int main(int argc, char *argv[])
 				return ERR_ARG;
 			}
 			break;
+		case 'B':
+			phfs_maxbaud(atoi(optarg));
+			break;
+		case 'e':
+			evfl = 1;
+			break;
+		case 'v':
+			log_init(log_level + 1);
+			break;
+		case 'S':
+			statsdir = optarg;
+			break;
+		case 'C':
+			capture = optarg;
+			break;
 		case 'm':
-			if (i < 8) {
-				mode[i] = PIPE;
-			}
 		case 'p':
-			if (i == 8) {
-				fprintf(stderr, "Too many ttys for open!\n");
-				return ERR_ARG;
-			}
-
-			ttys[i++] = optarg;
-			break;
-
 		case 'i':
-			if (i >= 8) {
-				fprintf(stderr, "Too many instances (-i %s)\n", optarg);
-				break;
-			}
-			mode[i] = UDP;
-			ttys[i++] = optarg;
-			break;
 		case 't':
-			if (i >= 8) {
-				fprintf(stderr, "Too many instances (-t %s)\n", optarg);
-				break;
-			}
-			mode[i] = TCP;
-			ttys[i++] = optarg;
-			break;
+		case 'q':
 		case 'u':
-			if (i >= 8) {
-				fprintf(stderr, "Too many instances (-u %s)\n", optarg);
-				break;
+			if (add_tty(&ttys, &mode, &i, optarg, (c == 'm') ? PIPE : (c == 'i') ? UDP : (c == 't') ? TCP : (c == 'q') ? QEMU : (c == 'u') ? USB_VYBRID : SERIAL) < 0) {
+				fprintf(stderr, "Out of memory (-%c %s)\n", c, optarg);
+				return ERR_MEM;
 			}
-			mode[i] = USB_VYBRID;
-			ttys[i++] = optarg; /* Load address */
 			break;
 		case 'a':
 		case 'x':
@@ -287,7 +408,33 @@ int main(int argc, char *argv[])
 	}
 
 	free(append);
+
+	/* Closed sockets and pipes are reported by write errors */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((statsdir != NULL) && (metrics_init(statsdir) < 0)) {
+		fprintf(stderr, "Can't enable metrics export\n");
+		return ERR_ARG;
+	}
+
+	if ((capture != NULL) && (capture_init(capture) < 0)) {
+		fprintf(stderr, "Can't create capture file %s\n", capture);
+		return ERR_ARG;
+	}
+
+	if (evfl && !bspfl) {
+		res = phoenixd_reactor(ttys, mode, i, kernel, sysdir, &speed, &children);
+		for (k = 0; k < children; k++) {
+			while ((wait(&st) < 0) && (errno == EINTR))
+				;
+		}
+		free(ttys);
+		free(mode);
+		return res;
+	}
+
 	for (k = 0; k < i; k++) {
+		log_flush();
 		res = fork();
 		if(res < 0) {
 			fprintf(stderr, "Fork error for %d child!\n", k);
@@ -302,33 +449,14 @@ int main(int argc, char *argv[])
 
 				res = usb_vybrid_dispatch(kernel,ttys[k], jumAddr, NULL, 0);
 			} else {
-				char *port;
 				unsigned speed_port = 0;
 
 				if (mode[k] == UDP) {
-					port = strchr(ttys[k], ':');
-					if (port != NULL) {
-						*port++ = '\0';
-						sscanf(port, "%u", &speed_port);
-					}
-
-					if ((speed_port == 0) || (speed_port > 0xffff)) {
-						speed_port = PHFS_UDPPORT;
-					}
-
+					speed_port = parse_port(ttys[k], PHFS_UDPPORT);
 					res = dispatch(ttys[k], mode[k], sysdir, (void *)&speed_port);
 				}
 				else if (mode[k] == TCP) {
-					port = strchr(ttys[k], ':');
-					if (port != NULL) {
-						*port++ = '\0';
-						sscanf(port, "%u", &speed_port);
-					}
-
-					if ((speed_port == 0) || (speed_port > 0xffff)) {
-						speed_port = PHFS_TCPPORT;
-					}
-
+					speed_port = parse_port(ttys[k], PHFS_TCPPORT);
 					res = dispatch(ttys[k], mode[k], sysdir, (void *)&speed_port);
 				}
 				else {
@@ -340,7 +468,12 @@ int main(int argc, char *argv[])
 			//free(ttys[k]);
 	}
 
-	for (k = 0; k < i; k++)
-		wait(&st);
+	/* Wait is interrupted by SIGUSR1 sent to whole process group */
+	for (k = 0; k < i; k++) {
+		while ((wait(&st) < 0) && (errno == EINTR))
+			;
+	}
+	free(ttys);
+	free(mode);
 	return 0;
 }
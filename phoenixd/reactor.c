@@ -0,0 +1,155 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Event loop (epoll/kqueue wrapper)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include <hostutils-common/errors.h>
+#include "reactor.h"
+
+
+#ifdef __linux__
+
+int reactor_init(reactor_t *r)
+{
+	if ((r->fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_add(reactor_t *r, int fd, void *arg)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = arg;
+
+	if (epoll_ctl(r->fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_del(reactor_t *r, int fd)
+{
+	struct epoll_event ev = { 0 };
+
+	if (epoll_ctl(r->fd, EPOLL_CTL_DEL, fd, &ev) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_wait(reactor_t *r, void **args, int n, int timeout)
+{
+	struct epoll_event evs[REACTOR_MAXEVENTS];
+	int i, res;
+
+	if (n > REACTOR_MAXEVENTS)
+		n = REACTOR_MAXEVENTS;
+
+	/* Signal interrupts wait, caller may check flags set by handler */
+	if ((res = epoll_wait(r->fd, evs, n, timeout)) < 0)
+		return (errno == EINTR) ? 0 : ERR_DISPATCH_IO;
+
+	for (i = 0; i < res; i++)
+		args[i] = evs[i].data.ptr;
+
+	return res;
+}
+
+#else
+
+int reactor_init(reactor_t *r)
+{
+	if ((r->fd = kqueue()) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_add(reactor_t *r, int fd, void *arg)
+{
+	struct kevent ev;
+
+	EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, arg);
+
+	if (kevent(r->fd, &ev, 1, NULL, 0, NULL) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_del(reactor_t *r, int fd)
+{
+	struct kevent ev;
+
+	EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+
+	if (kevent(r->fd, &ev, 1, NULL, 0, NULL) < 0)
+		return ERR_DISPATCH_IO;
+
+	return ERR_NONE;
+}
+
+
+int reactor_wait(reactor_t *r, void **args, int n, int timeout)
+{
+	struct kevent evs[REACTOR_MAXEVENTS];
+	struct timespec ts, *tsp = NULL;
+	int i, res;
+
+	if (n > REACTOR_MAXEVENTS)
+		n = REACTOR_MAXEVENTS;
+
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		tsp = &ts;
+	}
+
+	/* Signal interrupts wait, caller may check flags set by handler */
+	if ((res = kevent(r->fd, NULL, 0, evs, n, tsp)) < 0)
+		return (errno == EINTR) ? 0 : ERR_DISPATCH_IO;
+
+	for (i = 0; i < res; i++)
+		args[i] = evs[i].udata;
+
+	return res;
+}
+
+#endif
+
+
+void reactor_done(reactor_t *r)
+{
+	if (r->fd >= 0)
+		close(r->fd);
+	r->fd = -1;
+}
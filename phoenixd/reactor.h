@@ -0,0 +1,48 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Event loop (epoll/kqueue wrapper)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+
+/* Maximum number of events returned by single reactor_wait() call */
+#define REACTOR_MAXEVENTS 64
+
+
+typedef struct _reactor_t {
+	int fd;
+} reactor_t;
+
+
+/* Function creates event loop */
+extern int reactor_init(reactor_t *r);
+
+
+/* Function registers descriptor for read readiness, arg is returned by reactor_wait() */
+extern int reactor_add(reactor_t *r, int fd, void *arg);
+
+
+/* Function unregisters descriptor */
+extern int reactor_del(reactor_t *r, int fd);
+
+
+/* Function waits for ready descriptors (timeout in ms, -1 - infinite), returns number of args stored (0 if interrupted by signal) */
+extern int reactor_wait(reactor_t *r, void **args, int n, int timeout);
+
+
+/* Function destroys event loop */
+extern void reactor_done(reactor_t *r);
+
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of replies to recent requests (retransmitted requests are answered from it)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "metrics.h"
+
+
+replay_t *replay_alloc(void)
+{
+	return calloc(1, sizeof(replay_t));
+}
+
+
+static void replay_drop(replay_t *r, replay_entry_t *e)
+{
+	r->bytes -= e->len;
+	free(e->reply);
+	e->reply = NULL;
+	e->len = 0;
+}
+
+
+void replay_free(replay_t *r)
+{
+	unsigned int k;
+
+	if (r == NULL)
+		return;
+
+	for (k = 0; k < REPLAY_ENTRIES; k++)
+		free(r->entries[k].reply);
+	free(r);
+}
+
+
+static void replay_key(replay_key_t *key, msg_t *req)
+{
+	unsigned int len = msg_getlen(req);
+
+	memset(key, 0, sizeof(*key));
+	key->csum = req->csum;
+	key->type = req->type;
+	memcpy(key->data, req->data, (len < REPLAY_KEYSZ) ? len : REPLAY_KEYSZ);
+}
+
+
+msg_t *replay_find(replay_t *r, msg_t *req)
+{
+	unsigned long long now = metrics_now();
+	replay_entry_t *e;
+	replay_key_t key;
+	unsigned int k;
+
+	replay_key(&key, req);
+
+	for (k = 0; k < REPLAY_ENTRIES; k++) {
+		e = &r->entries[k];
+		if ((e->reply == NULL) || (memcmp(&e->key, &key, sizeof(key)) != 0))
+			continue;
+
+		if (now - e->time < REPLAY_TIMEOUT * 1000ULL)
+			return e->reply;
+
+		replay_drop(r, e);
+		break;
+	}
+
+	return NULL;
+}
+
+
+void replay_begin(replay_t *r, msg_t *req)
+{
+	replay_key(&r->cur, req);
+	r->pending = 1;
+}
+
+
+void replay_store(replay_t *r, msg_t *msg, const u8 *data, unsigned int len)
+{
+	unsigned int hlen = MSG_HDRSZ + msg_getlen(msg) - len, k;
+	replay_entry_t *e;
+	msg_t *reply;
+
+	/* Only the first reply belongs to request */
+	if (!r->pending)
+		return;
+	r->pending = 0;
+
+	if (hlen + len > REPLAY_MAXBYTES)
+		return;
+
+	/* Oldest replies make room for the new one */
+	for (k = 0; (r->bytes + hlen + len > REPLAY_MAXBYTES) && (k < REPLAY_ENTRIES); k++) {
+		if (r->entries[(r->next + k) % REPLAY_ENTRIES].reply != NULL)
+			replay_drop(r, &r->entries[(r->next + k) % REPLAY_ENTRIES]);
+	}
+
+	e = &r->entries[r->next];
+	if (e->reply != NULL)
+		replay_drop(r, e);
+
+	if ((reply = malloc(hlen + len)) == NULL)
+		return;
+
+	memcpy(reply, msg, hlen);
+	if (len > 0)
+		memcpy((u8 *)reply + hlen, data, len);
+
+	e->key = r->cur;
+	e->time = metrics_now();
+	e->reply = reply;
+	e->len = hlen + len;
+	r->bytes += e->len;
+	r->next = (r->next + 1) % REPLAY_ENTRIES;
+}
+
+
+void replay_end(replay_t *r)
+{
+	r->pending = 0;
+}
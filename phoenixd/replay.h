@@ -0,0 +1,83 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of replies to recent requests (retransmitted requests are answered from it)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "msg.h"
+
+
+/* Number of remembered replies */
+#define REPLAY_ENTRIES   32
+
+/* Maximum size of remembered replies of single session (oldest ones are dropped above it) */
+#define REPLAY_MAXBYTES  (256 * 1024)
+
+/* Replies are resent only to requests retransmitted within this time (ms), target may reuse seq after reboot */
+#define REPLAY_TIMEOUT   2000
+
+/* Number of request payload bytes compared in addition to header */
+#define REPLAY_KEYSZ     16
+
+
+/* Request identifying reply */
+typedef struct _replay_key_t {
+	u32 csum;                 /* checksum and seq */
+	u32 type;                 /* type and length */
+	u8 data[REPLAY_KEYSZ];
+} replay_key_t;
+
+
+typedef struct _replay_entry_t {
+	replay_key_t key;
+	unsigned long long time;  /* time of request (us) */
+	msg_t *reply;             /* NULL for free entry */
+	unsigned int len;
+} replay_entry_t;
+
+
+typedef struct _replay_t {
+	replay_entry_t entries[REPLAY_ENTRIES];
+	unsigned int next;        /* oldest entry */
+	unsigned int bytes;       /* size of remembered replies */
+	replay_key_t cur;         /* request being handled */
+	int pending;              /* reply to cur is not stored yet */
+} replay_t;
+
+
+/* Function allocates empty cache */
+extern replay_t *replay_alloc(void);
+
+
+/* Function releases cache */
+extern void replay_free(replay_t *r);
+
+
+/* Function returns stored reply to retransmitted request or NULL */
+extern msg_t *replay_find(replay_t *r, msg_t *req);
+
+
+/* Function starts handling of request, its reply is stored by replay_store() */
+extern void replay_begin(replay_t *r, msg_t *req);
+
+
+/* Function stores reply (data - last len bytes of payload) to request passed to replay_begin() */
+extern void replay_store(replay_t *r, msg_t *msg, const u8 *data, unsigned int len);
+
+
+/* Function finishes handling of request */
+extern void replay_end(replay_t *r);
+
+
+#endif
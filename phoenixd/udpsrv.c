@@ -0,0 +1,267 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * UDP endpoint serving PHFS sessions of many peers from single socket
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <hostutils-common/errors.h>
+#include <hostutils-common/log.h>
+#include "udpsrv.h"
+#include "replay.h"
+
+
+/* Receive buffer stride keeps messages aligned */
+#define UDPSRV_DGRAMSZ  ((MSG_HDRSZ + PHFS_UDPMAXLEN + 7) & ~7)
+
+
+static unsigned int udpsrv_hash(const struct sockaddr_in *addr)
+{
+	unsigned int h = 2166136261u;
+
+	h = (h ^ addr->sin_addr.s_addr) * 16777619u;
+	h = (h ^ addr->sin_port) * 16777619u;
+
+	return (h ^ (h >> 16)) & (UDPSRV_BUCKETS - 1);
+}
+
+
+int udpsrv_open(session_t *s, char *node, uint port)
+{
+	udpsrv_t *srv;
+	unsigned int k;
+
+	if ((srv = calloc(1, sizeof(*srv))) == NULL)
+		return ERR_MEM;
+
+	if ((srv->buffs = malloc(UDPSRV_BATCH * UDPSRV_DGRAMSZ)) == NULL) {
+		free(srv);
+		return ERR_MEM;
+	}
+
+	for (k = 0; k < UDPSRV_BATCH; k++)
+		srv->dgrams[k].msg = (msg_t *)(srv->buffs + k * UDPSRV_DGRAMSZ);
+
+	if ((s->fd = udp_open(node, port, &srv->beacon)) < 0) {
+		free(srv->buffs);
+		free(srv);
+		return ERR_DISPATCH_IO;
+	}
+
+	/* First beacon is sent right away */
+	srv->next = metrics_now();
+	s->udp = srv;
+
+	return ERR_NONE;
+}
+
+
+static void udpsrv_peerfree(udpsrv_peer_t *p)
+{
+	session_close(&p->s);
+	free(p->s.dev_addr);
+	free(p);
+}
+
+
+static udpsrv_peer_t *udpsrv_peer(session_t *s, const struct sockaddr_in *addr)
+{
+	char name[INET_ADDRSTRLEN];
+	udpsrv_t *srv = s->udp;
+	udpsrv_peer_t *p;
+	unsigned int h = udpsrv_hash(addr);
+	size_t len;
+
+	for (p = srv->buckets[h]; p != NULL; p = p->next) {
+		if ((p->addr.sin_addr.s_addr == addr->sin_addr.s_addr) && (p->addr.sin_port == addr->sin_port))
+			return p;
+	}
+
+	if (srv->npeers >= UDPSRV_MAXPEERS)
+		return NULL;
+
+	if ((p = calloc(1, sizeof(*p))) == NULL)
+		return NULL;
+
+	p->addr = *addr;
+
+	inet_ntop(AF_INET, &addr->sin_addr, name, sizeof(name));
+	len = strlen(name) + 7;
+	if ((p->s.dev_addr = malloc(len)) == NULL) {
+		free(p);
+		return NULL;
+	}
+	snprintf(p->s.dev_addr, len, "%s:%u", name, ntohs(addr->sin_port));
+
+	/* Peer session shares endpoint socket, replies are addressed by its transmit queue */
+	p->s.mode = UDP;
+	p->s.peer = 1;
+	p->s.sysdir = s->sysdir;
+	p->s.data = s->data;
+	p->s.fd = s->fd;
+	p->s.fd_out = s->fd;
+	p->s.state = MSGRECV_DESYN;
+	p->s.maxlen = s->maxlen;
+	p->s.window = 1;
+	p->s.evloop = 1;
+	p->s.send = s->send;
+	p->s.flush = s->flush;
+	p->s.tx.addr = &p->addr;
+	p->s.tx.addrlen = sizeof(p->addr);
+
+	/* Targets retransmit requests with lost replies */
+	if ((p->s.replay = replay_alloc()) == NULL) {
+		free(p->s.dev_addr);
+		free(p);
+		return NULL;
+	}
+
+	if (msg_rx_init(&p->s.rx) < 0) {
+		replay_free(p->s.replay);
+		free(p->s.dev_addr);
+		free(p);
+		return NULL;
+	}
+
+	p->next = srv->buckets[h];
+	srv->buckets[h] = p;
+	srv->npeers++;
+
+	log_info(s->dev_addr, "udp: New peer %s (%u peers)", p->s.dev_addr, srv->npeers);
+
+	return p;
+}
+
+
+int udpsrv_ready(session_t *s)
+{
+	udpsrv_t *srv = s->udp;
+	session_t *batch[UDPSRV_BATCH];
+	msg_tx_t *txs[UDPSRV_BATCH];
+	unsigned long long now;
+	unsigned int k, nb = 0, nt = 0;
+	udpsrv_peer_t *p;
+	udp_dgram_t *d;
+	int n;
+
+	if ((n = msg_udp_recvv(s->fd, srv->dgrams, UDPSRV_BATCH)) < 0) {
+		log_warn(s->dev_addr, "udp: Receiving error");
+		return ERR_NONE;
+	}
+
+	now = metrics_now();
+
+	for (k = 0; k < (unsigned int)n; k++) {
+		d = &srv->dgrams[k];
+
+		if ((p = udpsrv_peer(s, &d->addr)) == NULL) {
+			s->rx.desync++;
+			continue;
+		}
+		p->last = now;
+
+		/* Datagram doesn't match its header, truncated ones are dropped */
+		if ((d->len < MSG_HDRSZ) || (d->len != MSG_HDRSZ + msg_getlen(d->msg))) {
+			p->s.rx.desync++;
+			if ((d->len < MSG_HDRSZ) || (d->len < MSG_HDRSZ + msg_getlen(d->msg)) || (msg_getlen(d->msg) > p->s.rx.maxlen))
+				continue;
+		}
+
+		/* Replies of whole batch are queued, so they may refer to received datagrams */
+		if (!p->s.tx.cork) {
+			p->s.tx.cork = 1;
+			batch[nb++] = &p->s;
+		}
+
+		session_handle(&p->s, d->msg);
+	}
+
+	for (k = 0; k < nb; k++) {
+		batch[k]->tx.cork = 0;
+		if (batch[k]->tx.nframes > 0)
+			txs[nt++] = &batch[k]->tx;
+	}
+
+	/* Lost replies are retransmitted by targets */
+	if ((nt > 0) && (msg_udp_flushv(s->fd, txs, nt) < 0))
+		log_debug(s->dev_addr, "udp: Some replies couldn't be sent");
+
+	return ERR_NONE;
+}
+
+
+int udpsrv_timer(session_t *s)
+{
+	udpsrv_t *srv = s->udp;
+	udpsrv_peer_t **pp, *p;
+	unsigned long long now = metrics_now();
+	unsigned int k;
+
+	if (now >= srv->next) {
+		if (udp_beacon(s->fd, &srv->beacon) < 0)
+			log_debug(s->dev_addr, "udp: Can't send beacon");
+		srv->next = now + PHFS_UDPBEACON * 1000ULL;
+
+		for (k = 0; k < UDPSRV_BUCKETS; k++) {
+			for (pp = &srv->buckets[k]; (p = *pp) != NULL;) {
+				if (now - p->last < UDPSRV_IDLE * 1000ULL) {
+					pp = &p->next;
+					continue;
+				}
+
+				log_info(s->dev_addr, "udp: Closing idle peer %s", p->s.dev_addr);
+				*pp = p->next;
+				udpsrv_peerfree(p);
+				srv->npeers--;
+			}
+		}
+	}
+
+	return (srv->next - now + 999) / 1000;
+}
+
+
+unsigned int udpsrv_sessions(session_t *s, session_t **out, unsigned int n)
+{
+	udpsrv_peer_t *p;
+	unsigned int k, cnt = 0;
+
+	for (k = 0; k < UDPSRV_BUCKETS; k++) {
+		for (p = s->udp->buckets[k]; (p != NULL) && (cnt < n); p = p->next)
+			out[cnt++] = &p->s;
+	}
+
+	return cnt;
+}
+
+
+void udpsrv_close(session_t *s)
+{
+	udpsrv_t *srv = s->udp;
+	udpsrv_peer_t *p, *next;
+	unsigned int k;
+
+	for (k = 0; k < UDPSRV_BUCKETS; k++) {
+		for (p = srv->buckets[k]; p != NULL; p = next) {
+			next = p->next;
+			udpsrv_peerfree(p);
+		}
+	}
+
+	free(srv->buffs);
+	free(srv);
+	s->udp = NULL;
+}
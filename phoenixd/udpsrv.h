@@ -0,0 +1,74 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * UDP endpoint serving PHFS sessions of many peers from single socket
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _UDPSRV_H_
+#define _UDPSRV_H_
+
+#include <netinet/in.h>
+#include "dispatch.h"
+#include "msg_udp.h"
+
+
+/* Number of peer hash table buckets (must be a power of 2) */
+#define UDPSRV_BUCKETS   256
+
+/* Maximum number of peers, datagrams from new ones are dropped above it */
+#define UDPSRV_MAXPEERS  1024
+
+/* Peers idle for this time are closed (ms) */
+#define UDPSRV_IDLE      (600 * 1000)
+
+/* Number of datagrams received in single batch */
+#define UDPSRV_BATCH     16
+
+
+typedef struct _udpsrv_peer_t {
+	struct _udpsrv_peer_t *next;  /* hash chain */
+	struct sockaddr_in addr;
+	unsigned long long last;      /* time of last datagram (us) */
+	session_t s;
+} udpsrv_peer_t;
+
+
+typedef struct _udpsrv_t {
+	udpsrv_peer_t *buckets[UDPSRV_BUCKETS];
+	unsigned int npeers;
+	udp_beacon_t beacon;
+	unsigned long long next;      /* time of next beacon (us) */
+	udp_dgram_t dgrams[UDPSRV_BATCH];
+	u8 *buffs;                    /* receive buffers of dgrams */
+} udpsrv_t;
+
+
+/* Function opens endpoint socket for session s, peers are served by sessions created on first datagram */
+extern int udpsrv_open(session_t *s, char *node, uint port);
+
+
+/* Function receives batch of datagrams and dispatches them to peer sessions, replies are sent together */
+extern int udpsrv_ready(session_t *s);
+
+
+/* Function broadcasts due beacon and closes idle peers, returns time until next call (ms) */
+extern int udpsrv_timer(session_t *s);
+
+
+/* Function stores up to n peer sessions in out, returns number of stored ones */
+extern unsigned int udpsrv_sessions(session_t *s, session_t **out, unsigned int n);
+
+
+/* Function closes all peer sessions and the endpoint */
+extern void udpsrv_close(session_t *s);
+
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of sysdir tree metadata (answers lookups and directory listings)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "vcache.h"
+
+
+#ifdef __APPLE__
+#define st_mtim_nsec(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define st_mtim_nsec(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+#ifdef __linux__
+#define VCACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+
+static struct {
+	char *root;
+	vnode_t *rootnode;
+	vnode_t *buckets[VCACHE_BUCKETS];
+	vnode_t *watches[VCACHE_BUCKETS];
+	unsigned int count;
+	int ifd;                  /* change notifications, -1 - directories are revalidated by mtime */
+	unsigned long long loads;
+	unsigned long long hits;
+	unsigned long long misses;
+} vcache_common = { .ifd = -1 };
+
+
+static unsigned int vcache_hash(vnode_t *parent, const char *name, size_t len)
+{
+	unsigned int h = 2166136261u ^ (unsigned int)(((unsigned long)parent) >> 4);
+
+	for (; len > 0; name++, len--)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+
+	return h & (VCACHE_BUCKETS - 1);
+}
+
+
+static void vcache_setattr(vnode_t *v, struct stat *st)
+{
+	v->ino = st->st_ino;
+	v->mode = st->st_mode;
+	v->size = st->st_size;
+	v->mtime = st->st_mtime;
+	v->mtime_nsec = st_mtim_nsec(st);
+}
+
+
+static vnode_t *vcache_new(vnode_t *parent, const char *name, size_t len, struct stat *st)
+{
+	vnode_t *v;
+	unsigned int h;
+
+	if ((v = calloc(1, sizeof(*v) + len + 1)) == NULL)
+		return NULL;
+
+	memcpy(v->name, name, len);
+	v->parent = parent;
+	v->wd = -1;
+	vcache_setattr(v, st);
+
+	if (parent != NULL) {
+		h = vcache_hash(parent, name, len);
+		v->next = vcache_common.buckets[h];
+		vcache_common.buckets[h] = v;
+	}
+	vcache_common.count++;
+
+	return v;
+}
+
+
+static vnode_t *vcache_find(vnode_t *dir, const char *name, size_t len)
+{
+	vnode_t *v;
+
+	for (v = vcache_common.buckets[vcache_hash(dir, name, len)]; v != NULL; v = v->next) {
+		if ((v->parent == dir) && (strncmp(v->name, name, len) == 0) && (v->name[len] == '\0'))
+			return v;
+	}
+
+	return NULL;
+}
+
+
+/* Function builds host path of vnode, returns its length or -1 if it's too long */
+static int vcache_path(vnode_t *v, char *buff, size_t size)
+{
+	int len;
+
+	if (v->parent == NULL)
+		len = snprintf(buff, size, "%s", vcache_common.root);
+	else if ((len = vcache_path(v->parent, buff, size)) >= 0)
+		len += snprintf(buff + len, size - len, "/%s", v->name);
+
+	return ((len < 0) || ((size_t)len >= size)) ? -1 : len;
+}
+
+
+static void vcache_watch(vnode_t *dir, const char *path)
+{
+#ifdef __linux__
+	unsigned int h;
+
+	if ((vcache_common.ifd < 0) || ((dir->wd = inotify_add_watch(vcache_common.ifd, path, VCACHE_EVENTS)) < 0))
+		return;
+
+	h = dir->wd & (VCACHE_BUCKETS - 1);
+	dir->wnext = vcache_common.watches[h];
+	vcache_common.watches[h] = dir;
+#endif
+}
+
+
+static void vcache_unwatch(vnode_t *dir)
+{
+#ifdef __linux__
+	vnode_t **pv;
+
+	if (dir->wd < 0)
+		return;
+
+	for (pv = &vcache_common.watches[dir->wd & (VCACHE_BUCKETS - 1)]; *pv != NULL; pv = &(*pv)->wnext) {
+		if (*pv == dir) {
+			*pv = dir->wnext;
+			break;
+		}
+	}
+
+	inotify_rm_watch(vcache_common.ifd, dir->wd);
+	dir->wd = -1;
+#endif
+}
+
+
+static void vcache_unhash(vnode_t *v)
+{
+	vnode_t **pv;
+
+	for (pv = &vcache_common.buckets[vcache_hash(v->parent, v->name, strlen(v->name))]; *pv != NULL; pv = &(*pv)->next) {
+		if (*pv == v) {
+			*pv = v->next;
+			break;
+		}
+	}
+}
+
+
+/* Function forgets directory entries (recursively), they are read again on next access */
+static void vcache_unload(vnode_t *dir)
+{
+	unsigned int k;
+
+	for (k = 0; k < dir->nents; k++) {
+		if (dir->ents[k]->loaded)
+			vcache_unload(dir->ents[k]);
+		vcache_unhash(dir->ents[k]);
+		free(dir->ents[k]);
+		vcache_common.count--;
+	}
+
+	free(dir->ents);
+	dir->ents = NULL;
+	dir->nents = 0;
+	dir->loaded = 0;
+	vcache_unwatch(dir);
+}
+
+
+static int vcache_load(vnode_t *dir)
+{
+	char path[PATH_MAX];
+	unsigned int sz = 0;
+	struct dirent *de;
+	struct stat st;
+	vnode_t **ents, *v;
+	size_t len;
+	DIR *d;
+
+	if (vcache_path(dir, path, sizeof(path)) < 0)
+		return -1;
+
+	/* Changes made while reading are reported by watch added before */
+	vcache_watch(dir, path);
+
+	if ((d = opendir(path)) == NULL) {
+		vcache_unwatch(dir);
+		return -1;
+	}
+
+	while ((de = readdir(d)) != NULL) {
+		if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+			continue;
+
+		/* Symbolic links are described by their targets, dangling ones are skipped */
+		if (fstatat(dirfd(d), de->d_name, &st, 0) < 0)
+			continue;
+
+		if (dir->nents == sz) {
+			sz = (sz == 0) ? 16 : 2 * sz;
+			if ((ents = realloc(dir->ents, sz * sizeof(*ents))) == NULL)
+				break;
+			dir->ents = ents;
+		}
+
+		len = strlen(de->d_name);
+		if ((v = vcache_new(dir, de->d_name, len, &st)) == NULL)
+			break;
+		dir->ents[dir->nents++] = v;
+	}
+
+	closedir(d);
+
+	dir->loaded = 1;
+	vcache_common.loads++;
+
+	return 0;
+}
+
+
+/* Function updates attributes of vnode from host file */
+static int vcache_refresh(vnode_t *v)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if ((vcache_path(v, path, sizeof(path)) < 0) || (stat(path, &st) < 0))
+		return -1;
+
+	if (v->loaded && (!S_ISDIR(st.st_mode) || (v->mtime != st.st_mtime) || (v->mtime_nsec != st_mtim_nsec(&st))))
+		vcache_unload(v);
+	vcache_setattr(v, &st);
+
+	return 0;
+}
+
+
+/* Function applies pending change notifications */
+static void vcache_sync(void)
+{
+#ifdef __linux__
+	char buff[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	vnode_t *dir, *v;
+	ssize_t len, k;
+
+	if (vcache_common.ifd < 0)
+		return;
+
+	while ((len = read(vcache_common.ifd, buff, sizeof(buff))) > 0) {
+		for (k = 0; k < len; k += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)(buff + k);
+
+			/* Lost events, nothing can be trusted */
+			if (ev->mask & IN_Q_OVERFLOW) {
+				vcache_unload(vcache_common.rootnode);
+				continue;
+			}
+
+			for (dir = vcache_common.watches[ev->wd & (VCACHE_BUCKETS - 1)]; (dir != NULL) && (dir->wd != ev->wd); dir = dir->wnext)
+				;
+			if (dir == NULL)
+				continue;
+
+			if (ev->len == 0) {
+				if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+					vcache_unload((dir->parent != NULL) ? dir->parent : dir);
+				continue;
+			}
+
+			/* Entry changed, its vnode is updated in place */
+			if (!(ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+				if (((v = vcache_find(dir, ev->name, strlen(ev->name))) == NULL) || (vcache_refresh(v) == 0))
+					continue;
+			}
+
+			/* Entries were added or removed */
+			vcache_unload(dir);
+		}
+	}
+#endif
+}
+
+
+static int vcache_init(const char *root)
+{
+	struct stat st;
+
+	if ((vcache_common.root != NULL) && (strcmp(vcache_common.root, root) == 0))
+		return 0;
+
+	if (vcache_common.rootnode != NULL) {
+		vcache_unload(vcache_common.rootnode);
+		free(vcache_common.rootnode);
+		vcache_common.rootnode = NULL;
+		vcache_common.count = 0;
+	}
+	free(vcache_common.root);
+	vcache_common.root = NULL;
+
+#ifdef __linux__
+	if (vcache_common.ifd < 0)
+		vcache_common.ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+	if ((stat(root, &st) < 0) || !S_ISDIR(st.st_mode))
+		return -1;
+
+	if ((vcache_common.root = strdup(root)) == NULL)
+		return -1;
+
+	if ((vcache_common.rootnode = vcache_new(NULL, "", 0, &st)) == NULL) {
+		free(vcache_common.root);
+		vcache_common.root = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+vnode_t *vcache_lookup(const char *root, const char *path)
+{
+	unsigned long long loads = vcache_common.loads;
+	const char *p, *e;
+	vnode_t *v;
+	size_t len;
+
+	if (vcache_init(root) < 0)
+		return NULL;
+
+	vcache_sync();
+
+	if (vcache_common.count > VCACHE_MAXNODES)
+		vcache_unload(vcache_common.rootnode);
+
+	for (v = vcache_common.rootnode, p = path; v != NULL; p = e) {
+		while (*p == '/')
+			p++;
+		if (*p == '\0')
+			break;
+
+		for (e = p; (*e != '\0') && (*e != '/'); e++)
+			;
+		len = e - p;
+
+		if ((len == 1) && (p[0] == '.'))
+			continue;
+
+		/* Path can't leave sysdir */
+		if ((len == 2) && (p[0] == '.') && (p[1] == '.')) {
+			if (v->parent != NULL)
+				v = v->parent;
+			continue;
+		}
+
+		if (!S_ISDIR(v->mode))
+			return NULL;
+
+		/* Without notifications stat is needed to find out whether directory changed */
+		if ((vcache_common.ifd < 0) && v->loaded && (vcache_refresh(v) < 0))
+			return NULL;
+
+		if (!v->loaded && (vcache_load(v) < 0))
+			return NULL;
+
+		v = vcache_find(v, p, len);
+	}
+
+	if (vcache_common.loads == loads)
+		vcache_common.hits++;
+	else
+		vcache_common.misses++;
+
+	/* Attributes of files aren't reported without notifications */
+	if ((v != NULL) && (vcache_common.ifd < 0) && (vcache_refresh(v) < 0))
+		return NULL;
+
+	return v;
+}
+
+
+vnode_t *vcache_entry(vnode_t *dir, unsigned int idx)
+{
+	if (!S_ISDIR(dir->mode))
+		return NULL;
+
+	if (!dir->loaded && (vcache_load(dir) < 0))
+		return NULL;
+
+	return (idx < dir->nents) ? dir->ents[idx] : NULL;
+}
+
+
+void vcache_stats(unsigned long long *hits, unsigned long long *misses)
+{
+	*hits = vcache_common.hits;
+	*misses = vcache_common.misses;
+}
@@ -0,0 +1,58 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix server
+ *
+ * Cache of sysdir tree metadata (answers lookups and directory listings)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _VCACHE_H_
+#define _VCACHE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+/* Number of hash table buckets (must be a power of 2) */
+#define VCACHE_BUCKETS   4096
+
+/* Maximum number of cached vnodes (whole cache is dropped above it) */
+#define VCACHE_MAXNODES  65536
+
+
+typedef struct _vnode_t {
+	struct _vnode_t *next;    /* hash chain (parent, name) */
+	struct _vnode_t *wnext;   /* watch hash chain (loaded directories) */
+	struct _vnode_t *parent;  /* NULL for root */
+	struct _vnode_t **ents;   /* directory entries, valid if loaded */
+	unsigned int nents;
+	int loaded;
+	int wd;                   /* change notification watch */
+	ino_t ino;
+	mode_t mode;
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	char name[];
+} vnode_t;
+
+
+/* Function returns vnode of path relative to root or NULL if it doesn't exist */
+extern vnode_t *vcache_lookup(const char *root, const char *path);
+
+
+/* Function returns directory entry at index or NULL past the last one */
+extern vnode_t *vcache_entry(vnode_t *dir, unsigned int idx);
+
+
+/* Function returns number of lookups answered from memory and ones which read directories */
+extern void vcache_stats(unsigned long long *hits, unsigned long long *misses);
+
+
+#endif
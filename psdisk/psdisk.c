@@ -13,6 +13,7 @@
 
 #include <endian.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -29,8 +30,7 @@
 
 #endif
 
-/* TODO: change access to ptable.h */
-#include "../../phoenix-rtos-corelibs/libptable/ptable.h"
+#include "ptab.h"
 
 
 #define RESET                       "\033[0m"
@@ -46,6 +46,7 @@
 #define MEMORY_DECLARED(opts)       (opts & (1 << attr_memDeclare))
 #define PARTITIONS_DECLARED(opts)   (opts & (1 << attr_partsDeclare))
 #define PARTITIONS_REMOVE(opts)     (opts & (1 << attr_partsRemove))
+#define SPARSE_IMG(opts)            (opts & (1 << attr_sparseImg))
 
 
 #define CREATE_IMG(opts)            (!FILE_EXIST(opts) && MEMORY_DECLARED(opts) && PARTITIONS_DECLARED(opts) && !PARTITIONS_REMOVE(opts))
@@ -53,7 +54,11 @@
 #define READ_IMG(opts)              (FILE_EXIST(opts) && MEMORY_DECLARED(opts) && !PARTITIONS_DECLARED(opts) && !PARTITIONS_REMOVE(opts))
 
 
-enum { attr_fileExists = 0, attr_memDeclare, attr_partsDeclare, attr_partsRemove };
+/* Number of partition name hash table buckets (must be a power of 2) */
+#define PART_BUCKETS                64
+
+
+enum { attr_fileExists = 0, attr_memDeclare, attr_partsDeclare, attr_partsRemove, attr_sparseImg };
 
 
 enum { part_save = 1, part_remove, part_update };
@@ -62,6 +67,7 @@ enum { part_save = 1, part_remove, part_update };
 struct plist_node_t {
 	ptable_part_t part;
 	uint8_t status;
+	struct plist_node_t *hnext; /* name hash chain, same order as the list */
 	LIST_ENTRY(plist_node_t) ptrs;
 };
 
@@ -71,9 +77,11 @@ struct {
 	uint32_t memsz;
 	uint32_t blksz;
 	uint8_t opts; /* Individual bits define whether specific option is declared by user */
+	uint32_t tblsz; /* size of partition table read from image */
 	char *fileName;
-	FILE *file;
+	int fd;
 	LIST_HEAD(plist_t, plist_node_t) list;
+	struct plist_node_t *index[PART_BUCKETS];
 } psdisk_common;
 
 
@@ -107,6 +115,7 @@ static void psdisk_printHelp(const char *app)
 	printf(HELP_ALIGMENT, "   - m ", "<mem-size,block-size>", "declare memory parameters");
 	printf(HELP_ALIGMENT, "   - p ", "<name,offset,size,type>", "declare partition");
 	printf(HELP_ALIGMENT, "   - r ", "<name>", "remove partition");
+	printf(HELP_ALIGMENT, "   - s ", " ", "extend image to memory size (sparse)");
 	printf(HELP_ALIGMENT, "   - h ", " ", "show help");
 	printf("\n");
 	printf("\nPartition types:\n");
@@ -120,10 +129,13 @@ static void psdisk_printHelp(const char *app)
 static void psdisk_showPartsTable(void)
 {
 	struct plist_node_t *node;
+	struct stat st;
 
-	fseek(psdisk_common.file, 0L, SEEK_END);
+	if (fstat(psdisk_common.fd, &st) < 0) {
+		st.st_size = 0;
+	}
 	printf("\n");
-	printf(BOLDWHITE "Partition table %s: %ld bytes\n"RESET, psdisk_common.fileName, ftell(psdisk_common.file));
+	printf(BOLDWHITE "Partition table %s: %lld bytes\n"RESET, psdisk_common.fileName, (long long)st.st_size);
 	printf("Memory size: %u bytes\n", psdisk_common.memsz);
 	printf("Block size: %u bytes\n", psdisk_common.blksz);
 	printf("\n");
@@ -136,6 +148,63 @@ static void psdisk_showPartsTable(void)
 }
 
 
+/* Partition name index */
+
+static unsigned int psdisk_nameHash(const uint8_t *name)
+{
+	unsigned int h = 2166136261u;
+
+	for (; *name != '\0'; name++) {
+		h = (h ^ *name) * 16777619u;
+	}
+
+	return h & (PART_BUCKETS - 1);
+}
+
+
+static void psdisk_nodeAdd(struct plist_node_t *node)
+{
+	unsigned int h = psdisk_nameHash(node->part.name);
+
+	LIST_INSERT_HEAD(&psdisk_common.list, node, ptrs);
+	node->hnext = psdisk_common.index[h];
+	psdisk_common.index[h] = node;
+	psdisk_common.count++;
+}
+
+
+static void psdisk_nodeRemove(struct plist_node_t *node)
+{
+	struct plist_node_t **pnode;
+
+	for (pnode = &psdisk_common.index[psdisk_nameHash(node->part.name)]; *pnode != NULL; pnode = &(*pnode)->hnext) {
+		if (*pnode == node) {
+			*pnode = node->hnext;
+			break;
+		}
+	}
+
+	LIST_REMOVE(node, ptrs);
+	free(node);
+	psdisk_common.count--;
+}
+
+
+/* Returns the most recently added node with given name and status set */
+static struct plist_node_t *psdisk_nodeFind(const uint8_t *name)
+{
+	struct plist_node_t *node;
+
+	for (node = psdisk_common.index[psdisk_nameHash(name)]; node != NULL; node = node->hnext) {
+		if ((node->status != 0) && (strcmp((const char *)node->part.name, (const char *)name) == 0)) {
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+
 /* Partition table read/write functions */
 
 static ptable_t *psdisk_readImg(void)
@@ -143,11 +212,7 @@ static ptable_t *psdisk_readImg(void)
 	ptable_t *ptable;
 	uint32_t count, size;
 
-	if (fseek(psdisk_common.file, 0, SEEK_SET) != 0) {
-		return NULL;
-	}
-
-	if (fread(&count, sizeof(count), 1, psdisk_common.file) != 1) {
+	if (pread(psdisk_common.fd, &count, sizeof(count), 0) != sizeof(count)) {
 		return NULL;
 	}
 	count = le32toh(count);
@@ -157,19 +222,16 @@ static ptable_t *psdisk_readImg(void)
 		return NULL;
 	}
 
-	if (fseek(psdisk_common.file, 0, SEEK_SET) != 0) {
-		return NULL;
-	}
-
 	ptable = malloc(size);
 	if (ptable == NULL) {
 		return NULL;
 	}
 
-	if (fread(ptable, size, 1, psdisk_common.file) != 1) {
+	if (pread(psdisk_common.fd, ptable, size, 0) != (ssize_t)size) {
 		free(ptable);
 		return NULL;
 	}
+	psdisk_common.tblsz = size;
 
 	if (ptable_deserialize(ptable, psdisk_common.memsz, psdisk_common.blksz) < 0) {
 		free(ptable);
@@ -180,20 +242,44 @@ static ptable_t *psdisk_readImg(void)
 }
 
 
-static int psdisk_writeImg(ptable_t *ptable)
+/* Rewrites only the partition table block, the rest of the image is left untouched */
+static int psdisk_writeImg(const void *ptable, uint32_t size)
 {
-	uint32_t size;
+	void *zero;
+	int ret = 0;
 
-	if (fseek(psdisk_common.file, 0, SEEK_SET) != 0) {
+	if (pwrite(psdisk_common.fd, ptable, size, 0) != (ssize_t)size) {
 		return -1;
 	}
-	size = ptable_size(ptable->count);
 
-	if (ptable_serialize(ptable, psdisk_common.memsz, psdisk_common.blksz) < 0) {
+	/* Clear the tail of a previous, larger table */
+	if (psdisk_common.tblsz > size) {
+		zero = calloc(1, psdisk_common.tblsz - size);
+		if (zero == NULL) {
+			return -1;
+		}
+
+		if (pwrite(psdisk_common.fd, zero, psdisk_common.tblsz - size, size) != (ssize_t)(psdisk_common.tblsz - size)) {
+			ret = -1;
+		}
+		free(zero);
+	}
+
+	return ret;
+}
+
+
+/* Extends image to the memory size leaving a hole, so no padding is written */
+static int psdisk_extendImg(void)
+{
+	struct stat st;
+
+	if (fstat(psdisk_common.fd, &st) < 0) {
 		return -1;
 	}
 
-	if (fwrite(ptable, size, 1, psdisk_common.file) != 1) {
+	if ((st.st_size < psdisk_common.memsz) && (ftruncate(psdisk_common.fd, psdisk_common.memsz) < 0)) {
+		fprintf(stderr, "Cannot extend file %s, err: %s.\n", psdisk_common.fileName, strerror(errno));
 		return -1;
 	}
 
@@ -224,8 +310,7 @@ static int psdisk_readPartsTable(void)
 			break;
 		}
 		node->part = ptable->parts[i];
-		LIST_INSERT_HEAD(&psdisk_common.list, node, ptrs);
-		psdisk_common.count++;
+		psdisk_nodeAdd(node);
 	}
 	free(ptable);
 
@@ -266,8 +351,10 @@ static int psdisk_verifyPartsTable(void)
 static int psdisk_createPartsTable(void)
 {
 	struct plist_node_t *node;
-	ptable_t *ptable;
+	ptable_part_t *parts;
+	void *ptable;
 	uint32_t size;
+	ssize_t len;
 	int ret = 0, i = 0;
 
 	size = ptable_size(psdisk_common.count);
@@ -276,24 +363,28 @@ static int psdisk_createPartsTable(void)
 		return -1;
 	}
 
-	ptable = calloc(1, size);
-	if (ptable == NULL) {
+	ptable = malloc(size);
+	parts = calloc(psdisk_common.count + 1, sizeof(*parts));
+	if ((ptable == NULL) || (parts == NULL)) {
 		fprintf(stderr, "Cannot allocate memory, err: %s.\n", strerror(errno));
+		free(ptable);
+		free(parts);
 		return -1;
 	}
 
 	/* Prepare partition table */
-	ptable->count = psdisk_common.count;
 	LIST_FOREACH(node, &psdisk_common.list, ptrs) {
 		if (node->status == part_save) {
-			ptable->parts[i++] = node->part;
+			parts[i++] = node->part;
 		}
 	}
 
-	if (psdisk_writeImg(ptable) < 0) {
+	len = ptab_build(ptable, size, parts, psdisk_common.count, psdisk_common.memsz, psdisk_common.blksz);
+	if ((len < 0) || (psdisk_writeImg(ptable, len) < 0)) {
 		fprintf(stderr, "Cannot write partition table to file %s.\n", psdisk_common.fileName);
 		ret = -1;
 	}
+	free(parts);
 	free(ptable);
 
 	return ret;
@@ -302,6 +393,10 @@ static int psdisk_createPartsTable(void)
 
 static int psdisk_createImg(void)
 {
+	if (SPARSE_IMG(psdisk_common.opts) && (psdisk_extendImg() < 0)) {
+		return -1;
+	}
+
 	if (psdisk_createPartsTable() < 0) {
 		return -1;
 	}
@@ -318,7 +413,7 @@ static int psdisk_createImg(void)
 
 static int psdisk_updatePartsList(ptable_t *ptable)
 {
-	struct plist_node_t *node, *newNode, *tempNode;
+	struct plist_node_t *node, *newNode;
 	int action;
 	uint32_t i;
 
@@ -326,19 +421,10 @@ static int psdisk_updatePartsList(ptable_t *ptable)
 		/* Default action: partition from file differs from partition defined by the user */
 		action = part_save;
 
-		LIST_FOREACH(node, &psdisk_common.list, ptrs) {
-			if (strcmp((const char *)&node->part.name, (const char *)&ptable->parts[i].name) == 0) {
-				/* Remove partition defined by the user */
-				if (node->status == part_remove) {
-					action = part_remove;
-					break;
-				}
-				/* Update partition from file */
-				else if (node->status == part_save) {
-					action = part_update;
-					break;
-				}
-			}
+		node = psdisk_nodeFind(ptable->parts[i].name);
+		if (node != NULL) {
+			/* Remove partition defined by the user or update partition from file */
+			action = (node->status == part_remove) ? part_remove : part_update;
 		}
 
 		switch (action) {
@@ -350,16 +436,11 @@ static int psdisk_updatePartsList(ptable_t *ptable)
 				}
 				newNode->part = ptable->parts[i];
 				newNode->status = part_save;
-				LIST_INSERT_HEAD(&psdisk_common.list, newNode, ptrs);
-				psdisk_common.count++;
+				psdisk_nodeAdd(newNode);
 				break;
 
 			case part_remove:
-				tempNode = LIST_NEXT(node, ptrs);
-				LIST_REMOVE(node, ptrs);
-				free(node);
-				node = tempNode;
-				psdisk_common.count--;
+				psdisk_nodeRemove(node);
 				break;
 
 			case part_update:
@@ -429,8 +510,7 @@ static int psdisk_parseToRm(const char *arg)
 
 	strcpy((char *)node->part.name, arg);
 	node->status = part_remove;
-	LIST_INSERT_HEAD(&psdisk_common.list, node, ptrs);
-	psdisk_common.count++;
+	psdisk_nodeAdd(node);
 
 	return 0;
 }
@@ -439,9 +519,6 @@ static int psdisk_parseToRm(const char *arg)
 static int psdisk_parseToSave(const char *arg)
 {
 	struct plist_node_t *node;
-	const char *nptr;
-	char *endptr;
-	size_t len;
 
 	node = calloc(1, sizeof(*node));
 	if (node == NULL) {
@@ -449,51 +526,13 @@ static int psdisk_parseToSave(const char *arg)
 		return -1;
 	}
 
-	/* Parse partition name */
-	for (len = 0; len < sizeof(node->part.name); len++) {
-		if ((arg[len] == ',') || (arg[len] == '\0')) {
-			break;
-		}
-	}
-
-	if ((len == 0) || (len >= sizeof(node->part.name)) || (arg[len] != ',')) {
-		fprintf(stderr, "Invalid partition name - %s.\n", arg);
-		free(node);
-		return -1;
-	}
-	strncpy((char *)node->part.name, arg, len);
-	node->part.name[len] = '\0';
-
-	/* Parse partition offset */
-	nptr = arg + len + 1;
-	node->part.offset = strtoul(nptr, &endptr, 0);
-	if ((endptr == nptr) || (*endptr != ',')) {
-		fprintf(stderr, "Invalid partition offset - %s.\n", arg);
-		free(node);
-		return -1;
-	}
-
-	/* Parse partition size */
-	nptr = endptr + 1;
-	node->part.size = strtoul(nptr, &endptr, 0);
-	if ((endptr == nptr) || (*endptr != ',')) {
-		fprintf(stderr, "Invalid partition size - %s.\n", arg);
-		free(node);
-		return -1;
-	}
-
-	/* Parse partition type */
-	nptr = endptr + 1;
-	node->part.type = strtoul(nptr, &endptr, 0);
-	if ((endptr == nptr) || (*endptr != '\0')) {
-		fprintf(stderr, "Invalid partition type - %s.\n", arg);
+	if (ptab_parsePart(arg, &node->part) < 0) {
 		free(node);
 		return -1;
 	}
 
 	node->status = part_save;
-	LIST_INSERT_HEAD(&psdisk_common.list, node, ptrs);
-	psdisk_common.count++;
+	psdisk_nodeAdd(node);
 
 	return 0;
 }
@@ -529,8 +568,8 @@ static int psdisk_openImg(void)
 		psdisk_common.opts |= 1 << attr_fileExists;
 	}
 
-	psdisk_common.file = fopen(psdisk_common.fileName, FILE_EXIST(psdisk_common.opts) ? "r+b" : "w+b");
-	if (psdisk_common.file == NULL) {
+	psdisk_common.fd = open(psdisk_common.fileName, FILE_EXIST(psdisk_common.opts) ? O_RDWR : (O_RDWR | O_CREAT | O_TRUNC), 0666);
+	if (psdisk_common.fd < 0) {
 		fprintf(stderr, "Cannot open file - %s, err: %s.\n", psdisk_common.fileName, strerror(errno));
 		return -1;
 	}
@@ -549,8 +588,9 @@ static void psdisk_destroy(void)
 		free(node);
 	}
 
-	if (psdisk_common.file != NULL) {
-		fclose(psdisk_common.file);
+	if (psdisk_common.fd >= 0) {
+		close(psdisk_common.fd);
+		psdisk_common.fd = -1;
 	}
 }
 
@@ -608,6 +648,7 @@ int main(int argc, char *argv[])
 
 	psdisk_common.count = 0;
 	psdisk_common.opts = 0;
+	psdisk_common.fd = -1;
 	LIST_INIT(&psdisk_common.list);
 
 	if (argc < 2) {
@@ -629,7 +670,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	while ((opt = getopt(argc, argv, "r:m:p:h")) != -1) {
+	while ((opt = getopt(argc, argv, "r:m:p:sh")) != -1) {
 		switch (opt) {
 			case 'm':
 				if (!MEMORY_DECLARED(psdisk_common.opts)) {
@@ -661,6 +702,10 @@ int main(int argc, char *argv[])
 				psdisk_common.opts |= 1 << attr_partsRemove;
 				break;
 
+			case 's':
+				psdisk_common.opts |= 1 << attr_sparseImg;
+				break;
+
 			case 'h':
 				psdisk_printHelp(argv[0]);
 				psdisk_destroy();
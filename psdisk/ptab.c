@@ -0,0 +1,93 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix Systems Disk Tool
+ *
+ * Partition table builder
+ *
+ * Copyright 2020, 2023, 2026 Phoenix Systems
+ * Author: Hubert Buczynski, Lukasz Kosinski
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ptab.h"
+
+
+int ptab_parsePart(const char *arg, ptable_part_t *part)
+{
+	const char *nptr;
+	char *endptr;
+	size_t len;
+
+	memset(part, 0, sizeof(*part));
+
+	/* Parse partition name */
+	for (len = 0; len < sizeof(part->name); len++) {
+		if ((arg[len] == ',') || (arg[len] == '\0')) {
+			break;
+		}
+	}
+
+	if ((len == 0) || (len >= sizeof(part->name)) || (arg[len] != ',')) {
+		fprintf(stderr, "Invalid partition name - %s.\n", arg);
+		return -1;
+	}
+	strncpy((char *)part->name, arg, len);
+	part->name[len] = '\0';
+
+	/* Parse partition offset */
+	nptr = arg + len + 1;
+	part->offset = strtoul(nptr, &endptr, 0);
+	if ((endptr == nptr) || (*endptr != ',')) {
+		fprintf(stderr, "Invalid partition offset - %s.\n", arg);
+		return -1;
+	}
+
+	/* Parse partition size */
+	nptr = endptr + 1;
+	part->size = strtoul(nptr, &endptr, 0);
+	if ((endptr == nptr) || (*endptr != ',')) {
+		fprintf(stderr, "Invalid partition size - %s.\n", arg);
+		return -1;
+	}
+
+	/* Parse partition type */
+	nptr = endptr + 1;
+	part->type = strtoul(nptr, &endptr, 0);
+	if ((endptr == nptr) || (*endptr != '\0')) {
+		fprintf(stderr, "Invalid partition type - %s.\n", arg);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+ssize_t ptab_build(void *dst, size_t dstsz, const ptable_part_t *parts, uint32_t count, uint32_t memsz, uint32_t blksz)
+{
+	ptable_t *ptable = dst;
+	uint32_t size;
+
+	size = ptable_size(count);
+	if ((size > blksz) || (size > dstsz)) {
+		return -1;
+	}
+
+	/* Table is prepared in place */
+	memset(ptable, 0, size);
+	ptable->count = count;
+	memcpy(ptable->parts, parts, count * sizeof(ptable_part_t));
+
+	if (ptable_serialize(ptable, memsz, blksz) < 0) {
+		return -1;
+	}
+
+	return size;
+}
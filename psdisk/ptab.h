@@ -0,0 +1,34 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Phoenix Systems Disk Tool
+ *
+ * Partition table builder
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _PTAB_H_
+#define _PTAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* TODO: change access to ptable.h */
+#include "../../phoenix-rtos-corelibs/libptable/ptable.h"
+
+
+/* Parses partition declaration <name,offset,size,type> */
+extern int ptab_parsePart(const char *arg, ptable_part_t *part);
+
+
+/* Serializes partition table into dst (e.g. mapped image), returns table size, fails if it exceeds block size */
+extern ssize_t ptab_build(void *dst, size_t dstsz, const ptable_part_t *parts, uint32_t count, uint32_t memsz, uint32_t blksz);
+
+
+#endif
@@ -28,26 +28,16 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <limits.h>
+#include <wchar.h>
+#include <pthread.h>
 
 #include <hostutils-common/hid.h>
 #include <hostutils-common/script.h>
+#include <hostutils-common/stream.h>
+#include <hostutils-common/sdp.h>
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
-/* SDP protocol section */
-#define SET_CMD_TYPE(b, v) (b)[0] = (b)[1] = (v)
-#define _SET_UINT32(b, v, offs) \
-	do { \
-		(b)[offs + 0] = (v) >> 24; \
-		(b)[offs + 1] = (v) >> 16; \
-		(b)[offs + 2] = (v) >> 8; \
-		(b)[offs + 3] = (v)&0xFF; \
-	} while (0)
-#define SET_ADDR(b, v)   _SET_UINT32(b, v, 2)
-#define SET_COUNT(b, v)  _SET_UINT32(b, v, 7)
-#define SET_DATA(b, v)   _SET_UINT32(b, v, 11)
-#define SET_FORMAT(b, v) (b)[6] = (v);
-
 /* MCUBoot protocol */
 #define FRAME_CMD_OUT 1
 #define FRAME_DATA 2
@@ -57,88 +47,87 @@
 #define MCU_GET_PROPERTY_RESPONSE 0xa7
 #define MCU_MAX_PAYLOAD 1016
 
-#define CMD_SIZE 17
-#define BUF_SIZE 1025
-#define INTERRUPT_SIZE 65
 
-static int usbWaitTime = 10;
+/* Progress messages are suppressed when boards are flashed concurrently */
+#define PSU_INFO(...) \
+	do { \
+		if (!psu_common.quiet) \
+			fprintf(stderr, __VA_ARGS__); \
+	} while (0)
 
+#define PSU_MAXBOARDS 64
 
-void usage(const char *progname)
-{
-	printf(
-		"Usage: %s [OPTIONS] script_path\n"
-		"\t-t   set timeout for wait command (10 second default)\n"
-		"\t-h   display help\n",
-		progname);
-}
 
-
-static inline void set_write_file_cmd(unsigned char *b, uint32_t addr, uint8_t format, uint32_t size)
-{
-	SET_CMD_TYPE(b, 0x04);
-	SET_ADDR(b, addr);
-	SET_COUNT(b, size);
-	SET_FORMAT(b, format);
-}
+/* Blob registered by compilation, prepared by prefetch thread and shared (read-only) by all boards */
+typedef struct _psu_blob_t {
+	struct _psu_blob_t *next;
+	int type;
+	script_blob_t str;  /* file name or byte string in script */
+	script_blob_t data;
+	int fd;             /* file opened by compilation, -1 once mapped */
+	size_t size;
+	int ready;
+	const char *errstr; /* preparation failed */
+} psu_blob_t;
 
 
-static inline void set_dcd_write_cmd(unsigned char *b, uint32_t addr, uint32_t size)
-{
-	SET_CMD_TYPE(b, 0x0a);
-	SET_ADDR(b, addr);
-	SET_COUNT(b, size);
-}
+typedef struct {
+	sdp_t sdp;          /* device opened by the last WAIT */
+	unsigned int id;
+	char *path;         /* device path of the last WAIT */
+	char *name;         /* device path found by discovery */
+	char loc[64];       /* USB port, identifies board after re-enumeration ("" - unknown) */
+	wchar_t *serial;    /* serial number, used if port is unknown */
+	int discovered;     /* the first WAIT opens device found by discovery */
+	int running;
+	int res;
+	int line;
+	const char *errstr;
+	pthread_t tid;
+	script_t script;
+} psu_board_t;
 
 
-static inline void set_jmp_cmd(unsigned char *b, uint32_t addr)
-{
-	SET_CMD_TYPE(b, 0x0b);
-	SET_ADDR(b, addr);
-	SET_FORMAT(b, 0x20);
-}
+static struct {
+	int quiet;
+	int multi;          /* device is chosen per board, not by the first VID:PID match */
+	long int vid, pid;  /* the first WAIT of the script */
+	pthread_mutex_t lock; /* device enumeration, claimed devices and blobs */
+	pthread_cond_t prepared;
+	psu_board_t *boards;
+	unsigned int nboards;
+	psu_blob_t *blobs;    /* in order of use, list doesn't change after compilation */
+	pthread_t prefetch;
+	int prefetching;
+} psu_common = { .vid = -1, .pid = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .prepared = PTHREAD_COND_INITIALIZER };
 
 
-static inline void set_status_cmd(unsigned char *b)
-{
-	SET_CMD_TYPE(b, 0x05);
-}
+static int usbWaitTime = 10;
 
 
-static inline void set_write_reg_cmd(unsigned char *b, uint32_t addr, uint8_t format, uint32_t data)
+void usage(const char *progname)
 {
-	SET_CMD_TYPE(b, 0x02);
-	SET_ADDR(b, addr);
-	SET_FORMAT(b, format);
-	SET_COUNT(b, format / 8);
-	SET_DATA(b, data);
+	printf(
+		"Usage: %s [OPTIONS] script_path\n"
+		"\t-t   set timeout for wait command (10 second default)\n"
+		"\t-a   run script against all devices matched by the first WAIT concurrently\n"
+		"\t-d   run script against device given by path or serial number (can be repeated)\n"
+		"\t-h   display help\n",
+		progname);
 }
 
 
-static int sdp_writeRegister(hid_device *dev, uint32_t addr, uint8_t format, uint32_t data)
+static int psu_writeRegister(sdp_t *sdp, uint32_t addr, uint8_t format, uint32_t data)
 {
-	int rc;
-	unsigned char b[BUF_SIZE] = { 0 };
-	const uint32_t pattern = 0x128a8a12;
+	uint32_t status;
 
-	fprintf(stderr, " - Writing value: %#x, to the address: %#x\n", data, addr);
-	/* Send write command */
-	b[0] = 1;
-	set_write_reg_cmd(b + 1, addr, format, data);
+	PSU_INFO(" - Writing value: %#x, to the address: %#x\n", data, addr);
 
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_register command (rc=%d)\n", rc);
+	if (sdp_writeRegister(sdp, addr, format, data, &status) < 0)
 		return SCRIPT_ERROR;
-	}
-
-	/* Receive report 3 */
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 5) {
-		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
-		return SCRIPT_ERROR;
-	}
 
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 0 || memcmp(b + 1, &pattern, 4)) {
-		fprintf(stderr, "Failed to receive complete status (rc=%d, status=%02x%02x%02x%02x)\n", rc, b[1], b[2], b[3], b[4]);
+	if (status != SDP_REG_DONE) {
+		fprintf(stderr, "Failed to receive complete status (status=%08x)\n", status);
 		return SCRIPT_ERROR;
 	}
 
@@ -146,113 +135,30 @@ static int sdp_writeRegister(hid_device *dev, uint32_t addr, uint8_t format, uin
 }
 
 
-static int sdp_writeFile(hid_device *dev, uint32_t addr, uint8_t format, void *data, size_t size)
+static int psu_writeFile(sdp_t *sdp, uint32_t addr, uint8_t format, void *data, size_t size)
 {
-	int rc;
-	size_t n;
-	ssize_t offset = 0;
-	unsigned char b[BUF_SIZE] = { 0 };
-	const uint32_t pattern = 0x88888888;
-
-	/* Send write command */
-	b[0] = 1;
-	set_write_file_cmd(b + 1, addr, format, size);
-
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send write_file command (%d)\n", rc);
+	if (sdp_writeFile(sdp, addr, format, data, size, SDP_F_STATUS | (psu_common.quiet ? 0 : SDP_F_PROGRESS)) < 0)
 		return SCRIPT_ERROR;
-	}
-
-	/* Send contents */
-	b[0] = 2;
-	while (offset < size) {
-		n = (BUF_SIZE - 1 > size - offset) ? (size - offset) : (BUF_SIZE - 1);
-		memcpy(b + 1, data + offset, n);
-		offset += n;
 
-		/* print progress */
-		fprintf(stderr, "\r - Sent (%lu/%lu) %3.0f%% ", offset, size, ((float)offset / (float)size) * 100.0f);
-
-		/* Report 2 size has to be aligned to 16, information define in HID Report Descriptor - ID 2 */
-		if (n % 0x10) {
-			memset(b + 1 + n, 0, ((n + 0xf) & ~0xf) - n);
-			n = (n + 0xf) & ~0xf;
-		}
-
-		if ((rc = hid_write(dev, b, n + 1)) < 0) {
-			fprintf(stderr, "\nFailed to send image contents (rc=%d)\n", rc);
-			return SCRIPT_ERROR;
-		}
-	}
-	fprintf(stderr, "\n");
-
-	/* Receive report 3 */
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 5) {
-		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
-		return SCRIPT_ERROR;
-	}
-
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 0 || memcmp(b + 1, &pattern, 4)) {
-		fprintf(stderr, "Failed to receive complete status (rc=%d, status=%02x%02x%02x%02x)\n", rc, b[1], b[2], b[3], b[4]);
-		return SCRIPT_ERROR;
-	}
-
-	fprintf(stderr, " - File has been written correctly.\n");
+	PSU_INFO(" - File has been written correctly.\n");
 
 	return SCRIPT_OK;
 }
 
 
-static int sdp_jmpAddr(hid_device *dev, uint32_t addr)
+static int psu_jmpAddr(sdp_t *sdp, uint32_t addr)
 {
-	int rc;
-	unsigned char b[BUF_SIZE] = { 0 };
+	PSU_INFO(" - To the address: %#x\n", addr);
 
-	fprintf(stderr, " - To the address: %#x\n", addr);
-
-	/* Send write command */
-	b[0] = 1;
-	set_jmp_cmd(b + 1, addr);
-
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send jump_address command (rc=%d)\n", rc);
-		return rc;
-	}
-
-	/* Receive report 3 */
-	if ((rc = hid_read(dev, b, BUF_SIZE)) < 5) {
-		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
-		return -1;
-	}
-
-	return SCRIPT_OK;
+	return (sdp_jump(sdp, addr) < 0) ? SCRIPT_ERROR : SCRIPT_OK;
 }
 
 
-static int sdp_errStatus(hid_device *dev)
+static int psu_errStatus(sdp_t *sdp)
 {
-	unsigned char b[INTERRUPT_SIZE] = { 0 };
-	int rc;
-
-	b[0] = 1;
-	set_status_cmd(b + 1);
-
-	if ((rc = hid_write(dev, b, CMD_SIZE)) < 0) {
-		fprintf(stderr, "Failed to send status command (rc=%d)\n", rc);
-		return rc;
-	}
+	uint32_t status;
 
-	if ((rc = hid_read(dev, b, INTERRUPT_SIZE)) < 5) {
-		fprintf(stderr, "Failed to receive HAB mode (rc=%d)\n", rc);
-		return rc;
-	}
-
-	if ((rc = hid_read(dev, b, INTERRUPT_SIZE)) < 0) {
-		fprintf(stderr, "Failed to receive status (rc=%d)\n", rc);
-		return rc;
-	}
-
-	return SCRIPT_OK;
+	return (sdp_status(sdp, &status) < 0) ? SCRIPT_ERROR : SCRIPT_OK;
 }
 
 
@@ -293,7 +199,7 @@ static unsigned int paramByteSwap(unsigned int param)
 }
 
 
-static int mcuboot_getProperty(hid_device *dev, int which)
+static int mcuboot_getProperty(sdp_t *sdp, int which)
 {
 	unsigned char b[sizeof(mcuboot_frame_t) + sizeof(mcuboot_cmd_t) + 2 * 4] = { 0 };
 	mcuboot_frame_t *frame = (mcuboot_frame_t *)b;
@@ -308,12 +214,12 @@ static int mcuboot_getProperty(hid_device *dev, int which)
 	cmd->params[0] = paramByteSwap(which);
 	cmd->params[1] = 0;
 
-	if ((rc = hid_write(dev, b, sizeof(b))) < 0) {
+	if ((rc = sdp_write(sdp, b, sizeof(b))) < 0) {
 		fprintf(stderr, "Failed to send get_property command (rc=%d)\n", rc);
 		return rc;
 	}
 
-	if ((rc = hid_read(dev, b, sizeof(b))) < 0) {
+	if ((rc = sdp_read(sdp, b, sizeof(b))) < 0) {
 		fprintf(stderr, "Failed to receive GetProperty Response (rc=%d)\n", rc);
 		return rc;
 	}
@@ -323,41 +229,33 @@ static int mcuboot_getProperty(hid_device *dev, int which)
 		return -1;
 	}
 
-	fprintf(stderr, "Status: %d, Property: 0x%08x\n", paramByteSwap(cmd->params[0]), paramByteSwap(cmd->params[1]));
+	PSU_INFO("Status: %d, Property: 0x%08x\n", paramByteSwap(cmd->params[0]), paramByteSwap(cmd->params[1]));
 
 	return SCRIPT_OK;
 }
 
 
-static int mcuboot_loadImage(hid_device *dev, void *data, size_t size)
+static void mcuboot_dataHeader(unsigned char *report, size_t len)
 {
-	unsigned char b[sizeof(mcuboot_frame_t) + MCU_MAX_PAYLOAD] = { 0 };
-	mcuboot_frame_t *frame = (mcuboot_frame_t *)b;
-	int rc;
-	size_t offset = 0, chunk;
+	mcuboot_frame_t *frame = (mcuboot_frame_t *)report;
 
-	while (offset < size) {
-		chunk = size - offset;
-		if (chunk > MCU_MAX_PAYLOAD)
-			chunk = MCU_MAX_PAYLOAD;
-
-		frame->reportID = FRAME_DATA;
-		frame->size = size2LE(chunk);
+	frame->reportID = FRAME_DATA;
+	frame->padding = 0;
+	frame->size = size2LE(len);
+}
 
-		memcpy(frame->payload, (char *)data + offset, chunk);
 
-		if ((rc = hid_write(dev, b, sizeof(mcuboot_frame_t) + chunk)) < 0) {
-			fprintf(stderr, "Failed to send data (rc=%d)\n", rc);
-			return rc;
-		}
-
-		offset += chunk;
+static int mcuboot_loadImage(sdp_t *sdp, void *data, size_t size)
+{
+	const stream_fmt_t fmt = { .hdrsz = sizeof(mcuboot_frame_t), .payload = MCU_MAX_PAYLOAD, .align = 1, .header = mcuboot_dataHeader };
+	int rc;
 
-		/* print progress */
-		fprintf(stderr, "\r - Sent (%lu/%lu) %3.0f%% ", offset, size, ((float)offset / (float)size) * 100.0f);
+	if ((rc = sdp_stream(sdp, &fmt, data, size, !psu_common.quiet)) < 0) {
+		fprintf(stderr, "\nFailed to send data (rc=%d)\n", rc);
+		return rc;
 	}
 
-	fprintf(stderr, " - File has been written correctly.\n");
+	PSU_INFO(" - File has been written correctly.\n");
 
 	return SCRIPT_OK;
 }
@@ -379,50 +277,58 @@ static inline int8_t char_to_hex(char c)
 }
 
 
+/* Function decodes byte string, it's only validated if blob is NULL */
 static int parse_byte_string(script_blob_t str, script_blob_t *blob)
 {
 	void *ptr;
+	char *out = NULL, c;
 	int8_t bh, bl;
 
-	ptr = realloc(blob->ptr, str.end - str.ptr + 1);
-	if (ptr == NULL) {
-		free(blob->ptr);
-		*blob = SCRIPT_BLOB_EMPTY;
+	if (blob != NULL) {
+		ptr = realloc(blob->ptr, str.end - str.ptr + 1);
+		if (ptr == NULL) {
+			free(blob->ptr);
+			*blob = SCRIPT_BLOB_EMPTY;
 
-		fprintf(stderr, "Unable to allocate memory.\n");
+			fprintf(stderr, "Unable to allocate memory.\n");
 
-		return SCRIPT_ERROR;
+			return SCRIPT_ERROR;
+		}
+
+		blob->ptr = out = ptr;
 	}
 
-	blob->ptr = ptr;
+	for (; str.ptr < str.end; str.ptr++) {
+		c = *str.ptr;
 
-	for (blob->end = blob->ptr; str.ptr < str.end; str.ptr++) {
-		if (*str.ptr != '\\') {
-			*blob->end++ = *str.ptr;
-			continue;
-		}
+		if (c == '\\') {
+			str.ptr++;
 
-		str.ptr++;
+			if (*str.ptr == '\\') {
+				c = *str.ptr;
+			}
+			else if ((*str.ptr == 'x' || *str.ptr == 'X') &&
+				((bh = char_to_hex(*(++str.ptr))) != SCRIPT_ERROR) && ((bl = char_to_hex(*(++str.ptr))) != SCRIPT_ERROR)) {
+				c = (bh << 4) | bl;
+			}
+			else {
+				if (blob != NULL) {
+					free(blob->ptr);
+					blob->ptr = NULL;
+				}
 
-		if (*str.ptr == '\\') {
-			*blob->end++ = *str.ptr;
-			continue;
-		}
-		else if (*str.ptr == 'x' || *str.ptr == 'X') {
-			if (((bh = char_to_hex(*(++str.ptr))) != SCRIPT_ERROR) && ((bl = char_to_hex(*(++str.ptr))) != SCRIPT_ERROR)) {
-				*blob->end    = bh << 4;
-				*blob->end++ |= bl;
-				continue;
+				fprintf(stderr, "Malformed byte string passed.\n");
+				return SCRIPT_ERROR;
 			}
 		}
 
-		free(blob->ptr);
-		blob->ptr = NULL;
-
-		fprintf(stderr, "Malformed byte string passed.\n");
-		return SCRIPT_ERROR;
+		if (out != NULL)
+			*out++ = c;
 	}
 
+	if (blob != NULL)
+		blob->end = out;
+
 	return SCRIPT_OK;
 }
 
@@ -442,60 +348,302 @@ static int close_buffer(int type, script_blob_t *blob)
 }
 
 
-static int get_buffer(script_t *s, int type, script_blob_t str, script_blob_t *blob)
+static psu_blob_t *find_buffer(int type, script_blob_t str)
 {
-	int fd;
-	struct stat statbuf;
+	psu_blob_t *b;
 
-	if (type == 'F') {
-		char *name = strndup(str.ptr, str.end - str.ptr);
+	for (b = psu_common.blobs; b != NULL; b = b->next) {
+		if ((b->type == type) && (b->str.end - b->str.ptr == str.end - str.ptr) && (memcmp(b->str.ptr, str.ptr, str.end - str.ptr) == 0))
+			break;
+	}
 
-		if ((fd = open(name, O_RDONLY)) < 0)
-			s->errstr = "File not found.";
+	return b;
+}
 
-		free(name);
 
-		if (!s->errstr) {
-			fstat(fd, &statbuf);
-			if ((blob->ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
-				blob->end = blob->ptr + statbuf.st_size;
-			}
-			else {
-				s->errstr = "Unable to mmap file.";
-			}
+/* Function validates blob during compilation and registers it for prefetching */
+static int add_buffer(script_t *s, int type, script_blob_t str)
+{
+	psu_blob_t *b, **last;
+	struct stat statbuf;
+	char *name;
 
-			close(fd);
+	if (find_buffer(type, str) != NULL)
+		return SCRIPT_OK;
+
+	if ((b = calloc(1, sizeof(*b))) == NULL) {
+		s->errstr = "Unable to allocate memory.";
+	}
+	else if (type == 'F') {
+		b->fd = -1;
+		if ((name = strndup(str.ptr, str.end - str.ptr)) != NULL) {
+			b->fd = open(name, O_RDONLY);
+			free(name);
 		}
+
+		if (b->fd < 0)
+			s->errstr = "File not found.";
+		else if ((fstat(b->fd, &statbuf) < 0) || (statbuf.st_size == 0))
+			s->errstr = "Unable to mmap file.";
+		else
+			b->size = statbuf.st_size;
 	}
 	else if (type == 'S') {
-		if (parse_byte_string(str, blob) < 0)
+		b->fd = -1;
+		if (parse_byte_string(str, NULL) < 0)
 			s->errstr = "Error while parsing byte string.";
 	}
 
 	if (s->errstr) {
+		if ((b != NULL) && (b->fd >= 0))
+			close(b->fd);
+		free(b);
 		s->next.str = str;
 		return SCRIPT_ERROR;
 	}
 
-	if (s->flags & SCRIPT_F_DRYRUN) {
-		close_buffer(type, blob);
+	b->type = type;
+	b->str = str;
+	for (last = &psu_common.blobs; *last != NULL; last = &(*last)->next)
+		;
+	*last = b;
+
+	return SCRIPT_OK;
+}
+
+
+/* Function maps file (starting its read-ahead) or decodes byte string */
+static void prepare_buffer(psu_blob_t *b)
+{
+	void *ptr;
+
+	if (b->type == 'F') {
+		if ((ptr = mmap(NULL, b->size, PROT_READ, MAP_PRIVATE, b->fd, 0)) != MAP_FAILED) {
+			madvise(ptr, b->size, MADV_WILLNEED);
+			b->data.ptr = ptr;
+			b->data.end = b->data.ptr + b->size;
+		}
+		else {
+			b->errstr = "Unable to mmap file.";
+		}
+
+		close(b->fd);
+		b->fd = -1;
 	}
-	else {
-		fprintf(stderr, " - Sending to the device: %.*s\n", (int)(str.end - str.ptr), str.ptr);
+	else if (b->type == 'S') {
+		if (parse_byte_string(b->str, &b->data) < 0)
+			b->errstr = "Error while parsing byte string.";
+	}
+}
+
+
+/* Blobs are prepared in order of use while device is awaited */
+static void *prefetch_buffers(void *arg)
+{
+	psu_blob_t *b;
+
+	(void)arg;
+
+	for (b = psu_common.blobs; b != NULL; b = b->next) {
+		prepare_buffer(b);
+
+		pthread_mutex_lock(&psu_common.lock);
+		b->ready = 1;
+		pthread_cond_broadcast(&psu_common.prepared);
+		pthread_mutex_unlock(&psu_common.lock);
+	}
+
+	return NULL;
+}
+
+
+static void prefetch_start(void)
+{
+	if (pthread_create(&psu_common.prefetch, NULL, prefetch_buffers, NULL) == 0)
+		psu_common.prefetching = 1;
+	else
+		prefetch_buffers(NULL);
+}
+
+
+/* Function returns blob shared by all boards, it stays valid until free_buffers() */
+static int get_buffer(script_t *s, int type, script_blob_t str, script_blob_t *blob)
+{
+	psu_blob_t *b;
+
+	if (s->flags & SCRIPT_F_DRYRUN)
+		return add_buffer(s, type, str);
+
+	if ((b = find_buffer(type, str)) == NULL) {
+		s->errstr = "Data wasn't prepared.";
+		s->next.str = str;
+		return SCRIPT_ERROR;
 	}
 
+	pthread_mutex_lock(&psu_common.lock);
+	while (!b->ready)
+		pthread_cond_wait(&psu_common.prepared, &psu_common.lock);
+	pthread_mutex_unlock(&psu_common.lock);
+
+	if (b->errstr) {
+		s->errstr = b->errstr;
+		s->next.str = str;
+		return SCRIPT_ERROR;
+	}
+
+	*blob = b->data;
+	PSU_INFO(" - Sending to the device: %.*s\n", (int)(str.end - str.ptr), str.ptr);
+
 	return SCRIPT_OK;
 }
 
 
+static void free_buffers(void)
+{
+	psu_blob_t *b;
+
+	if (psu_common.prefetching) {
+		pthread_join(psu_common.prefetch, NULL);
+		psu_common.prefetching = 0;
+	}
+
+	while ((b = psu_common.blobs) != NULL) {
+		psu_common.blobs = b->next;
+		if (b->fd >= 0)
+			close(b->fd);
+		if (b->data.ptr != NULL)
+			close_buffer(b->type, &b->data);
+		free(b);
+	}
+}
+
+
+/* Function finds USB port of hidraw device, it doesn't change when board re-enumerates */
+static int board_location(const char *path, char *loc, size_t size)
+{
+#ifdef __linux__
+	char sys[PATH_MAX], real[PATH_MAX], *p;
+	const char *name;
+	int k;
+
+	if (((name = strrchr(path, '/')) == NULL) || (strncmp(name + 1, "hidraw", 6) != 0))
+		return -1;
+
+	/* .../usb1/1-2/1-2:1.0/0003:15A2:0080.0005 */
+	snprintf(sys, sizeof(sys), "/sys/class/hidraw/%s/device", name + 1);
+	if (realpath(sys, real) == NULL)
+		return -1;
+
+	for (k = 0; k < 2; k++) {
+		if ((p = strrchr(real, '/')) == NULL)
+			return -1;
+		*p = '\0';
+	}
+
+	if (((p = strrchr(real, '/')) == NULL) || (strchr(p, ':') != NULL) || (strlen(p + 1) >= size))
+		return -1;
+
+	strcpy(loc, p + 1);
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+
+/* Function checks whether device is used by another board */
+static int board_claimed(psu_board_t *b, const char *path)
+{
+	unsigned int k;
+
+	for (k = 0; k < psu_common.nboards; k++) {
+		if ((&psu_common.boards[k] != b) && sdp_opened(&psu_common.boards[k].sdp) && (strcmp(psu_common.boards[k].path, path) == 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+
+/* Function opens device of board, the one found by discovery or its successor after re-enumeration */
+static int board_open(psu_board_t *b, long int vid, long int pid)
+{
+	struct hid_device_info *list, *it;
+	hid_device *dev = NULL;
+	char loc[sizeof(b->loc)];
+
+	/* The only board may use libusb backend, boards found by discovery are identified by hidapi paths */
+	if (!psu_common.multi)
+		return sdp_open(&b->sdp, vid, pid);
+
+	pthread_mutex_lock(&psu_common.lock);
+
+	if (b->discovered) {
+		if ((dev = hid_open_path(b->path)) != NULL) {
+			b->discovered = 0;
+			sdp_attach(&b->sdp, dev);
+		}
+		pthread_mutex_unlock(&psu_common.lock);
+		return (dev != NULL) ? 0 : -1;
+	}
+
+	list = hid_enumerate(vid, pid);
+	for (it = list; it != NULL; it = it->next) {
+		if (b->loc[0] != '\0') {
+			if ((board_location(it->path, loc, sizeof(loc)) < 0) || (strcmp(loc, b->loc) != 0))
+				continue;
+		}
+		else if ((b->serial != NULL) && (it->serial_number != NULL)) {
+			if (wcscmp(b->serial, it->serial_number) != 0)
+				continue;
+		}
+		else if (board_claimed(b, it->path)) {
+			continue;
+		}
+
+		if ((dev = hid_open_path(it->path)) != NULL) {
+			free(b->path);
+			b->path = strdup(it->path);
+			sdp_attach(&b->sdp, dev);
+			break;
+		}
+	}
+
+	if (list != NULL)
+		hid_free_enumeration(list);
+
+	pthread_mutex_unlock(&psu_common.lock);
+
+	return (dev != NULL) ? 0 : -1;
+}
+
+
+static void board_release(void)
+{
+	psu_board_t *b;
+	unsigned int k;
+
+	for (k = 0; k < psu_common.nboards; k++) {
+		b = &psu_common.boards[k];
+		sdp_close(&b->sdp);
+		free(b->path);
+		free(b->name);
+		free(b->serial);
+		memset(b, 0, sizeof(*b));
+	}
+
+	psu_common.nboards = 0;
+}
+
+
 static int wait_cmd(script_t *s)
 {
 	int retries;
 	long int vid, pid;
-	hid_device **dev = (hid_device **)s->arg;
+	psu_board_t *b = s->arg;
 
-	if (*dev != NULL)
-		hid_close(*dev);
+	sdp_close(&b->sdp);
 
 	if (script_expect(s, script_tok_integer, "VID number was expected") != SCRIPT_OK)
 		return SCRIPT_ERROR;
@@ -507,15 +655,21 @@ static int wait_cmd(script_t *s)
 
 	pid = s->token.num & 0xffff;
 
-	if (s->flags & SCRIPT_F_DRYRUN)
+	if (s->flags & SCRIPT_F_DRYRUN) {
+		/* Boards are discovered by the first WAIT */
+		if (psu_common.vid < 0) {
+			psu_common.vid = vid;
+			psu_common.pid = pid;
+		}
 		return SCRIPT_OK;
+	}
 
 	for (retries = usbWaitTime; ; retries--) {
-		fprintf(stderr, "Waiting (%02d sec) for USB hid device %04x:%04x.\r", retries, (int)vid, (int)pid);
+		PSU_INFO("Waiting (%02d sec) for USB hid device %04x:%04x.\r", retries, (int)vid, (int)pid);
 
 		sleep(1);
 
-		if ((*dev = open_device(vid, pid)) != NULL)
+		if (board_open(b, vid, pid) == 0)
 			break;
 
 		if (retries > 0)
@@ -533,7 +687,7 @@ static int wait_cmd(script_t *s)
 static int write_reg_cmd(script_t *s)
 {
 	long int addr, data, format;
-	hid_device *dev = *(hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (script_expect(s, script_tok_integer, "Address value was expected") != SCRIPT_OK)
 		return SCRIPT_ERROR;
@@ -553,12 +707,12 @@ static int write_reg_cmd(script_t *s)
 	if (s->flags & SCRIPT_F_DRYRUN)
 		return SCRIPT_OK;
 
-	if (!dev) {
+	if (!sdp_opened(sdp)) {
 		s->errstr = "Device not available";
 		return SCRIPT_ERROR;
 	}
 
-	if (sdp_writeRegister(dev, addr, format, data) == SCRIPT_OK)
+	if (psu_writeRegister(sdp, addr, format, data) == SCRIPT_OK)
 		return SCRIPT_OK;
 
 	s->errstr = "Command failed";
@@ -570,7 +724,7 @@ static int write_reg_cmd(script_t *s)
 static int jump_addr_cmd(script_t *s)
 {
 	long int addr;
-	hid_device *dev = *(hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (script_expect(s, script_tok_integer, "Address value was expected") != SCRIPT_OK)
 		return SCRIPT_ERROR;
@@ -580,12 +734,12 @@ static int jump_addr_cmd(script_t *s)
 	if (s->flags & SCRIPT_F_DRYRUN)
 		return SCRIPT_OK;
 
-	if (!dev) {
+	if (!sdp_opened(sdp)) {
 		s->errstr = "Device not available";
 		return SCRIPT_ERROR;
 	}
 
-	if (sdp_jmpAddr(dev, addr) == SCRIPT_OK)
+	if (psu_jmpAddr(sdp, addr) == SCRIPT_OK)
 		return SCRIPT_OK;
 
 	s->errstr = "Command failed";
@@ -596,17 +750,17 @@ static int jump_addr_cmd(script_t *s)
 
 static int err_status_cmd(script_t *s)
 {
-	hid_device *dev = *(hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (s->flags & SCRIPT_F_DRYRUN)
 		return SCRIPT_OK;
 
-	if (!dev) {
+	if (!sdp_opened(sdp)) {
 		s->errstr = "Device not available";
 		return SCRIPT_ERROR;
 	}
 
-	if (sdp_errStatus(dev) == SCRIPT_OK)
+	if (psu_errStatus(sdp) == SCRIPT_OK)
 		return SCRIPT_OK;
 
 	s->errstr = "Command failed";
@@ -621,7 +775,7 @@ static int write_file_cmd(script_t *s)
 	script_blob_t str;
 	script_blob_t blob = SCRIPT_BLOB_EMPTY;
 	long int addr = 0, format = 0, offset = 0, size = 0;
-	hid_device *dev = *( hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (!(s->next.str.end - s->next.str.ptr == 1 && (*s->next.str.ptr == 'F' || *s->next.str.ptr == 'S'))) {
 		s->errstr = "Type F or S expected";
@@ -677,10 +831,8 @@ static int write_file_cmd(script_t *s)
 
 	res = SCRIPT_ERROR;
 
-	if (dev)
-		res = sdp_writeFile(dev, addr, format, blob.ptr + offset, size);
-
-	close_buffer(type, &blob);
+	if (sdp_opened(sdp))
+		res = psu_writeFile(sdp, addr, format, blob.ptr + offset, size);
 
 	if (res == SCRIPT_OK)
 		return SCRIPT_OK;
@@ -704,7 +856,7 @@ static int load_image_cmd(script_t *s)
 	int res;
 	script_blob_t str;
 	script_blob_t blob = SCRIPT_BLOB_EMPTY;
-	hid_device *dev = *( hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (script_expect(s, script_tok_string, "String in quotes was expected") != SCRIPT_OK)
 		return SCRIPT_ERROR;
@@ -719,10 +871,8 @@ static int load_image_cmd(script_t *s)
 
 	res = SCRIPT_ERROR;
 
-	if (dev)
-		res = mcuboot_loadImage(dev, blob.ptr, blob.end - blob.ptr);
-
-	close_buffer('F', &blob);
+	if (sdp_opened(sdp))
+		res = mcuboot_loadImage(sdp, blob.ptr, blob.end - blob.ptr);
 
 	if (res == SCRIPT_OK)
 		return SCRIPT_OK;
@@ -735,17 +885,17 @@ static int load_image_cmd(script_t *s)
 
 static int get_property_cmd(script_t *s)
 {
-	hid_device *dev = *(hid_device **)s->arg;
+	sdp_t *sdp = &((psu_board_t *)s->arg)->sdp;
 
 	if (s->flags & SCRIPT_F_DRYRUN)
 		return SCRIPT_OK;
 
-	if (!dev) {
+	if (!sdp_opened(sdp)) {
 		s->errstr = "Device not available";
 		return SCRIPT_ERROR;
 	}
 
-	if (mcuboot_getProperty(dev, 1) == SCRIPT_OK)
+	if (mcuboot_getProperty(sdp, 1) == SCRIPT_OK)
 		return SCRIPT_OK;
 
 	s->errstr = "Command failed";
@@ -754,6 +904,127 @@ static int get_property_cmd(script_t *s)
 }
 
 
+/* Function finds boards given by selectors (path or serial number), all devices of the first WAIT without them */
+static int board_discover(char **sel, unsigned int nsel)
+{
+	struct hid_device_info *list, *it;
+	wchar_t wsel[128];
+	unsigned int k, prev = 0;
+	psu_board_t *b;
+	int retries;
+
+	for (retries = usbWaitTime; ; retries--) {
+		fprintf(stderr, "Discovering (%02d sec) USB hid devices %04x:%04x.\r", retries, (int)psu_common.vid, (int)psu_common.pid);
+
+		sleep(1);
+
+		board_release();
+
+		list = hid_enumerate(psu_common.vid, psu_common.pid);
+		for (it = list; (it != NULL) && (psu_common.nboards < PSU_MAXBOARDS); it = it->next) {
+			for (k = 0; k < nsel; k++) {
+				if (strcmp(sel[k], it->path) == 0)
+					break;
+				if ((it->serial_number != NULL) && (mbstowcs(wsel, sel[k], sizeof(wsel) / sizeof(wsel[0])) < sizeof(wsel) / sizeof(wsel[0])) && (wcscmp(wsel, it->serial_number) == 0))
+					break;
+			}
+
+			if ((nsel > 0) && (k == nsel))
+				continue;
+
+			b = &psu_common.boards[psu_common.nboards];
+			if (((b->path = strdup(it->path)) == NULL) || ((b->name = strdup(it->path)) == NULL)) {
+				free(b->path);
+				b->path = NULL;
+				break;
+			}
+
+			b->id = psu_common.nboards++;
+			b->discovered = 1;
+			if (board_location(it->path, b->loc, sizeof(b->loc)) < 0)
+				b->loc[0] = '\0';
+			if ((it->serial_number != NULL) && (it->serial_number[0] != L'\0'))
+				b->serial = wcsdup(it->serial_number);
+		}
+
+		if (list != NULL)
+			hid_free_enumeration(list);
+
+		/* Selected devices have to be found, otherwise set of devices has to be stable */
+		if ((nsel > 0) ? (psu_common.nboards >= nsel) : ((psu_common.nboards > 0) && (psu_common.nboards == prev)))
+			break;
+
+		prev = psu_common.nboards;
+
+		if (retries > 0)
+			continue;
+
+		if (psu_common.nboards > 0)
+			break;
+
+		fprintf(stderr, "\nNo USB hid device %04x:%04x found\n", (int)psu_common.vid, (int)psu_common.pid);
+		return -1;
+	}
+
+	fprintf(stderr, "\nFound %u board(s)\n", psu_common.nboards);
+	if ((nsel > 0) && (psu_common.nboards < nsel))
+		fprintf(stderr, "Warning: %u of %u selected devices not found\n", nsel - psu_common.nboards, nsel);
+
+	return psu_common.nboards;
+}
+
+
+static void *board_run(void *arg)
+{
+	psu_board_t *b = arg;
+
+	b->res = script_run(&b->script, 0);
+	b->errstr = b->script.errstr;
+	b->line = b->script.token.line_no;
+
+	return NULL;
+}
+
+
+/* Function runs script against every board on its own thread, returns number of failed boards */
+static int board_runAll(const script_t *script)
+{
+	unsigned int k, failed = 0;
+	psu_board_t *b;
+
+	for (k = 0; k < psu_common.nboards; k++) {
+		b = &psu_common.boards[k];
+		b->script = *script;
+		b->script.arg = b;
+
+		if (pthread_create(&b->tid, NULL, board_run, b) == 0) {
+			b->running = 1;
+		}
+		else {
+			b->res = SCRIPT_ERROR;
+			b->errstr = "Unable to start thread";
+		}
+	}
+
+	for (k = 0; k < psu_common.nboards; k++) {
+		b = &psu_common.boards[k];
+		if (b->running)
+			pthread_join(b->tid, NULL);
+
+		if (b->res == SCRIPT_OK) {
+			printf("Board %u (%s): OK\n", b->id, (b->loc[0] != '\0') ? b->loc : b->name);
+		}
+		else {
+			printf("Board %u (%s): FAILED (%s, line %d)\n", b->id, (b->loc[0] != '\0') ? b->loc : b->name,
+				(b->errstr != NULL) ? b->errstr : "error", b->line);
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+
 /*
  * NOTE: because binary search is used, function names
  * must be sorted in lexical order, use upper-case,
@@ -779,11 +1050,12 @@ int main(int argc, char *argv[])
 	long int tmp;
 	int opt, res = -1;
 	script_t script;
-	hid_device *dev = NULL;
-	char *ptr;
+	psu_board_t board = { 0 };
+	char *ptr, *sel[PSU_MAXBOARDS];
+	unsigned int nsel = 0;
 
 	for (;;) {
-		opt = getopt(argc, argv, "ht:");
+		opt = getopt(argc, argv, "ht:ad:");
 		if (opt == -1) {
 			break;
 		}
@@ -803,6 +1075,19 @@ int main(int argc, char *argv[])
 				usbWaitTime = (int)tmp;
 				break;
 
+			case 'a':
+				psu_common.multi = 1;
+				break;
+
+			case 'd':
+				if (nsel == PSU_MAXBOARDS) {
+					fprintf(stderr, "Too many devices (%d limit)\n", PSU_MAXBOARDS);
+					return EXIT_FAILURE;
+				}
+				sel[nsel++] = optarg;
+				psu_common.multi = 1;
+				break;
+
 			default:
 				usage(argv[0]);
 				return EXIT_FAILURE;
@@ -819,25 +1104,47 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	script_set_funcs(&script, funcs, &dev);
+	script_set_funcs(&script, funcs, &board);
 
-	/* First interpret script in dry-run mode to check syntax
+	/* First compile script (commands are interpreted in dry-run mode) to check syntax
 	 * and if files specified in the script exist and check
 	 * if they are readable
 	 */
-	if (script_parse(&script, SCRIPT_F_DRYRUN) != SCRIPT_OK) {
+	if (script_compile(&script) != SCRIPT_OK) {
+		free_buffers();
 		script_close(&script);
 		fprintf(stderr, "Exiting due to error in script file.\n");
 		return EXIT_FAILURE;
 	}
 
+	if (psu_common.multi && (psu_common.vid < 0)) {
+		free_buffers();
+		script_close(&script);
+		fprintf(stderr, "Script doesn't WAIT for any device.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Files are mapped and read ahead while devices are awaited */
+	prefetch_start();
+
 	if (hid_init() == 0) {
-		/* Interpret script, now things like memalloc, hid device comm. may fail */
-		res = script_parse(&script, SCRIPT_F_SHOWLINES);
-		hid_close(dev);
+		/* Run compiled script, now things like memalloc, hid device comm. may fail */
+		if (!psu_common.multi) {
+			res = script_run(&script, SCRIPT_F_SHOWLINES);
+			sdp_close(&board.sdp);
+		}
+		else if ((psu_common.boards = calloc(PSU_MAXBOARDS, sizeof(psu_board_t))) != NULL) {
+			/* Boards are flashed concurrently, only results are reported */
+			psu_common.quiet = 1;
+			if (board_discover(sel, nsel) > 0)
+				res = (board_runAll(&script) == 0) ? SCRIPT_OK : SCRIPT_ERROR;
+			board_release();
+			free(psu_common.boards);
+		}
 		hid_exit();
 	}
 
+	free_buffers();
 	script_close(&script);
 
 	return res < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -0,0 +1,1101 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Tool to generate syspage based on plo scripts
+ *
+ * Syspage builder
+ *
+ * Copyright 2022, 2026 Phoenix Systems
+ *
+ * Author: Hubert Buczynski
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "syspage32.h"
+#include "syspage64.h"
+#include "sysgen.h"
+
+
+#define ALIGN_ADDR(addr, align) (align ? ((addr + (align - 1)) & ~(align - 1)) : addr)
+#define CAST_SYSPTR(type, ptr)  ((type)(sysgen_common.buff + ptr - (sysgen_common.pkernel + sysgen_common.offs)))
+#define RUN(fun32, fun64)       ((sysgen_common.type == syspage32_type) ? (fun32) : ((sysgen_common.type == syspage64_type) ? (fun64) : -1))
+
+/* Reserve +1 for terminating NULL pointer in conformance to C standard */
+#define SIZE_CMD_ARGV     (10 + 1)
+
+/* Number of alias and map name hash table buckets (must be a power of 2) */
+#define SIZE_NAME_BUCKETS 256
+
+
+enum { mAttrRead = 0x01, mAttrWrite = 0x02, mAttrExec = 0x04, mAttrShareable = 0x08,
+	   mAttrCacheable = 0x10, mAttrBufferable = 0x20 };
+
+enum { flagSyspageExec = 0x01 };
+
+enum { syspage32_type = 0, syspage64_type };
+
+
+struct phfs_alias_t {
+	char name[32];
+	unsigned long long  addr;
+	unsigned long long size;
+
+	struct phfs_alias_t *next; /* hash chain */
+};
+
+
+/* Map name index entry */
+typedef struct _sysgen_mapname_t {
+	struct _sysgen_mapname_t *next; /* hash chain */
+	uint8_t id;
+	char name[];
+} sysgen_mapname_t;
+
+
+/* Map address range, maps don't overlap so the array sorted by start is sorted by end as well */
+typedef struct {
+	unsigned long long start;
+	unsigned long long end;
+} sysgen_range_t;
+
+
+typedef struct {
+	const char *name;
+	const int (*run)(int, char *[]);
+} cmd_t;
+
+
+struct {
+	int type;
+	syspage32_t *syspage32;
+	syspage64_t *syspage64;
+
+	unsigned long long pkernel;
+	unsigned long long offs;
+
+	unsigned long long maxsz;
+	uint8_t *buff;
+
+	struct phfs_alias_t *aliases[SIZE_NAME_BUCKETS];
+	sysgen_mapname_t *mapnames[SIZE_NAME_BUCKETS];
+
+	sysgen_range_t *ranges;
+	size_t nranges;
+	size_t szranges;
+} sysgen_common;
+
+
+extern int sysgen_cmdAlias(int argc, char *argv[]);
+extern int sysgen_cmdMap(int argc, char *argv[]);
+extern int sysgen_cmdApp(int argc, char *argv[]);
+extern int sysgen_cmdConsole(int argc, char *argv[]);
+
+
+static const cmd_t cmds[] = {
+	{ .name = "alias", .run = sysgen_cmdAlias },
+	{ .name = "map", .run = sysgen_cmdMap },
+	{ .name = "app", .run = sysgen_cmdApp },
+	{ .name = "console", .run = sysgen_cmdConsole }
+};
+
+
+/* Allocate data in a buffer */
+
+static sysptr32_t sysgen32_buffAlloc(unsigned long long sz)
+{
+	sysptr32_t ptr;
+	unsigned long long newSz = ALIGN_ADDR(sysgen_common.syspage32->size + sz, sizeof(long long));
+
+	if (newSz >= sysgen_common.maxsz) {
+		fprintf(stderr, "Cannot allocate size 0x%x; current buffer size 0x%x\n", (unsigned int)sz, sysgen_common.syspage32->size);
+		return 0;
+	}
+
+	ptr = sysgen_common.syspage32->size + sysgen_common.pkernel + sysgen_common.offs;
+	sysgen_common.syspage32->size = newSz;
+
+	return ptr;
+}
+
+
+static sysptr64_t sysgen64_buffAlloc(unsigned long long sz)
+{
+	sysptr64_t ptr;
+	unsigned long long newSz = ALIGN_ADDR(sysgen_common.syspage64->size + sz, sizeof(long long));
+
+	if (newSz >= sysgen_common.maxsz) {
+		fprintf(stderr, "Cannot allocate size 0x%x; current buffer size 0x%lx\n", (unsigned int)sz, sysgen_common.syspage64->size);
+		return 0;
+	}
+
+	ptr = sysgen_common.syspage64->size + sysgen_common.pkernel + sysgen_common.offs;
+	sysgen_common.syspage64->size = newSz;
+
+	return ptr;
+}
+
+
+/* Name indexes */
+
+static unsigned int sysgen_nameHash(const char *name, size_t len)
+{
+	unsigned int h = 2166136261u;
+
+	while (len-- > 0)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+
+	return h & (SIZE_NAME_BUCKETS - 1);
+}
+
+
+/* Alias command */
+
+static struct phfs_alias_t *sysgen_aliasFind(const char *name, size_t len)
+{
+	struct phfs_alias_t *alias;
+
+	/* Names are stored truncated to the alias name buffer */
+	if (len > sizeof(alias->name) - 1)
+		len = sizeof(alias->name) - 1;
+
+	for (alias = sysgen_common.aliases[sysgen_nameHash(name, len)]; alias != NULL; alias = alias->next) {
+		if ((strncmp(alias->name, name, len) == 0) && (alias->name[len] == '\0'))
+			return alias;
+	}
+
+	return NULL;
+}
+
+
+int sysgen_cmdAlias(int argc, char *argv[])
+{
+	char *end;
+	unsigned int i;
+	unsigned long long addr = 0;
+	unsigned long long size = 0;
+	struct phfs_alias_t *alias;
+	unsigned int h;
+
+	if (argc != 4) {
+		fprintf(stderr, "\n%s: Wrong argument count", argv[0]);
+		return -1;
+	}
+
+	for (i = 2; i < 4; ++i) {
+		if (i == 2)
+			addr = strtoul(argv[i], &end, 0);
+		else if (i == 3)
+			size = strtoul(argv[i], &end, 0);
+
+		if (*end) {
+			fprintf(stderr, "\n%s: Wrong arguments", argv[0]);
+			return -1;
+		}
+	}
+
+	alias = malloc(sizeof(struct phfs_alias_t));
+	if (alias == NULL)
+		return -1;
+
+	strncpy(alias->name, argv[1], sizeof(alias->name) - 1);
+	alias->name[sizeof(alias->name) - 1] = '\0';
+	alias->size = size;
+	alias->addr = addr + sysgen_common.pkernel;
+
+	/* The latest definition of a name is found first */
+	h = sysgen_nameHash(alias->name, strlen(alias->name));
+	alias->next = sysgen_common.aliases[h];
+	sysgen_common.aliases[h] = alias;
+
+	/* Update max image size */
+	if (sysgen_common.type == syspage64_type) {
+		if (sysgen_common.syspage64->hs.imgsz < (addr + size))
+			sysgen_common.syspage64->hs.imgsz = addr + size;
+	}
+	else if (sysgen_common.type == syspage32_type) {
+		if (sysgen_common.syspage32->hs.imgsz < (addr + size))
+			sysgen_common.syspage32->hs.imgsz = addr + size;
+	}
+	else {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Map command for both 32 & 64 bit architecture */
+
+static sysgen_mapname_t *sysgen_mapFind(const char *name)
+{
+	sysgen_mapname_t *m;
+
+	for (m = sysgen_common.mapnames[sysgen_nameHash(name, strlen(name))]; m != NULL; m = m->next) {
+		if (strcmp(m->name, name) == 0)
+			return m;
+	}
+
+	return NULL;
+}
+
+
+static int sysgen_mapNameResolve(const char *name, uint8_t *id)
+{
+	sysgen_mapname_t *m = sysgen_mapFind(name);
+
+	if (m == NULL)
+		return -1;
+
+	*id = m->id;
+
+	return 0;
+}
+
+
+/* Returns index of the first range starting at or above addr */
+static size_t sysgen_rangeLowerBound(unsigned long long addr)
+{
+	size_t lo = 0, hi = sysgen_common.nranges, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (sysgen_common.ranges[mid].start < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+static int sysgen_mapOverlapping(const char *name, unsigned long long start, unsigned long long end)
+{
+	size_t pos;
+
+	if (sysgen_mapFind(name) != NULL)
+		return -1;
+
+	/* Only the last range starting below the end can reach over the start */
+	pos = sysgen_rangeLowerBound(end);
+	if ((pos > 0) && (sysgen_common.ranges[pos - 1].end > start))
+		return -1;
+
+	return 0;
+}
+
+
+static int sysgen_mapIndex(const char *name, uint8_t id, unsigned long long start, unsigned long long end)
+{
+	sysgen_range_t *ranges;
+	sysgen_mapname_t *m;
+	size_t len = strlen(name), pos, sz;
+	unsigned int h;
+
+	if (sysgen_common.nranges == sysgen_common.szranges) {
+		sz = (sysgen_common.szranges == 0) ? 32 : sysgen_common.szranges * 2;
+		ranges = realloc(sysgen_common.ranges, sz * sizeof(*ranges));
+		if (ranges == NULL)
+			return -1;
+
+		sysgen_common.ranges = ranges;
+		sysgen_common.szranges = sz;
+	}
+
+	m = malloc(sizeof(*m) + len + 1);
+	if (m == NULL)
+		return -1;
+
+	memcpy(m->name, name, len + 1);
+	m->id = id;
+	h = sysgen_nameHash(name, len);
+	m->next = sysgen_common.mapnames[h];
+	sysgen_common.mapnames[h] = m;
+
+	/* Ranges with equal start are ordered by end, empty one goes first */
+	pos = sysgen_rangeLowerBound(start);
+	while ((pos < sysgen_common.nranges) && (sysgen_common.ranges[pos].start == start) && (sysgen_common.ranges[pos].end < end))
+		pos++;
+
+	memmove(&sysgen_common.ranges[pos + 1], &sysgen_common.ranges[pos], (sysgen_common.nranges - pos) * sizeof(sysgen_range_t));
+	sysgen_common.ranges[pos].start = start;
+	sysgen_common.ranges[pos].end = end;
+	sysgen_common.nranges++;
+
+	return 0;
+}
+
+
+static int sysgen32_mapAdd(const char *mapName, addr32_t start, addr32_t end, unsigned int attr)
+{
+	size_t len;
+	char *name;
+	sysptr32_t ptr;
+	syspage_map32_t *map, *headMap;
+
+	ptr = sysgen32_buffAlloc(sizeof(syspage_map32_t));
+	if (ptr == 0)
+		return -1;
+
+	map = CAST_SYSPTR(syspage_map32_t *, ptr);
+
+	len = strlen(mapName);
+	map->name = sysgen32_buffAlloc(len + 1);
+	if (map->name == 0)
+		return -1;
+
+	name = CAST_SYSPTR(char *, map->name);
+	memcpy(name, mapName, len + 1);
+
+	map->entries = 0;
+	map->start = start;
+	map->end = end;
+	map->attr = attr;
+
+	if (sysgen_common.syspage32->maps == 0) {
+		map->next = ptr;
+		map->prev = ptr;
+		sysgen_common.syspage32->maps = ptr;
+
+		map->id = 0;
+	}
+	else {
+		headMap = CAST_SYSPTR(syspage_map32_t *, sysgen_common.syspage32->maps);
+
+		map->prev = headMap->prev;
+		CAST_SYSPTR(syspage_map32_t *, headMap->prev)->next = ptr;
+		map->next = sysgen_common.syspage32->maps;
+		headMap->prev = ptr;
+
+		map->id = CAST_SYSPTR(syspage_map32_t *, map->prev)->id + 1;
+	}
+
+	return sysgen_mapIndex(mapName, map->id, start, end);
+}
+
+
+static int sysgen64_mapAdd(const char *mapName, addr64_t start, addr64_t end, unsigned int attr)
+{
+	size_t len;
+	char *name;
+	sysptr64_t ptr;
+	syspage_map64_t *map, *headMap;
+
+	ptr = sysgen64_buffAlloc(sizeof(syspage_map64_t));
+	if (ptr == 0)
+		return -1;
+
+	map = CAST_SYSPTR(syspage_map64_t *, ptr);
+
+	len = strlen(mapName);
+	map->name = sysgen64_buffAlloc(len + 1);
+	if (map->name == 0)
+		return -1;
+
+	name = CAST_SYSPTR(char *, map->name);
+	memcpy(name, mapName, len + 1);
+
+	map->entries = 0;
+	map->start = start;
+	map->end = end;
+	map->attr = attr;
+
+	if (sysgen_common.syspage64->maps == 0) {
+		map->next = ptr;
+		map->prev = ptr;
+		sysgen_common.syspage64->maps = ptr;
+
+		map->id = 0;
+	}
+	else {
+		headMap = CAST_SYSPTR(syspage_map64_t *, sysgen_common.syspage64->maps);
+
+		map->prev = headMap->prev;
+		CAST_SYSPTR(syspage_map64_t *, headMap->prev)->next = ptr;
+		map->next = sysgen_common.syspage64->maps;
+		headMap->prev = ptr;
+
+		map->id = CAST_SYSPTR(syspage_map64_t *, map->prev)->id + 1;
+	}
+
+	return sysgen_mapIndex(mapName, map->id, start, end);
+}
+
+
+static int sysgen_strAttr2ui(const char *str, unsigned int *attr)
+{
+	int i;
+
+	*attr = 0;
+	for (i = 0; str[i]; ++i) {
+		switch (str[i]) {
+			case 'r':
+				*attr |= mAttrRead;
+				break;
+			case 'w':
+				*attr |= mAttrWrite;
+				break;
+			case 'x':
+				*attr |= mAttrExec;
+				break;
+			case 's':
+				*attr |= mAttrShareable;
+				break;
+			case 'c':
+				*attr |= mAttrCacheable;
+				break;
+			case 'b':
+				*attr |= mAttrBufferable;
+				break;
+			default:
+				fprintf(stderr, "\nsysgen: Wrong attribute - '%c'", str[i]);
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+int sysgen_cmdMap(int argc, char *argv[])
+{
+	int res;
+	char *endptr;
+	unsigned long long start, end;
+	unsigned int attr;
+
+	if (argc != 5) {
+		fprintf(stderr, "\n%s: Wrong argument count", argv[0]);
+		return -1;
+	}
+
+	start = strtoul(argv[2], &endptr, 0);
+	if (*endptr) {
+		fprintf(stderr, "\n%s: Wrong arguments", argv[0]);
+		return -1;
+	}
+
+	end = strtoul(argv[3], &endptr, 0);
+	if (*endptr) {
+		fprintf(stderr, "\n%s: Wrong arguments", argv[0]);
+		return -1;
+	}
+
+	if (end < start) {
+		fprintf(stderr, "\n%s: Wrong arguments", argv[0]);
+		return -1;
+	}
+
+	res = sysgen_strAttr2ui(argv[4], &attr);
+	if (res < 0)
+		return res;
+
+	/* Check whether map's name exists or map overlaps with other maps */
+	res = sysgen_mapOverlapping(argv[1], start, end);
+	if (res < 0)
+		return res;
+
+	res = RUN(sysgen32_mapAdd(argv[1], start, end, attr),
+		sysgen64_mapAdd(argv[1], start, end, attr));
+
+	return res;
+}
+
+
+/* App command for both 32 & 64 bit architecture */
+
+static int sysgen_mapsAdd2Prog(uint8_t *mapIDs, size_t nb, const char *mapNames)
+{
+	int res;
+	uint8_t id = 0;
+	unsigned int i;
+
+	for (i = 0; i < nb; ++i) {
+		res = sysgen_mapNameResolve(mapNames, &id);
+		if (res < 0) {
+			fprintf(stderr, "\nCan't add map %s", mapNames);
+			return res;
+		}
+
+		mapIDs[i] = id;
+		mapNames += strlen(mapNames) + 1; /* name + '\0' */
+	}
+
+	return 0;
+}
+
+
+static size_t sysgen_mapsParse(char *maps, char sep)
+{
+	size_t nb = 0;
+
+	while (*maps != '\0') {
+		if (*maps == sep) {
+			*maps = '\0';
+			++nb;
+		}
+		maps++;
+	}
+
+	return ++nb;
+}
+
+
+static int sysgen32_appAdd(const char *name, size_t namelen, char *imaps, char *dmaps, const char *appArgv, uint32_t flags)
+{
+	int res;
+	char *argv;
+	sysptr32_t ptr;
+	struct phfs_alias_t *alias;
+	syspage_prog32_t *prog, *headProg;
+
+	size_t dmapSz, imapSz, len, argvSz;
+	const uint32_t isExec = (flags & flagSyspageExec) != 0;
+
+	alias = sysgen_aliasFind(name, namelen);
+	if (alias == NULL)
+		return -1;
+
+	/* First instance in imap is a map for the instructions */
+	imapSz = sysgen_mapsParse(imaps, ';');
+	dmapSz = sysgen_mapsParse(dmaps, ';');
+
+	len = strlen(appArgv);
+	argvSz = isExec + len + 1; /* [X] + argv + '\0' */
+
+	ptr = sysgen32_buffAlloc(sizeof(syspage_prog32_t));
+	if (ptr == 0)
+		return -1;
+
+	prog = CAST_SYSPTR(syspage_prog32_t *, ptr);
+	prog->dmaps = sysgen32_buffAlloc(sizeof(uint8_t) * dmapSz);
+	prog->imaps = sysgen32_buffAlloc(sizeof(uint8_t) * imapSz);
+	prog->argv = sysgen32_buffAlloc(sizeof(uint8_t) * argvSz);
+
+	if ((prog->dmaps == 0) || (prog->imaps == 0) || (prog->argv == 0))
+		return -1;
+
+	prog->imapSz = imapSz;
+	prog->dmapSz = dmapSz;
+	prog->start = alias->addr;
+	prog->end = alias->addr + alias->size;
+
+	argv = CAST_SYSPTR(char *, prog->argv);
+	if (isExec)
+		argv[0] = 'X';
+
+	memcpy(argv + isExec, appArgv, len);
+	argv[argvSz - 1] = '\0';
+
+	if ((res = sysgen_mapsAdd2Prog(CAST_SYSPTR(uint8_t *, prog->imaps), imapSz, imaps)) < 0 ||
+		(res = sysgen_mapsAdd2Prog(CAST_SYSPTR(uint8_t *, prog->dmaps), dmapSz, dmaps)) < 0)
+		return res;
+
+	if (sysgen_common.syspage32->progs == 0) {
+		prog->next = ptr;
+		prog->prev = ptr;
+		sysgen_common.syspage32->progs = ptr;
+	}
+	else {
+		headProg = CAST_SYSPTR(syspage_prog32_t *, sysgen_common.syspage32->progs);
+
+		prog->prev = headProg->prev;
+		CAST_SYSPTR(syspage_prog32_t *, headProg->prev)->next = ptr;
+		prog->next = sysgen_common.syspage32->progs;
+		headProg->prev = ptr;
+	}
+
+	return 0;
+}
+
+
+static int sysgen64_appAdd(const char *name, size_t namelen, char *imaps, char *dmaps, const char *appArgv, uint32_t flags)
+{
+	int res;
+	char *argv;
+	sysptr64_t ptr;
+	struct phfs_alias_t *alias;
+	syspage_prog64_t *prog, *headProg;
+
+	size_t dmapSz, imapSz, len, argvSz;
+	const uint32_t isExec = (flags & flagSyspageExec) != 0;
+
+	alias = sysgen_aliasFind(name, namelen);
+	if (alias == NULL)
+		return -1;
+
+	/* First instance in imap is a map for the instructions */
+	imapSz = sysgen_mapsParse(imaps, ';');
+	dmapSz = sysgen_mapsParse(dmaps, ';');
+
+	len = strlen(appArgv);
+	argvSz = isExec + len + 1; /* [X] + argv + '\0' */
+
+	ptr = sysgen64_buffAlloc(sizeof(syspage_prog64_t));
+	if (ptr == 0)
+		return -1;
+
+	prog = CAST_SYSPTR(syspage_prog64_t *, ptr);
+	prog->dmaps = sysgen64_buffAlloc(sizeof(uint8_t) * dmapSz);
+	prog->imaps = sysgen64_buffAlloc(sizeof(uint8_t) * imapSz);
+	prog->argv = sysgen64_buffAlloc(sizeof(uint8_t) * argvSz);
+
+	if ((prog->dmaps == 0) || (prog->imaps == 0) || (prog->argv == 0))
+		return -1;
+
+	prog->imapSz = imapSz;
+	prog->dmapSz = dmapSz;
+	prog->start = alias->addr;
+	prog->end = alias->addr + alias->size;
+
+	argv = CAST_SYSPTR(char *, prog->argv);
+	if (isExec)
+		argv[0] = 'X';
+
+	memcpy(argv + isExec, appArgv, len);
+	argv[argvSz - 1] = '\0';
+
+	if ((res = sysgen_mapsAdd2Prog(CAST_SYSPTR(uint8_t *, prog->imaps), imapSz, imaps)) < 0 ||
+		(res = sysgen_mapsAdd2Prog(CAST_SYSPTR(uint8_t *, prog->dmaps), dmapSz, dmaps)) < 0)
+		return res;
+
+	if (sysgen_common.syspage64->progs == 0) {
+		prog->next = ptr;
+		prog->prev = ptr;
+		sysgen_common.syspage64->progs = ptr;
+	}
+	else {
+		headProg = CAST_SYSPTR(syspage_prog64_t *, sysgen_common.syspage64->progs);
+
+		prog->prev = headProg->prev;
+		CAST_SYSPTR(syspage_prog64_t *, headProg->prev)->next = ptr;
+		prog->next = sysgen_common.syspage64->progs;
+		headProg->prev = ptr;
+	}
+
+	return 0;
+}
+
+
+int sysgen_cmdApp(int argc, char *argv[])
+{
+	size_t pos;
+	int argvID = 0;
+
+	char *imaps, *dmaps;
+	unsigned int flags = 0;
+
+	const char *appArgv;
+
+	if (argc < 5 || argc > 6) {
+		fprintf(stderr, "\n%s: Wrong argument count", argv[0]);
+		return -1;
+	}
+
+	/* ARG_0: command name */
+
+	/* ARG_1: alias to device - it will be checked in phfs_open */
+
+	/* ARG_2: optional flags */
+	argvID = 2;
+	if (argv[argvID][0] == '-') {
+		if ((argv[argvID][1] | 0x20) == 'x' && argv[argvID][2] == '\0') {
+			flags |= flagSyspageExec;
+			argvID++;
+		}
+		else {
+			fprintf(stderr, "\n%s: Wrong arguments", argv[0]);
+			return -1;
+		}
+	}
+
+	if (argvID != (argc - 3)) {
+		fprintf(stderr, "\n%s: Invalid arg, 'dmap' is not declared", argv[0]);
+		return -1;
+	}
+
+	/* ARG_3: name + argv */
+	appArgv = argv[argvID];
+	for (pos = 0; appArgv[pos]; pos++) {
+		if (appArgv[pos] == ';')
+			break;
+	}
+
+	/* ARG_4: maps for instructions */
+	imaps = argv[++argvID];
+
+	/* ARG_5: maps for data */
+	dmaps = argv[++argvID];
+
+	return RUN(sysgen32_appAdd(appArgv, pos, imaps, dmaps, appArgv, flags),
+		sysgen64_appAdd(appArgv, pos, imaps, dmaps, appArgv, flags));
+}
+
+
+/* Console command */
+
+int sysgen_cmdConsole(int argc, char *argv[])
+{
+	char *endptr;
+	unsigned int minor;
+
+	if (argc != 2) {
+		fprintf(stderr, "\n%s: Wrong argument count", argv[0]);
+		return -EINVAL;
+	}
+
+	strtoul(argv[1], &endptr, 0);
+	if (*endptr != '.') {
+		fprintf(stderr, "\nWrong major value: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	minor = strtoul(++endptr, &endptr, 0);
+	if (*endptr != '\0') {
+		fprintf(stderr, "\nWrong minor value: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	if (sysgen_common.type == syspage64_type)
+		sysgen_common.syspage64->console = minor;
+	else if (sysgen_common.type == syspage32_type)
+		sysgen_common.syspage32->console = minor;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/* Parsing script  */
+
+/* Splits line into arguments in place */
+static int sysgen_parseArgLine(char *line, char *argv[], size_t argvsz)
+{
+	int argc = 0;
+
+	while (*line != '\0') {
+		if (isspace(*line)) {
+			if (isblank(*line++))
+				continue;
+			else
+				break;
+		}
+
+		if (!isgraph(*line)) {
+			fprintf(stderr, "\nInvalid character in command");
+			return -EINVAL;
+		}
+
+		/* Argument count and one NULL pointer */
+		if (argc + 1 >= argvsz) {
+			fprintf(stderr, "\nToo many arguments");
+			return -EINVAL;
+		}
+
+		argv[argc++] = line;
+
+		while (isgraph(*line))
+			line++;
+
+		if (*line == '\0')
+			break;
+
+		if (!isspace(*line)) {
+			fprintf(stderr, "\nInvalid character in command");
+			return -EINVAL;
+		}
+
+		if (!isblank(*line)) {
+			/* Line ends here */
+			*line = '\0';
+			break;
+		}
+
+		*line++ = '\0';
+	}
+
+	argv[argc] = NULL;
+
+	return argc;
+}
+
+
+static int sysgen_parseScript(const char *fname)
+{
+	FILE *file;
+	size_t len = 0;
+	char *line = NULL;
+	int sz, argc, i, ret;
+	char *argv[SIZE_CMD_ARGV];
+
+	file = fopen(fname, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open file %s\n", fname);
+		return -1;
+	}
+
+	while ((sz = getline(&line, &len, file)) != -1) {
+		/* EOF */
+		if (line == NULL || *line == '\0') {
+			free(line);
+			fclose(file);
+			return 0;
+		}
+
+		argc = sysgen_parseArgLine(line, argv, SIZE_CMD_ARGV);
+		/* skip empty lines */
+		if (argc == 0)
+			continue;
+
+		/* error */
+		if (argc < 0) {
+			free(line);
+			fclose(file);
+			return argc;
+		}
+
+		/* Find command and launch associated function */
+		for (i = 0; i < sizeof(cmds) / sizeof(cmd_t); ++i) {
+			if (strcmp(argv[0], cmds[i].name) != 0)
+				continue;
+
+			if ((ret = cmds[i].run(argc, argv)) < 0) {
+				fprintf(stderr, "Failed %s\n", argv[0]);
+				free(line);
+				fclose(file);
+				return ret;
+			}
+
+			break;
+		}
+	}
+
+	free(line);
+	fclose(file);
+
+	return 0;
+}
+
+
+/* Auxiliary functions */
+
+static void sysgen_dump32(void)
+{
+	sysptr32_t ptr;
+	const syspage_prog32_t *prog;
+
+	printf("\n\tSyspage:\n");
+	printf("\tImage size: 0x%08x\n", sysgen_common.syspage32->hs.imgsz);
+	printf("\tSyspage size: 0x%08x\n", sysgen_common.syspage32->size);
+	printf("\tKernel physical address: 0x%08x\n", sysgen_common.syspage32->pkernel);
+	printf("\tConsole: 0x%02x\n", sysgen_common.syspage32->console);
+	printf("\tPrograms:\n");
+	if (sysgen_common.syspage32->progs != 0) {
+		ptr = sysgen_common.syspage32->progs;
+		do {
+			prog = CAST_SYSPTR(syspage_prog32_t *, ptr);
+			printf("\t\t%s\n", CAST_SYSPTR(char *, prog->argv));
+		} while ((ptr = prog->next) != sysgen_common.syspage32->progs);
+	}
+	else {
+		printf("\t\tnot defined\n");
+	}
+}
+
+
+static void sysgen_dump64(void)
+{
+	sysptr64_t ptr;
+	const syspage_prog64_t *prog;
+
+	printf("\n\tSyspage:\n");
+	printf("\tImage size: 0x%08x\n", sysgen_common.syspage64->hs.imgsz);
+	printf("\tSyspage size: 0x%lx\n", sysgen_common.syspage64->size);
+	printf("\tKernel physical address: 0x%lx\n", sysgen_common.syspage64->pkernel);
+	printf("\tConsole: 0x%02x\n", sysgen_common.syspage64->console);
+	printf("\tPrograms:\n");
+	if (sysgen_common.syspage64->progs != 0) {
+		ptr = sysgen_common.syspage64->progs;
+		do {
+			prog = CAST_SYSPTR(syspage_prog64_t *, ptr);
+			printf("\t\t%s\n", CAST_SYSPTR(char *, prog->argv));
+		} while ((ptr = prog->next) != sysgen_common.syspage64->progs);
+	}
+	else {
+		printf("\t\tnot defined\n");
+	}
+}
+
+
+static int sysgen_archSet(const char *arch)
+{
+	char *endptr;
+	unsigned long val = strtoul(arch, &endptr, 0);
+
+	if (*endptr != '\0')
+		return -1;
+
+	switch (val) {
+		case 32:
+			sysgen_common.type = syspage32_type;
+			sysgen_common.syspage32 = (syspage32_t *)sysgen_common.buff;
+			sysgen_common.syspage32->size = ALIGN_ADDR(sizeof(syspage32_t), sizeof(long long));
+			sysgen_common.syspage32->pkernel = sysgen_common.pkernel;
+			break;
+
+		case 64:
+			sysgen_common.type = syspage64_type;
+			sysgen_common.syspage64 = (syspage64_t *)sysgen_common.buff;
+			sysgen_common.syspage64->size = ALIGN_ADDR(sizeof(syspage64_t), sizeof(long long));
+			sysgen_common.syspage64->pkernel = sysgen_common.pkernel;
+			break;
+
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+
+void sysgen_cleanup(void)
+{
+	struct phfs_alias_t *alias;
+	sysgen_mapname_t *m;
+	unsigned int i;
+
+	for (i = 0; i < SIZE_NAME_BUCKETS; i++) {
+		while ((alias = sysgen_common.aliases[i]) != NULL) {
+			sysgen_common.aliases[i] = alias->next;
+			free(alias);
+		}
+
+		while ((m = sysgen_common.mapnames[i]) != NULL) {
+			sysgen_common.mapnames[i] = m->next;
+			free(m);
+		}
+	}
+
+	free(sysgen_common.ranges);
+	free(sysgen_common.buff);
+	memset(&sysgen_common, 0, sizeof(sysgen_common));
+}
+
+
+/* Library interface */
+
+int sysgen_parseProps(const char *arg, sysgen_opts_t *opts)
+{
+	char *endptr;
+
+	opts->pkernel = strtoul(arg, &endptr, 0);
+	if (*endptr != ':') {
+		fprintf(stderr, "Wrong physical image address %s\n", arg);
+		return -1;
+	}
+
+	opts->offs = strtoul(endptr + 1, &endptr, 0);
+	if (*endptr != ':') {
+		fprintf(stderr, "Wrong syspage offset %s\n", arg);
+		return -1;
+	}
+
+	opts->maxsz = strtoul(endptr + 1, &endptr, 0);
+	if (*endptr != '\0') {
+		fprintf(stderr, "Wrong syspage size %s\n", arg);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int sysgen_build(const sysgen_opts_t *opts)
+{
+	sysgen_common.pkernel = opts->pkernel;
+	sysgen_common.offs = opts->offs;
+	sysgen_common.maxsz = opts->maxsz;
+
+	/* Prepare syspage structure */
+	sysgen_common.buff = calloc(sysgen_common.maxsz, sizeof(uint8_t));
+	if (sysgen_common.buff == NULL)
+		return -1;
+
+	if (sysgen_archSet(opts->arch) < 0) {
+		fprintf(stderr, "Wrong architecture value - %s. Syspagen supports 32-bit and 64-bit architectures\n", opts->arch);
+		return -1;
+	}
+
+	/* Parse preinit script with map and console commands */
+	if (sysgen_parseScript(opts->preinitScript) < 0) {
+		fprintf(stderr, "Cannot parse preinit script: %s\n", opts->preinitScript);
+		return -1;
+	}
+
+	/* Parse user script descring programs in the syspage */
+	if (sysgen_parseScript(opts->userScript) < 0) {
+		fprintf(stderr, "Cannot parse user script: %s\n", opts->userScript);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+size_t sysgen_size(void)
+{
+	if (sysgen_common.type == syspage32_type)
+		return sysgen_common.syspage32->size;
+	else if (sysgen_common.type == syspage64_type)
+		return sysgen_common.syspage64->size;
+
+	return 0;
+}
+
+
+int sysgen_store(void *dst, size_t dstsz)
+{
+	size_t sz = sysgen_size();
+
+	if ((sysgen_common.buff == NULL) || (sz > dstsz))
+		return -1;
+
+	memcpy(dst, sysgen_common.buff, sz);
+
+	return 0;
+}
+
+
+int sysgen_aliasForeach(int (*fn)(void *arg, const char *name, unsigned long long offs, unsigned long long size), void *arg)
+{
+	struct phfs_alias_t *alias;
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < SIZE_NAME_BUCKETS; i++) {
+		for (alias = sysgen_common.aliases[i]; alias != NULL; alias = alias->next) {
+			if ((res = fn(arg, alias->name, alias->addr - sysgen_common.pkernel, alias->size)) < 0)
+				return res;
+		}
+	}
+
+	return 0;
+}
+
+
+void sysgen_dump(void)
+{
+	RUN(sysgen_dump32(), sysgen_dump64());
+}
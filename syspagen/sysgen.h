@@ -0,0 +1,57 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Tool to generate syspage based on plo scripts
+ *
+ * Syspage builder
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _SYSGEN_H_
+#define _SYSGEN_H_
+
+#include <stddef.h>
+
+
+typedef struct {
+	const char *arch;            /* supported 32 & 64 bit architecture, i.e. "32" or "64" */
+	unsigned long long pkernel;  /* beginning physical address of the target image */
+	unsigned long long offs;     /* syspage's offset in the target image */
+	unsigned long long maxsz;    /* max syspage's size */
+	const char *preinitScript;
+	const char *userScript;
+} sysgen_opts_t;
+
+
+/* Parses syspage properties given as <pimg:offs:sz> */
+extern int sysgen_parseProps(const char *arg, sysgen_opts_t *opts);
+
+
+/* Builds syspage described by plo scripts, state has to be released with sysgen_cleanup() even on failure */
+extern int sysgen_build(const sysgen_opts_t *opts);
+
+
+/* Returns size of the built syspage */
+extern size_t sysgen_size(void);
+
+
+/* Copies the built syspage to dst (image + offs), dstsz is the space available there */
+extern int sysgen_store(void *dst, size_t dstsz);
+
+
+/* Calls fn for every alias defined by scripts, offs is relative to the image beginning */
+extern int sysgen_aliasForeach(int (*fn)(void *arg, const char *name, unsigned long long offs, unsigned long long size), void *arg);
+
+
+extern void sysgen_dump(void);
+
+
+extern void sysgen_cleanup(void);
+
+
+#endif